@@ -0,0 +1,467 @@
+/*
+ * Host time per instruction, for every opcode
+ *
+ * Build every source file except main.c, tools and fuzz together with this
+ * one, with optimizations on and -lm.
+ *
+ * usage: fakeoid-bench [-r samples] [-n cycles] [-c baseline]
+ *
+ * Every opcode runs on its own, as a block of copies of the instruction
+ * followed by a jump back, with operands pointing at RAM that's filled so
+ * that every pointer in it points at RAM again. Jumps, calls, returns and
+ * BRK loop on themselves instead. The cost of the jump back is taken off
+ * using what the JMP loop measured, so what's left is what the handler and
+ * the dispatch cost. WAI and STP stop the clock and aren't measured.
+ *
+ * One line per opcode goes to stdout, with the mean and standard deviation
+ * over the samples, so two builds can be compared, -c does that against the
+ * output of another run. A 16x16 matrix of the means goes to stderr.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "../cpu/ops.h"
+
+#define DEFAULT_SAMPLES 7
+#define DEFAULT_CYCLES 2000000
+
+/* Unrolled blocks start here and take up to BLOCK_SIZE bytes */
+#define BLOCK 0x8000
+#define BLOCK_SIZE 0x800
+
+/*
+ * Instructions looping on themselves go here. Returns find the stack filled
+ * with the high byte, so they come back to SELF (RTI) or SELF + 1 (RTS).
+ */
+#define SELF 0x8484
+#define SELF_FILL 0x84
+
+/* Every byte of RAM, so pointers read from it point at $0202 */
+#define RAM_FILL 0x02
+#define RAM_TOP 0x8000
+
+/* Operands */
+#define OPERAND_ZP 0x80
+#define OPERAND_ABS 0x0300
+#define POINTER 0x0400 /* for JMP (a) and JMP (a,x) */
+
+/* A change is reported if it's bigger than both of these */
+#define CHANGE_SIGMAS 3.0
+#define CHANGE_RATIO 0.05
+
+typedef enum
+{
+    TEMPLATE_BLOCK,
+    TEMPLATE_SELF,
+    TEMPLATE_NONE,
+} template_t;
+
+typedef struct
+{
+    bool measured;
+    double mean;
+    double stddev;
+} result_t;
+
+static const char *const mode_names[] = {
+    [ADDR_MODE_ABSOLUTE] = "abs",
+    [ADDR_MODE_ABSOLUTE_INDEXED_INDIRECT] = "(abs,x)",
+    [ADDR_MODE_ABSOLUTE_X] = "abs,x",
+    [ADDR_MODE_ABSOLUTE_Y] = "abs,y",
+    [ADDR_MODE_ABSOLUTE_INDIRECT] = "(abs)",
+    [ADDR_MODE_ACCUMULATOR] = "a",
+    [ADDR_MODE_IMMEDIATE] = "#",
+    [ADDR_MODE_IMPLIED] = "i",
+    [ADDR_MODE_RELATIVE] = "r",
+    [ADDR_MODE_ZEROPAGE] = "zp",
+    [ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT] = "(zp,x)",
+    [ADDR_MODE_ZEROPAGE_X] = "zp,x",
+    [ADDR_MODE_ZEROPAGE_Y] = "zp,y",
+    [ADDR_MODE_ZEROPAGE_INDIRECT] = "(zp)",
+    [ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED] = "(zp),y",
+    [ADDR_MODE_ZEROPAGE_RELATIVE] = "zp,r",
+};
+
+static result_t results[256];
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-r samples] [-n cycles] [-c baseline]\n", prog);
+    exit(1);
+}
+
+/* By name, the opcodes differ between CPU variants */
+static template_t template_of(uint8_t opcode)
+{
+    static const char *const self[] = { "brk", "jmp", "jsr", "rti", "rts" };
+    static const char *const none[] = { "jam", "stp", "wai" };
+
+    for (size_t i = 0; i < sizeof(self) / sizeof(self[0]); i++)
+        if (strcmp(op_names[opcode], self[i]) == 0)
+            return TEMPLATE_SELF;
+
+    for (size_t i = 0; i < sizeof(none) / sizeof(none[0]); i++)
+        if (strcmp(op_names[opcode], none[i]) == 0)
+            return TEMPLATE_NONE;
+
+    return TEMPLATE_BLOCK;
+}
+
+static void fill(uint32_t addr, word_t value, uint32_t len)
+{
+    for (uint32_t end = addr + len; addr < end; addr++)
+        mem_poke(addr, value);
+}
+
+static void put16(addr_t addr, addr_t value)
+{
+    mem_poke(addr, value & 0xFF);
+    mem_poke(addr + 1, value >> 8);
+}
+
+static void reset_machine(void)
+{
+    fill(0, RAM_FILL, RAM_TOP);
+    fill(RAM_TOP, 0xEA, MEM_SIZE - RAM_TOP);
+
+    reg.a = reg.x = reg.y = RAM_FILL;
+    reg.s = 0xFF;
+    reg.p = word_to_procstat(0x24);
+    cpu_state = CPU_RUNNING;
+    cpu_irq_lines = 0;
+}
+
+/* Returns the number of copies */
+static unsigned int write_block(uint8_t opcode)
+{
+    unsigned int length = addr_mode_length[ops[opcode].addr_mode];
+    unsigned int copies = (BLOCK_SIZE - 3) / length;
+    addr_t addr = BLOCK;
+
+    for (unsigned int i = 0; i < copies; i++, addr += length)
+    {
+        mem_poke(addr, opcode);
+
+        switch (ops[opcode].addr_mode)
+        {
+        case ADDR_MODE_IMMEDIATE:
+            mem_poke(addr + 1, RAM_FILL);
+            break;
+        case ADDR_MODE_RELATIVE:
+            /* Taken or not, on to the next copy */
+            mem_poke(addr + 1, 0);
+            break;
+        case ADDR_MODE_ZEROPAGE_RELATIVE:
+            mem_poke(addr + 1, OPERAND_ZP);
+            mem_poke(addr + 2, 0);
+            break;
+        case ADDR_MODE_ABSOLUTE:
+        case ADDR_MODE_ABSOLUTE_X:
+        case ADDR_MODE_ABSOLUTE_Y:
+            put16(addr + 1, OPERAND_ABS);
+            break;
+        default:
+            if (length == 2)
+                mem_poke(addr + 1, OPERAND_ZP);
+            break;
+        }
+    }
+
+    /* JMP BLOCK */
+    mem_poke(addr, 0x4C);
+    put16(addr + 1, BLOCK);
+
+    reg.pc = BLOCK;
+    return copies;
+}
+
+static void write_self(uint8_t opcode)
+{
+    reg.pc = SELF;
+
+    switch (opcode)
+    {
+    case 0x00:
+        put16(VECTOR_IRQBRK, SELF);
+        break;
+    case 0x20:
+    case 0x4C:
+        put16(SELF + 1, SELF);
+        break;
+    case 0x40:
+        fill(0x100, SELF_FILL, 0x100);
+        break;
+    case 0x60:
+        fill(0x100, SELF_FILL, 0x100);
+        reg.pc = SELF + 1;
+        break;
+    case 0x6C:
+        put16(SELF + 1, POINTER);
+        put16(POINTER, SELF);
+        break;
+    case 0x7C:
+        put16(SELF + 1, POINTER);
+        put16(POINTER + reg.x, SELF);
+        break;
+    }
+
+    mem_poke(reg.pc, opcode);
+}
+
+static uint64_t thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* An operand the handler reads differently would take it off the block */
+static bool ran_off(uint8_t opcode, template_t template, unsigned int copies, addr_t pc)
+{
+    unsigned int length = addr_mode_length[ops[opcode].addr_mode];
+
+    if (template == TEMPLATE_SELF)
+        return reg.pc != pc;
+
+    return reg.pc < BLOCK || reg.pc > BLOCK + copies * length || (reg.pc - BLOCK) % length != 0;
+}
+
+/* Returns ns per instruction, or -1 if it ran off */
+static double take_sample(uint8_t opcode, uint64_t cycles, double jump_ns)
+{
+    template_t template = template_of(opcode);
+    unsigned int copies = 0;
+    uint64_t instructions;
+    uint64_t jumps;
+    uint64_t start;
+    double ns;
+    addr_t pc;
+
+    reset_machine();
+    if (template == TEMPLATE_BLOCK)
+        copies = write_block(opcode);
+    else
+        write_self(opcode);
+    pc = reg.pc;
+
+    /* Warm up the caches and the branch predictor */
+    cpu_run(cpu_cycles + cycles / 4);
+
+    instructions = cpu_instructions;
+    start = thread_ns();
+    cpu_run(cpu_cycles + cycles);
+    ns = thread_ns() - start;
+    instructions = cpu_instructions - instructions;
+
+    if (ran_off(opcode, template, copies, pc))
+    {
+        fprintf(stderr, "bench: %02X %s ran off to $%04X\n", opcode, op_names[opcode], reg.pc);
+        return -1;
+    }
+
+    jumps = copies ? instructions / (copies + 1) : 0;
+    return (ns - jumps * jump_ns) / (instructions - jumps);
+}
+
+/*
+ * A sample of every opcode per round rather than all samples of one opcode
+ * in a row, so whatever the host does in between spreads over all of them
+ * and shows up in the deviation
+ */
+static int measure(int samples, uint64_t cycles)
+{
+    double sum[256] = { 0 };
+    double squares[256] = { 0 };
+    bool failed[256] = { false };
+
+    for (int round = 0; round < samples; round++)
+    {
+        /* The jump back in every block costs what JMP costs */
+        double jump_ns = take_sample(0x4C, cycles, 0);
+
+        if (jump_ns < 0)
+            return -1;
+
+        for (int i = 0; i < 256; i++)
+        {
+            double ns;
+
+            if (template_of(i) == TEMPLATE_NONE || failed[i])
+                continue;
+
+            ns = i == 0x4C ? jump_ns : take_sample(i, cycles, jump_ns);
+            if (ns < 0)
+            {
+                failed[i] = true;
+                continue;
+            }
+
+            sum[i] += ns;
+            squares[i] += ns * ns;
+        }
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (template_of(i) == TEMPLATE_NONE || failed[i])
+            continue;
+
+        results[i].measured = true;
+        results[i].mean = sum[i] / samples;
+        results[i].stddev =
+            samples > 1 ? sqrt(fmax(0, (squares[i] - sum[i] * sum[i] / samples) / (samples - 1)))
+                        : 0;
+    }
+
+    for (int i = 0; i < 256; i++)
+        if (failed[i])
+            return -1;
+
+    return 0;
+}
+
+static void print_results(void)
+{
+    printf("# opcode\tname\tmode\tcycles\tmean_ns\tstddev_ns\n");
+
+    for (int i = 0; i < 256; i++)
+    {
+        printf("%02X\t%s\t%s\t%d\t", i, op_names[i], mode_names[ops[i].addr_mode],
+               ops[i].cycles);
+        if (results[i].measured)
+            printf("%.3f\t%.3f\n", results[i].mean, results[i].stddev);
+        else
+            printf("-\t-\n");
+    }
+}
+
+static void print_matrix(void)
+{
+    fprintf(stderr, "ns per instruction, low nibble across\n\n    ");
+    for (int lo = 0; lo < 16; lo++)
+        fprintf(stderr, "  x%X  ", lo);
+    fprintf(stderr, "\n");
+
+    for (int hi = 0; hi < 16; hi++)
+    {
+        fprintf(stderr, "%Xx  ", hi);
+        for (int lo = 0; lo < 16; lo++)
+        {
+            const result_t *r = &results[hi << 4 | lo];
+
+            if (r->measured)
+                fprintf(stderr, "%5.1f ", r->mean);
+            else
+                fprintf(stderr, "    - ");
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static int compare(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int n = 0;
+    int changed = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(stderr, "\nchanges against %s:\n", path);
+
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned int opcode;
+        double mean;
+        double stddev;
+        const result_t *r;
+        double delta;
+
+        n++;
+        if (line[0] == '#')
+            continue;
+
+        if (sscanf(line, "%x %*s %*s %*d %lf %lf", &opcode, &mean, &stddev) != 3)
+        {
+            /* Not measured */
+            if (sscanf(line, "%x", &opcode) == 1 && opcode < 256)
+                continue;
+
+            fprintf(stderr, "bench: %s:%d: syntax error\n", path, n);
+            fclose(f);
+            return -1;
+        }
+
+        r = &results[opcode & 0xFF];
+        if (!r->measured)
+            continue;
+
+        delta = r->mean - mean;
+        if (fabs(delta) > CHANGE_SIGMAS * sqrt(stddev * stddev + r->stddev * r->stddev) &&
+            fabs(delta) > CHANGE_RATIO * mean)
+        {
+            fprintf(stderr, "  %02X %-8s %-7s %7.2f -> %7.2f ns  %+.0f%%\n", opcode,
+                    op_names[opcode & 0xFF], mode_names[ops[opcode & 0xFF].addr_mode], mean,
+                    r->mean, 100 * delta / mean);
+            changed++;
+        }
+    }
+
+    if (!changed)
+        fprintf(stderr, "  none\n");
+
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = DEFAULT_SAMPLES;
+    uint64_t cycles = DEFAULT_CYCLES;
+    const char *baseline = NULL;
+    int status = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            samples = atoi(optarg);
+            break;
+        case 'n':
+            cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            baseline = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (samples < 1 || !cycles)
+        usage(argv[0]);
+
+    if (measure(samples, cycles) < 0)
+        status = 1;
+
+    print_results();
+    print_matrix();
+
+    if (baseline && compare(baseline) < 0)
+        status = 1;
+
+    return status;
+}
@@ -0,0 +1,43 @@
+#include "../cpu/cpu.h"
+#include "board.h"
+#include "decode.h"
+#include "ram.h"
+
+static void via_irq(void *ctx, bool asserted)
+{
+    cpu_irq(IRQ_SOURCE_VIA, asserted);
+}
+
+static void acia_irq(void *ctx, bool asserted)
+{
+    cpu_irq(IRQ_SOURCE_ACIA, asserted);
+}
+
+int board_init(board_t *board, const via_callbacks_t *via_callbacks,
+               const acia_callbacks_t *acia_callbacks, void *ctx)
+{
+    board->via_callbacks = via_callbacks ? *via_callbacks : (via_callbacks_t){ 0 };
+    board->via_callbacks.irq = via_irq;
+    board->acia_callbacks = acia_callbacks ? *acia_callbacks : (acia_callbacks_t){ 0 };
+    board->acia_callbacks.irq = acia_irq;
+
+    ram_init();
+
+    /* RS0-RS3 of the VIA are on A0-A3 */
+    via_init(&board->via, &board->via_callbacks, ctx);
+    if (decode_map_io("via", via_mmio_read, via_mmio_write, &board->via) < 0)
+        return -1;
+
+    /* RS0-RS1 of the ACIA are on A0-A1 */
+    acia_init(&board->acia, &board->acia_callbacks, ctx);
+    if (decode_map_io("acia", acia_mmio_read, acia_mmio_write, &board->acia) < 0)
+        return -1;
+
+    return decode_map_rom() < 0 ? -1 : 0;
+}
+
+void board_reset(board_t *board)
+{
+    via_init(&board->via, &board->via_callbacks, board->via.ctx);
+    acia_init(&board->acia, &board->acia_callbacks, board->acia.ctx);
+}
@@ -0,0 +1,40 @@
+#ifndef CORE_BOARD_H_
+#define CORE_BOARD_H_
+
+#include "../dev/acia.h"
+#include "../dev/via.h"
+
+/*
+ * The board
+ *
+ * The RAM, the ROM, a VIA and an ACIA behind the address decoder, with the VIA
+ * and the ACIA on IRQB. Whoever builds it decides what's on the VIA's ports
+ * and the ACIA's serial line through the callbacks it passes, the board wires
+ * up the interrupts itself.
+ */
+typedef struct
+{
+    via_t via;
+    acia_t acia;
+
+    /* What the devices call: the callbacks given, with the board's irq */
+    via_callbacks_t via_callbacks;
+    acia_callbacks_t acia_callbacks;
+} board_t;
+
+/*
+ * Put the RAM and the devices on the bus and map them, after bus_init() and
+ * whatever has to be evaluated before the RAM. The bus can't be taken apart
+ * again, so this is once per process. ctx is passed to the callbacks, whose
+ * irq is ignored. Returns -1 on error.
+ */
+int board_init(board_t *board, const via_callbacks_t *via_callbacks,
+               const acia_callbacks_t *acia_callbacks, void *ctx);
+
+/*
+ * The devices back to their state at power on, for another machine on the
+ * same board. None of their events may be pending, see sched_clear().
+ */
+void board_reset(board_t *board);
+
+#endif /* CORE_BOARD_H_ */
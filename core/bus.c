@@ -2,19 +2,51 @@
 #include <stdbool.h>
 
 #include "bus.h"
+#include "decode.h"
+
+#define MAX_DEVICES 16
+#define MAX_OBSERVERS 16
+
+/*
+ * Every element of an array needs its own initializer, otherwise the type of
+ * all but the first pin is zero (PIN_TYPE_INPUT)
+ */
+#define PIN(type) { PIN_TYPE_##type, PIN_STATE_NONE, { NULL, NULL } }
+#define PINS4(type) PIN(type), PIN(type), PIN(type), PIN(type)
+#define PINS8(type) PINS4(type), PINS4(type)
 
 /* CPU */
-pin_t cpu_addr_bus[16] = { { PIN_TYPE_OUTPUT, PIN_STATE_NONE, { NULL, NULL } } };
-pin_t cpu_data_bus[8] = { { PIN_TYPE_BIDIRECTIONAL, PIN_STATE_NONE, { NULL, NULL } } };
-pin_t cpu_rwb = { PIN_TYPE_OUTPUT, PIN_STATE_NONE, { NULL, NULL } };
+pin_t cpu_addr_bus[16] = { PINS8(OUTPUT), PINS8(OUTPUT) };
+pin_t cpu_data_bus[8] = { PINS8(BIDIRECTIONAL) };
+pin_t cpu_rwb = PIN(OUTPUT);
+
+/* Address decoder */
+pin_t decode_addr_bus[16] = { PINS8(INPUT), PINS8(INPUT) };
+pin_t decode_ram_cs = PIN(OUTPUT);
+pin_t decode_ram_oe = PIN(OUTPUT);
 
 /* RAM */
-pin_t ram_addr_bus[15] = { { PIN_TYPE_INPUT, PIN_STATE_NONE, { NULL, NULL } } };
-pin_t ram_data_bus[8] = { { PIN_TYPE_BIDIRECTIONAL, PIN_STATE_NONE, { NULL, NULL } } };
-pin_t ram_we = { PIN_TYPE_INPUT, PIN_STATE_NONE, { NULL, NULL } };
-pin_t ram_oe = { PIN_TYPE_INPUT, PIN_STATE_NONE, { NULL, NULL } };
-pin_t ram_cs = { PIN_TYPE_INPUT, PIN_STATE_NONE, { NULL, NULL } };
-// oe and cs - ignore for now
+pin_t ram_addr_bus[15] = { PINS8(INPUT), PINS4(INPUT), PIN(INPUT), PIN(INPUT), PIN(INPUT) };
+pin_t ram_data_bus[8] = { PINS8(BIDIRECTIONAL) };
+pin_t ram_we = PIN(INPUT);
+pin_t ram_oe = PIN(INPUT);
+pin_t ram_cs = PIN(INPUT);
+
+uint64_t bus_contentions = 0;
+
+static struct
+{
+    bus_device_t evaluate;
+    void *ctx;
+} devices[MAX_DEVICES];
+static int device_count = 0;
+
+static struct
+{
+    bus_observer_t observer;
+    void *ctx;
+} observers[MAX_OBSERVERS];
+static int observer_count = 0;
 
 /*
  * Get around the fact that the default initialization above doesn't work well
@@ -29,7 +61,10 @@ static void init_pin(pin_t *pin)
 static void init_pins(void)
 {
     for (int i = 0; i < 16; i++)
+    {
         init_pin(&cpu_addr_bus[i]);
+        init_pin(&decode_addr_bus[i]);
+    }
 
     for (int i = 0; i < 15; i++)
         init_pin(&ram_addr_bus[i]);
@@ -41,6 +76,8 @@ static void init_pins(void)
     }
 
     init_pin(&cpu_rwb);
+    init_pin(&decode_ram_cs);
+    init_pin(&decode_ram_oe);
     init_pin(&ram_we);
     init_pin(&ram_oe);
     init_pin(&ram_cs);
@@ -55,7 +92,11 @@ static void init_cpu_ram_bus(void)
         dl_list_add(&cpu_data_bus[i].list, &ram_data_bus[i].list);
 
     dl_list_add(&cpu_rwb.list, &ram_we.list);
-    dl_list_add(&cpu_addr_bus[14].list, &ram_oe.list);
+    for (int i = 0; i < 16; i++)
+        dl_list_add(&cpu_addr_bus[i].list, &decode_addr_bus[i].list);
+
+    dl_list_add(&decode_ram_cs.list, &ram_cs.list);
+    dl_list_add(&decode_ram_oe.list, &ram_oe.list);
 }
 
 static bool pin_asserted(const pin_t *pin)
@@ -106,8 +147,88 @@ pin_state_t pin_evaluate(pin_t *pin)
     return state;
 }
 
+pin_state_t pin_net_state(pin_t *pin)
+{
+    pin_state_t state = pin_evaluate(pin);
+
+    if (!pin_asserted(pin))
+        return state;
+
+    return state == PIN_STATE_NONE ? pin->state : PIN_STATE_INVALID;
+}
+
+void pins_set(pin_t *pins, int count, unsigned int value)
+{
+    for (int i = 0; i < count; i++)
+        pin_set(&pins[i], value & (1u << i) ? PIN_STATE_HI : PIN_STATE_LO);
+}
+
+void pins_release(pin_t *pins, int count)
+{
+    for (int i = 0; i < count; i++)
+        pin_set(&pins[i], PIN_STATE_NONE);
+}
+
+unsigned int pins_evaluate(pin_t *pins, int count, bool *floating)
+{
+    unsigned int value = 0;
+
+    *floating = false;
+
+    for (int i = 0; i < count; i++)
+    {
+        switch (pin_evaluate(&pins[i]))
+        {
+        case PIN_STATE_HI:
+            value |= 1u << i;
+            break;
+        case PIN_STATE_LO:
+            break;
+        case PIN_STATE_NONE:
+            *floating = true;
+            break;
+        case PIN_STATE_INVALID:
+            bus_contentions++;
+            break;
+        }
+    }
+
+    return value;
+}
+
+void bus_attach(bus_device_t evaluate, void *ctx)
+{
+    assert(device_count < MAX_DEVICES);
+    devices[device_count].evaluate = evaluate;
+    devices[device_count].ctx = ctx;
+    device_count++;
+}
+
+void bus_evaluate(void)
+{
+    for (int i = 0; i < device_count; i++)
+        devices[i].evaluate(devices[i].ctx);
+}
+
+void bus_observe(bus_observer_t observer, void *ctx)
+{
+    assert(observer_count < MAX_OBSERVERS);
+    observers[observer_count].observer = observer;
+    observers[observer_count].ctx = ctx;
+    observer_count++;
+}
+
+void bus_cycle(const bus_cycle_t *cycle)
+{
+    for (int i = 0; i < observer_count; i++)
+        observers[i].observer(cycle, observers[i].ctx);
+}
+
 void bus_init(void)
 {
         init_pins();
         init_cpu_ram_bus();
+
+        /* The decoder goes first, it selects the chips for the others */
+        decode_attach();
 }
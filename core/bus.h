@@ -1,7 +1,9 @@
 #ifndef CORE_BUS_H_
 #define CORE_BUS_H_
 
+#include <stdbool.h>
 #include <stddef.h> /* FIXME: issues with flycheck and NULL being undefined */
+#include <stdint.h>
 
 #include "../utils/list.h"
 
@@ -31,6 +33,46 @@ void bus_init(void);
 pin_state_t pin_evaluate(pin_t *pin);
 void pin_set(pin_t *pin, pin_state_t state);
 
+/* Level on the whole net, unlike pin_evaluate() counting the pin itself */
+pin_state_t pin_net_state(pin_t *pin);
+
+/*
+ * Helpers for groups of pins carrying a binary value, least significant bit
+ * first. pins_evaluate() sets *floating if any of the pins isn't driven.
+ */
+void pins_set(pin_t *pins, int count, unsigned int value);
+void pins_release(pin_t *pins, int count);
+unsigned int pins_evaluate(pin_t *pins, int count, bool *floating);
+
+/* Number of times more than one pin drove the same net */
+extern uint64_t bus_contentions;
+
+/*
+ * Pin level devices. After the CPU has driven its pins for a bus cycle, every
+ * attached device gets to look at its input pins and drive its outputs.
+ */
+typedef void (*bus_device_t)(void *ctx);
+
+void bus_attach(bus_device_t evaluate, void *ctx);
+void bus_evaluate(void);
+
+/*
+ * Bus cycle observers. At cycle and pin accuracy, every bus cycle the CPU
+ * performs (including dummy reads) is reported to the observers.
+ */
+typedef struct
+{
+    uint64_t cycle;
+    uint16_t addr;
+    uint8_t data;
+    bool write;
+} bus_cycle_t;
+
+typedef void (*bus_observer_t)(const bus_cycle_t *cycle, void *ctx);
+
+void bus_observe(bus_observer_t observer, void *ctx);
+void bus_cycle(const bus_cycle_t *cycle);
+
 /* FIXME: Move this to cpu and ram modules */
 
 /* CPU */
@@ -38,12 +80,16 @@ extern pin_t cpu_addr_bus[16];
 extern pin_t cpu_data_bus[8];
 extern pin_t cpu_rwb;
 
+/* Address decoder, see decode.h */
+extern pin_t decode_addr_bus[16];
+extern pin_t decode_ram_cs;
+extern pin_t decode_ram_oe;
+
 /* RAM */
 extern pin_t ram_addr_bus[15];
 extern pin_t ram_data_bus[8];
 extern pin_t ram_we;
 extern pin_t ram_oe;
 extern pin_t ram_cs;
-// oe and cs - ignore for now
 
 #endif /* CORE_BUS_H_ */
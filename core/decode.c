@@ -0,0 +1,398 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "decode.h"
+
+#define MAX_NODES 256
+
+/* What the board was built with */
+static const char *const board_equations[] = {
+    "ram = !A15 & !(A14 & (A13 | A12))",
+    "acia = !A15 & A14 & !A13 & A12",
+    "via = !A15 & A14 & A13",
+    "rom = A15",
+};
+
+typedef enum
+{
+    NODE_LINE,
+    NODE_CONST,
+    NODE_NOT,
+    NODE_AND,
+    NODE_OR,
+} node_type_t;
+
+typedef struct
+{
+    node_type_t type;
+    int value; /* address line or constant */
+    int left;
+    int right;
+} node_t;
+
+typedef struct
+{
+    node_t nodes[MAX_NODES];
+    int node_count;
+    char names[DECODE_MAX_CHIPS][DECODE_NAME_LEN];
+    int roots[DECODE_MAX_CHIPS];
+    int chip_count;
+    unsigned int lines; /* address lines looked at */
+    const char *p; /* parser position */
+} equations_t;
+
+static uint8_t table[1 << 16];
+static char chip_names[DECODE_MAX_CHIPS][DECODE_NAME_LEN];
+static int chip_count = 0;
+static bool loaded = false;
+static int ram_chip = -1;
+static int rom_chip = -1;
+
+/* Select lines left to something else, see decode_yield() */
+static bool cs_yielded = false;
+static bool oe_yielded = false;
+
+const uint8_t *decode_table = table;
+unsigned int decode_shift = 0;
+
+/*
+ * Parsing, by recursive descent
+ */
+static int parse_or(equations_t *eq);
+
+static void skip_space(equations_t *eq)
+{
+    while (isspace((unsigned char)*eq->p))
+        eq->p++;
+}
+
+/* Children of -1 are parse errors passed up */
+static int new_node(equations_t *eq, node_type_t type, int value, int left, int right)
+{
+    bool binary = type == NODE_AND || type == NODE_OR;
+
+    if (left < 0 || (binary && right < 0) || eq->node_count == MAX_NODES)
+        return -1;
+
+    eq->nodes[eq->node_count] = (node_t){ type, value, left, right };
+    return eq->node_count++;
+}
+
+static int parse_factor(equations_t *eq)
+{
+    skip_space(eq);
+
+    if (*eq->p == '!' || *eq->p == '/')
+    {
+        eq->p++;
+        return new_node(eq, NODE_NOT, 0, parse_factor(eq), -1);
+    }
+
+    if (*eq->p == '(')
+    {
+        int node;
+
+        eq->p++;
+        node = parse_or(eq);
+        skip_space(eq);
+        if (*eq->p++ != ')')
+            return -1;
+        return node;
+    }
+
+    if (*eq->p == '0' || *eq->p == '1')
+        return new_node(eq, NODE_CONST, *eq->p++ == '1', 0, -1);
+
+    if (toupper((unsigned char)*eq->p) == 'A' && isdigit((unsigned char)eq->p[1]))
+    {
+        char *end;
+        long line = strtol(eq->p + 1, &end, 10);
+
+        if (line > 15)
+            return -1;
+        eq->p = end;
+        eq->lines |= BIT(line);
+        return new_node(eq, NODE_LINE, line, 0, -1);
+    }
+
+    return -1;
+}
+
+static int parse_and(equations_t *eq)
+{
+    int node = parse_factor(eq);
+
+    for (skip_space(eq); *eq->p == '&'; skip_space(eq))
+    {
+        eq->p++;
+        node = new_node(eq, NODE_AND, 0, node, parse_factor(eq));
+    }
+
+    return node;
+}
+
+static int parse_or(equations_t *eq)
+{
+    int node = parse_and(eq);
+
+    for (skip_space(eq); *eq->p == '|'; skip_space(eq))
+    {
+        eq->p++;
+        node = new_node(eq, NODE_OR, 0, node, parse_and(eq));
+    }
+
+    return node;
+}
+
+/* One "name = expression" line */
+static int parse_line(equations_t *eq, char *line)
+{
+    char *eq_sign = strchr(line, '=');
+    char *name = line;
+    size_t len;
+
+    if (!eq_sign || eq->chip_count == DECODE_MAX_CHIPS)
+        return -1;
+
+    while (isspace((unsigned char)*name))
+        name++;
+    for (len = eq_sign - name; len && isspace((unsigned char)name[len - 1]); len--)
+        ;
+    if (len == 0 || len >= DECODE_NAME_LEN)
+        return -1;
+
+    eq->p = eq_sign + 1;
+    eq->roots[eq->chip_count] = parse_or(eq);
+    skip_space(eq);
+    if (eq->roots[eq->chip_count] < 0 || *eq->p)
+        return -1;
+
+    snprintf(eq->names[eq->chip_count], DECODE_NAME_LEN, "%.*s", (int)len, name);
+    eq->chip_count++;
+    return 0;
+}
+
+/*
+ * Compiling
+ */
+static bool evaluate(const equations_t *eq, int node, unsigned int addr)
+{
+    const node_t *n = &eq->nodes[node];
+
+    switch (n->type)
+    {
+    case NODE_LINE:
+        return addr & BIT(n->value);
+    case NODE_CONST:
+        return n->value;
+    case NODE_NOT:
+        return !evaluate(eq, n->left, addr);
+    case NODE_AND:
+        return evaluate(eq, n->left, addr) && evaluate(eq, n->right, addr);
+    case NODE_OR:
+        return evaluate(eq, n->left, addr) || evaluate(eq, n->right, addr);
+    }
+
+    return false;
+}
+
+static void compile(const equations_t *eq)
+{
+    /* Equations only looking at A8-A15 need an entry per page */
+    unsigned int shift = eq->lines & 0xFF ? 0 : 8;
+
+    for (unsigned int i = 0; i < (1u << 16) >> shift; i++)
+    {
+        uint8_t mask = 0;
+
+        for (int chip = 0; chip < eq->chip_count; chip++)
+            if (evaluate(eq, eq->roots[chip], i << shift))
+                mask |= BIT(chip);
+
+        table[i] = mask;
+    }
+
+    decode_shift = shift;
+    chip_count = eq->chip_count;
+    memcpy(chip_names, eq->names, sizeof(chip_names));
+    loaded = true;
+    ram_chip = decode_chip("ram");
+    rom_chip = decode_chip("rom");
+}
+
+static void load_board(void)
+{
+    static equations_t eq;
+    char line[128];
+
+    memset(&eq, 0, sizeof(eq));
+    for (size_t i = 0; i < sizeof(board_equations) / sizeof(board_equations[0]); i++)
+    {
+        snprintf(line, sizeof(line), "%s", board_equations[i]);
+        parse_line(&eq, line);
+    }
+
+    compile(&eq);
+}
+
+int decode_load(const char *path)
+{
+    static equations_t eq;
+    char line[256];
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    memset(&eq, 0, sizeof(eq));
+    while (fgets(line, sizeof(line), f))
+    {
+        char *p = line;
+
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        while (isspace((unsigned char)*p))
+            p++;
+
+        if (*p && parse_line(&eq, p) < 0)
+        {
+            fprintf(stderr, "decode: %s:%d: syntax error\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    compile(&eq);
+
+    return 0;
+}
+
+int decode_chip(const char *name)
+{
+    if (!loaded)
+        load_board();
+
+    for (int i = 0; i < chip_count; i++)
+        if (strcmp(chip_names[i], name) == 0)
+            return i;
+
+    return -1;
+}
+
+/* Whether a chip is selected for a page, or -1 if for part of it */
+static int page_selected(const char *chip, int index, unsigned int page)
+{
+    unsigned int selected = 0;
+
+    for (unsigned int addr = page << 8; addr < (page + 1) << 8; addr++)
+        selected += (decode_select(addr) >> index) & 1;
+
+    if (selected != 0 && selected != 256)
+    {
+        fprintf(stderr, "decode: %s is selected for part of page %02x\n", chip, page);
+        return -1;
+    }
+
+    return selected != 0;
+}
+
+int decode_map_io(const char *chip, mem_io_read_t read, mem_io_write_t write, void *ctx)
+{
+    int index = decode_chip(chip);
+    int mapped = 0;
+
+    if (index < 0)
+    {
+        fprintf(stderr, "decode: no chip select for %s\n", chip);
+        return -1;
+    }
+
+    for (unsigned int page = 0; page < 256; page++)
+    {
+        int selected = page_selected(chip, index, page);
+
+        if (selected < 0)
+            return -1;
+        if (!selected)
+            continue;
+
+        mem_map_io(page, 1, read, write, ctx);
+        mapped++;
+    }
+
+    return mapped;
+}
+
+int decode_map_rom(void)
+{
+    int index = decode_chip("rom");
+    int mapped = 0;
+
+    if (index < 0)
+        return 0;
+
+    for (unsigned int page = 0; page < 256; page++)
+    {
+        int selected = page_selected("rom", index, page);
+
+        if (selected < 0)
+            return -1;
+        if (!selected)
+            continue;
+
+        mem_page_flags[page] |= MEM_PAGE_ROM;
+        mapped++;
+    }
+
+    return mapped;
+}
+
+/*
+ * Pin level. The RAM's CS and OE are active low, and OE only has to be
+ * asserted for reads, as WE overrides it. Where the ROM is selected the RAM
+ * isn't, so writes there go nowhere, as at the other levels.
+ */
+static void decode_evaluate(void *ctx)
+{
+    bool floating;
+    unsigned int addr = pins_evaluate(decode_addr_bus, 16, &floating);
+    uint8_t chips = floating ? 0 : decode_select(addr);
+    bool selected = ram_chip >= 0 && chips & BIT(ram_chip) &&
+                    !(rom_chip >= 0 && chips & BIT(rom_chip));
+
+    pin_set(&decode_ram_cs, cs_yielded ? PIN_STATE_NONE : selected ? PIN_STATE_LO : PIN_STATE_HI);
+    pin_set(&decode_ram_oe, oe_yielded ? PIN_STATE_NONE : selected ? PIN_STATE_LO : PIN_STATE_HI);
+}
+
+void decode_yield(const pin_t *net, bool yield)
+{
+    if (net == &ram_cs)
+    {
+        cs_yielded = yield;
+        if (yield)
+            pin_set(&decode_ram_cs, PIN_STATE_NONE);
+    }
+    else if (net == &ram_oe)
+    {
+        oe_yielded = yield;
+        if (yield)
+            pin_set(&decode_ram_oe, PIN_STATE_NONE);
+    }
+}
+
+void decode_attach(void)
+{
+    if (!loaded)
+        load_board();
+
+    bus_attach(decode_evaluate, NULL);
+}
@@ -0,0 +1,70 @@
+#ifndef CORE_DECODE_H_
+#define CORE_DECODE_H_
+
+#include <stdint.h>
+
+#include "../cpu/mem.h"
+#include "bus.h"
+
+/*
+ * Address decoder
+ *
+ * The glue logic selecting the chips of the board, described as one boolean
+ * equation per chip select over the address lines:
+ *
+ *     # comment
+ *     ram  = !A15 & !(A14 & (A13 | A12))
+ *     acia = !A15 & A14 & !A13 & A12
+ *     via  = !A15 & A14 & A13
+ *     rom  = A15
+ *
+ * with ! (or /) for not, & for and, | for or, and parentheses. A select is
+ * true when the chip is selected, whatever the polarity of its pin.
+ *
+ * The equations are compiled into a table of chip select masks indexed by
+ * address, or by page when no equation looks at A0-A7, so decoding costs one
+ * lookup however involved the memory map is. Without an equations file the
+ * board's own decoder above is used.
+ */
+#define DECODE_MAX_CHIPS 8
+#define DECODE_NAME_LEN 16
+
+/* Returns -1 on error, with the previous equations left in place */
+int decode_load(const char *path);
+
+/* Index of a chip select for masks, or -1 */
+int decode_chip(const char *name);
+
+extern const uint8_t *decode_table;
+extern unsigned int decode_shift;
+
+/* Mask of the chips selected at an address */
+static inline uint8_t decode_select(addr_t addr)
+{
+    return decode_table[addr >> decode_shift];
+}
+
+/*
+ * mem_map_io() for every page a chip is selected in. The chip has to be
+ * selected for all of those pages or none of it. Returns -1 on error.
+ */
+int decode_map_io(const char *chip, mem_io_read_t read, mem_io_write_t write, void *ctx);
+
+/*
+ * Make the pages the ROM is selected for read-only, see MEM_PAGE_ROM. Like
+ * decode_map_io() the ROM has to be selected for all of a page or none of it.
+ * Without a ROM select nothing is. Returns -1 on error.
+ */
+int decode_map_rom(void);
+
+/* Drive the RAM's select lines at pin accuracy, called from bus_init() */
+void decode_attach(void);
+
+/*
+ * Stop driving a select line, ram_cs or ram_oe, for something else to drive
+ * it instead, like a co-simulated model of the glue logic. Two drivers on the
+ * line would leave it invalid and the RAM never selected.
+ */
+void decode_yield(const pin_t *net, bool yield);
+
+#endif /* CORE_DECODE_H_ */
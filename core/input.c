@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu/cpu.h"
+#include "input.h"
+#include "sched.h"
+#include "state.h"
+
+/* A delivery, as recorded */
+typedef struct
+{
+    uint64_t cycle;
+    int queue;
+    uint32_t code;
+    uint32_t value;
+} delivery_t;
+
+static input_queue_t *queues[INPUT_MAX_QUEUES];
+static int queue_count = 0;
+
+/* Machine side, saved with the machine */
+static struct
+{
+    sched_event_t poll;
+    uint64_t next[INPUT_MAX_QUEUES]; /* earliest cycle for the next event */
+    uint64_t replayed;
+} machine;
+
+static FILE *record;
+static delivery_t *replay;
+static uint64_t replay_count;
+
+int input_queue_init(input_queue_t *queue, const char *name, uint64_t spacing,
+                     input_deliver_t deliver, void *ctx)
+{
+    if (queue_count == INPUT_MAX_QUEUES || strlen(name) >= INPUT_NAME_LEN)
+        return -1;
+
+    for (int i = 0; i < queue_count; i++)
+        if (strcmp(queues[i]->name, name) == 0)
+            return -1;
+
+    strcpy(queue->name, name);
+    queue->spacing = spacing;
+    queue->deliver = deliver;
+    queue->ctx = ctx;
+    queue->index = queue_count;
+    spsc_init(&queue->ring, INPUT_QUEUE_SIZE, 1);
+
+    queues[queue_count++] = queue;
+    return 0;
+}
+
+/*
+ * Host thread
+ */
+bool input_push_at(input_queue_t *queue, uint64_t cycle, uint32_t code, uint32_t value)
+{
+    if (!spsc_try_space(&queue->ring))
+        return false;
+
+    queue->events[spsc_back(&queue->ring)] = (input_event_t){
+        .cycle = cycle,
+        .code = code,
+        .value = value,
+    };
+    spsc_push(&queue->ring);
+    spsc_publish(&queue->ring);
+
+    return true;
+}
+
+bool input_push(input_queue_t *queue, uint32_t code, uint32_t value)
+{
+    return input_push_at(queue, 0, code, value);
+}
+
+/*
+ * Machine
+ */
+static void deliver(input_queue_t *queue, const input_event_t *event)
+{
+    queue->deliver(queue->ctx, event);
+    machine.next[queue->index] = event->cycle + queue->spacing;
+
+    /*
+     * Deliveries are at most one per spacing, so flushing each costs little and
+     * the recording survives the emulator being killed
+     */
+    if (record)
+    {
+        fprintf(record, "%llu %s %u %u\n", (unsigned long long)event->cycle, queue->name,
+                event->code, event->value);
+        fflush(record);
+    }
+}
+
+/* Deliver whatever is due, returns when the next event will be */
+static uint64_t drain(input_queue_t *queue, uint64_t now)
+{
+    uint64_t due = UINT64_MAX;
+
+    while (spsc_ready(&queue->ring))
+    {
+        input_event_t event = queue->events[spsc_front(&queue->ring)];
+        uint64_t at = event.cycle > machine.next[queue->index] ? event.cycle
+                                                               : machine.next[queue->index];
+
+        if (at > now)
+        {
+            due = at;
+            break;
+        }
+
+        event.cycle = now;
+        deliver(queue, &event);
+        spsc_pop(&queue->ring);
+    }
+
+    return due;
+}
+
+static uint64_t drain_replay(uint64_t now)
+{
+    while (machine.replayed < replay_count && replay[machine.replayed].cycle <= now)
+    {
+        const delivery_t *d = &replay[machine.replayed++];
+        input_event_t event = { .cycle = d->cycle, .code = d->code, .value = d->value };
+
+        deliver(queues[d->queue], &event);
+    }
+
+    return machine.replayed < replay_count ? replay[machine.replayed].cycle : UINT64_MAX;
+}
+
+static void poll(void *ctx, uint64_t when)
+{
+    uint64_t next = when + INPUT_POLL_PERIOD;
+
+    if (replay)
+    {
+        uint64_t due = drain_replay(when);
+
+        if (due < next)
+            next = due;
+    }
+    else
+    {
+        for (int i = 0; i < queue_count; i++)
+        {
+            uint64_t due = drain(queues[i], when);
+
+            if (due < next)
+                next = due;
+        }
+    }
+
+    sched_add(&machine.poll, next);
+}
+
+static void input_fixup(void *data, const void *live, size_t size)
+{
+    sched_event_fixup(data, live);
+}
+
+static int load_replay(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    uint64_t size = 0;
+    int n = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned long long cycle;
+        char name[INPUT_NAME_LEN];
+        delivery_t *d;
+        int queue = -1;
+
+        n++;
+        if (line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+
+        if (replay_count == size)
+        {
+            delivery_t *grown = realloc(replay, (size ? size * 2 : 256) * sizeof(*replay));
+
+            if (!grown)
+            {
+                fprintf(stderr, "input: %s: out of memory\n", path);
+                fclose(f);
+                return -1;
+            }
+            replay = grown;
+            size = size ? size * 2 : 256;
+        }
+
+        d = &replay[replay_count];
+        if (sscanf(line, "%llu %15s %u %u", &cycle, name, &d->code, &d->value) != 4 ||
+            (replay_count && cycle < replay[replay_count - 1].cycle))
+        {
+            fprintf(stderr, "input: %s:%d: syntax error\n", path, n);
+            fclose(f);
+            return -1;
+        }
+
+        for (int i = 0; i < queue_count; i++)
+            if (strcmp(queues[i]->name, name) == 0)
+                queue = i;
+
+        if (queue < 0)
+        {
+            fprintf(stderr, "input: %s:%d: no queue %s\n", path, n, name);
+            fclose(f);
+            return -1;
+        }
+
+        d->cycle = cycle;
+        d->queue = queue;
+        replay_count++;
+    }
+
+    fclose(f);
+
+    /* Nothing to replay is still a replay */
+    if (!replay)
+        replay = malloc(sizeof(*replay));
+
+    return replay ? 0 : -1;
+}
+
+int input_start(const char *record_path, const char *replay_path)
+{
+    if (replay_path && load_replay(replay_path) < 0)
+        return -1;
+
+    if (record_path)
+    {
+        record = fopen(record_path, "w");
+        if (!record)
+        {
+            perror(record_path);
+            return -1;
+        }
+    }
+
+    state_register("input", &machine, sizeof(machine), input_fixup);
+
+    sched_event_init(&machine.poll, poll, NULL);
+    sched_add(&machine.poll, cpu_cycles + INPUT_POLL_PERIOD);
+
+    return 0;
+}
+
+int input_stop(void)
+{
+    int ret = 0;
+
+    if (record)
+    {
+        if (ferror(record) || fclose(record) != 0)
+        {
+            fprintf(stderr, "input: can't write the recording\n");
+            ret = -1;
+        }
+        record = NULL;
+    }
+
+    free(replay);
+    replay = NULL;
+    replay_count = 0;
+
+    return ret;
+}
@@ -0,0 +1,76 @@
+#ifndef CORE_INPUT_H_
+#define CORE_INPUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../utils/spsc.h"
+
+/*
+ * Input from host threads
+ *
+ * Every device taking input from outside has a queue of its own, with a
+ * single host thread pushing into it and the machine taking events out.
+ * Neither side ever waits for the other: a full queue refuses the event, and
+ * the machine only looks at the queues from a scheduler event, every
+ * INPUT_POLL_PERIOD cycles or at the cycle an event was stamped with,
+ * whichever comes first.
+ *
+ * When a host thread pushes something is up to the host, so the cycle an
+ * event is delivered at is only decided by the machine. Deliveries can be
+ * recorded, and a recording replayed instead of the queues gives the same
+ * run again.
+ */
+#define INPUT_QUEUE_SIZE 1024
+#define INPUT_MAX_QUEUES 8
+#define INPUT_POLL_PERIOD 1000
+#define INPUT_NAME_LEN 16
+
+/* What code and value mean is up to the device */
+typedef struct
+{
+    uint64_t cycle; /* 0 for as soon as possible */
+    uint32_t code;
+    uint32_t value;
+} input_event_t;
+
+typedef void (*input_deliver_t)(void *ctx, const input_event_t *event);
+
+typedef struct
+{
+    char name[INPUT_NAME_LEN];
+    uint64_t spacing;
+    input_deliver_t deliver;
+    void *ctx;
+    int index;
+
+    input_event_t events[INPUT_QUEUE_SIZE];
+    spsc_t ring;
+} input_queue_t;
+
+/*
+ * Set up a queue and make it known to the machine. Consecutive events are
+ * delivered at least spacing cycles apart, e.g. the time a byte takes on a
+ * serial line. Returns -1 if there are too many queues or the name is taken.
+ */
+int input_queue_init(input_queue_t *queue, const char *name, uint64_t spacing,
+                     input_deliver_t deliver, void *ctx);
+
+/*
+ * From the one host thread feeding the queue. The cycles events are stamped
+ * with must not go down. Returns false if the queue is full.
+ */
+bool input_push(input_queue_t *queue, uint32_t code, uint32_t value);
+bool input_push_at(input_queue_t *queue, uint64_t cycle, uint32_t code, uint32_t value);
+
+/*
+ * Start looking at the queues, after they're set up and before a savestate
+ * is loaded, the polling is part of the saved state. With a recording to
+ * replay, events come from there and the queues are ignored.
+ */
+int input_start(const char *record, const char *replay);
+
+/* Flush the recording. Returns -1 if writing it failed. */
+int input_stop(void);
+
+#endif /* CORE_INPUT_H_ */
@@ -0,0 +1,208 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../cpu/mem.h"
+#include "../utils/cache.h"
+#include "mp.h"
+#include "sched.h"
+
+/* Polls of another CPU's progress before yielding the host CPU */
+#define SPIN_POLLS 100
+
+typedef struct
+{
+    /* The CPU won't use the shared bus before this cycle */
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t now;
+
+    /* See mp_stats_t, only written by the CPU but read while it runs */
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t accesses;
+    atomic_uint_fast64_t wait_states;
+} mp_cpu_t;
+
+static mp_cpu_t cpus[MP_MAX_CPUS];
+static int cpu_count = 1;
+static atomic_int ready;
+
+static uint8_t *shared_ram;
+static unsigned int shared_first;
+static unsigned int shared_pages;
+static mp_setup_t setup_cpu;
+static void *setup_ctx;
+
+/*
+ * First cycle the shared bus hasn't been granted for. Only the CPU whose turn
+ * it is touches it, and turns are handed over through the release and acquire
+ * of the progress counters.
+ */
+static uint64_t bus_free = 0;
+
+static CPU_LOCAL int self;
+static CPU_LOCAL sched_event_t quantum;
+
+/* Shared bus cycles in the current instruction */
+static CPU_LOCAL uint64_t stamp_base;
+static CPU_LOCAL uint64_t stamp_offset;
+
+static void publish(uint64_t t)
+{
+    if (t > atomic_load_explicit(&cpus[self].now, memory_order_relaxed))
+        atomic_store_explicit(&cpus[self].now, t, memory_order_release);
+}
+
+/* The one writer needs no atomic add, only a store the reader sees whole */
+static void count(atomic_uint_fast64_t *counter, uint64_t n)
+{
+    uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+
+    atomic_store_explicit(counter, value + n, memory_order_relaxed);
+}
+
+/* Whether CPU j is past our access at cycle t in bus order */
+static bool after(int j, uint64_t t)
+{
+    uint64_t now = atomic_load_explicit(&cpus[j].now, memory_order_acquire);
+
+    return now > t || (now == t && j > self);
+}
+
+static void wait_turn(uint64_t t)
+{
+    for (int j = 0; j < cpu_count; j++)
+    {
+        unsigned int polls = 0;
+
+        if (j == self)
+            continue;
+
+        while (!after(j, t))
+            if (++polls >= SPIN_POLLS)
+                sched_yield();
+    }
+}
+
+/* Arbitrate for the shared bus, returns the cycle granted */
+static uint64_t grant(void)
+{
+    uint64_t t;
+
+    if (stamp_base != cpu_cycles)
+    {
+        stamp_base = cpu_cycles;
+        stamp_offset = 0;
+    }
+
+    for (;;)
+    {
+        t = stamp_base + stamp_offset;
+        publish(t);
+        wait_turn(t);
+
+        if (t >= bus_free)
+            break;
+
+        /* Lost the cycle: RDY low and BE released until the bus is free */
+        count(&cpus[self].wait_states, bus_free - t);
+        cpu_cycles += bus_free - t;
+        stamp_base = cpu_cycles - stamp_offset;
+    }
+
+    bus_free = t + 1;
+    stamp_offset++;
+    count(&cpus[self].accesses, 1);
+
+    return t;
+}
+
+static word_t shared_read(void *ctx, addr_t addr)
+{
+    uint64_t t = grant();
+    word_t word = shared_ram[addr - shared_first * 256];
+
+    publish(t + 1);
+    return word;
+}
+
+static void shared_write(void *ctx, addr_t addr, word_t word)
+{
+    uint64_t t = grant();
+
+    shared_ram[addr - shared_first * 256] = word;
+    publish(t + 1);
+}
+
+/* Let the others know how far we are even without shared accesses */
+static void quantum_expired(void *ctx, uint64_t when)
+{
+    publish(cpu_cycles);
+    sched_add(&quantum, when + MP_QUANTUM);
+}
+
+static void attach(int cpu)
+{
+    self = cpu;
+    setup_cpu(cpu, setup_ctx);
+
+    mem_map_io(shared_first, shared_pages, shared_read, shared_write, NULL);
+    sched_event_init(&quantum, quantum_expired, NULL);
+    sched_add(&quantum, cpu_cycles + MP_QUANTUM);
+
+    /* Nobody runs before everybody is set up */
+    atomic_fetch_add(&ready, 1);
+    while (atomic_load(&ready) < cpu_count)
+        sched_yield();
+}
+
+static void *cpu_thread(void *arg)
+{
+    attach((int)(intptr_t)arg);
+    cpu_run(UINT64_MAX);
+
+    return NULL;
+}
+
+int mp_start(int count, uint8_t *shared, unsigned int first_page, unsigned int pages,
+             mp_setup_t setup, void *ctx)
+{
+    if (count < 1 || count > MP_MAX_CPUS || first_page + pages > 256)
+    {
+        fprintf(stderr, "mp: can't have %d CPUs sharing pages %02x-%02x\n", count, first_page,
+                first_page + pages - 1);
+        return -1;
+    }
+
+    cpu_count = count;
+    shared_ram = shared;
+    shared_first = first_page;
+    shared_pages = pages;
+    setup_cpu = setup;
+    setup_ctx = ctx;
+
+    for (int i = 1; i < count; i++)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, cpu_thread, (void *)(intptr_t)i) != 0)
+        {
+            fprintf(stderr, "mp: can't start CPU %d\n", i);
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+
+    attach(0);
+    return 0;
+}
+
+void mp_stop(void)
+{
+    atomic_store_explicit(&cpus[self].now, UINT64_MAX, memory_order_release);
+}
+
+void mp_get_stats(int cpu, mp_stats_t *stats)
+{
+    stats->accesses = atomic_load_explicit(&cpus[cpu].accesses, memory_order_relaxed);
+    stats->wait_states = atomic_load_explicit(&cpus[cpu].wait_states, memory_order_relaxed);
+}
@@ -0,0 +1,54 @@
+#ifndef CORE_MP_H_
+#define CORE_MP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * Multiprocessor boards
+ *
+ * Every CPU runs on a host thread of its own, with its own registers, memory
+ * map, memory and scheduler (see CPU_LOCAL). What the CPUs share is a window
+ * of RAM behind an arbitrated bus, mapped into each of them like a device.
+ *
+ * The CPUs only synchronize on shared bus cycles. Each one publishes how far
+ * it has got, at every shared access and at least every MP_QUANTUM cycles. A
+ * shared access at cycle t waits until every other CPU is past t (ties go to
+ * the lower numbered CPU), so the shared bus sees its cycles in the same order
+ * on every run, however the host schedules the threads.
+ *
+ * The arbiter grants the bus for one cycle at a time. A CPU that asks for a
+ * cycle that was already granted has RDY pulled low and BE released until the
+ * bus is free, which costs it wait states just like on the board.
+ *
+ * Debugging, differential checking, hooks and the heatmap only follow CPU 0,
+ * the one on the thread that called mp_start().
+ */
+#define MP_MAX_CPUS 4
+#define MP_QUANTUM 64
+
+/* Called on every CPU's own thread before it starts, to set up its machine */
+typedef void (*mp_setup_t)(int cpu, void *ctx);
+
+typedef struct
+{
+    uint64_t accesses; /* shared bus cycles */
+    uint64_t wait_states; /* cycles spent with RDY low */
+} mp_stats_t;
+
+/*
+ * Map the shared RAM at the given pages of every CPU, make the calling thread
+ * CPU 0 and start the others. They run until the process exits. Returns once
+ * every CPU is set up, or -1 on error.
+ */
+int mp_start(int count, uint8_t *shared, unsigned int first_page, unsigned int pages,
+             mp_setup_t setup, void *ctx);
+
+/* CPU 0 is done, the others stop waiting for it */
+void mp_stop(void);
+
+void mp_get_stats(int cpu, mp_stats_t *stats);
+
+#endif /* CORE_MP_H_ */
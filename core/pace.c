@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <time.h>
+
+#include "../cpu/cpu.h"
+#include "pace.h"
+
+#define NS_PER_SEC UINT64_C(1000000000)
+
+pace_stats_t pace_stats;
+
+static uint64_t rate;
+static uint64_t spin_ns;
+
+/* Wall clock time and cycle that deadlines are counted from */
+static uint64_t anchor_ns;
+static uint64_t anchor_cycles;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+uint64_t pace_start(uint64_t hz, uint64_t jitter_ns)
+{
+    uint64_t batch = hz * jitter_ns / NS_PER_SEC;
+
+    rate = hz;
+    spin_ns = jitter_ns / 4 < PACE_MAX_SPIN_NS ? jitter_ns / 4 : PACE_MAX_SPIN_NS;
+    anchor_ns = now_ns();
+    anchor_cycles = cpu_cycles;
+
+    return batch ? batch : 1;
+}
+
+void pace_wait(void)
+{
+    uint64_t cycles = cpu_cycles - anchor_cycles;
+    uint64_t deadline = anchor_ns + cycles / rate * NS_PER_SEC + cycles % rate * NS_PER_SEC / rate;
+    uint64_t now = now_ns();
+
+    pace_stats.batches++;
+
+    if (now >= deadline)
+    {
+        uint64_t lag = now - deadline;
+
+        pace_stats.late++;
+        pace_stats.lag_ns = lag;
+        pace_stats.total_lag_ns += lag;
+        if (lag > pace_stats.max_lag_ns)
+            pace_stats.max_lag_ns = lag;
+
+        if (lag > PACE_RESYNC_NS)
+        {
+            anchor_ns = now;
+            anchor_cycles = cpu_cycles;
+            pace_stats.resyncs++;
+        }
+        return;
+    }
+
+    pace_stats.lag_ns = 0;
+
+    if (deadline - now > spin_ns)
+    {
+        struct timespec ts = {
+            .tv_sec = (deadline - spin_ns) / NS_PER_SEC,
+            .tv_nsec = (deadline - spin_ns) % NS_PER_SEC,
+        };
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+
+    while (now_ns() < deadline)
+        ;
+}
+
+void pace_report(FILE *f)
+{
+    if (!pace_stats.batches)
+        return;
+
+    fprintf(f, "pace: %llu batches, %llu late, lag max %.3f ms, mean %.3f ms, %llu resyncs\n",
+            (unsigned long long)pace_stats.batches, (unsigned long long)pace_stats.late,
+            pace_stats.max_lag_ns / 1e6, pace_stats.total_lag_ns / 1e6 / pace_stats.batches,
+            (unsigned long long)pace_stats.resyncs);
+}
@@ -0,0 +1,46 @@
+#ifndef CORE_PACE_H_
+#define CORE_PACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Real-time pacing
+ *
+ * The emulator runs batches of cycles as fast as it can, and after each one
+ * sleeps until the wall clock reaches the time the batch ends at on the real
+ * board. Deadlines are absolute, counted from when pacing started, so
+ * oversleeping in one batch is made up in the next instead of adding up. The
+ * last stretch before a deadline is spun rather than slept, since waking up
+ * from a sleep takes longer than asked.
+ *
+ * A batch is as long as the allowed jitter, the most the guest gets ahead of
+ * the wall clock. When the host falls too far behind (a debugger stop, a
+ * stalled host) the debt is written off instead of running flat out to catch
+ * up.
+ */
+#define PACE_DEFAULT_JITTER_NS 1000000
+#define PACE_MAX_SPIN_NS 200000
+#define PACE_RESYNC_NS 100000000
+
+typedef struct
+{
+    uint64_t batches;
+    uint64_t late; /* batches that finished after their deadline */
+    uint64_t lag_ns; /* how late the last batch was */
+    uint64_t max_lag_ns;
+    uint64_t total_lag_ns;
+    uint64_t resyncs; /* times the debt was written off */
+} pace_stats_t;
+
+extern pace_stats_t pace_stats;
+
+/* Start pacing to hz from the current cycle. Returns the batch length. */
+uint64_t pace_start(uint64_t hz, uint64_t jitter_ns);
+
+/* Wait for the wall clock to catch up with cpu_cycles */
+void pace_wait(void);
+
+void pace_report(FILE *f);
+
+#endif /* CORE_PACE_H_ */
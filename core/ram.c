@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+#include "../cpu/mem.h"
+#include "bus.h"
+#include "ram.h"
+
+/* CS, WE and OE are active low */
+static void ram_evaluate(void *ctx)
+{
+    bool floating;
+    unsigned int addr;
+
+    static bool warned = false;
+    pin_state_t cs;
+
+    pins_release(ram_data_bus, 8);
+
+    cs = pin_evaluate(&ram_cs);
+    if (cs == PIN_STATE_INVALID && !warned)
+    {
+        /* Like the decoder and a model both driving it */
+        fprintf(stderr, "ram: CS is driven by more than one device, the RAM is never selected\n");
+        warned = true;
+    }
+
+    if (cs != PIN_STATE_LO)
+        return;
+
+    addr = pins_evaluate(ram_addr_bus, 15, &floating);
+    if (floating)
+        return;
+
+    if (pin_evaluate(&ram_we) == PIN_STATE_LO)
+    {
+        uint8_t data = pins_evaluate(ram_data_bus, 8, &floating);
+
+        if (!floating)
+            mem_poke(addr, data);
+    }
+    else if (pin_evaluate(&ram_oe) == PIN_STATE_LO)
+    {
+        pins_set(ram_data_bus, 8, mem_peek(addr));
+    }
+}
+
+void ram_init(void)
+{
+    bus_attach(ram_evaluate, NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef CORE_RAM_H_
+#define CORE_RAM_H_
+
+/*
+ * Pin level model of the 32K static RAM, wired up by bus_init(). Cell n of
+ * the RAM is address n of memory (see mem_peek()), so the pin level and the
+ * faster accuracy levels look at the same state.
+ */
+void ram_init(void);
+
+#endif /* CORE_RAM_H_ */
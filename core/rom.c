@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+#include "../cpu/mem.h"
+#include "rom.h"
+
+static uint8_t image[ROM_SIZE];
+static size_t image_len = 0;
+
+int rom_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    long len;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) <= 0 || len > ROM_SIZE)
+    {
+        fprintf(stderr, "rom: %s: not a ROM image of up to %d bytes\n", path, ROM_SIZE);
+        fclose(f);
+        return -1;
+    }
+
+    rewind(f);
+    if (fread(image, 1, len, f) != (size_t)len)
+    {
+        fprintf(stderr, "rom: %s: short read\n", path);
+        fclose(f);
+        image_len = 0;
+        return -1;
+    }
+
+    fclose(f);
+    image_len = len;
+    mem_write_block(MEM_SIZE - len, image, len);
+    return 0;
+}
+
+const uint8_t *rom_image(size_t *len)
+{
+    *len = image_len;
+    return image_len ? image : NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef CORE_ROM_H_
+#define CORE_ROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The board's EEPROM, selected for $8000-$FFFF. An image smaller than that
+ * goes at the top, where the vectors are.
+ */
+#define ROM_BASE 0x8000
+#define ROM_SIZE 0x8000
+
+/* Read an image and write it to memory. Returns -1 on error. */
+int rom_load(const char *path);
+
+/* The image last loaded, for telling ROMs apart. NULL before any. */
+const uint8_t *rom_image(size_t *len);
+
+#endif /* CORE_ROM_H_ */
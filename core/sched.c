@@ -0,0 +1,376 @@
+/*
+ * Hierarchical timing wheel, see Varghese & Lauck, "Hashed and Hierarchical
+ * Timing Wheels".
+ *
+ * Level l has SLOTS slots covering SLOTS^l cycles each. An event goes into the
+ * lowest level at which it agrees with the current time on all higher bits,
+ * in the slot given by its own bits for that level. When the current time
+ * reaches the start of a slot on a higher level, its events are cascaded down
+ * to the lower levels. Events beyond the range of the top level are kept on
+ * an overflow list, which is looked at again whenever the top level wraps.
+ *
+ * Occupied slots are tracked in one bitmap per level, so finding the next
+ * point in time where something happens takes a handful of bit scans.
+ */
+#include "sched.h"
+#include "stats.h"
+
+#define LEVELS 4
+#define LEVEL_BITS 6
+#define SLOTS (1 << LEVEL_BITS)
+#define SLOT_MASK (SLOTS - 1)
+#define WHEEL_BITS (LEVELS * LEVEL_BITS)
+
+#define SLOT_NONE (-1)
+#define SLOT_OVERFLOW (LEVELS * SLOTS)
+
+/* Every CPU has a scheduler of its own, for the devices it owns */
+static CPU_LOCAL struct dl_list wheel[LEVELS][SLOTS];
+static CPU_LOCAL uint64_t occupied[LEVELS];
+static CPU_LOCAL struct dl_list overflow;
+static CPU_LOCAL bool initialized = false;
+
+/* Every event before this cycle has fired */
+static CPU_LOCAL uint64_t wheel_now = 0;
+
+CPU_LOCAL uint64_t sched_deadline = UINT64_MAX;
+CPU_LOCAL uint64_t sched_next = UINT64_MAX;
+
+CPU_LOCAL uint64_t sched_quantum = 1;
+
+static void init_wheel(void)
+{
+    for (int l = 0; l < LEVELS; l++)
+        for (int s = 0; s < SLOTS; s++)
+            dl_list_init(&wheel[l][s]);
+
+    dl_list_init(&overflow);
+    initialized = true;
+}
+
+static void insert(sched_event_t *event)
+{
+    uint64_t when = event->when < wheel_now ? wheel_now : event->when;
+    int level;
+
+    if ((when >> WHEEL_BITS) != (wheel_now >> WHEEL_BITS))
+    {
+        event->slot = SLOT_OVERFLOW;
+        dl_list_add_tail(&overflow, &event->list);
+        return;
+    }
+
+    for (level = 0; level < LEVELS - 1; level++)
+    {
+        int above = LEVEL_BITS * (level + 1);
+
+        if ((when >> above) == (wheel_now >> above))
+            break;
+    }
+
+    int s = (when >> (LEVEL_BITS * level)) & SLOT_MASK;
+
+    event->slot = level * SLOTS + s;
+    dl_list_add_tail(&wheel[level][s], &event->list);
+    occupied[level] |= UINT64_C(1) << s;
+}
+
+static void remove_event(sched_event_t *event)
+{
+    int slot = event->slot;
+
+    dl_list_del(&event->list);
+    event->slot = SLOT_NONE;
+
+    if (slot != SLOT_OVERFLOW)
+    {
+        int level = slot / SLOTS;
+        int s = slot % SLOTS;
+
+        if (dl_list_empty(&wheel[level][s]))
+            occupied[level] &= ~(UINT64_C(1) << s);
+    }
+}
+
+/* Move every event on a list back through insert() */
+static void redistribute(struct dl_list *list)
+{
+    struct dl_list pending;
+    sched_event_t *event, *n;
+
+    /* Detach first, events may land on the same list again */
+    dl_list_init(&pending);
+    dl_list_for_each_safe(event, n, list, sched_event_t, list)
+    {
+        remove_event(event);
+        dl_list_add_tail(&pending, &event->list);
+    }
+
+    dl_list_for_each_safe(event, n, &pending, sched_event_t, list)
+    {
+        dl_list_del(&event->list);
+        insert(event);
+    }
+}
+
+/*
+ * The next cycle at which an event fires or a slot needs to be cascaded. The
+ * insertion rule guarantees that every event on a level lies in the current
+ * rotation of that level, at or after the current slot.
+ */
+static uint64_t next_time(void)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int l = 0; l < LEVELS; l++)
+    {
+        int shift = LEVEL_BITS * l;
+        int cur = (wheel_now >> shift) & SLOT_MASK;
+        uint64_t mask = occupied[l] & (~UINT64_C(0) << cur);
+
+        if (!mask)
+            continue;
+
+        uint64_t rotation = wheel_now >> (shift + LEVEL_BITS) << (shift + LEVEL_BITS);
+        uint64_t t = rotation | ((uint64_t)__builtin_ctzll(mask) << shift);
+
+        if (t < best)
+            best = t;
+    }
+
+    if (!dl_list_empty(&overflow))
+    {
+        uint64_t t = ((wheel_now >> WHEEL_BITS) + 1) << WHEEL_BITS;
+
+        if (t < best)
+            best = t;
+    }
+
+    return best;
+}
+
+static void cascade(uint64_t t)
+{
+    if ((t & ((UINT64_C(1) << WHEEL_BITS) - 1)) == 0)
+        redistribute(&overflow);
+
+    for (int l = LEVELS - 1; l > 0; l--)
+    {
+        int shift = LEVEL_BITS * l;
+        int s = (t >> shift) & SLOT_MASK;
+
+        if ((t & ((UINT64_C(1) << shift) - 1)) == 0 && occupied[l] & (UINT64_C(1) << s))
+            redistribute(&wheel[l][s]);
+    }
+}
+
+/* When the CPU has to look at an event due at the given cycle */
+static uint64_t deadline_for(uint64_t when)
+{
+    uint64_t late = when % sched_quantum ? sched_quantum - when % sched_quantum : 0;
+
+    return when > UINT64_MAX - late ? UINT64_MAX : when + late;
+}
+
+static void set_next(uint64_t next)
+{
+    sched_next = next;
+    sched_deadline = deadline_for(next);
+}
+
+void sched_event_init(sched_event_t *event, sched_callback_t callback, void *ctx)
+{
+    event->when = 0;
+    event->callback = callback;
+    event->ctx = ctx;
+    event->slot = SLOT_NONE;
+    event->list.next = NULL;
+    event->list.prev = NULL;
+}
+
+void sched_add(sched_event_t *event, uint64_t when)
+{
+    if (!initialized)
+        init_wheel();
+
+    if (sched_pending(event))
+        remove_event(event);
+
+    event->when = when;
+    insert(event);
+
+    if (when < sched_next)
+        sched_next = when;
+    if (deadline_for(when) < sched_deadline)
+        sched_deadline = deadline_for(when);
+}
+
+void sched_cancel(sched_event_t *event)
+{
+    /* The deadline stays, an early sched_run() just doesn't find anything */
+    if (sched_pending(event))
+        remove_event(event);
+}
+
+bool sched_pending(const sched_event_t *event)
+{
+    return event->slot != SLOT_NONE;
+}
+
+void sched_run(uint64_t now)
+{
+    if (!initialized)
+        init_wheel();
+
+    for (;;)
+    {
+        uint64_t t = next_time();
+        struct dl_list *slot;
+
+        if (t > now)
+            break;
+
+        wheel_now = t;
+        cascade(t);
+
+        /* Callbacks may add events for this very cycle, which land here too */
+        slot = &wheel[0][t & SLOT_MASK];
+        while (!dl_list_empty(slot))
+        {
+            sched_event_t *event = dl_list_first(slot, sched_event_t, list);
+
+            remove_event(event);
+
+            if (stats_timing)
+            {
+                void *ctx = event->ctx;
+                uint64_t start = stats_clock();
+
+                event->callback(ctx, event->when);
+                stats_device_time(ctx, stats_clock() - start);
+            }
+            else
+            {
+                event->callback(event->ctx, event->when);
+            }
+        }
+
+        wheel_now = t + 1;
+    }
+
+    if (now >= wheel_now)
+        wheel_now = now + 1;
+
+    set_next(next_time());
+}
+
+void sched_kick(void)
+{
+    sched_deadline = 0;
+}
+
+void sched_set_quantum(uint64_t cycles)
+{
+    sched_quantum = cycles ? cycles : 1;
+    if (sched_deadline)
+        sched_deadline = deadline_for(sched_next);
+}
+
+void sched_sync_slow(uint64_t now)
+{
+    sched_run(now);
+    sched_kick();
+}
+
+int sched_save(sched_snapshot_t *snapshot)
+{
+    sched_event_t *event;
+
+    if (!initialized)
+        init_wheel();
+
+    snapshot->now = wheel_now;
+    snapshot->count = 0;
+
+    for (int l = 0; l < LEVELS; l++)
+    {
+        for (int slot = 0; slot < SLOTS; slot++)
+        {
+            dl_list_for_each(event, &wheel[l][slot], sched_event_t, list)
+            {
+                if (snapshot->count == SCHED_SNAPSHOT_MAX)
+                    return -1;
+                snapshot->events[snapshot->count] = event;
+                snapshot->when[snapshot->count++] = event->when;
+            }
+        }
+    }
+
+    dl_list_for_each(event, &overflow, sched_event_t, list)
+    {
+        if (snapshot->count == SCHED_SNAPSHOT_MAX)
+            return -1;
+        snapshot->events[snapshot->count] = event;
+        snapshot->when[snapshot->count++] = event->when;
+    }
+
+    return 0;
+}
+
+/* Leave every event on a list as if it had been cancelled, and the list empty */
+static void forget(struct dl_list *list)
+{
+    sched_event_t *event, *n;
+
+    dl_list_for_each_safe(event, n, list, sched_event_t, list)
+    {
+        event->slot = SLOT_NONE;
+        event->list.next = NULL;
+        event->list.prev = NULL;
+    }
+    dl_list_init(list);
+}
+
+void sched_clear(void)
+{
+    if (!initialized)
+        init_wheel();
+
+    /* Only occupied slots have anything to forget */
+    for (int l = 0; l < LEVELS; l++)
+    {
+        while (occupied[l])
+        {
+            int slot = __builtin_ctzll(occupied[l]);
+
+            forget(&wheel[l][slot]);
+            occupied[l] &= occupied[l] - 1;
+        }
+    }
+    forget(&overflow);
+}
+
+void sched_restore(const sched_snapshot_t *snapshot)
+{
+    sched_clear();
+
+    wheel_now = snapshot->now;
+
+    for (unsigned int i = 0; i < snapshot->count; i++)
+    {
+        sched_event_t *event = snapshot->events[i];
+
+        event->when = snapshot->when[i];
+        insert(event);
+    }
+
+    set_next(next_time());
+}
+
+void sched_event_fixup(sched_event_t *event, const sched_event_t *live)
+{
+    event->callback = live->callback;
+    event->ctx = live->ctx;
+    event->list.next = NULL;
+    event->list.prev = NULL;
+}
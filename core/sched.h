@@ -0,0 +1,113 @@
+#ifndef CORE_SCHED_H_
+#define CORE_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../cpu/cpu.h"
+#include "../utils/list.h"
+
+/*
+ * Cycle-stamped event scheduler
+ *
+ * Events are kept in a hierarchical timing wheel, so adding and cancelling
+ * an event is O(1) no matter how far ahead it is. The CPU only has to compare
+ * the cycle count against sched_deadline between instructions, and call
+ * sched_run() when it is reached.
+ */
+typedef void (*sched_callback_t)(void *ctx, uint64_t when);
+
+typedef struct sched_event
+{
+    uint64_t when;
+    sched_callback_t callback;
+    void *ctx;
+    int slot; /* private: where in the wheel the event is */
+    struct dl_list list;
+} sched_event_t;
+
+/*
+ * Cycle at which sched_run() needs to be called next. This can be earlier than
+ * the next event, but never later unless there's a quantum.
+ */
+extern CPU_LOCAL uint64_t sched_deadline;
+
+/* Cycle of the next event, again earlier rather than later */
+extern CPU_LOCAL uint64_t sched_next;
+
+void sched_event_init(sched_event_t *event, sched_callback_t callback, void *ctx);
+
+/*
+ * Fire the event once cycle 'when' is reached. The callback gets the cycle the
+ * event was scheduled for, which can be slightly earlier than the current one.
+ * Adding an event that is already pending reschedules it.
+ */
+void sched_add(sched_event_t *event, uint64_t when);
+void sched_cancel(sched_event_t *event);
+bool sched_pending(const sched_event_t *event);
+
+/* Fire every event due at or before now */
+void sched_run(uint64_t now);
+
+/* Make the CPU return to sched_run() after the current instruction */
+void sched_kick(void);
+
+/*
+ * Temporal decoupling. With a quantum of Q cycles the CPU runs on past a due
+ * event, up to the next multiple of Q, before sched_run() fires it. It leaves
+ * its instruction loop far less often when events are frequent, and events,
+ * with the interrupts they raise, come up to Q - 1 cycles late. They still
+ * fire in order and get the cycle they were scheduled for, but interrupts
+ * raised more often than every Q cycles merge. The default of 1 fires every
+ * event on time.
+ *
+ * A device mustn't be accessed with its events overdue, so the memory map
+ * calls sched_sync() with the CPU's time before passing on a device access.
+ * It fires whatever is due by then, and makes the CPU return to sched_run()
+ * after the instruction to take what that raised.
+ */
+extern CPU_LOCAL uint64_t sched_quantum;
+
+void sched_set_quantum(uint64_t cycles);
+void sched_sync_slow(uint64_t now);
+
+static inline void sched_sync(uint64_t now)
+{
+    if (sched_quantum > 1 && now >= sched_next)
+        sched_sync_slow(now);
+}
+
+/*
+ * Snapshots of the pending events, for putting a machine back into an earlier
+ * state. Restoring drops everything pending and puts the saved events back.
+ * The event structures themselves are restored by their owners first, along
+ * with the rest of their state, so no event may be pending outside of the
+ * state being restored.
+ *
+ * The wheel is linked through the live events, so everything pending has to
+ * be dropped with sched_clear() before the owners overwrite them. An event
+ * that isn't in the snapshot is left not pending, as if cancelled.
+ */
+#define SCHED_SNAPSHOT_MAX 32
+
+typedef struct
+{
+    uint64_t now;
+    unsigned int count;
+    sched_event_t *events[SCHED_SNAPSHOT_MAX];
+    uint64_t when[SCHED_SNAPSHOT_MAX];
+} sched_snapshot_t;
+
+/* Returns -1 if there are too many pending events */
+int sched_save(sched_snapshot_t *snapshot);
+void sched_clear(void);
+void sched_restore(const sched_snapshot_t *snapshot);
+
+/*
+ * Point an event whose bytes were loaded from a savestate back at the live
+ * callback. Whether it was pending comes from the savestate, and the wheel is
+ * put back with sched_restore() afterwards.
+ */
+void sched_event_fixup(sched_event_t *event, const sched_event_t *live);
+
+#endif /* CORE_SCHED_H_ */
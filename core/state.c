@@ -0,0 +1,487 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "bus.h"
+#include "sched.h"
+#include "state.h"
+
+#define STATE_MAGIC "FAKEOID"
+#define SECTION_ALIGN 4096
+
+#define ALIGN(n) (((n) + SECTION_ALIGN - 1) & ~(uint64_t)(SECTION_ALIGN - 1))
+
+typedef struct
+{
+    char name[STATE_NAME_LEN];
+    uint64_t offset;
+    uint64_t size;
+} state_section_t;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    state_section_t sections[STATE_MAX_SECTIONS];
+} state_header_t;
+
+/* A pending event, by where its structure is in the file */
+typedef struct
+{
+    uint32_t section;
+    uint32_t offset;
+    uint64_t when;
+} state_event_t;
+
+typedef struct
+{
+    uint64_t now;
+    uint32_t count;
+    state_event_t events[SCHED_SNAPSHOT_MAX];
+} state_sched_t;
+
+static state_sched_t sched_state;
+
+static struct
+{
+    char name[STATE_NAME_LEN];
+    void *data;
+    size_t size;
+    state_fixup_t fixup;
+    uint8_t *const *pages; /* instead of data, see state_register_pages() */
+    size_t page_size;
+    state_writable_t writable;
+} sections[STATE_MAX_SECTIONS] = {
+    { .name = "sched", .data = &sched_state, .size = sizeof(sched_state) },
+};
+static int section_count = 1;
+
+static pid_t checkpoint_pid = -1;
+
+void state_register(const char *name, void *data, size_t size, state_fixup_t fixup)
+{
+    if (section_count == STATE_MAX_SECTIONS)
+    {
+        fprintf(stderr, "state: too many sections, %s isn't saved\n", name);
+        return;
+    }
+
+    snprintf(sections[section_count].name, STATE_NAME_LEN, "%s", name);
+    sections[section_count].data = data;
+    sections[section_count].size = size;
+    sections[section_count].fixup = fixup;
+    sections[section_count].pages = NULL;
+    section_count++;
+}
+
+void state_register_pages(const char *name, uint8_t *const *pages, unsigned int count,
+                          size_t page_size, state_writable_t writable)
+{
+    if (section_count == STATE_MAX_SECTIONS)
+    {
+        fprintf(stderr, "state: too many sections, %s isn't saved\n", name);
+        return;
+    }
+
+    state_register(name, NULL, count * page_size, NULL);
+    sections[section_count - 1].pages = pages;
+    sections[section_count - 1].page_size = page_size;
+    sections[section_count - 1].writable = writable;
+}
+
+/* The nets the pins are connected to are wired up by bus_init() */
+static void pins_fixup(void *data, const void *live, size_t size)
+{
+    pin_t *pins = data;
+    const pin_t *prev = live;
+
+    for (size_t i = 0; i < size / sizeof(pin_t); i++)
+        pins[i].list = prev[i].list;
+}
+
+void state_register_machine(void)
+{
+    /*
+     * An NMI is always taken before cpu_run() returns, unless the run ended
+     * with cpu_exit(), so none can be pending. The registers are named after
+     * the CPU variant, a savestate from another one doesn't load.
+     */
+    state_register("reg_" CPU_VARIANT_NAME, &reg, sizeof(reg), NULL);
+    state_register("cycles", &cpu_cycles, sizeof(cpu_cycles), NULL);
+    state_register("cpu_state", &cpu_state, sizeof(cpu_state), NULL);
+    state_register("irq_lines", &cpu_irq_lines, sizeof(cpu_irq_lines), NULL);
+#if MEM_SPARSE
+    state_register_pages("mem", mem_pages, 256, 256, mem_writable_page);
+#else
+    state_register("mem", mem, sizeof(mem), NULL);
+#endif
+
+    state_register("cpu_addr_bus", cpu_addr_bus, sizeof(cpu_addr_bus), pins_fixup);
+    state_register("cpu_data_bus", cpu_data_bus, sizeof(cpu_data_bus), pins_fixup);
+    state_register("cpu_rwb", &cpu_rwb, sizeof(cpu_rwb), pins_fixup);
+    state_register("decode_ram_cs", &decode_ram_cs, sizeof(decode_ram_cs), pins_fixup);
+    state_register("decode_ram_oe", &decode_ram_oe, sizeof(decode_ram_oe), pins_fixup);
+    state_register("ram_addr_bus", ram_addr_bus, sizeof(ram_addr_bus), pins_fixup);
+    state_register("ram_data_bus", ram_data_bus, sizeof(ram_data_bus), pins_fixup);
+    state_register("ram_we", &ram_we, sizeof(ram_we), pins_fixup);
+    state_register("ram_oe", &ram_oe, sizeof(ram_oe), pins_fixup);
+    state_register("ram_cs", &ram_cs, sizeof(ram_cs), pins_fixup);
+}
+
+/*
+ * Saving
+ */
+static int find_section(const void *p)
+{
+    for (int i = 0; i < section_count; i++)
+    {
+        const uint8_t *data = sections[i].data;
+
+        if (data && (const uint8_t *)p >= data && (const uint8_t *)p < data + sections[i].size)
+            return i;
+    }
+
+    return -1;
+}
+
+static int save_events(void)
+{
+    sched_snapshot_t snapshot;
+
+    if (sched_save(&snapshot) < 0)
+    {
+        fprintf(stderr, "state: too many pending events\n");
+        return -1;
+    }
+
+    memset(&sched_state, 0, sizeof(sched_state));
+    sched_state.now = snapshot.now;
+    sched_state.count = snapshot.count;
+
+    for (unsigned int i = 0; i < snapshot.count; i++)
+    {
+        int section = find_section(snapshot.events[i]);
+
+        if (section < 0)
+        {
+            fprintf(stderr, "state: pending event outside of the saved state\n");
+            return -1;
+        }
+
+        sched_state.events[i].section = section;
+        sched_state.events[i].offset =
+            (const uint8_t *)snapshot.events[i] - (const uint8_t *)sections[section].data;
+        sched_state.events[i].when = snapshot.when[i];
+    }
+
+    return 0;
+}
+
+static int write_at(int fd, const void *data, size_t size, uint64_t offset)
+{
+    const uint8_t *p = data;
+
+    while (size)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+
+        if (n < 0)
+            return -1;
+
+        p += n;
+        size -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+int state_save(const char *path)
+{
+    state_header_t header = { .magic = STATE_MAGIC, .version = STATE_VERSION };
+    uint64_t offset = ALIGN(sizeof(header));
+    char tmp[PATH_MAX];
+    int fd;
+
+    if (save_events() < 0)
+        return -1;
+
+    header.count = section_count;
+    for (int i = 0; i < section_count; i++)
+    {
+        memcpy(header.sections[i].name, sections[i].name, STATE_NAME_LEN);
+        header.sections[i].offset = offset;
+        header.sections[i].size = sections[i].size;
+        offset = ALIGN(offset + sections[i].size);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(tmp);
+        return -1;
+    }
+
+    bool failed = write_at(fd, &header, sizeof(header), 0) < 0;
+    for (int i = 0; i < section_count && !failed; i++)
+    {
+        if (!sections[i].pages)
+        {
+            failed = write_at(fd, sections[i].data, sections[i].size,
+                              header.sections[i].offset) < 0;
+            continue;
+        }
+
+        for (size_t off = 0; off < sections[i].size && !failed; off += sections[i].page_size)
+            failed = write_at(fd, sections[i].pages[off / sections[i].page_size],
+                              sections[i].page_size, header.sections[i].offset + off) < 0;
+    }
+
+    /* The last section is padded too, so every section can be mapped on its own */
+    failed = failed || ftruncate(fd, offset) < 0 || fsync(fd) < 0;
+
+    if (close(fd) < 0 || failed || rename(tmp, path) < 0)
+    {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Loading
+ */
+static int load_error(const char *path, const char *what, const char *section)
+{
+    fprintf(stderr, "state: %s: %s%s%s\n", path, what, section ? " " : "", section ? section : "");
+    return -1;
+}
+
+/* Check everything before touching the machine, so a bad file changes nothing */
+static int check_header(const char *path, const state_header_t *header, uint64_t size,
+                        const state_section_t **found)
+{
+    if (size < sizeof(*header) || memcmp(header->magic, STATE_MAGIC, sizeof(header->magic)))
+        return load_error(path, "not a savestate", NULL);
+
+    if (header->version != STATE_VERSION)
+        return load_error(path, "savestate version doesn't match", NULL);
+
+    if (header->count > STATE_MAX_SECTIONS)
+        return load_error(path, "too many sections", NULL);
+
+    for (int i = 0; i < section_count; i++)
+    {
+        found[i] = NULL;
+
+        for (uint32_t j = 0; j < header->count; j++)
+            if (strncmp(header->sections[j].name, sections[i].name, STATE_NAME_LEN) == 0)
+                found[i] = &header->sections[j];
+
+        if (!found[i])
+            return load_error(path, "no section", sections[i].name);
+
+        if (found[i]->size != sections[i].size || found[i]->offset > size ||
+            found[i]->size > size - found[i]->offset)
+            return load_error(path, "wrong size for section", sections[i].name);
+    }
+
+    return 0;
+}
+
+/* Where each pending event goes in this build's sections */
+static int check_events(const char *path, const state_header_t *header,
+                        const state_section_t **found, const state_sched_t *saved,
+                        sched_snapshot_t *snapshot)
+{
+    if (saved->count > SCHED_SNAPSHOT_MAX)
+        return load_error(path, "too many pending events", NULL);
+
+    snapshot->now = saved->now;
+    snapshot->count = saved->count;
+
+    for (uint32_t i = 0; i < saved->count; i++)
+    {
+        const state_event_t *event = &saved->events[i];
+        const state_section_t *in;
+        int section = -1;
+
+        if (event->section >= header->count)
+            return load_error(path, "pending event in unknown section", NULL);
+
+        in = &header->sections[event->section];
+        for (int j = 0; j < section_count; j++)
+            if (found[j] == in)
+                section = j;
+
+        if (section < 0 || event->offset + sizeof(sched_event_t) > sections[section].size)
+            return load_error(path, "pending event outside of section", in->name);
+
+        snapshot->events[i] = (sched_event_t *)((uint8_t *)sections[section].data + event->offset);
+        snapshot->when[i] = event->when;
+    }
+
+    return 0;
+}
+
+static void load_pages(int section, const uint8_t *src)
+{
+    size_t page_size = sections[section].page_size;
+
+    for (unsigned int page = 0; page < sections[section].size / page_size; page++)
+    {
+        const uint8_t *saved = src + page * page_size;
+
+        if (memcmp(sections[section].pages[page], saved, page_size) != 0)
+            memcpy(sections[section].writable(page), saved, page_size);
+    }
+}
+
+/* Room for the live copy of the largest section that needs fixing up */
+static void *alloc_live(void)
+{
+    size_t size = 1;
+
+    for (int i = 1; i < section_count; i++)
+        if (!sections[i].pages && sections[i].fixup && sections[i].size > size)
+            size = sections[i].size;
+
+    return malloc(size);
+}
+
+int state_load(const char *path)
+{
+    const state_section_t *found[STATE_MAX_SECTIONS];
+    sched_snapshot_t snapshot;
+    const uint8_t *map;
+    void *live = NULL;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    int ret = -1;
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED)
+        return load_error(path, "can't map", NULL);
+
+    const state_header_t *header = (const state_header_t *)map;
+
+    if (check_header(path, header, st.st_size, found) == 0 &&
+        check_events(path, header, found, (const state_sched_t *)(map + found[0]->offset),
+                     &snapshot) == 0)
+    {
+        live = alloc_live();
+        if (!live)
+            load_error(path, "out of memory", NULL);
+    }
+
+    if (live)
+    {
+        /* Unlink the events while they're still the live ones */
+        sched_clear();
+
+        /* Readers of exported memory wait for the machine as a whole */
+        mem_change_begin();
+        for (int i = 1; i < section_count; i++)
+        {
+            const uint8_t *src = map + found[i]->offset;
+
+            if (sections[i].pages)
+            {
+                load_pages(i, src);
+            }
+            else if (sections[i].fixup)
+            {
+                memcpy(live, sections[i].data, sections[i].size);
+                memcpy(sections[i].data, src, sections[i].size);
+                sections[i].fixup(sections[i].data, live, sections[i].size);
+            }
+            else
+            {
+                memcpy(sections[i].data, src, sections[i].size);
+            }
+        }
+        mem_change_end();
+
+        sched_restore(&snapshot);
+        ret = 0;
+    }
+
+    free(live);
+    munmap((void *)map, st.st_size);
+    return ret;
+}
+
+/*
+ * Checkpoints
+ */
+
+/* Returns 1 while the checkpoint is still being written */
+static int reap(int options)
+{
+    pid_t pid;
+    int status;
+
+    if (checkpoint_pid < 0)
+        return 0;
+
+    pid = waitpid(checkpoint_pid, &status, options);
+    if (pid == 0)
+        return 1;
+
+    checkpoint_pid = -1;
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "state: writing a checkpoint failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int state_checkpoint(const char *path)
+{
+    pid_t pid;
+
+    if (reap(WNOHANG) == 1)
+        return 1;
+
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("state: fork");
+        return -1;
+    }
+
+    /* Nothing the parent has buffered gets flushed twice */
+    if (pid == 0)
+        _exit(state_save(path) < 0 ? 1 : 0);
+
+    checkpoint_pid = pid;
+    return 0;
+}
+
+int state_checkpoint_wait(void)
+{
+    return reap(0) < 0 ? -1 : 0;
+}
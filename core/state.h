@@ -0,0 +1,65 @@
+#ifndef CORE_STATE_H_
+#define CORE_STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Savestates
+ *
+ * A savestate is a header followed by page aligned sections, each holding the
+ * raw bytes of a piece of machine state registered with state_register().
+ * Loading maps the file, checks that every registered section is there with
+ * the size this build expects, copies the sections into place and lets their
+ * owners fix up the pointers in them. Nothing is parsed, and a build whose
+ * structures changed size refuses the file instead of misreading it. Files
+ * are in host byte order.
+ *
+ * Pending scheduler events are saved as a section and an offset into it, so
+ * every event that can be pending between runs has to live in registered
+ * state.
+ */
+#define STATE_VERSION 5
+#define STATE_MAX_SECTIONS 32
+#define STATE_NAME_LEN 16
+
+/*
+ * Called after a section was loaded over live state, with a copy of what was
+ * there before. Puts back whatever can't come from a file, like callbacks.
+ */
+typedef void (*state_fixup_t)(void *data, const void *live, size_t size);
+
+void state_register(const char *name, void *data, size_t size, state_fixup_t fixup);
+
+/*
+ * A section made of pages that don't have to be contiguous, saved as if they
+ * were. Loading only asks writable() for a page whose saved contents differ
+ * from what it holds, pages that are shared stay so (see cpu/mem.h).
+ */
+typedef uint8_t *(*state_writable_t)(unsigned int page);
+
+void state_register_pages(const char *name, uint8_t *const *pages, unsigned int count,
+                          size_t page_size, state_writable_t writable);
+
+/* Register the CPU, memory and bus pins. Devices register themselves. */
+void state_register_machine(void);
+
+/*
+ * Only between runs of cpu_run(). Saving writes to a temporary file that is
+ * renamed over the old one once it is on disk. Return -1 on error, a failed
+ * load leaves the machine untouched.
+ */
+int state_save(const char *path);
+int state_load(const char *path);
+
+/*
+ * Save from a forked child, which gets a copy-on-write snapshot of the
+ * machine, so the emulator only waits for the fork. Returns 1 if the previous
+ * checkpoint is still being written and this one was skipped, -1 on error.
+ */
+int state_checkpoint(const char *path);
+
+/* Wait for a checkpoint in progress. Returns -1 if writing it failed. */
+int state_checkpoint_wait(void);
+
+#endif /* CORE_STATE_H_ */
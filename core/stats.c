@@ -0,0 +1,168 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "../debug/irqlat.h"
+#include "bus.h"
+#include "pace.h"
+#include "stats.h"
+
+static stats_block_t *block = NULL;
+static char block_name[64];
+
+bool stats_timing = false;
+
+/* Counted by the emulator thread, published by stats_publish() */
+static struct
+{
+    char name[STATS_NAME_LEN];
+    void *ctx;
+    uint64_t host_ns;
+    uint64_t calls;
+} devices[STATS_MAX_DEVICES];
+static int device_count = 0;
+
+_Static_assert(STATS_MAX_IRQ_SOURCES == IRQLAT_SOURCES, "a block for every interrupt source");
+
+static uint64_t start_ns;
+static uint64_t last_ns;
+static uint64_t last_cycles;
+
+void stats_add_device(const char *name, void *ctx)
+{
+    if (device_count == STATS_MAX_DEVICES)
+        return;
+
+    snprintf(devices[device_count].name, STATS_NAME_LEN, "%s", name);
+    devices[device_count].ctx = ctx;
+    device_count++;
+}
+
+void stats_device_time(void *ctx, uint64_t ns)
+{
+    for (int i = 0; i < device_count; i++)
+    {
+        if (devices[i].ctx == ctx)
+        {
+            devices[i].host_ns += ns;
+            devices[i].calls++;
+            return;
+        }
+    }
+}
+
+int stats_open(const char *name)
+{
+    int fd;
+
+    snprintf(block_name, sizeof(block_name), "%s", name);
+    fd = shm_open(block_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(*block)) < 0)
+    {
+        perror(block_name);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    block = mmap(NULL, sizeof(*block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED)
+    {
+        perror(block_name);
+        block = NULL;
+        return -1;
+    }
+
+    block->version = STATS_VERSION;
+    block->pid = getpid();
+    block->device_count = device_count;
+    for (int i = 0; i < device_count; i++)
+        memcpy(block->devices[i].name, devices[i].name, STATS_NAME_LEN);
+
+    /* Recording has to start first */
+    block->irq_source_count = irqlat_active ? IRQLAT_SOURCES : 0;
+    for (uint32_t i = 0; i < block->irq_source_count; i++)
+        snprintf(block->irqs[i].name, STATS_NAME_LEN, "%s", irqlat_source_name(i));
+
+    /* Readers check the magic last */
+    atomic_thread_fence(memory_order_release);
+    block->magic = STATS_MAGIC;
+
+    for (int i = 0; i < 256; i++)
+        if (mem_page_flags[i] & MEM_PAGE_IO)
+            mem_page_flags[i] |= MEM_PAGE_TIMED;
+
+    start_ns = last_ns = stats_clock();
+    last_cycles = cpu_cycles;
+    stats_timing = true;
+
+    return 0;
+}
+
+void stats_close(void)
+{
+    if (!block)
+        return;
+
+    stats_timing = false;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] &= ~MEM_PAGE_TIMED;
+
+    munmap(block, sizeof(*block));
+    shm_unlink(block_name);
+    block = NULL;
+}
+
+static void publish_irq_hist(stats_irq_hist_t *out, const irqlat_hist_t *hist)
+{
+    atomic_store_explicit(&out->count, hist->count, memory_order_relaxed);
+    atomic_store_explicit(&out->sum, hist->sum, memory_order_relaxed);
+    atomic_store_explicit(&out->p50, irqlat_quantile(hist, 0.5), memory_order_relaxed);
+    atomic_store_explicit(&out->p99, irqlat_quantile(hist, 0.99), memory_order_relaxed);
+    atomic_store_explicit(&out->max, hist->max, memory_order_relaxed);
+}
+
+void stats_publish(void)
+{
+    uint64_t now = stats_clock();
+
+    if (!block)
+        return;
+
+    if (now > last_ns)
+    {
+        atomic_store_explicit(&block->khz, (cpu_cycles - last_cycles) * 1000000 / (now - last_ns),
+                              memory_order_relaxed);
+        last_ns = now;
+        last_cycles = cpu_cycles;
+    }
+
+    atomic_store_explicit(&block->host_ns, now - start_ns, memory_order_relaxed);
+    atomic_store_explicit(&block->cycles, cpu_cycles, memory_order_relaxed);
+    atomic_store_explicit(&block->instructions, cpu_instructions, memory_order_relaxed);
+    atomic_store_explicit(&block->interrupts, cpu_interrupts, memory_order_relaxed);
+    atomic_store_explicit(&block->bus_contentions, bus_contentions, memory_order_relaxed);
+    atomic_store_explicit(&block->pace_late, pace_stats.late, memory_order_relaxed);
+    atomic_store_explicit(&block->pace_lag_ns, pace_stats.lag_ns, memory_order_relaxed);
+    atomic_store_explicit(&block->pace_max_lag_ns, pace_stats.max_lag_ns, memory_order_relaxed);
+
+    for (int i = 0; i < device_count; i++)
+    {
+        atomic_store_explicit(&block->devices[i].host_ns, devices[i].host_ns,
+                              memory_order_relaxed);
+        atomic_store_explicit(&block->devices[i].calls, devices[i].calls, memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < block->irq_source_count; i++)
+    {
+        publish_irq_hist(&block->irqs[i].latency, irqlat_hist(i, IRQLAT_LATENCY));
+        publish_irq_hist(&block->irqs[i].duration, irqlat_hist(i, IRQLAT_DURATION));
+    }
+
+    atomic_fetch_add_explicit(&block->updates, 1, memory_order_relaxed);
+}
@@ -0,0 +1,105 @@
+#ifndef CORE_STATS_H_
+#define CORE_STATS_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Live statistics
+ *
+ * The emulator publishes a fixed layout block in a POSIX shared memory
+ * segment, which tools/stats.c and anything else can map and read while it
+ * runs. The counters are kept privately while running and copied into the
+ * block with relaxed atomic stores between runs of cpu_run(), so the
+ * instruction loop doesn't know about any of it. Readers get each counter
+ * untorn, but not necessarily all of them from the same update.
+ *
+ * Device host time is what memory mapped accesses to a device and its
+ * scheduled events took on the host, measured only while publishing.
+ * Interrupt latencies are only there while debug/irqlat.h is recording.
+ */
+#define STATS_MAGIC 0x54534B46 /* "FKST" */
+#define STATS_VERSION 3
+#define STATS_MAX_DEVICES 8
+#define STATS_MAX_IRQ_SOURCES 9 /* the IRQ lines and NMIB */
+#define STATS_NAME_LEN 16
+
+typedef struct
+{
+    char name[STATS_NAME_LEN];
+    _Atomic uint64_t host_ns;
+    _Atomic uint64_t calls;
+} stats_device_block_t;
+
+/* In cycles, quantiles to within an eighth */
+typedef struct
+{
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t p50;
+    _Atomic uint64_t p99;
+    _Atomic uint64_t max;
+} stats_irq_hist_t;
+
+typedef struct
+{
+    char name[STATS_NAME_LEN];
+    stats_irq_hist_t latency; /* from assertion to vector */
+    stats_irq_hist_t duration; /* from vector to RTI */
+} stats_irq_block_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid; /* of the emulator, to tell whether the block is stale */
+    uint32_t device_count;
+    uint32_t irq_source_count;
+
+    _Atomic uint64_t updates;
+    _Atomic uint64_t host_ns; /* since the block was created */
+    _Atomic uint64_t cycles;
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t interrupts;
+    _Atomic uint64_t bus_contentions;
+    _Atomic uint64_t khz; /* emulated clock over the last update interval */
+
+    /* Real-time pacing, see core/pace.h */
+    _Atomic uint64_t pace_late;
+    _Atomic uint64_t pace_lag_ns;
+    _Atomic uint64_t pace_max_lag_ns;
+
+    stats_device_block_t devices[STATS_MAX_DEVICES];
+    stats_irq_block_t irqs[STATS_MAX_IRQ_SOURCES];
+} stats_block_t;
+
+/* Create the segment, named like "/fakeoid". Returns -1 on error. */
+int stats_open(const char *name);
+/* Remove the segment again */
+void stats_close(void);
+
+/*
+ * Name a device for the host time statistics, ctx being what it passes to
+ * mem_map_io() and its scheduled events. Only before stats_open().
+ */
+void stats_add_device(const char *name, void *ctx);
+
+/* Copy the counters into the block */
+void stats_publish(void);
+
+/* Set while publishing, the memory and scheduler code time devices then */
+extern bool stats_timing;
+
+static inline uint64_t stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_device_time(void *ctx, uint64_t ns);
+
+#endif /* CORE_STATS_H_ */
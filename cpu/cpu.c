@@ -1,7 +1,26 @@
+#include "../core/sched.h"
+#include "../debug/debug.h"
+#include "../debug/diff.h"
+#include "../debug/heat.h"
+#include "../debug/irqlat.h"
+#include "../hle/hle.h"
 #include "cpu.h"
+#include "mem.h"
+#include "ops.h"
 
-registers_t reg = { 0 };
-uint8_t mem[1 << 16] = { 0 };
+CPU_LOCAL registers_t reg = { 0 };
+CPU_LOCAL uint64_t cpu_cycles = 0;
+CPU_LOCAL uint64_t cpu_instructions = 0;
+CPU_LOCAL uint64_t cpu_interrupts = 0;
+CPU_LOCAL cpu_state_t cpu_state = CPU_RUNNING;
+CPU_LOCAL uint8_t *cpu_coverage = NULL;
+CPU_LOCAL unsigned int cpu_irq_lines = 0;
+CPU_LOCAL bool cpu_nmi_pending = false;
+CPU_LOCAL addr_t cpu_calls[CPU_CALL_DEPTH];
+CPU_LOCAL unsigned int cpu_call_depth = 0;
+CPU_LOCAL unsigned int cpu_exit_states = 0;
+
+static CPU_LOCAL bool exiting = false;
 
 /*
  * Order of bitfields is implementation defined, so we need a helper function
@@ -14,7 +33,7 @@ uint8_t procstat_to_word(procstat_t p)
     word |= p.i << 2;
     word |= p.d << 3;
     word |= p.b << 4;
-    /* bit 5 is unused */
+    word |= BIT(5); /* unused, always reads as 1 */
     word |= p.v << 6;
     word |= p.n << 7;
 
@@ -34,3 +53,176 @@ procstat_t word_to_procstat(uint8_t word)
         .n = word & BIT(7),
     };
 }
+
+/*
+ * Interrupts
+ *
+ * Checking for interrupts between every pair of instructions would cost the
+ * instruction loop a test. Instead, anything that can make an interrupt due
+ * (asserting a line, unmasking with a line asserted) kicks the scheduler, and
+ * interrupts are taken between batches.
+ */
+void cpu_irq(unsigned int source, bool asserted)
+{
+    if (asserted)
+    {
+        irqlat_lines(source & ~cpu_irq_lines, true);
+        cpu_irq_lines |= source;
+        sched_kick();
+    }
+    else
+    {
+        irqlat_lines(source & cpu_irq_lines, false);
+        cpu_irq_lines &= ~source;
+    }
+}
+
+void cpu_nmi(void)
+{
+    irqlat_nmi();
+    cpu_nmi_pending = true;
+    sched_kick();
+}
+
+static void interrupt(addr_t vector)
+{
+    procstat_t p = reg.p;
+
+    diff_interrupt(vector);
+    irqlat_enter(vector, cpu_irq_lines);
+    cpu_call(reg.pc);
+    cpu_state = CPU_RUNNING;
+    cpu_interrupts++;
+
+    p.b = 0;
+    push16(reg.pc);
+    push(procstat_to_word(p));
+    reg.p.i = 1;
+#if CPU_CMOS
+    reg.p.d = 0;
+#endif
+
+    addr_t lo = mem_read(vector);
+    reg.pc = lo | (mem_read(vector + 1) << 8);
+    cpu_cycles += 7;
+}
+
+void cpu_reset(void)
+{
+    addr_t lo = mem_read(VECTOR_RESET);
+
+    reg.pc = lo | (mem_read(VECTOR_RESET + 1) << 8);
+    reg.p.i = 1;
+    reg.p.d = 0;
+    reg.p.b = 1;
+    cpu_state = CPU_RUNNING;
+}
+
+void cpu_clear(void)
+{
+    reg = (registers_t){ 0 };
+    cpu_cycles = 0;
+    cpu_instructions = 0;
+    cpu_interrupts = 0;
+    cpu_state = CPU_RUNNING;
+    cpu_irq_lines = 0;
+    cpu_call_depth = 0;
+    cpu_exit_states = 0;
+    cpu_nmi_pending = false;
+    exiting = false;
+}
+
+void cpu_exit(void)
+{
+    exiting = true;
+    sched_kick();
+}
+
+static void run_done(void *ctx, uint64_t when)
+{
+    (void)when;
+    *(bool *)ctx = true;
+}
+
+void cpu_run(uint64_t until)
+{
+    sched_event_t end;
+    bool done = false;
+
+    /* The end of the run is just another event */
+    sched_event_init(&end, run_done, &done);
+    sched_add(&end, until);
+
+    while (!done)
+    {
+        uint64_t retired = 0;
+
+        /* The clock keeps running while waiting, straight to the next event, on time */
+        if (cpu_state != CPU_RUNNING && cpu_cycles < sched_deadline)
+            cpu_cycles = sched_deadline = sched_next > cpu_cycles ? sched_next : cpu_cycles;
+
+        while (cpu_cycles < sched_deadline)
+        {
+            uint16_t flags = mem_page_flags[reg.pc >> 8];
+
+            if (flags & (MEM_PAGE_BREAK | MEM_PAGE_HOOK | MEM_PAGE_DIFF))
+            {
+                if (flags & MEM_PAGE_BREAK)
+                {
+                    debug_exec(reg.pc);
+                    if (exiting)
+                        break;
+                }
+
+                /* A hook returns to the caller, which needs the checks again */
+                if (flags & MEM_PAGE_HOOK && hle_exec(reg.pc))
+                    continue;
+
+                if (flags & MEM_PAGE_DIFF)
+                    diff_exec(reg.pc);
+            }
+
+            const op_desc_t *op = &ops[shift_opcode()];
+
+            op->handler();
+            cpu_cycles += op->cycles;
+            retired++;
+        }
+
+        cpu_instructions += retired;
+        sched_run(cpu_cycles);
+        debug_poll();
+
+        if (exiting)
+        {
+            /* Whatever is due gets taken before the first instruction of the next run */
+            exiting = false;
+            sched_kick();
+            break;
+        }
+
+        if (cpu_state == CPU_STOPPED)
+        {
+            /* Nothing but a reset gets it going again */
+        }
+        else if (cpu_nmi_pending)
+        {
+            cpu_nmi_pending = false;
+            interrupt(VECTOR_NMIB);
+        }
+        else if (cpu_irq_lines && !reg.p.i)
+        {
+            interrupt(VECTOR_IRQBRK);
+        }
+        else if (cpu_irq_lines)
+        {
+            /* A masked IRQ still ends WAI, execution just continues */
+            cpu_state = CPU_RUNNING;
+        }
+
+        if (cpu_exit_states & BIT(cpu_state))
+            break;
+    }
+
+    sched_cancel(&end);
+}
@@ -6,6 +6,41 @@
 
 #define BIT(n) (1u << (n))
 
+/*
+ * CPU variant, chosen at build time with e.g. -DCPU_VARIANT=CPU_NMOS. Each
+ * gets an opcode table of its own, the instruction handlers don't check.
+ *
+ *   CPU_WDC       WDC W65C02S, the default
+ *   CPU_ROCKWELL  Rockwell R65C02, without WAI and STP
+ *   CPU_NMOS      NMOS 6502, with the undocumented opcodes, NMOS decimal
+ *                 flags and the JMP (a) page wrap
+ */
+#define CPU_NMOS 1
+#define CPU_WDC 2
+#define CPU_ROCKWELL 3
+
+#ifndef CPU_VARIANT
+#define CPU_VARIANT CPU_WDC
+#endif
+
+#if CPU_VARIANT == CPU_NMOS
+#define CPU_VARIANT_NAME "nmos"
+#elif CPU_VARIANT == CPU_WDC
+#define CPU_VARIANT_NAME "wdc"
+#elif CPU_VARIANT == CPU_ROCKWELL
+#define CPU_VARIANT_NAME "rockwell"
+#else
+#error "unknown CPU_VARIANT"
+#endif
+
+#define CPU_CMOS (CPU_VARIANT != CPU_NMOS)
+
+/*
+ * State of the emulated CPU and everything it owns (its memory map and
+ * scheduler). Every host thread runs a CPU of its own, see core/mp.h.
+ */
+#define CPU_LOCAL _Thread_local
+
 #define VECTOR_NMIB 0xFFFA
 #define VECTOR_RESET 0xFFFC
 #define VECTOR_IRQBRK 0xFFFE
@@ -53,7 +88,97 @@ typedef struct
 word_t procstat_to_word(procstat_t p);
 procstat_t word_to_procstat(word_t word);
 
-extern registers_t reg;
-extern word_t mem[1 << 16];
+extern CPU_LOCAL registers_t reg;
+
+/* Elapsed CPU cycles since power on */
+extern CPU_LOCAL uint64_t cpu_cycles;
+
+/* Totals for statistics, instructions are only added up between batches */
+extern CPU_LOCAL uint64_t cpu_instructions;
+extern CPU_LOCAL uint64_t cpu_interrupts;
+
+/* WAI waits for an interrupt, STP for a reset */
+typedef enum
+{
+    CPU_RUNNING,
+    CPU_WAITING,
+    CPU_STOPPED,
+} cpu_state_t;
+
+extern CPU_LOCAL cpu_state_t cpu_state;
+
+/*
+ * Edge coverage of guest control flow, for fuzzing. When set, branches,
+ * jumps, calls and returns count each (source, target) pair they take in a
+ * hashed map of this size.
+ */
+#define CPU_COVERAGE_BITS 14
+#define CPU_COVERAGE_SIZE (1 << CPU_COVERAGE_BITS)
+
+extern CPU_LOCAL uint8_t *cpu_coverage;
+
+/*
+ * Shadow call stack, for the profiler. JSR, BRK and interrupts push the address
+ * they were made from, RTS and RTI pop it. Only the innermost CPU_CALL_DEPTH
+ * calls are kept, deeper ones overwrite the oldest. Code returning through a
+ * pushed address instead of a JSR pops a call it never made, the depth just
+ * stops at zero.
+ */
+#define CPU_CALL_DEPTH 64
+
+extern CPU_LOCAL addr_t cpu_calls[CPU_CALL_DEPTH];
+extern CPU_LOCAL unsigned int cpu_call_depth;
+
+static inline void cpu_call(addr_t from)
+{
+    cpu_calls[cpu_call_depth++ % CPU_CALL_DEPTH] = from;
+}
+
+static inline void cpu_return(void)
+{
+    cpu_call_depth -= cpu_call_depth != 0;
+}
+
+/* Execute instructions until at least the given cycle is reached */
+void cpu_run(uint64_t until);
+
+/*
+ * Ending runs early, for embedding. After cpu_exit(), cpu_run() returns at the
+ * next instruction boundary, leaving interrupts that are due there to the
+ * start of the next run. Called from a debug stop handler, the instruction at
+ * the stop isn't executed. A run also returns as soon as the CPU gets into one
+ * of cpu_exit_states (a mask of BIT(cpu_state_t)), rather than letting the
+ * clock run on while it waits.
+ */
+extern CPU_LOCAL unsigned int cpu_exit_states;
+
+void cpu_exit(void);
+
+/*
+ * Interrupt inputs. IRQB is level triggered and shared, so every device
+ * asserts its own bit of cpu_irq_lines. NMIB is edge triggered, an edge sets
+ * cpu_nmi_pending until the NMI is taken.
+ */
+#define IRQ_SOURCE_VIA BIT(0)
+#define IRQ_SOURCE_ACIA BIT(1)
+
+extern CPU_LOCAL unsigned int cpu_irq_lines;
+extern CPU_LOCAL bool cpu_nmi_pending;
+
+void cpu_irq(unsigned int source, bool asserted);
+void cpu_nmi(void);
+
+/*
+ * RESB: start over at the reset vector with IRQB masked and decimal mode off,
+ * whatever the CPU was doing. The other registers are left as they are.
+ */
+void cpu_reset(void);
+
+/*
+ * Everything back to how it is at power on, registers, counters, interrupts
+ * and the call stack, for another machine in the same process. Reset the CPU
+ * afterwards to run it.
+ */
+void cpu_clear(void);
 
 #endif /* CPU_CPU_H_ */
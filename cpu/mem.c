@@ -1,34 +1,88 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "../core/bus.h"
+#include "../core/sched.h"
+#include "../core/stats.h"
+#include "../debug/debug.h"
+#include "../debug/diff.h"
+#include "../debug/heat.h"
 #include "cpu.h"
+#include "mem.h"
+#include "mem_shm.h"
+
+/* The stack lives in page 1, s is the offset of the next free byte */
+#define STACK(a) (0x100 | (uint8_t)(a))
+
+#if MEM_SPARSE
+/* What every page holds until it's written */
+static const uint8_t zero_page[256];
+
+CPU_LOCAL uint16_t mem_page_flags[256] = { [0 ... 255] = MEM_PAGE_SHARED };
+CPU_LOCAL uint8_t *mem_pages[256] = { [0 ... 255] = (uint8_t *)zero_page };
+#else
+CPU_LOCAL uint16_t mem_page_flags[256] = { 0 };
+CPU_LOCAL uint8_t mem[MEM_SIZE] = { 0 };
+#endif
 
-#define STACK(a) ((uint8_t)(0xFF + a))
+static CPU_LOCAL accuracy_t accuracy = ACCURACY_INSTRUCTION;
 
-/* FIXME: Temporary util functions */
-static void cpu_bus_addr_set(uint16_t addr)
+static CPU_LOCAL uint8_t dirty[256];
+static CPU_LOCAL unsigned int dirty_count = 0;
+
+static CPU_LOCAL struct
 {
-    for (int i = 0; i < 16; i++) {
-            pin_set(&cpu_addr_bus[i], addr & BIT(i));
-    }
-}
+    mem_io_read_t read;
+    mem_io_write_t write;
+    void *ctx;
+} io[256];
 
-static void cpu_bus_data_set(uint8_t addr)
+/* Exported memory, see mem_export() */
+static CPU_LOCAL mem_shm_t *shm = NULL;
+static CPU_LOCAL char shm_name[64];
+static CPU_LOCAL unsigned int changing = 0;
+
+static const char *const accuracy_names[] = {
+    [ACCURACY_INSTRUCTION] = "instruction",
+    [ACCURACY_CYCLE] = "cycle",
+    [ACCURACY_PIN] = "pin",
+};
+
+/*
+ * Cycle number of the current bus cycle. cpu_cycles is only advanced at the
+ * end of an instruction, so count the bus cycles since then.
+ */
+static uint64_t bus_cycle_stamp(void)
 {
-        for (int i = 0; i < 8; i++) {
-                pin_set(&cpu_data_bus[i], addr & BIT(i));
-        }
+    static CPU_LOCAL uint64_t base = 0;
+    static CPU_LOCAL uint64_t offset = 0;
+
+    if (base != cpu_cycles)
+    {
+        base = cpu_cycles;
+        offset = 0;
+    }
+
+    return base + offset++;
 }
 
 /*
- * Memory access functions
- *
- * TODO: Here we should yield to the core
+ * Bus cycles at pin accuracy. The CPU drives its pins, every device responds,
+ * and for reads the CPU samples the data bus.
  */
-uint8_t mem_read(addr_t addr)
+static word_t pin_read(addr_t addr)
 {
-    uint8_t word = 0;
+    bool floating;
+    word_t word;
 
-    for (int i = 0; i < 16; i++)
-            pin_set(&cpu_addr_bus[i], addr & BIT(i));
+    pins_set(cpu_addr_bus, 16, addr);
+    pin_set(&cpu_rwb, PIN_STATE_HI);
+    pins_release(cpu_data_bus, 8);
 
     /* yield */
 
@@ -40,17 +94,485 @@ uint8_t mem_read(addr_t addr)
      * Another thought - This conditional variable could be defined in terms of
      * pin state.
      */
+    bus_evaluate();
+
+    word = pins_evaluate(cpu_data_bus, 8, &floating);
+
+    /* Devices that aren't modelled at pin level yet (ROM) read from memory */
+    return floating ? mem_peek(addr) : word;
+}
+
+static void pin_write(addr_t addr, word_t word)
+{
+    pins_set(cpu_addr_bus, 16, addr);
+    pins_set(cpu_data_bus, 8, word);
+    pin_set(&cpu_rwb, PIN_STATE_LO);
+
+    bus_evaluate();
+}
+
+/*
+ * Memory mapped devices aren't modelled at pin level, but their accesses are
+ * still bus cycles
+ */
+static void bus_report(addr_t addr, word_t word, bool write)
+{
+    bus_cycle_t cycle = { .cycle = bus_cycle_stamp(), .addr = addr, .data = word, .write = write };
 
-    for (int i = 0; i < 8; i++)
-            word |= pin_evaluate(&cpu_data_bus[i]) >> i;
+    bus_cycle(&cycle);
+}
+
+static word_t bus_read(addr_t addr)
+{
+    word_t word = accuracy == ACCURACY_PIN ? pin_read(addr) : mem_peek(addr);
 
+    bus_report(addr, word, false);
     return word;
-    /* return mem[addr]; */
 }
 
-void mem_write(addr_t addr, word_t word)
+static void bus_write(addr_t addr, word_t word)
+{
+    if (accuracy == ACCURACY_PIN)
+        pin_write(addr, word);
+    else if (!(mem_page_flags[addr >> 8] & MEM_PAGE_ROM))
+        mem_poke(addr, word);
+
+    bus_report(addr, word, true);
+}
+
+void mem_map_io(unsigned int first_page, unsigned int count, mem_io_read_t read,
+                mem_io_write_t write, void *ctx)
+{
+    mem_change_begin();
+    for (unsigned int page = first_page; page < first_page + count && page < 256; page++)
+    {
+        io[page].read = read;
+        io[page].write = write;
+        io[page].ctx = ctx;
+        mem_page_flags[page] |= MEM_PAGE_IO;
+        if (shm)
+            atomic_fetch_or_explicit(&shm->header.pages[page], MEM_SHM_PAGE_IO,
+                                     memory_order_relaxed);
+    }
+    mem_change_end();
+}
+
+void mem_set_accuracy(accuracy_t new_accuracy)
+{
+    /* Leave the bus idle, with nothing driven by the CPU */
+    if (accuracy == ACCURACY_PIN && new_accuracy != ACCURACY_PIN)
+    {
+        pins_release(cpu_addr_bus, 16);
+        pins_release(cpu_data_bus, 8);
+        pin_set(&cpu_rwb, PIN_STATE_NONE);
+    }
+
+    accuracy = new_accuracy;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (accuracy == ACCURACY_INSTRUCTION)
+            mem_page_flags[i] &= ~MEM_PAGE_BUS;
+        else
+            mem_page_flags[i] |= MEM_PAGE_BUS;
+    }
+}
+
+accuracy_t mem_get_accuracy(void)
 {
-    mem[addr] = word;
+    return accuracy;
+}
+
+int accuracy_from_name(const char *name, accuracy_t *out)
+{
+    for (int i = 0; i < (int)(sizeof(accuracy_names) / sizeof(accuracy_names[0])); i++)
+    {
+        if (strcmp(name, accuracy_names[i]) == 0)
+        {
+            *out = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Pages
+ */
+void mem_change_begin(void)
+{
+    if (!shm || changing++)
+        return;
+
+    atomic_fetch_add_explicit(&shm->header.generation, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void mem_change_end(void)
+{
+    if (!shm || --changing)
+        return;
+
+    atomic_fetch_add_explicit(&shm->header.generation, 1, memory_order_release);
+}
+
+void mem_export_close(void)
+{
+    if (!shm_name[0])
+        return;
+
+    shm_unlink(shm_name);
+    shm_name[0] = '\0';
+}
+
+#if MEM_SPARSE
+/* Pages of the segment other CPUs map, see mem_share() */
+static CPU_LOCAL bool lent[256];
+
+/* Free the page if it's a copy of the CPU's own */
+static void drop_page(unsigned int page)
+{
+    if (mem_page_flags[page] & MEM_PAGE_SHARED)
+        return;
+
+    if (!shm || mem_pages[page] != shm->data[page])
+        free(mem_pages[page]);
+}
+
+uint8_t *mem_writable_page(unsigned int page)
+{
+    uint8_t *copy;
+
+    if (!(mem_page_flags[page] & MEM_PAGE_SHARED))
+        return mem_pages[page];
+
+    if (shm && !lent[page])
+    {
+        /* Exported, the segment already has what the page holds */
+        copy = shm->data[page];
+    }
+    else
+    {
+        copy = malloc(256);
+        if (!copy)
+        {
+            fprintf(stderr, "mem: out of memory\n");
+            abort();
+        }
+
+        if (shm)
+            atomic_fetch_and_explicit(&shm->header.pages[page], ~MEM_SHM_PAGE_LIVE,
+                                      memory_order_relaxed);
+    }
+
+    memcpy(copy, mem_pages[page], 256);
+    mem_pages[page] = copy;
+    mem_page_flags[page] &= ~MEM_PAGE_SHARED;
+
+    return copy;
+}
+
+const void *mem_share(unsigned int first_page, unsigned int count)
+{
+    for (unsigned int page = first_page; page < first_page + count && page < 256; page++)
+    {
+        if (shm && mem_pages[page] == shm->data[page])
+            lent[page] = true;
+        mem_page_flags[page] |= MEM_PAGE_SHARED;
+    }
+
+    return mem_pages;
+}
+
+void mem_map_shared(unsigned int first_page, unsigned int count, const void *shared)
+{
+    uint8_t *const *pages = shared;
+
+    mem_change_begin();
+    for (unsigned int page = first_page; page < first_page + count && page < 256; page++)
+    {
+        drop_page(page);
+
+        mem_pages[page] = pages[page];
+        mem_page_flags[page] |= MEM_PAGE_SHARED;
+        if (shm && !lent[page])
+            memcpy(shm->data[page], pages[page], 256);
+    }
+    mem_change_end();
+}
+
+void mem_release(void)
+{
+    mem_change_begin();
+    for (unsigned int page = 0; page < 256; page++)
+    {
+        drop_page(page);
+
+        mem_pages[page] = (uint8_t *)zero_page;
+        mem_page_flags[page] |= MEM_PAGE_SHARED;
+        if (shm && !lent[page])
+            memset(shm->data[page], 0, 256);
+    }
+    mem_change_end();
+}
+
+int mem_export(const char *name)
+{
+    int fd;
+
+    if (shm)
+    {
+        fprintf(stderr, "mem: memory is already exported\n");
+        return -1;
+    }
+
+    snprintf(shm_name, sizeof(shm_name), "%s", name);
+    fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(*shm)) < 0)
+    {
+        perror(shm_name);
+        if (fd >= 0)
+            close(fd);
+        shm_name[0] = '\0';
+        return -1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        perror(shm_name);
+        shm = NULL;
+        shm_name[0] = '\0';
+        return -1;
+    }
+
+    shm->header.version = MEM_SHM_VERSION;
+    shm->header.pid = getpid();
+    shm->header.page_size = MEM_SHM_PAGE_SIZE;
+    shm->header.page_count = MEM_SHM_PAGES;
+    shm->header.data_offset = offsetof(mem_shm_t, data);
+
+    /* The CPU's own pages move in, shared ones stay shared until written */
+    for (unsigned int page = 0; page < 256; page++)
+    {
+        memcpy(shm->data[page], mem_pages[page], 256);
+        if (!(mem_page_flags[page] & MEM_PAGE_SHARED))
+        {
+            free(mem_pages[page]);
+            mem_pages[page] = shm->data[page];
+        }
+
+        lent[page] = false;
+        atomic_init(&shm->header.pages[page], MEM_SHM_PAGE_LIVE |
+                    (mem_page_flags[page] & MEM_PAGE_IO ? MEM_SHM_PAGE_IO : 0));
+    }
+
+    /* Readers check the magic last */
+    atomic_thread_fence(memory_order_release);
+    shm->header.magic = MEM_SHM_MAGIC;
+
+    return 0;
+}
+
+void mem_read_block(addr_t addr, void *data, size_t len)
+{
+    uint8_t *p = data;
+
+    for (uint32_t a = addr, n; len; a += n, p += n, len -= n)
+    {
+        n = 256 - (a & 0xFF) < len ? 256 - (a & 0xFF) : len;
+        memcpy(p, mem_pages[a >> 8] + (a & 0xFF), n);
+    }
+}
+
+void mem_write_block(addr_t addr, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    mem_change_begin();
+    for (uint32_t a = addr, n; len; a += n, p += n, len -= n)
+    {
+        uint8_t *page = mem_pages[a >> 8];
+
+        n = 256 - (a & 0xFF) < len ? 256 - (a & 0xFF) : len;
+        if (mem_page_flags[a >> 8] & MEM_PAGE_SHARED)
+        {
+            if (memcmp(page + (a & 0xFF), p, n) == 0)
+                continue;
+            page = mem_writable_page(a >> 8);
+        }
+
+        memcpy(page + (a & 0xFF), p, n);
+    }
+    mem_change_end();
+}
+#else
+uint8_t *mem_writable_page(unsigned int page)
+{
+    return &mem[page << 8];
+}
+
+/* The other CPUs take a copy, of the pages as they are now */
+const void *mem_share(unsigned int first_page, unsigned int count)
+{
+    return mem;
+}
+
+void mem_map_shared(unsigned int first_page, unsigned int count, const void *shared)
+{
+    if (first_page < 256)
+        memcpy(&mem[first_page << 8], (const uint8_t *)shared + (first_page << 8),
+               (count < 256 - first_page ? count : 256 - first_page) << 8);
+}
+
+void mem_release(void)
+{
+    memset(mem, 0, sizeof(mem));
+}
+
+int mem_export(const char *name)
+{
+    fprintf(stderr, "mem: exporting memory needs MEM_SPARSE=1\n");
+    return -1;
+}
+
+void mem_read_block(addr_t addr, void *data, size_t len)
+{
+    memcpy(data, &mem[addr], len);
+}
+
+void mem_write_block(addr_t addr, const void *data, size_t len)
+{
+    memcpy(&mem[addr], data, len);
+}
+#endif
+
+/*
+ * Write tracking
+ */
+void mem_track_start(void)
+{
+    dirty_count = 0;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] |= MEM_PAGE_TRACK;
+}
+
+void mem_track_stop(void)
+{
+    dirty_count = 0;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] &= ~MEM_PAGE_TRACK;
+}
+
+unsigned int mem_dirty_pages(const uint8_t **pages)
+{
+    *pages = dirty;
+    return dirty_count;
+}
+
+void mem_track_reset(void)
+{
+    for (unsigned int i = 0; i < dirty_count; i++)
+        mem_page_flags[dirty[i]] |= MEM_PAGE_TRACK;
+    dirty_count = 0;
+}
+
+/*
+ * Memory access functions, slow paths
+ */
+word_t mem_read_slow(addr_t addr)
+{
+    if (mem_page_flags[addr >> 8] & MEM_PAGE_WATCH_READ)
+        debug_access(addr, false);
+
+    return mem_fetch_slow(addr, HEAT_READ);
+}
+
+word_t mem_fetch_slow(addr_t addr, uint8_t heat)
+{
+    uint16_t flags = mem_page_flags[addr >> 8];
+
+    if (flags & MEM_PAGE_HEAT)
+        heat_access(addr, heat);
+
+    if (flags & MEM_PAGE_IO)
+    {
+        sched_sync(cpu_cycles);
+
+        uint64_t start = flags & MEM_PAGE_TIMED ? stats_clock() : 0;
+        word_t word = io[addr >> 8].read(io[addr >> 8].ctx, addr);
+
+        if (flags & MEM_PAGE_TIMED)
+            stats_device_time(io[addr >> 8].ctx, stats_clock() - start);
+
+        if (flags & MEM_PAGE_DIFF)
+            diff_io_read(addr, word);
+        if (flags & MEM_PAGE_BUS)
+            bus_report(addr, word, false);
+        return word;
+    }
+
+    if (flags & MEM_PAGE_BUS)
+        return bus_read(addr);
+
+    return mem_peek(addr);
+}
+
+void mem_write_slow(addr_t addr, word_t word)
+{
+    uint16_t flags = mem_page_flags[addr >> 8];
+
+    if (flags & MEM_PAGE_HEAT)
+        heat_access(addr, HEAT_WRITE);
+
+    if (flags & MEM_PAGE_WATCH_WRITE)
+        debug_access(addr, true);
+
+    if (flags & MEM_PAGE_DIFF)
+        diff_write(addr, word);
+
+    if (flags & MEM_PAGE_TRACK)
+    {
+        mem_page_flags[addr >> 8] &= ~MEM_PAGE_TRACK;
+        dirty[dirty_count++] = addr >> 8;
+    }
+
+    if (flags & MEM_PAGE_IO)
+    {
+        sched_sync(cpu_cycles);
+
+        uint64_t start = flags & MEM_PAGE_TIMED ? stats_clock() : 0;
+
+        io[addr >> 8].write(io[addr >> 8].ctx, addr, word);
+
+        if (flags & MEM_PAGE_TIMED)
+            stats_device_time(io[addr >> 8].ctx, stats_clock() - start);
+
+        if (flags & MEM_PAGE_BUS)
+            bus_report(addr, word, true);
+    }
+    else if (flags & MEM_PAGE_BUS)
+    {
+        bus_write(addr, word);
+    }
+    else if (!(flags & MEM_PAGE_ROM))
+    {
+        mem_poke(addr, word);
+    }
+}
+
+/*
+ * Dummy reads of memory mapped devices are skipped, they'd have side effects
+ * like clearing interrupt flags
+ */
+void mem_dummy_read_slow(addr_t addr)
+{
+    if (mem_page_flags[addr >> 8] & MEM_PAGE_IO)
+        bus_report(addr, 0, false);
+    else
+        bus_read(addr);
 }
 
 /*
@@ -62,11 +584,12 @@ void push(uint8_t word)
     mem_write(STACK(reg.s--), word);
 }
 
+/* The high byte goes first, so the address ends up little-endian in memory */
 void push16(uint16_t dword)
 {
     /* TODO: overflow? */
-    mem_write(STACK(reg.s--), dword & 0xFF);
     mem_write(STACK(reg.s--), (dword >> 8) & 0xFF);
+    mem_write(STACK(reg.s--), dword & 0xFF);
 }
 
 uint8_t pop(void)
@@ -76,22 +599,7 @@ uint8_t pop(void)
 
 uint16_t pop16(void)
 {
-    uint16_t dword = mem_read(STACK(++reg.s)) << 8;
-    dword |= mem_read(STACK(++reg.s));
+    uint16_t dword = mem_read(STACK(++reg.s));
+    dword |= mem_read(STACK(++reg.s)) << 8;
     return dword;
 }
-
-/*
- * Utility functions to read a (double) word and advance the program counter.
- * Useful during instruction decoding.
- */
-uint8_t shift(void)
-{
-    return mem_read(reg.pc++);
-}
-
-uint16_t shift16(void)
-{
-    /* 65C02 is little-endian */
-    return shift() + (shift() << 8);
-}
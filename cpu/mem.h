@@ -1,13 +1,241 @@
 #ifndef CPU_MEM_H_
 #define CPU_MEM_H_
 
+#include <stddef.h>
+
+#include "../debug/heat.h"
 #include "cpu.h"
 
 /*
- * Memory access functions
+ * Per-page flags of the memory map. A page with no flags set has nothing
+ * special going on and its accesses go straight to memory, so the only cost
+ * to the access functions is a single test of this table.
  */
-uint8_t mem_read(addr_t addr);
-void mem_write(addr_t addr, word_t word);
+#define MEM_PAGE_BREAK BIT(0) /* execution breakpoint on the page */
+#define MEM_PAGE_WATCH_READ BIT(1) /* read watchpoint on the page */
+#define MEM_PAGE_WATCH_WRITE BIT(2) /* write watchpoint on the page */
+#define MEM_PAGE_BUS BIT(3) /* accesses are bus cycles, see mem_set_accuracy() */
+#define MEM_PAGE_IO BIT(4) /* memory mapped device, see mem_map_io() */
+#define MEM_PAGE_HOOK BIT(5) /* HLE hook entry point, see hle/hle.h */
+#define MEM_PAGE_DIFF BIT(6) /* differential checking, see debug/diff.h */
+#define MEM_PAGE_TRACK BIT(7) /* first write is recorded, see mem_track_start() */
+#define MEM_PAGE_HEAT BIT(8) /* accesses are recorded, see debug/heat.h */
+#define MEM_PAGE_TIMED BIT(9) /* device accesses are timed, see core/stats.h */
+#define MEM_PAGE_SHARED BIT(10) /* read-only, a write copies it, see MEM_SPARSE */
+#define MEM_PAGE_ROM BIT(11) /* ROM, writes are dropped, see decode_map_rom() */
+
+extern CPU_LOCAL uint16_t mem_page_flags[256];
+
+/*
+ * How memory is kept, chosen at build time with -DMEM_SPARSE=0 or 1:
+ *
+ *   0  A flat 64K per CPU, the default. Accesses skip the directory, which
+ *      makes a machine about a fifth faster, and sharing pages copies them.
+ *   1  A directory of 256 byte pages. Until a page is written it is the zero
+ *      page every CPU shares, and pages can be shared read-only between CPUs,
+ *      like the ROM of a multiprocessor board. Shared pages have
+ *      MEM_PAGE_SHARED set, which sends writes to the slow path, where the
+ *      first one gives the CPU a copy of its own. A machine takes up the
+ *      directory and the pages it wrote instead of 64K, which only pays off
+ *      with many CPUs in one process, and exporting memory needs it.
+ */
+#ifndef MEM_SPARSE
+#define MEM_SPARSE 0
+#endif
+
+#define MEM_SIZE ((size_t)1 << 16)
+
+#if MEM_SPARSE
+extern CPU_LOCAL uint8_t *mem_pages[256];
+#else
+extern CPU_LOCAL uint8_t mem[MEM_SIZE];
+#endif
+
+/* The page to write to, made the CPU's own if it was shared */
+uint8_t *mem_writable_page(unsigned int page);
+
+/*
+ * Share pages with other CPUs, which map them by passing what this returns to
+ * mem_map_shared(). The pages become read-only for this CPU too and are never
+ * freed, so the others can use them for as long as they run.
+ */
+const void *mem_share(unsigned int first_page, unsigned int count);
+void mem_map_shared(unsigned int first_page, unsigned int count, const void *shared);
+
+/* Back to all zeroes, freeing the pages of the CPU's own */
+void mem_release(void);
+
+/*
+ * Export the CPU's memory in a POSIX shared memory segment, named like
+ * "/fakeoid-mem", for other processes to map read-only, see cpu/mem_shm.h.
+ * The pages move into the segment and are accessed there like anywhere else.
+ * Needs MEM_SPARSE=1. Returns -1 on error.
+ */
+int mem_export(const char *name);
+/* Remove the segment's name, the pages stay where they are */
+void mem_export_close(void);
+
+/* Bracket changes to memory other than by the CPU, for readers of the export */
+void mem_change_begin(void);
+void mem_change_end(void);
+
+/*
+ * Memory without the memory map, for loaders, debuggers and the like: devices
+ * don't see these accesses and nothing is recorded. Blocks have to be within
+ * the 64K, writing what a shared page already holds leaves it shared.
+ */
+static inline word_t mem_peek(addr_t addr)
+{
+#if MEM_SPARSE
+    return mem_pages[addr >> 8][addr & 0xFF];
+#else
+    return mem[addr];
+#endif
+}
+
+static inline void mem_poke(addr_t addr, word_t word)
+{
+#if MEM_SPARSE
+    uint8_t *page = mem_pages[addr >> 8];
+
+    if (mem_page_flags[addr >> 8] & MEM_PAGE_SHARED)
+        page = mem_writable_page(addr >> 8);
+    page[addr & 0xFF] = word;
+#else
+    mem[addr] = word;
+#endif
+}
+
+void mem_read_block(addr_t addr, void *data, size_t len);
+void mem_write_block(addr_t addr, const void *data, size_t len);
+
+/*
+ * Memory mapped devices. Accesses to the mapped pages are passed to the
+ * device instead of memory. Devices are mapped at page granularity, and
+ * decode the address bits within their pages themselves.
+ */
+typedef word_t (*mem_io_read_t)(void *ctx, addr_t addr);
+typedef void (*mem_io_write_t)(void *ctx, addr_t addr, word_t word);
+
+void mem_map_io(unsigned int first_page, unsigned int count, mem_io_read_t read,
+                mem_io_write_t write, void *ctx);
+
+/*
+ * Write tracking, for restoring memory from a snapshot without copying all of
+ * it. The first write to each page is recorded and clears the page's flag, so
+ * later writes to it cost nothing. Writes not made through mem_write() aren't
+ * seen.
+ */
+void mem_track_start(void);
+void mem_track_stop(void);
+/* Pages written since tracking started or was last reset */
+unsigned int mem_dirty_pages(const uint8_t **pages);
+/* Forget the written pages and track them again */
+void mem_track_reset(void);
+
+/*
+ * Accuracy levels
+ *
+ * INSTRUCTION: accesses go straight to memory.
+ * CYCLE: every access, including the dummy reads the 65C02 does, is a bus
+ *        cycle that bus observers see.
+ * PIN: like CYCLE, but every bus cycle drives the CPU pins and lets the
+ *      attached pin level devices respond.
+ *
+ * The level can be changed at any instruction boundary. All levels share the
+ * same memory and register state, so there is nothing else to hand off.
+ */
+typedef enum
+{
+    ACCURACY_INSTRUCTION,
+    ACCURACY_CYCLE,
+    ACCURACY_PIN,
+} accuracy_t;
+
+void mem_set_accuracy(accuracy_t accuracy);
+accuracy_t mem_get_accuracy(void);
+/* Returns 0 and sets *accuracy on success, -1 for an unknown name */
+int accuracy_from_name(const char *name, accuracy_t *accuracy);
+
+/*
+ * Memory access functions. The slow paths handle pages with flags set.
+ */
+word_t mem_read_slow(addr_t addr);
+word_t mem_fetch_slow(addr_t addr, uint8_t heat);
+void mem_write_slow(addr_t addr, word_t word);
+void mem_dummy_read_slow(addr_t addr);
+
+/*
+ * Pages with only the heatmap flag stay inline, so recording the heatmap costs
+ * little more than the shadow update. Reads of shared and ROM pages are like
+ * any.
+ */
+static inline word_t mem_read(addr_t addr)
+{
+    uint16_t flags = mem_page_flags[addr >> 8] & ~(MEM_PAGE_SHARED | MEM_PAGE_ROM);
+
+    if (flags)
+    {
+        if (flags != MEM_PAGE_HEAT)
+            return mem_read_slow(addr);
+        heat_access(addr, HEAT_READ);
+    }
+
+    return mem_peek(addr);
+}
+
+static inline void mem_write(addr_t addr, word_t word)
+{
+    uint16_t flags = mem_page_flags[addr >> 8];
+
+    if (flags)
+    {
+        if (flags != MEM_PAGE_HEAT)
+        {
+            mem_write_slow(addr, word);
+            return;
+        }
+        heat_access(addr, HEAT_WRITE);
+    }
+
+    /* Not shared, or the flags would have sent it to the slow path */
+#if MEM_SPARSE
+    mem_pages[addr >> 8][addr & 0xFF] = word;
+#else
+    mem[addr] = word;
+#endif
+}
+
+/*
+ * Instruction fetches, reads that read watchpoints don't see, as they only
+ * watch data. heat is what the heatmap records: HEAT_READ for operands, and
+ * HEAT_EXEC too for the opcode, so the instruction loop needs no test of its
+ * own for it.
+ */
+static inline word_t mem_fetch(addr_t addr, uint8_t heat)
+{
+    uint16_t flags =
+        mem_page_flags[addr >> 8] & ~(MEM_PAGE_SHARED | MEM_PAGE_ROM | MEM_PAGE_WATCH_READ);
+
+    if (flags)
+    {
+        if (flags != MEM_PAGE_HEAT)
+            return mem_fetch_slow(addr, heat);
+        heat_access(addr, heat);
+    }
+
+    return mem_peek(addr);
+}
+
+/*
+ * Reads the CPU does on the bus without using the result. They only matter
+ * when accesses are bus cycles.
+ */
+static inline void mem_dummy_read(addr_t addr)
+{
+    if (mem_page_flags[addr >> 8] & MEM_PAGE_BUS)
+        mem_dummy_read_slow(addr);
+}
 
 /*
  * Stack manipulation functions
@@ -23,7 +251,21 @@ uint16_t pop16(void);
  *
  * TODO: Move this elsewhere. Too specific.
  */
-uint8_t shift(void);
-uint16_t shift16(void);
+static inline uint8_t shift(void)
+{
+    return mem_fetch(reg.pc++, HEAT_READ);
+}
+
+static inline uint8_t shift_opcode(void)
+{
+    return mem_fetch(reg.pc++, HEAT_READ | HEAT_EXEC);
+}
+
+static inline uint16_t shift16(void)
+{
+    /* 65C02 is little-endian */
+    uint16_t lo = shift();
+    return lo | (shift() << 8);
+}
 
 #endif /* CPU_MEM_H_ */
@@ -0,0 +1,64 @@
+#ifndef CPU_MEM_SHM_H_
+#define CPU_MEM_SHM_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Shared memory layout of exported guest memory, see mem_export()
+ *
+ * This header is all a reader needs. The segment starts with a header and
+ * holds the CPU's 64K from MEM_SHM_DATA on, page aligned so it can be mapped
+ * on its own. The CPU reads and writes the pages there in place, so a reader
+ * that maps the segment read-only sees guest memory as it runs, at no cost to
+ * the emulator.
+ *
+ * The page map has flags for each 256 byte page of the guest:
+ *
+ *   MEM_SHM_PAGE_LIVE  the segment has what the CPU reads there. A page the
+ *                      CPU shared with other CPUs and then wrote is a copy of
+ *                      its own outside the segment, and the segment keeps the
+ *                      shared one.
+ *   MEM_SHM_PAGE_IO    a device is mapped there and gets the accesses, the
+ *                      segment has the memory behind it
+ *
+ * The generation is odd while the emulator changes memory other than by
+ * running the CPU: loading a ROM or state, mapping pages or clearing them. A
+ * reader that wants a consistent copy reads the generation before and after
+ * copying, with acquire ordering, and retries if it was odd or has changed.
+ * The running CPU doesn't touch it, its writes land a byte at a time as they
+ * would on the board.
+ */
+#define MEM_SHM_MAGIC 0x4D4D4B46 /* "FKMM" */
+#define MEM_SHM_VERSION 1
+#define MEM_SHM_PAGE_SIZE 256
+#define MEM_SHM_PAGES 256
+#define MEM_SHM_DATA 4096
+
+#define MEM_SHM_PAGE_LIVE 0x01
+#define MEM_SHM_PAGE_IO 0x02
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid; /* of the emulator, to tell whether the memory is stale */
+    uint32_t page_size;
+    uint32_t page_count;
+    uint32_t data_offset;
+
+    _Atomic uint32_t generation;
+    _Atomic uint8_t pages[MEM_SHM_PAGES];
+} mem_shm_header_t;
+
+typedef struct
+{
+    union
+    {
+        mem_shm_header_t header;
+        uint8_t header_space[MEM_SHM_DATA];
+    };
+    uint8_t data[MEM_SHM_PAGES][MEM_SHM_PAGE_SIZE];
+} mem_shm_t;
+
+#endif /* CPU_MEM_SHM_H_ */
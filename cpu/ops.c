@@ -1,246 +1,344 @@
+#include "../core/sched.h"
+#include "../debug/irqlat.h"
 #include "cpu.h"
 #include "mem.h"
 #include "ops.h"
 
-#include <stdlib.h> /* TODO: remove */
-
 /*
  * Arithmetic utility functions. Pretty much every arithmetic operation sets
- * some bits in the processor status register, and this depends on the value in
- * the accumulator.
+ * the zero and negative bits in the processor status register depending on
+ * its result.
  */
-static void set_zero()
+static inline void set_nz(word_t value)
 {
-    if (reg.a == 0)
-        reg.p.z = 1;
-}
-
-static void set_negative()
-{
-    if (reg.a & BIT(7))
-        reg.p.n = 1;
+    reg.p.z = !value;
+    reg.p.n = value & BIT(7);
 }
 
 /*
- * Memory access abstraction for a given operand_t. Depending on the operand
- * type, a load or store looks different.
+ * Interrupts are only taken between batches of instructions, so unmasking
+ * them with a request pending has to end the current batch.
  */
-static uint8_t load(const operand_t operand)
+static inline void irq_unmasked(void)
 {
-    switch (operand.type)
-    {
-    case OPERAND_TYPE_WORD:
-    case OPERAND_TYPE_WORD_ADDRESS:
-        return operand.word;
-    case OPERAND_TYPE_ADDRESS:
-        return mem_read(operand.addr);
-    case OPERAND_TYPE_ACCUMULATOR:
-        return reg.a;
-    case OPERAND_TYPE_NONE:
-    default:
-        // TODO: error handling!
-        abort();
-    }
+    if (cpu_irq_lines && !reg.p.i)
+        sched_kick();
 }
 
-static uint16_t addr(const operand_t operand)
+/* Fibonacci hashing, the high bits of the product are the well mixed ones */
+static inline void edge(addr_t from, addr_t to)
 {
-    switch (operand.type)
-    {
-    case OPERAND_TYPE_ADDRESS:
-    case OPERAND_TYPE_WORD_ADDRESS:
-        return operand.addr;
-    case OPERAND_TYPE_NONE:
-    case OPERAND_TYPE_WORD:
-    case OPERAND_TYPE_ACCUMULATOR:
-    default:
-        abort();
-    }
-}
+    uint32_t hash = ((uint32_t)from << 16 | to) * UINT32_C(0x9E3779B1);
 
-static void store(const operand_t operand, const word_t word)
-{
-    switch (operand.type)
-    {
-    case OPERAND_TYPE_ADDRESS:
-        mem_write(operand.addr, word);
-        break;
-    case OPERAND_TYPE_ACCUMULATOR:
-        reg.a = word;
-        break;
-    case OPERAND_TYPE_NONE:
-    case OPERAND_TYPE_WORD:
-    case OPERAND_TYPE_WORD_ADDRESS:
-    default:
-        // TODO: error handling
-        abort();
-    }
+    if (cpu_coverage)
+        cpu_coverage[hash >> (32 - CPU_COVERAGE_BITS)]++;
 }
 
 /*
- * Operand handlers now follow
+ * Effective address computation, one function per addressing mode.
+ *
+ * Instruction handlers are generated once per (operation, addressing mode)
+ * pair from the opcode table at the bottom of this file, so each of these is
+ * inlined into its handlers and nothing about the operand is decided at
+ * runtime.
  */
-
-/* ADC: Add with carry */
-static void adc(operand_t operand)
+static inline addr_t zp_pointer(uint8_t zp)
 {
-    uint8_t carry = reg.p.c;
-    uint16_t result;
-
-    result = reg.a + load(operand) + carry;
-    reg.a = result & 0xFF;
-
-    /* set carry flag */
-    reg.p.c = result & BIT(8);
-
-    /* set overflow flag
-     *
-     * WDC's programming manual says that the overflow (V) flag is
-     * calculated by XORing the carry from bit 7 (which is bit 8) with the
-     * carry from bit 6 (which is bit 7). See p. 136. TODO: Check this.
-     */
-    reg.p.v = (result & BIT(8)) ^ (result & BIT(7));
-
-    set_zero();
-    set_negative();
+    /* The high byte of the pointer wraps around within the zero page */
+    addr_t lo = mem_read(zp);
+    return lo | (mem_read((uint8_t)(zp + 1)) << 8);
 }
 
-/* AND: Logical AND */
-static void and (operand_t operand)
+static inline addr_t abs_pointer(addr_t ptr)
 {
-    reg.a &= load(operand);
+    addr_t lo = mem_read(ptr);
+#if CPU_VARIANT == CPU_NMOS
+    /* The high byte comes from the same page, JMP ($12FF) reads $12FF and $1200 */
+    return lo | (mem_read((ptr & 0xFF00) | (uint8_t)(ptr + 1)) << 8);
+#else
+    /* Unlike on the NMOS 6502, this doesn't wrap around within the page */
+    return lo | (mem_read(ptr + 1) << 8);
+#endif
+}
 
-    set_zero();
-    set_negative();
+static inline addr_t ea_zp(void)
+{
+    return shift();
 }
 
-/* ASL: Arithmetic shift left */
-static void asl(operand_t operand)
+static inline addr_t ea_zpx(void)
 {
-    uint16_t result = load(operand) << 1;
-    store(operand, result & 0xFF);
+    return (uint8_t)(shift() + reg.x);
+}
 
-    /* set carry flag */
-    reg.p.c = result & BIT(8);
+static inline addr_t ea_zpy(void)
+{
+    return (uint8_t)(shift() + reg.y);
+}
 
-    set_zero();
-    set_negative();
+static inline addr_t ea_abs(void)
+{
+    return shift16();
 }
 
-/* BBR: Branch on bit reset */
-static void bbr_(operand_t operand, int nr)
+static inline addr_t ea_absx(void)
 {
-    /* TODO: review this */
-    if (!(load(operand) & BIT(nr)))
-        reg.pc = addr(operand);
+    return shift16() + reg.x;
 }
 
-static void bbr0(operand_t operand)
+/*
+ * Shifts and rotates with abs,X are the exception among read-modify-writes,
+ * they only take the extra cycle when indexing crosses a page.
+ */
+static inline addr_t ea_absxp(void)
 {
-    bbr_(operand, 0);
+    addr_t base = shift16();
+    addr_t addr = base + reg.x;
+
+    if ((base ^ addr) >> 8)
+    {
+        mem_dummy_read(reg.pc - 1);
+        cpu_cycles++;
+    }
+
+    return addr;
 }
 
-static void bbr1(operand_t operand)
+static inline addr_t ea_absy(void)
 {
-    bbr_(operand, 1);
+    return shift16() + reg.y;
 }
 
-static void bbr2(operand_t operand)
+static inline addr_t ea_ind(void)
 {
-    bbr_(operand, 2);
+    return abs_pointer(shift16());
 }
 
-static void bbr3(operand_t operand)
+static inline addr_t ea_absxind(void)
 {
-    bbr_(operand, 3);
+    return abs_pointer(shift16() + reg.x);
 }
 
-static void bbr4(operand_t operand)
+static inline addr_t ea_zpxind(void)
 {
-    bbr_(operand, 4);
+    return zp_pointer(shift() + reg.x);
 }
 
-static void bbr5(operand_t operand)
+static inline addr_t ea_zpind(void)
 {
-    bbr_(operand, 5);
+    return zp_pointer(shift());
 }
 
-static void bbr6(operand_t operand)
+static inline addr_t ea_zpindy(void)
 {
-    bbr_(operand, 6);
+    return zp_pointer(shift()) + reg.y;
 }
 
-static void bbr7(operand_t operand)
+/*
+ * Operand loads for read instructions. Indexed reads take an extra cycle when
+ * indexing crosses a page boundary. Writes and read-modify-writes always take
+ * that cycle, so it is part of their base cycle count instead.
+ */
+static inline word_t load_indexed(addr_t base, word_t index)
 {
-    bbr_(operand, 7);
+    addr_t addr = base + index;
+
+    if ((base ^ addr) >> 8)
+    {
+#if CPU_VARIANT == CPU_NMOS
+        /* The NMOS 6502 reads the address before the carry into the high byte */
+        mem_dummy_read((base & 0xFF00) | (addr & 0x00FF));
+#else
+        /* The 65C02 rereads the last instruction byte during the extra cycle */
+        mem_dummy_read(reg.pc - 1);
+#endif
+        cpu_cycles++;
+    }
+
+    return mem_read(addr);
 }
 
-/* BBS: Branch on bit set */
-static void bbs_(operand_t operand, int nr)
+static inline word_t load_imm(void)
 {
-    /* TODO: review this */
-    if (load(operand) & BIT(nr))
-        reg.pc = addr(operand);
+    return shift();
 }
 
-static void bbs0(operand_t operand)
+static inline word_t load_absx(void)
 {
-    bbs_(operand, 0);
+    return load_indexed(shift16(), reg.x);
 }
-static void bbs1(operand_t operand)
+
+static inline word_t load_absy(void)
 {
-    bbs_(operand, 1);
+    return load_indexed(shift16(), reg.y);
 }
-static void bbs2(operand_t operand)
+
+static inline word_t load_zpindy(void)
 {
-    bbs_(operand, 2);
+    return load_indexed(zp_pointer(shift()), reg.y);
 }
-static void bbs3(operand_t operand)
+
+#define DEFINE_LOAD(mode)                                                                          \
+    static inline word_t load_##mode(void)                                                         \
+    {                                                                                              \
+        return mem_read(ea_##mode());                                                              \
+    }
+
+DEFINE_LOAD(zp)
+DEFINE_LOAD(zpx)
+DEFINE_LOAD(zpy)
+DEFINE_LOAD(abs)
+DEFINE_LOAD(zpxind)
+DEFINE_LOAD(zpind)
+
+/* Taken branches take an extra cycle, and one more if they cross a page */
+static inline void branch(int8_t offset)
 {
-    bbs_(operand, 3);
+    addr_t target = reg.pc + offset;
+
+    mem_dummy_read(reg.pc);
+    cpu_cycles++;
+
+    if ((reg.pc ^ target) >> 8)
+    {
+        mem_dummy_read(reg.pc);
+        cpu_cycles++;
+    }
+
+    reg.pc = target;
 }
-static void bbs4(operand_t operand)
+
+/*
+ * Operations now follow. Their signature depends on the kind of instruction:
+ *
+ *   read:              void op(word_t value)
+ *   write:             word_t op(void), returns the value to store
+ *   read-modify-write: word_t op(word_t value), returns the value to store
+ *   write, by address: word_t op(addr_t addr), returns the value to store
+ *   implied:           void op(void)
+ *   branch:            bool op(void), returns whether to branch
+ *   bit branch:        bool op(word_t value), returns whether to branch
+ *   jump:              void op(addr_t addr)
+ */
+
+/*
+ * Binary addition, shared by ADC and SBC. Overflow is set when both operands
+ * have the same sign and the result has the other one.
+ */
+static inline void add_binary(word_t value)
 {
-    bbs_(operand, 4);
+    uint16_t result = reg.a + value + reg.p.c;
+
+    reg.p.c = result & BIT(8);
+    reg.p.v = ~(reg.a ^ value) & (reg.a ^ result) & BIT(7);
+    reg.a = result & 0xFF;
+
+    set_nz(reg.a);
 }
-static void bbs5(operand_t operand)
+
+/* ADC: Add with carry */
+static inline void adc(word_t value)
 {
-    bbs_(operand, 5);
+    int lo, result;
+
+    if (!reg.p.d)
+    {
+        add_binary(value);
+        return;
+    }
+
+    /*
+     * Decimal mode, see http://6502.org/tutorials/decimal_mode.html. The
+     * 65C02 takes an extra cycle for it and, unlike the NMOS 6502, sets N and
+     * Z from the decimal result.
+     */
+    lo = (reg.a & 0x0F) + (value & 0x0F) + reg.p.c;
+    if (lo >= 0x0A)
+        lo = ((lo + 0x06) & 0x0F) + 0x10;
+
+    result = (int8_t)(reg.a & 0xF0) + (int8_t)(value & 0xF0) + lo;
+    reg.p.v = result < -128 || result > 127;
+
+    result = (reg.a & 0xF0) + (value & 0xF0) + lo;
+#if CPU_VARIANT == CPU_NMOS
+    /* N is taken before the high digit is adjusted, Z from the binary sum */
+    reg.p.n = result & BIT(7);
+    reg.p.z = !((reg.a + value + reg.p.c) & 0xFF);
+#endif
+    if (result >= 0xA0)
+        result += 0x60;
+
+    reg.p.c = result >= 0x100;
+    reg.a = result & 0xFF;
+#if CPU_CMOS
+    set_nz(reg.a);
+    cpu_cycles++;
+#endif
 }
-static void bbs6(operand_t operand)
+
+/* AND: Logical AND */
+static inline void and (word_t value)
 {
-    bbs_(operand, 6);
+    reg.a &= value;
+
+    set_nz(reg.a);
 }
-static void bbs7(operand_t operand)
+
+/* ASL: Arithmetic shift left */
+static inline word_t asl(word_t value)
 {
-    bbs_(operand, 7);
+    uint16_t result = value << 1;
+
+    /* set carry flag */
+    reg.p.c = result & BIT(8);
+
+    set_nz(result & 0xFF);
+    return result & 0xFF;
 }
 
+/* BBR: Branch on bit reset */
+/* BBS: Branch on bit set */
+#define DEFINE_BBR_BBS(nr)                                                                         \
+    static inline bool bbr##nr(word_t value)                                                       \
+    {                                                                                              \
+        return !(value & BIT(nr));                                                                 \
+    }                                                                                              \
+                                                                                                   \
+    static inline bool bbs##nr(word_t value)                                                       \
+    {                                                                                              \
+        return value & BIT(nr);                                                                    \
+    }
+
+DEFINE_BBR_BBS(0)
+DEFINE_BBR_BBS(1)
+DEFINE_BBR_BBS(2)
+DEFINE_BBR_BBS(3)
+DEFINE_BBR_BBS(4)
+DEFINE_BBR_BBS(5)
+DEFINE_BBR_BBS(6)
+DEFINE_BBR_BBS(7)
+
 /* BCC: Branch if carry clear */
-static void bcc(operand_t operand)
+static inline bool bcc(void)
 {
-    if (!reg.p.c)
-        reg.pc = addr(operand);
+    return !reg.p.c;
 }
 
 /* BCS: Branch if carry set */
-static void bcs(operand_t operand)
+static inline bool bcs(void)
 {
-    if (reg.p.c)
-        reg.pc = addr(operand);
+    return reg.p.c;
 }
 
 /* BEQ: Branch if equal */
-static void beq(operand_t operand)
+static inline bool beq(void)
 {
-    if (reg.p.z)
-        reg.pc = addr(operand);
+    return reg.p.z;
 }
 
 /* BIT: Bit test */
-static void bit(operand_t operand)
+static inline void bit(word_t value)
 {
-    uint8_t value = load(operand);
     uint8_t result = reg.a & value;
 
     reg.p.z = !result;
@@ -249,89 +347,96 @@ static void bit(operand_t operand)
     reg.p.n = value & BIT(7);
 }
 
+/* BIT #imm only affects Z, there is no memory operand to take N and V from */
+static inline void bit_imm(word_t value)
+{
+    reg.p.z = !(reg.a & value);
+}
+
 /* BMI: Branch if minus */
-static void bmi(operand_t operand)
+static inline bool bmi(void)
 {
-    if (reg.p.n)
-        reg.pc = addr(operand);
+    return reg.p.n;
 }
 
-/* BNI: Branch if not equal */
-static void bni(operand_t operand)
+/* BNE: Branch if not equal */
+static inline bool bne(void)
 {
-    if (!reg.p.z)
-        reg.pc = addr(operand);
+    return !reg.p.z;
 }
 
 /* BPL: Branch if positive */
-static void bpl(operand_t operand)
+static inline bool bpl(void)
 {
-    if (!reg.p.n)
-        reg.pc = addr(operand);
+    return !reg.p.n;
 }
 
 /* BRA: Branch always */
-static void bra(operand_t operand)
+static inline bool bra(void)
 {
-    reg.pc = addr(operand);
+    return true;
 }
 
 /* BRK: Force interrupt */
-static void brk(operand_t operand)
+static inline void brk(void)
 {
-    (void)operand;
-    push16(reg.pc);
-    push(procstat_to_word(reg.p));
+    addr_t lo;
+
+    /* The byte after BRK is skipped, it's free for a signature */
+    cpu_call(reg.pc - 1);
+    irqlat_enter(VECTOR_IRQBRK, 0);
+    push16(reg.pc + 1);
+    push(procstat_to_word(reg.p) | BIT(4));
     reg.p.i = 1;
-    reg.pc = VECTOR_IRQBRK;
+#if CPU_CMOS
+    reg.p.d = 0;
+#endif
+
+    lo = mem_read(VECTOR_IRQBRK);
+    reg.pc = lo | (mem_read(VECTOR_IRQBRK + 1) << 8);
 }
 
 /* BVC: Branch if overflow clear */
-static void bvc(operand_t operand)
+static inline bool bvc(void)
 {
-    if (!reg.p.v)
-        reg.pc = addr(operand);
+    return !reg.p.v;
 }
 
 /* BVS: Branch if overflow set */
-static void bvs(operand_t operand)
+static inline bool bvs(void)
 {
-    if (reg.p.v)
-        reg.pc = addr(operand);
+    return reg.p.v;
 }
 
 /* CLC: Clear carry flag */
-static void clc(operand_t operand)
+static inline void clc(void)
 {
-    (void)operand;
     reg.p.c = 0;
 }
 
 /* CLD: Clear decimal mode */
-static void cld(operand_t operand)
+static inline void cld(void)
 {
-    (void)operand;
     reg.p.d = 0;
 }
 
 /* CLI: Clear interrupt disable */
-static void cli(operand_t operand)
+static inline void cli(void)
 {
-    (void)operand;
     reg.p.i = 0;
+    irq_unmasked();
 }
 
 /* CLV: Clear overflow flag */
-static void clv(operand_t operand)
+static inline void clv(void)
 {
-    (void)operand;
     reg.p.v = 0;
 }
 
 /* CMP: Compare */
-static void cmp(operand_t operand)
+static inline void cmp(word_t value)
 {
-    int16_t result = reg.a - load(operand);
+    int16_t result = reg.a - value;
 
     reg.p.c = result >= 0;
     reg.p.z = result == 0;
@@ -339,9 +444,9 @@ static void cmp(operand_t operand)
 }
 
 /* CPX: Compare X register */
-static void cpx(operand_t operand)
+static inline void cpx(word_t value)
 {
-    int16_t result = reg.x - load(operand);
+    int16_t result = reg.x - value;
 
     reg.p.c = result >= 0;
     reg.p.z = result == 0;
@@ -349,9 +454,9 @@ static void cpx(operand_t operand)
 }
 
 /* CPY: Compare Y register */
-static void cpy(operand_t operand)
+static inline void cpy(word_t value)
 {
-    int16_t result = reg.y - load(operand);
+    int16_t result = reg.y - value;
 
     reg.p.c = result >= 0;
     reg.p.z = result == 0;
@@ -359,714 +464,1307 @@ static void cpy(operand_t operand)
 }
 
 /* DEC: Decrement memory */
-static void dec(operand_t operand)
+static inline word_t dec(word_t value)
 {
-    uint8_t result = load(operand) - 1;
+    uint8_t result = value - 1;
 
-    reg.p.z = !result;
-    reg.p.n = result & BIT(7);
-    store(operand, result);
+    set_nz(result);
+    return result;
 }
 
 /* DEX: Decrement X register */
-static void dex(operand_t operand)
+static inline void dex(void)
 {
-    (void)operand;
     reg.x--;
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    set_nz(reg.x);
 }
 
 /* DEY: Decrement Y register */
-static void dey(operand_t operand)
+static inline void dey(void)
 {
-    (void)operand;
     reg.y--;
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+    set_nz(reg.y);
 }
 
 /* EOR: Exclusive OR */
-static void eor(operand_t operand)
+static inline void eor(word_t value)
 {
-    reg.a ^= load(operand);
+    reg.a ^= value;
 
-    reg.p.z = !reg.a;
-    reg.p.n = reg.a & BIT(7);
+    set_nz(reg.a);
 }
 
 /* INC: Increment memory */
-static void inc(operand_t operand)
+static inline word_t inc(word_t value)
 {
-    uint8_t result = load(operand) + 1;
+    uint8_t result = value + 1;
 
-    reg.p.z = !result;
-    reg.p.n = result & BIT(7);
-    store(operand, result);
+    set_nz(result);
+    return result;
 }
 
 /* INX: Increment X register */
-static void inx(operand_t operand)
+static inline void inx(void)
 {
-    (void)operand;
     reg.x++;
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    set_nz(reg.x);
 }
 
 /* INY: Increment Y register */
-static void iny(operand_t operand)
+static inline void iny(void)
 {
-    (void)operand;
     reg.y++;
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+    set_nz(reg.y);
 }
 
 /* JMP: Jump */
-static void jmp(operand_t operand)
+static inline void jmp(addr_t addr)
 {
-    reg.pc = addr(operand);
+    reg.pc = addr;
 }
 
 /* JSR: Jump to subroutine */
-static void jsr(operand_t operand)
+static inline void jsr(addr_t addr)
 {
+    /* The last byte of the JSR, the return address may be in the next routine */
+    cpu_call(reg.pc - 1);
     push16(reg.pc - 1);
-    reg.pc = addr(operand);
+    reg.pc = addr;
 }
 
 /* LDA: Load accumulator */
 /* NOTE:
  * https://retrocomputing.stackexchange.com/questions/145/why-does-6502-indexed-lda-take-an-extra-cycle-at-page-boundaries
  */
-static void lda(operand_t operand)
+static inline void lda(word_t value)
 {
-    reg.a = load(operand);
+    reg.a = value;
 
-    reg.p.z = !reg.a;
-    reg.p.n = reg.a & BIT(7);
+    set_nz(reg.a);
 }
 
 /* LDX: Load X register */
-static void ldx(operand_t operand)
+static inline void ldx(word_t value)
 {
-    reg.x = load(operand);
+    reg.x = value;
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    set_nz(reg.x);
 }
 
 /* LDY: Load Y register */
-static void ldy(operand_t operand)
+static inline void ldy(word_t value)
 {
-    reg.y = load(operand);
+    reg.y = value;
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+    set_nz(reg.y);
 }
 
 /* LSR: Logical shift right */
-static void lsr(operand_t operand)
+static inline word_t lsr(word_t value)
 {
-    uint8_t word = load(operand);
+    uint8_t result = value >> 1;
 
-    reg.p.c = word & BIT(0);
-    reg.a = word >> 1;
-    reg.p.z = !reg.a;
-    reg.p.n = reg.a & BIT(7);
+    reg.p.c = value & BIT(0);
+    set_nz(result);
+    return result;
 }
 
 /* NOP: No operation */
-static void nop(operand_t operand)
+static inline void nop(void)
 {
-    (void)operand;
+}
+
+/*
+ * The 65C02 defines all undocumented opcodes as NOPs, and so do a few of the
+ * NMOS 6502's. Some of them have operands, which are read and discarded.
+ */
+static inline void nop_read(word_t value)
+{
+    (void)value;
 }
 
 /* ORA: Logical inclusive OR */
-static void ora(operand_t operand)
+static inline void ora(word_t value)
 {
-    reg.a |= load(operand);
+    reg.a |= value;
 
-    reg.p.z = !reg.a;
-    reg.p.n = reg.a & BIT(7);
+    set_nz(reg.a);
 }
 
 /* PHA: Push accumulator */
-static void pha(operand_t operand)
+static inline void pha(void)
 {
-    (void)operand;
     push(reg.a);
 }
 
 /* PHP: Push processor status */
-static void php(operand_t operand)
+static inline void php(void)
 {
-    (void)operand;
-    push(procstat_to_word(reg.p));
+    push(procstat_to_word(reg.p) | BIT(4));
 }
 
 /* PHX: Push X register */
-static void phx(operand_t operand)
+static inline void phx(void)
 {
-    (void)operand;
     push(reg.x);
 }
 
 /* PHY: Push Y register */
-static void phy(operand_t operand)
+static inline void phy(void)
 {
-    (void)operand;
     push(reg.y);
 }
 
 /* PLA: Pull accumulator */
-static void pla(operand_t operand)
+static inline void pla(void)
 {
-    (void)operand;
     reg.a = pop();
 
-    reg.p.z = !reg.a;
-    reg.p.n = reg.a & BIT(7);
+    set_nz(reg.a);
 }
 
 /* PLP: Pull processor status */
-static void plp(operand_t operand)
+static inline void plp(void)
 {
-    (void)operand;
-    reg.p = word_to_procstat(pop());
+    /* B isn't a flag of its own, it only exists in pushed copies of P */
+    reg.p = word_to_procstat(pop() | BIT(4));
+    irq_unmasked();
 }
 
 /* PLX: Pull X register */
-static void plx(operand_t operand)
+static inline void plx(void)
 {
-    (void)operand;
     reg.x = pop();
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    set_nz(reg.x);
 }
 
 /* PLY: Pull Y register */
-static void ply(operand_t operand)
+static inline void ply(void)
 {
-    (void)operand;
     reg.y = pop();
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+    set_nz(reg.y);
 }
 
 /* RMB: Reset memory bit */
-static void rmb_(operand_t operand, int nr)
+/* SMB: Set memory bit */
+#define DEFINE_RMB_SMB(nr)                                                                         \
+    static inline word_t rmb##nr(word_t value)                                                     \
+    {                                                                                              \
+        return value & ~BIT(nr);                                                                   \
+    }                                                                                              \
+                                                                                                   \
+    static inline word_t smb##nr(word_t value)                                                     \
+    {                                                                                              \
+        return value | BIT(nr);                                                                    \
+    }
+
+DEFINE_RMB_SMB(0)
+DEFINE_RMB_SMB(1)
+DEFINE_RMB_SMB(2)
+DEFINE_RMB_SMB(3)
+DEFINE_RMB_SMB(4)
+DEFINE_RMB_SMB(5)
+DEFINE_RMB_SMB(6)
+DEFINE_RMB_SMB(7)
+
+/* ROL: Rotate left */
+static inline word_t rol(word_t value)
 {
-    store(operand, load(operand) & ~BIT(nr));
+    uint16_t result = (value << 1) | reg.p.c;
+
+    reg.p.c = result & BIT(8);
+    set_nz(result & 0xFF); /* restrict test to lower 8 bits */
+    return result & 0xFF;
 }
 
-static void rmb0(operand_t operand)
+/* ROR: Rotate right */
+static inline word_t ror(word_t value)
 {
-    rmb_(operand, 0);
+    uint8_t result = (value >> 1) | (reg.p.c << 7);
+
+    reg.p.c = value & BIT(0);
+    set_nz(result);
+    return result;
 }
 
-static void rmb1(operand_t operand)
+/* RTI: Return from interrupt */
+static inline void rti(void)
 {
-    rmb_(operand, 1);
+    addr_t from = reg.pc;
+
+    reg.p = word_to_procstat(pop() | BIT(4));
+    reg.pc = pop16();
+    cpu_return();
+    irqlat_return();
+    edge(from, reg.pc);
+    irq_unmasked();
 }
 
-static void rmb2(operand_t operand)
+/* RTS: Return from subroutine */
+static inline void rts(void)
 {
-    rmb_(operand, 2);
+    addr_t from = reg.pc;
+
+    reg.pc = pop16() + 1;
+    cpu_return();
+    edge(from, reg.pc);
 }
 
-static void rmb3(operand_t operand)
+/* SBC: Subtract with carry */
+static inline void sbc(word_t value)
 {
-    rmb_(operand, 3);
+    int lo, result;
+
+    if (!reg.p.d)
+    {
+        add_binary(~value);
+        return;
+    }
+
+#if CPU_VARIANT == CPU_NMOS
+    /* Decimal mode. All the flags are those of the binary subtraction. */
+    lo = (reg.a & 0x0F) - (value & 0x0F) + reg.p.c - 1;
+    if (lo < 0)
+        lo = ((lo - 0x06) & 0x0F) - 0x10;
+
+    result = (reg.a & 0xF0) - (value & 0xF0) + lo;
+    if (result < 0)
+        result -= 0x60;
+
+    add_binary(~value);
+    reg.a = result & 0xFF;
+#else
+    /* Decimal mode. C and V are the same as for the binary subtraction. */
+    lo = (reg.a & 0x0F) - (value & 0x0F) + reg.p.c - 1;
+    result = reg.a - value + reg.p.c - 1;
+
+    reg.p.c = result >= 0;
+    reg.p.v = (reg.a ^ value) & (reg.a ^ result) & BIT(7);
+
+    if (result < 0)
+        result -= 0x60;
+    if (lo < 0)
+        result -= 0x06;
+
+    reg.a = result & 0xFF;
+    set_nz(reg.a);
+    cpu_cycles++;
+#endif
 }
 
-static void rmb4(operand_t operand)
+/* SEC: Set carry flag */
+static inline void sec(void)
 {
-    rmb_(operand, 4);
+    reg.p.c = 1;
 }
 
-static void rmb5(operand_t operand)
+/* SED: Set decimal flag */
+static inline void sed(void)
 {
-    rmb_(operand, 5);
+    reg.p.d = 1;
 }
 
-static void rmb6(operand_t operand)
+/* SEI: Set interrupt disable */
+static inline void sei(void)
 {
-    rmb_(operand, 6);
+    reg.p.i = 1;
 }
 
-static void rmb7(operand_t operand)
+/* STA: Store accumulator */
+static inline word_t sta(void)
 {
-    rmb_(operand, 7);
+    return reg.a;
 }
 
-/* ROL: Rotate left */
-static void rol(operand_t operand)
+/* STP: Stop the clock until reset */
+static inline void stp(void)
 {
-    uint16_t result = (load(operand) << 1) | reg.p.c;
-
-    reg.p.c = result & BIT(8);
-    reg.p.z = !(result & 0xFF); /* restrict test to lower 8 bits */
-    reg.p.n = result & BIT(7);
-    store(operand, result & 0xFF);
+    cpu_state = CPU_STOPPED;
+    sched_kick();
 }
 
-/* ROR: Rotate right */
-static void ror(operand_t operand)
+/* STX: Store X register */
+static inline word_t stx(void)
 {
-    uint8_t tmp = load(operand);
-    uint8_t result = (tmp >> 1) | (reg.p.c << 7);
-
-    reg.p.c = tmp & BIT(0);
-    reg.p.z = !result;
-    reg.p.n = result & BIT(7);
-    store(operand, result);
+    return reg.x;
 }
 
-/* RTI: Return from interrupt */
-static void rti(operand_t operand)
+/* STY: Store Y register */
+static inline word_t sty(void)
 {
-    (void)operand;
-    reg.p = word_to_procstat(pop());
-    reg.pc = pop16();
+    return reg.y;
 }
 
-/* RTS: Return from subroutine */
-static void rts(operand_t operand)
+/* STZ: Store zero */
+static inline word_t stz(void)
 {
-    (void)operand;
-    reg.pc = pop16() + 1;
+    return 0;
 }
 
-/* SBC: Subtract with carry */
-static void sbc(operand_t operand)
+/* TAX: Transfer accumulator to X */
+static inline void tax(void)
 {
-    uint8_t carry = reg.p.c;
-    uint16_t result;
-
-    result = reg.a - load(operand) - (1 - carry);
-    reg.a = result & 0xFF;
-
-    /* set carry flag */
-    reg.p.c = result & BIT(8);
-
-    /* set overflow flag
-     *
-     * This follows the same XORing logic as in ADC.
-     */
-    reg.p.v = (result & BIT(8)) ^ (result & BIT(7));
+    reg.x = reg.a;
 
-    reg.p.z = !result;
-    reg.p.n = result & BIT(7);
+    set_nz(reg.x);
 }
 
-/* SEC: Set carry flag */
-static void sec(operand_t operand)
+/* TAY: Transfer accumulator to Y */
+static inline void tay(void)
 {
-    (void)operand;
-    reg.p.c = 1;
+    reg.y = reg.a;
+
+    set_nz(reg.y);
 }
 
-/* SED: Set decimal flag */
-static void sed(operand_t operand)
+/* TRB: Test and reset bits */
+static inline word_t trb(word_t value)
 {
-    (void)operand;
-    reg.p.d = 1;
+    reg.p.z = !(value & reg.a);
+    return value & ~reg.a;
 }
 
-/* SEI: Set interrupt disable */
-static void sei(operand_t operand)
+/* TSB: Test and set bits */
+static inline word_t tsb(word_t value)
 {
-    (void)operand;
-    reg.p.i = 1;
+    reg.p.z = !(value & reg.a);
+    return value | reg.a;
 }
 
-/* SMB: Set memory bit */
-static void smb_(operand_t operand, int nr)
+/* TSX: Transfer stack pointer to X */
+static inline void tsx(void)
 {
-    store(operand, load(operand) | BIT(nr));
+    reg.x = reg.s;
+
+    set_nz(reg.x);
 }
 
-static void smb0(operand_t operand)
+/* TXA: Transfer X to accumulator */
+static inline void txa(void)
 {
-    smb_(operand, 0);
+    reg.a = reg.x;
+
+    set_nz(reg.a);
 }
 
-static void smb1(operand_t operand)
+/* TXS: Transfer X to stack pointer */
+static inline void txs(void)
 {
-    smb_(operand, 1);
+    reg.s = reg.x;
 }
 
-static void smb2(operand_t operand)
+/* TYA: Transfer Y to accumulator */
+static inline void tya(void)
 {
-    smb_(operand, 2);
+    reg.a = reg.y;
+
+    set_nz(reg.a);
 }
 
-static void smb3(operand_t operand)
+/* WAI: Wait for interrupt */
+static inline void wai(void)
 {
-    smb_(operand, 3);
+    cpu_state = CPU_WAITING;
+    sched_kick();
 }
 
-static void smb4(operand_t operand)
+/*
+ * Undocumented operations of the NMOS 6502, reference:
+ * https://www.masswerk.at/nowgobang/2021/6502-illegal-opcodes
+ *
+ * Most combine two documented ones that share a row of the opcode matrix.
+ * The unstable ones depend on the chip and its temperature, what's here is
+ * the usual behaviour.
+ */
+
+/* The high byte of the address before indexing, plus one */
+static inline word_t high_plus_one(addr_t addr, word_t index)
 {
-    smb_(operand, 4);
+    return ((addr_t)(addr - index) >> 8) + 1;
 }
 
-static void smb5(operand_t operand)
+/* ALR: AND, then LSR A */
+static inline void alr(word_t value)
 {
-    smb_(operand, 5);
+    and(value);
+    reg.a = lsr(reg.a);
 }
 
-static void smb6(operand_t operand)
+/* ANC: AND, with bit 7 copied into carry */
+static inline void anc(word_t value)
 {
-    smb_(operand, 6);
+    and(value);
+    reg.p.c = reg.p.n;
 }
 
-static void smb7(operand_t operand)
+/* ANE: AND X, through a constant that varies between chips */
+static inline void ane(word_t value)
 {
-    smb_(operand, 7);
+    reg.a = (reg.a | 0xEE) & reg.x & value;
+
+    set_nz(reg.a);
 }
 
-/* STA: Store accumulator */
-static void sta(operand_t operand)
+/* ARR: AND, then ROR A with C and V from bits 6 and 5 */
+static inline void arr(word_t value)
 {
-    store(operand, reg.a);
+    uint8_t result = reg.a & value;
+
+    reg.a = (result >> 1) | (reg.p.c << 7);
+    if (!reg.p.d)
+    {
+        set_nz(reg.a);
+        reg.p.c = reg.a & BIT(6);
+        reg.p.v = (reg.a ^ (reg.a << 1)) & BIT(6);
+        return;
+    }
+
+    /* Decimal mode fixes up each digit of the AND, ADC style */
+    reg.p.n = reg.p.c;
+    reg.p.z = !reg.a;
+    reg.p.v = (result ^ reg.a) & BIT(6);
+
+    if ((result & 0x0F) + (result & 0x01) > 0x05)
+        reg.a = (reg.a & 0xF0) | ((reg.a + 0x06) & 0x0F);
+
+    reg.p.c = (result & 0xF0) + (result & 0x10) > 0x50;
+    if (reg.p.c)
+        reg.a += 0x60;
 }
 
-/* STP: Stop */
-static void stp(operand_t operand)
+/* DCP: DEC, then CMP */
+static inline word_t dcp(word_t value)
 {
-    (void)operand;
-    /* TODO: Implement this */
+    value = dec(value);
+    cmp(value);
+    return value;
 }
 
-/* STX: Store X register */
-static void stx(operand_t operand)
+/* ISC: INC, then SBC */
+static inline word_t isc(word_t value)
 {
-    store(operand, reg.x);
+    value = inc(value);
+    sbc(value);
+    return value;
 }
 
-/* STY: Store Y register */
-static void sty(operand_t operand)
+/* JAM: Lock up until reset, the bus keeps cycling */
+static inline void jam(void)
 {
-    store(operand, reg.y);
+    cpu_state = CPU_STOPPED;
+    sched_kick();
 }
 
-/* STZ: Store zero */
-static void stz(operand_t operand)
+/* LAS: AND with S into A, X and S */
+static inline void las(word_t value)
 {
-    store(operand, 0);
+    reg.a = reg.x = reg.s = reg.s & value;
+
+    set_nz(reg.a);
 }
 
-/* TAX: Transfer accumulator to X */
-static void tax(operand_t operand)
+/* LAX: LDA and LDX at once */
+static inline void lax(word_t value)
 {
-    (void)operand;
-    reg.x = reg.a;
+    reg.a = reg.x = value;
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    set_nz(reg.a);
 }
 
-/* TAY: Transfer accumulator to Y */
-static void tay(operand_t operand)
+/* LXA: LAX, through the same constant as ANE */
+static inline void lxa(word_t value)
 {
-    (void)operand;
-    reg.y = reg.a;
+    reg.a = reg.x = (reg.a | 0xEE) & value;
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+    set_nz(reg.a);
 }
 
-/* TRB: Test and reset bits */
-static void trb(operand_t operand)
+/* RLA: ROL, then AND */
+static inline word_t rla(word_t value)
 {
-    uint8_t word = load(operand);
-
-    reg.p.z = word & reg.a;
-    store(operand, word & ~reg.a);
+    value = rol(value);
+    and(value);
+    return value;
 }
 
-/* TSB: Test and set bits */
-static void tsb(operand_t operand)
+/* RRA: ROR, then ADC */
+static inline word_t rra(word_t value)
 {
-    uint8_t word = load(operand);
+    value = ror(value);
+    adc(value);
+    return value;
+}
 
-    reg.p.z = word & reg.a;
-    store(operand, word | reg.a);
+/* SAX: Store A AND X */
+static inline word_t sax(void)
+{
+    return reg.a & reg.x;
 }
 
-/* TSX: Transfer stack pointer to X */
-static void tsx(operand_t operand)
+/* SBX: X = (A AND X) - operand, flags as for CMP */
+static inline void sbx(word_t value)
 {
-    (void)operand;
-    reg.x = reg.s;
+    int16_t result = (reg.a & reg.x) - value;
 
-    reg.p.z = !reg.x;
-    reg.p.n = reg.x & BIT(7);
+    reg.p.c = result >= 0;
+    reg.x = result & 0xFF;
+    set_nz(reg.x);
 }
 
-/* TSY: Transfer stack pointer to Y */
-static void tsy(operand_t operand)
+/*
+ * SHA, SHX, SHY and TAS store a register ANDed with the high byte of the
+ * address plus one. When indexing crosses a page the real chip also takes the
+ * high byte of the address from the stored value, which isn't emulated.
+ */
+
+/* SHA: Store A AND X AND H+1 */
+static inline word_t sha(addr_t addr)
 {
-    (void)operand;
-    reg.y = reg.s;
+    return reg.a & reg.x & high_plus_one(addr, reg.y);
+}
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.y & BIT(7);
+/* SHX: Store X AND H+1 */
+static inline word_t shx(addr_t addr)
+{
+    return reg.x & high_plus_one(addr, reg.y);
 }
 
-/* TXS: Transfer X to stack pointer */
-static void txs(operand_t operand)
+/* SHY: Store Y AND H+1 */
+static inline word_t shy(addr_t addr)
 {
-    (void)operand;
-    reg.s = reg.x;
+    return reg.y & high_plus_one(addr, reg.x);
 }
 
-/* TYA: Transfer Y to accumulator */
-static void tya(operand_t operand)
+/* SLO: ASL, then ORA */
+static inline word_t slo(word_t value)
 {
-    (void)operand;
-    reg.a = reg.y;
+    value = asl(value);
+    ora(value);
+    return value;
+}
 
-    reg.p.z = !reg.y;
-    reg.p.n = reg.a & BIT(7);
+/* SRE: LSR, then EOR */
+static inline word_t sre(word_t value)
+{
+    value = lsr(value);
+    eor(value);
+    return value;
 }
 
-/* WAI: Wait for interrupt */
-static void wai(operand_t operand)
+/* TAS: S = A AND X, then store S AND H+1 */
+static inline word_t tas(addr_t addr)
 {
-    (void)operand;
-    /* TODO: Implement this */
-    reg.p.b = 1;
+    reg.s = reg.a & reg.x;
+    return reg.s & high_plus_one(addr, reg.y);
 }
 
-op_desc_t ops[] = {
-    /*
-     * TODO: Fill in the "blanks" with NOP
-     */
-    [0x69] = { adc, ADDR_MODE_IMMEDIATE },
-    [0x65] = { adc, ADDR_MODE_ZEROPAGE },
-    [0x75] = { adc, ADDR_MODE_ZEROPAGE_X },
-    [0x6D] = { adc, ADDR_MODE_ABSOLUTE },
-    [0x7D] = { adc, ADDR_MODE_ABSOLUTE_X },
-    [0x79] = { adc, ADDR_MODE_ABSOLUTE_Y },
-    [0x61] = { adc, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0x71] = { adc, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0x72] = { adc, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0x29] = { and, ADDR_MODE_IMMEDIATE },
-    [0x25] = { and, ADDR_MODE_ZEROPAGE },
-    [0x35] = { and, ADDR_MODE_ZEROPAGE_X },
-    [0x2D] = { and, ADDR_MODE_ABSOLUTE },
-    [0x3D] = { and, ADDR_MODE_ABSOLUTE_X },
-    [0x39] = { and, ADDR_MODE_ABSOLUTE_Y },
-    [0x21] = { and, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0x31] = { and, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0x32] = { and, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0x0A] = { asl, ADDR_MODE_ACCUMULATOR },
-    [0x06] = { asl, ADDR_MODE_ZEROPAGE },
-    [0x16] = { asl, ADDR_MODE_ZEROPAGE_X },
-    [0x0E] = { asl, ADDR_MODE_ABSOLUTE },
-    [0x1E] = { asl, ADDR_MODE_ABSOLUTE_X },
-    /*
-     * TODO: Add now BBRn instructions, which actually use a combination of the
-     * addressing modes zero page and relative: zp,r. TODO: Check if the 3rd
-     * byte (relative) is even read if branch condition is false. See
-     * http://6502.org/tutorials/65c02opcodes.html for more info.
-     */
-    [0x0F] = { bbr0, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x1F] = { bbr1, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x2F] = { bbr2, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x3F] = { bbr3, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x4F] = { bbr4, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x5F] = { bbr5, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x6F] = { bbr6, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x7F] = { bbr7, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x8F] = { bbs0, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x9F] = { bbs1, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xAF] = { bbs2, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xBF] = { bbs3, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xCF] = { bbs4, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xDF] = { bbs5, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xEF] = { bbs6, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0xFF] = { bbs7, ADDR_MODE_ZEROPAGE_RELATIVE },
-    [0x90] = { bcc, ADDR_MODE_RELATIVE },
-    [0xB0] = { bcs, ADDR_MODE_RELATIVE },
-    [0xF0] = { beq, ADDR_MODE_RELATIVE },
-    [0x30] = { bmi, ADDR_MODE_RELATIVE },
-    [0xD0] = { bni, ADDR_MODE_RELATIVE },
-    [0x10] = { bpl, ADDR_MODE_RELATIVE },
-    [0x80] = { bra, ADDR_MODE_RELATIVE },
-    [0x50] = { bvc, ADDR_MODE_RELATIVE },
-    [0x70] = { bvs, ADDR_MODE_RELATIVE },
-    [0x89] = { bit, ADDR_MODE_IMMEDIATE },
-    [0x24] = { bit, ADDR_MODE_ZEROPAGE },
-    [0x34] = { bit, ADDR_MODE_ZEROPAGE },
-    [0x2C] = { bit, ADDR_MODE_ABSOLUTE },
-    [0x3C] = { bit, ADDR_MODE_ABSOLUTE_X },
-    [0x00] = { brk, ADDR_MODE_IMPLIED },
-    [0x18] = { clc, ADDR_MODE_IMPLIED },
-    [0xD8] = { cld, ADDR_MODE_IMPLIED },
-    [0x58] = { cli, ADDR_MODE_IMPLIED },
-    [0xB8] = { clv, ADDR_MODE_IMPLIED },
-    [0xC9] = { cmp, ADDR_MODE_IMMEDIATE },
-    [0xC5] = { cmp, ADDR_MODE_ZEROPAGE },
-    [0xD5] = { cmp, ADDR_MODE_ZEROPAGE_X },
-    [0xCD] = { cmp, ADDR_MODE_ABSOLUTE },
-    [0xDD] = { cmp, ADDR_MODE_ABSOLUTE_X },
-    [0xD9] = { cmp, ADDR_MODE_ABSOLUTE_Y },
-    [0xC1] = { cmp, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0xD1] = { cmp, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0xD2] = { cmp, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0xE0] = { cpx, ADDR_MODE_IMMEDIATE },
-    [0xE4] = { cpx, ADDR_MODE_ZEROPAGE },
-    [0xEC] = { cpx, ADDR_MODE_ABSOLUTE },
-    [0xC0] = { cpy, ADDR_MODE_IMMEDIATE },
-    [0xC4] = { cpy, ADDR_MODE_ZEROPAGE },
-    [0xCC] = { cpy, ADDR_MODE_ABSOLUTE },
-    [0x3A] = { dec, ADDR_MODE_ACCUMULATOR },
-    [0xC6] = { dec, ADDR_MODE_ZEROPAGE },
-    [0xD6] = { dec, ADDR_MODE_ZEROPAGE_X },
-    [0xCE] = { dec, ADDR_MODE_ABSOLUTE },
-    [0xDE] = { dec, ADDR_MODE_ABSOLUTE_X },
-    [0xCA] = { dex, ADDR_MODE_IMPLIED },
-    [0x88] = { dey, ADDR_MODE_IMPLIED },
-    [0x49] = { eor, ADDR_MODE_IMMEDIATE },
-    [0x45] = { eor, ADDR_MODE_ZEROPAGE },
-    [0x55] = { eor, ADDR_MODE_ZEROPAGE_X },
-    [0x4D] = { eor, ADDR_MODE_ABSOLUTE },
-    [0x5D] = { eor, ADDR_MODE_ABSOLUTE_X },
-    [0x59] = { eor, ADDR_MODE_ABSOLUTE_Y },
-    [0x41] = { eor, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0x51] = { eor, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0x52] = { eor, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0x1A] = { inc, ADDR_MODE_ACCUMULATOR },
-    [0xE6] = { inc, ADDR_MODE_ZEROPAGE },
-    [0xF6] = { inc, ADDR_MODE_ZEROPAGE_X },
-    [0xEE] = { inc, ADDR_MODE_ABSOLUTE },
-    [0xFE] = { inc, ADDR_MODE_ABSOLUTE_X },
-    [0xE8] = { inx, ADDR_MODE_IMPLIED },
-    [0xC8] = { iny, ADDR_MODE_IMPLIED },
-    [0x4C] = { jmp, ADDR_MODE_ABSOLUTE },
-    [0x6C] = { jmp, ADDR_MODE_ABSOLUTE_INDIRECT },
-    [0x7C] = { jmp, ADDR_MODE_ABSOLUTE_INDEXED_INDIRECT },
-    [0x20] = { jsr, ADDR_MODE_ABSOLUTE },
-    [0xA9] = { lda, ADDR_MODE_IMMEDIATE },
-    [0xA5] = { lda, ADDR_MODE_ZEROPAGE },
-    [0xB5] = { lda, ADDR_MODE_ZEROPAGE_X },
-    [0xAD] = { lda, ADDR_MODE_ABSOLUTE },
-    [0xBD] = { lda, ADDR_MODE_ABSOLUTE_X },
-    [0xB9] = { lda, ADDR_MODE_ABSOLUTE_Y },
-    [0xA1] = { lda, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0xB1] = { lda, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0xB2] = { lda, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0xA2] = { ldx, ADDR_MODE_IMMEDIATE },
-    [0xA6] = { ldx, ADDR_MODE_ZEROPAGE },
-    [0xB6] = { ldx, ADDR_MODE_ZEROPAGE_Y },
-    [0xAE] = { ldx, ADDR_MODE_ABSOLUTE },
-    [0xBE] = { ldx, ADDR_MODE_ABSOLUTE_Y },
-    [0xA0] = { ldy, ADDR_MODE_IMMEDIATE },
-    [0xA4] = { ldy, ADDR_MODE_ZEROPAGE },
-    [0xB4] = { ldy, ADDR_MODE_ZEROPAGE_X },
-    [0xAC] = { ldy, ADDR_MODE_ABSOLUTE },
-    [0xBC] = { ldy, ADDR_MODE_ABSOLUTE_X },
-    [0x4A] = { lsr, ADDR_MODE_ACCUMULATOR, },
-    [0x46] = { lsr, ADDR_MODE_ZEROPAGE },
-    [0x56] = { lsr, ADDR_MODE_ZEROPAGE_X },
-    [0x5E] = { lsr, ADDR_MODE_ABSOLUTE_X },
-    [0xEA] = { nop, ADDR_MODE_IMPLIED },
-    [0x09] = { ora, ADDR_MODE_IMMEDIATE },
-    [0x05] = { ora, ADDR_MODE_ZEROPAGE },
-    [0x15] = { ora, ADDR_MODE_ZEROPAGE_X },
-    [0x0D] = { ora, ADDR_MODE_ABSOLUTE },
-    [0x1D] = { ora, ADDR_MODE_ABSOLUTE_X },
-    [0x19] = { ora, ADDR_MODE_ABSOLUTE_Y },
-    [0x01] = { ora, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0x11] = { ora, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0x12] = { ora, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0x48] = { pha, ADDR_MODE_IMPLIED },
-    [0x08] = { php, ADDR_MODE_IMPLIED },
-    [0xDA] = { phx, ADDR_MODE_IMPLIED },
-    [0x5A] = { phy, ADDR_MODE_IMPLIED },
-    [0x68] = { pla, ADDR_MODE_IMPLIED },
-    [0x28] = { plp, ADDR_MODE_IMPLIED },
-    [0xFA] = { plx, ADDR_MODE_IMPLIED },
-    [0x7A] = { ply, ADDR_MODE_IMPLIED },
-    [0x07] = { rmb0, ADDR_MODE_ZEROPAGE },
-    [0x17] = { rmb1, ADDR_MODE_ZEROPAGE },
-    [0x27] = { rmb2, ADDR_MODE_ZEROPAGE },
-    [0x37] = { rmb3, ADDR_MODE_ZEROPAGE },
-    [0x47] = { rmb4, ADDR_MODE_ZEROPAGE },
-    [0x57] = { rmb5, ADDR_MODE_ZEROPAGE },
-    [0x67] = { rmb6, ADDR_MODE_ZEROPAGE },
-    [0x77] = { rmb7, ADDR_MODE_ZEROPAGE },
-    [0x2A] = { rol, ADDR_MODE_ACCUMULATOR },
-    [0x26] = { rol, ADDR_MODE_ZEROPAGE },
-    [0x36] = { rol, ADDR_MODE_ZEROPAGE_X },
-    [0x2E] = { rol, ADDR_MODE_ABSOLUTE },
-    [0x3E] = { rol, ADDR_MODE_ABSOLUTE_X },
-    [0x6A] = { ror, ADDR_MODE_ACCUMULATOR },
-    [0x66] = { ror, ADDR_MODE_ZEROPAGE },
-    [0x76] = { ror, ADDR_MODE_ZEROPAGE_X },
-    [0x6E] = { ror, ADDR_MODE_ABSOLUTE },
-    [0x7E] = { ror, ADDR_MODE_ABSOLUTE_X },
-    [0x40] = { rti, ADDR_MODE_IMPLIED },
-    [0x60] = { rts, ADDR_MODE_IMPLIED },
-    [0xE9] = { sbc, ADDR_MODE_IMMEDIATE },
-    [0xE5] = { sbc, ADDR_MODE_ZEROPAGE },
-    [0xF5] = { sbc, ADDR_MODE_ZEROPAGE_X },
-    [0xED] = { sbc, ADDR_MODE_ABSOLUTE },
-    [0xFD] = { sbc, ADDR_MODE_ABSOLUTE_X },
-    [0xF9] = { sbc, ADDR_MODE_ABSOLUTE_Y },
-    [0xE1] = { sbc, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0xF1] = { sbc, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0xF2] = { sbc, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0x38] = { sec, ADDR_MODE_IMPLIED },
-    [0xF8] = { sed, ADDR_MODE_IMPLIED },
-    [0x78] = { sei, ADDR_MODE_IMPLIED },
-    [0x87] = { smb0, ADDR_MODE_ZEROPAGE },
-    [0x97] = { smb1, ADDR_MODE_ZEROPAGE },
-    [0xA7] = { smb2, ADDR_MODE_ZEROPAGE },
-    [0xB7] = { smb3, ADDR_MODE_ZEROPAGE },
-    [0xC7] = { smb4, ADDR_MODE_ZEROPAGE },
-    [0xD7] = { smb5, ADDR_MODE_ZEROPAGE },
-    [0xE7] = { smb6, ADDR_MODE_ZEROPAGE },
-    [0xF7] = { smb7, ADDR_MODE_ZEROPAGE },
-    [0x85] = { sta, ADDR_MODE_ZEROPAGE },
-    [0x95] = { sta, ADDR_MODE_ZEROPAGE_X },
-    [0x8D] = { sta, ADDR_MODE_ABSOLUTE },
-    [0x9D] = { sta, ADDR_MODE_ABSOLUTE_X },
-    [0x99] = { sta, ADDR_MODE_ABSOLUTE_Y },
-    [0x81] = { sta, ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT },
-    [0x91] = { sta, ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED },
-    [0x92] = { sta, ADDR_MODE_ZEROPAGE_INDIRECT },
-    [0xDB] = { stp, ADDR_MODE_IMPLIED },
-    [0x86] = { stx, ADDR_MODE_ZEROPAGE },
-    [0x96] = { stx, ADDR_MODE_ZEROPAGE_Y },
-    [0x8E] = { stx, ADDR_MODE_ABSOLUTE },
-    [0x84] = { sty, ADDR_MODE_ZEROPAGE },
-    [0x94] = { sty, ADDR_MODE_ZEROPAGE_X },
-    [0x8C] = { sty, ADDR_MODE_ABSOLUTE },
-    [0x64] = { stz, ADDR_MODE_ZEROPAGE },
-    [0x74] = { stz, ADDR_MODE_ZEROPAGE_X },
-    [0x9C] = { stz, ADDR_MODE_ABSOLUTE },
-    [0x9E] = { stz, ADDR_MODE_ABSOLUTE_X },
-    [0xAA] = { tax, ADDR_MODE_IMPLIED },
-    [0xA8] = { tay, ADDR_MODE_IMPLIED },
-    [0x14] = { trb, ADDR_MODE_ZEROPAGE },
-    [0x1C] = { trb, ADDR_MODE_ABSOLUTE },
-    [0x04] = { tsb, ADDR_MODE_ZEROPAGE },
-    [0x0C] = { tsb, ADDR_MODE_ABSOLUTE },
-    [0xBA] = { tsx, ADDR_MODE_IMPLIED },
-    [0x8A] = { tsy, ADDR_MODE_IMPLIED },
-    [0x9A] = { txs, ADDR_MODE_IMPLIED },
-    [0x98] = { tya, ADDR_MODE_IMPLIED },
-    [0xCB] = { wai, ADDR_MODE_IMPLIED },
+/*
+ * The opcode tables, one per CPU_VARIANT
+ *
+ * X(kind, opcode, operation, addressing mode, cycles)
+ *
+ * Opcodes are written as two uppercase hex digits without the 0x prefix. Every
+ * opcode must appear exactly once, which is checked at compile time below.
+ */
+#if CPU_CMOS
+
+/* Rockwell's parts don't have WAI and STP, they're NOPs like the other gaps */
+#if CPU_VARIANT == CPU_ROCKWELL
+#define OPCODE_CB(X) X(IMPLIED1, CB, nop, imp, 1)
+#define OPCODE_DB(X) X(IMPLIED1, DB, nop, imp, 1)
+#else
+#define OPCODE_CB(X) X(IMPLIED, CB, wai, imp, 3)
+#define OPCODE_DB(X) X(IMPLIED, DB, stp, imp, 3)
+#endif
+
+/* Reference: http://6502.org/tutorials/65c02opcodes.html and WDC datasheet */
+#define OPCODES(X)                                                                                 \
+    X(IMPLIED, 00, brk, imp, 7)                                                                    \
+    X(READ, 01, ora, zpxind, 6)                                                                    \
+    X(READ, 02, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, 03, nop, imp, 1)                                                                   \
+    X(RMW, 04, tsb, zp, 5)                                                                         \
+    X(READ, 05, ora, zp, 3)                                                                        \
+    X(RMW, 06, asl, zp, 5)                                                                         \
+    X(RMW, 07, rmb0, zp, 5)                                                                        \
+    X(IMPLIED, 08, php, imp, 3)                                                                    \
+    X(READ, 09, ora, imm, 2)                                                                       \
+    X(RMW_A, 0A, asl, acc, 2)                                                                      \
+    X(IMPLIED1, 0B, nop, imp, 1)                                                                   \
+    X(RMW, 0C, tsb, abs, 6)                                                                        \
+    X(READ, 0D, ora, abs, 4)                                                                       \
+    X(RMW, 0E, asl, abs, 6)                                                                        \
+    X(BIT_BRANCH, 0F, bbr0, zprel, 5)                                                              \
+    X(BRANCH, 10, bpl, rel, 2)                                                                     \
+    X(READ, 11, ora, zpindy, 5)                                                                    \
+    X(READ, 12, ora, zpind, 5)                                                                     \
+    X(IMPLIED1, 13, nop, imp, 1)                                                                   \
+    X(RMW, 14, trb, zp, 5)                                                                         \
+    X(READ, 15, ora, zpx, 4)                                                                       \
+    X(RMW, 16, asl, zpx, 6)                                                                        \
+    X(RMW, 17, rmb1, zp, 5)                                                                        \
+    X(IMPLIED, 18, clc, imp, 2)                                                                    \
+    X(READ, 19, ora, absy, 4)                                                                      \
+    X(RMW_A, 1A, inc, acc, 2)                                                                      \
+    X(IMPLIED1, 1B, nop, imp, 1)                                                                   \
+    X(RMW, 1C, trb, abs, 6)                                                                        \
+    X(READ, 1D, ora, absx, 4)                                                                      \
+    X(RMW, 1E, asl, absxp, 6)                                                                      \
+    X(BIT_BRANCH, 1F, bbr1, zprel, 5)                                                              \
+    X(JUMP, 20, jsr, abs, 6)                                                                       \
+    X(READ, 21, and, zpxind, 6)                                                                    \
+    X(READ, 22, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, 23, nop, imp, 1)                                                                   \
+    X(READ, 24, bit, zp, 3)                                                                        \
+    X(READ, 25, and, zp, 3)                                                                        \
+    X(RMW, 26, rol, zp, 5)                                                                         \
+    X(RMW, 27, rmb2, zp, 5)                                                                        \
+    X(IMPLIED, 28, plp, imp, 4)                                                                    \
+    X(READ, 29, and, imm, 2)                                                                       \
+    X(RMW_A, 2A, rol, acc, 2)                                                                      \
+    X(IMPLIED1, 2B, nop, imp, 1)                                                                   \
+    X(READ, 2C, bit, abs, 4)                                                                       \
+    X(READ, 2D, and, abs, 4)                                                                       \
+    X(RMW, 2E, rol, abs, 6)                                                                        \
+    X(BIT_BRANCH, 2F, bbr2, zprel, 5)                                                              \
+    X(BRANCH, 30, bmi, rel, 2)                                                                     \
+    X(READ, 31, and, zpindy, 5)                                                                    \
+    X(READ, 32, and, zpind, 5)                                                                     \
+    X(IMPLIED1, 33, nop, imp, 1)                                                                   \
+    X(READ, 34, bit, zpx, 4)                                                                       \
+    X(READ, 35, and, zpx, 4)                                                                       \
+    X(RMW, 36, rol, zpx, 6)                                                                        \
+    X(RMW, 37, rmb3, zp, 5)                                                                        \
+    X(IMPLIED, 38, sec, imp, 2)                                                                    \
+    X(READ, 39, and, absy, 4)                                                                      \
+    X(RMW_A, 3A, dec, acc, 2)                                                                      \
+    X(IMPLIED1, 3B, nop, imp, 1)                                                                   \
+    X(READ, 3C, bit, absx, 4)                                                                      \
+    X(READ, 3D, and, absx, 4)                                                                      \
+    X(RMW, 3E, rol, absxp, 6)                                                                      \
+    X(BIT_BRANCH, 3F, bbr3, zprel, 5)                                                              \
+    X(IMPLIED, 40, rti, imp, 6)                                                                    \
+    X(READ, 41, eor, zpxind, 6)                                                                    \
+    X(READ, 42, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, 43, nop, imp, 1)                                                                   \
+    X(READ, 44, nop_read, zp, 3)                                                                   \
+    X(READ, 45, eor, zp, 3)                                                                        \
+    X(RMW, 46, lsr, zp, 5)                                                                         \
+    X(RMW, 47, rmb4, zp, 5)                                                                        \
+    X(IMPLIED, 48, pha, imp, 3)                                                                    \
+    X(READ, 49, eor, imm, 2)                                                                       \
+    X(RMW_A, 4A, lsr, acc, 2)                                                                      \
+    X(IMPLIED1, 4B, nop, imp, 1)                                                                   \
+    X(JUMP, 4C, jmp, abs, 3)                                                                       \
+    X(READ, 4D, eor, abs, 4)                                                                       \
+    X(RMW, 4E, lsr, abs, 6)                                                                        \
+    X(BIT_BRANCH, 4F, bbr4, zprel, 5)                                                              \
+    X(BRANCH, 50, bvc, rel, 2)                                                                     \
+    X(READ, 51, eor, zpindy, 5)                                                                    \
+    X(READ, 52, eor, zpind, 5)                                                                     \
+    X(IMPLIED1, 53, nop, imp, 1)                                                                   \
+    X(READ, 54, nop_read, zpx, 4)                                                                  \
+    X(READ, 55, eor, zpx, 4)                                                                       \
+    X(RMW, 56, lsr, zpx, 6)                                                                        \
+    X(RMW, 57, rmb5, zp, 5)                                                                        \
+    X(IMPLIED, 58, cli, imp, 2)                                                                    \
+    X(READ, 59, eor, absy, 4)                                                                      \
+    X(IMPLIED, 5A, phy, imp, 3)                                                                    \
+    X(IMPLIED1, 5B, nop, imp, 1)                                                                   \
+    X(READ, 5C, nop_read, abs, 8)                                                                  \
+    X(READ, 5D, eor, absx, 4)                                                                      \
+    X(RMW, 5E, lsr, absxp, 6)                                                                      \
+    X(BIT_BRANCH, 5F, bbr5, zprel, 5)                                                              \
+    X(IMPLIED, 60, rts, imp, 6)                                                                    \
+    X(READ, 61, adc, zpxind, 6)                                                                    \
+    X(READ, 62, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, 63, nop, imp, 1)                                                                   \
+    X(WRITE, 64, stz, zp, 3)                                                                       \
+    X(READ, 65, adc, zp, 3)                                                                        \
+    X(RMW, 66, ror, zp, 5)                                                                         \
+    X(RMW, 67, rmb6, zp, 5)                                                                        \
+    X(IMPLIED, 68, pla, imp, 4)                                                                    \
+    X(READ, 69, adc, imm, 2)                                                                       \
+    X(RMW_A, 6A, ror, acc, 2)                                                                      \
+    X(IMPLIED1, 6B, nop, imp, 1)                                                                   \
+    X(JUMP, 6C, jmp, ind, 6)                                                                       \
+    X(READ, 6D, adc, abs, 4)                                                                       \
+    X(RMW, 6E, ror, abs, 6)                                                                        \
+    X(BIT_BRANCH, 6F, bbr6, zprel, 5)                                                              \
+    X(BRANCH, 70, bvs, rel, 2)                                                                     \
+    X(READ, 71, adc, zpindy, 5)                                                                    \
+    X(READ, 72, adc, zpind, 5)                                                                     \
+    X(IMPLIED1, 73, nop, imp, 1)                                                                   \
+    X(WRITE, 74, stz, zpx, 4)                                                                      \
+    X(READ, 75, adc, zpx, 4)                                                                       \
+    X(RMW, 76, ror, zpx, 6)                                                                        \
+    X(RMW, 77, rmb7, zp, 5)                                                                        \
+    X(IMPLIED, 78, sei, imp, 2)                                                                    \
+    X(READ, 79, adc, absy, 4)                                                                      \
+    X(IMPLIED, 7A, ply, imp, 4)                                                                    \
+    X(IMPLIED1, 7B, nop, imp, 1)                                                                   \
+    X(JUMP, 7C, jmp, absxind, 6)                                                                   \
+    X(READ, 7D, adc, absx, 4)                                                                      \
+    X(RMW, 7E, ror, absxp, 6)                                                                      \
+    X(BIT_BRANCH, 7F, bbr7, zprel, 5)                                                              \
+    X(BRANCH, 80, bra, rel, 2)                                                                     \
+    X(WRITE, 81, sta, zpxind, 6)                                                                   \
+    X(READ, 82, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, 83, nop, imp, 1)                                                                   \
+    X(WRITE, 84, sty, zp, 3)                                                                       \
+    X(WRITE, 85, sta, zp, 3)                                                                       \
+    X(WRITE, 86, stx, zp, 3)                                                                       \
+    X(RMW, 87, smb0, zp, 5)                                                                        \
+    X(IMPLIED, 88, dey, imp, 2)                                                                    \
+    X(READ, 89, bit_imm, imm, 2)                                                                   \
+    X(IMPLIED, 8A, txa, imp, 2)                                                                    \
+    X(IMPLIED1, 8B, nop, imp, 1)                                                                   \
+    X(WRITE, 8C, sty, abs, 4)                                                                      \
+    X(WRITE, 8D, sta, abs, 4)                                                                      \
+    X(WRITE, 8E, stx, abs, 4)                                                                      \
+    X(BIT_BRANCH, 8F, bbs0, zprel, 5)                                                              \
+    X(BRANCH, 90, bcc, rel, 2)                                                                     \
+    X(WRITE, 91, sta, zpindy, 6)                                                                   \
+    X(WRITE, 92, sta, zpind, 5)                                                                    \
+    X(IMPLIED1, 93, nop, imp, 1)                                                                   \
+    X(WRITE, 94, sty, zpx, 4)                                                                      \
+    X(WRITE, 95, sta, zpx, 4)                                                                      \
+    X(WRITE, 96, stx, zpy, 4)                                                                      \
+    X(RMW, 97, smb1, zp, 5)                                                                        \
+    X(IMPLIED, 98, tya, imp, 2)                                                                    \
+    X(WRITE, 99, sta, absy, 5)                                                                     \
+    X(IMPLIED, 9A, txs, imp, 2)                                                                    \
+    X(IMPLIED1, 9B, nop, imp, 1)                                                                   \
+    X(WRITE, 9C, stz, abs, 4)                                                                      \
+    X(WRITE, 9D, sta, absx, 5)                                                                     \
+    X(WRITE, 9E, stz, absx, 5)                                                                     \
+    X(BIT_BRANCH, 9F, bbs1, zprel, 5)                                                              \
+    X(READ, A0, ldy, imm, 2)                                                                       \
+    X(READ, A1, lda, zpxind, 6)                                                                    \
+    X(READ, A2, ldx, imm, 2)                                                                       \
+    X(IMPLIED1, A3, nop, imp, 1)                                                                   \
+    X(READ, A4, ldy, zp, 3)                                                                        \
+    X(READ, A5, lda, zp, 3)                                                                        \
+    X(READ, A6, ldx, zp, 3)                                                                        \
+    X(RMW, A7, smb2, zp, 5)                                                                        \
+    X(IMPLIED, A8, tay, imp, 2)                                                                    \
+    X(READ, A9, lda, imm, 2)                                                                       \
+    X(IMPLIED, AA, tax, imp, 2)                                                                    \
+    X(IMPLIED1, AB, nop, imp, 1)                                                                   \
+    X(READ, AC, ldy, abs, 4)                                                                       \
+    X(READ, AD, lda, abs, 4)                                                                       \
+    X(READ, AE, ldx, abs, 4)                                                                       \
+    X(BIT_BRANCH, AF, bbs2, zprel, 5)                                                              \
+    X(BRANCH, B0, bcs, rel, 2)                                                                     \
+    X(READ, B1, lda, zpindy, 5)                                                                    \
+    X(READ, B2, lda, zpind, 5)                                                                     \
+    X(IMPLIED1, B3, nop, imp, 1)                                                                   \
+    X(READ, B4, ldy, zpx, 4)                                                                       \
+    X(READ, B5, lda, zpx, 4)                                                                       \
+    X(READ, B6, ldx, zpy, 4)                                                                       \
+    X(RMW, B7, smb3, zp, 5)                                                                        \
+    X(IMPLIED, B8, clv, imp, 2)                                                                    \
+    X(READ, B9, lda, absy, 4)                                                                      \
+    X(IMPLIED, BA, tsx, imp, 2)                                                                    \
+    X(IMPLIED1, BB, nop, imp, 1)                                                                   \
+    X(READ, BC, ldy, absx, 4)                                                                      \
+    X(READ, BD, lda, absx, 4)                                                                      \
+    X(READ, BE, ldx, absy, 4)                                                                      \
+    X(BIT_BRANCH, BF, bbs3, zprel, 5)                                                              \
+    X(READ, C0, cpy, imm, 2)                                                                       \
+    X(READ, C1, cmp, zpxind, 6)                                                                    \
+    X(READ, C2, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, C3, nop, imp, 1)                                                                   \
+    X(READ, C4, cpy, zp, 3)                                                                        \
+    X(READ, C5, cmp, zp, 3)                                                                        \
+    X(RMW, C6, dec, zp, 5)                                                                         \
+    X(RMW, C7, smb4, zp, 5)                                                                        \
+    X(IMPLIED, C8, iny, imp, 2)                                                                    \
+    X(READ, C9, cmp, imm, 2)                                                                       \
+    X(IMPLIED, CA, dex, imp, 2)                                                                    \
+    OPCODE_CB(X)                                                                                   \
+    X(READ, CC, cpy, abs, 4)                                                                       \
+    X(READ, CD, cmp, abs, 4)                                                                       \
+    X(RMW, CE, dec, abs, 6)                                                                        \
+    X(BIT_BRANCH, CF, bbs4, zprel, 5)                                                              \
+    X(BRANCH, D0, bne, rel, 2)                                                                     \
+    X(READ, D1, cmp, zpindy, 5)                                                                    \
+    X(READ, D2, cmp, zpind, 5)                                                                     \
+    X(IMPLIED1, D3, nop, imp, 1)                                                                   \
+    X(READ, D4, nop_read, zpx, 4)                                                                  \
+    X(READ, D5, cmp, zpx, 4)                                                                       \
+    X(RMW, D6, dec, zpx, 6)                                                                        \
+    X(RMW, D7, smb5, zp, 5)                                                                        \
+    X(IMPLIED, D8, cld, imp, 2)                                                                    \
+    X(READ, D9, cmp, absy, 4)                                                                      \
+    X(IMPLIED, DA, phx, imp, 3)                                                                    \
+    OPCODE_DB(X)                                                                                   \
+    X(READ, DC, nop_read, abs, 4)                                                                  \
+    X(READ, DD, cmp, absx, 4)                                                                      \
+    X(RMW, DE, dec, absx, 7)                                                                       \
+    X(BIT_BRANCH, DF, bbs5, zprel, 5)                                                              \
+    X(READ, E0, cpx, imm, 2)                                                                       \
+    X(READ, E1, sbc, zpxind, 6)                                                                    \
+    X(READ, E2, nop_read, imm, 2)                                                                  \
+    X(IMPLIED1, E3, nop, imp, 1)                                                                   \
+    X(READ, E4, cpx, zp, 3)                                                                        \
+    X(READ, E5, sbc, zp, 3)                                                                        \
+    X(RMW, E6, inc, zp, 5)                                                                         \
+    X(RMW, E7, smb6, zp, 5)                                                                        \
+    X(IMPLIED, E8, inx, imp, 2)                                                                    \
+    X(READ, E9, sbc, imm, 2)                                                                       \
+    X(IMPLIED, EA, nop, imp, 2)                                                                    \
+    X(IMPLIED1, EB, nop, imp, 1)                                                                   \
+    X(READ, EC, cpx, abs, 4)                                                                       \
+    X(READ, ED, sbc, abs, 4)                                                                       \
+    X(RMW, EE, inc, abs, 6)                                                                        \
+    X(BIT_BRANCH, EF, bbs6, zprel, 5)                                                              \
+    X(BRANCH, F0, beq, rel, 2)                                                                     \
+    X(READ, F1, sbc, zpindy, 5)                                                                    \
+    X(READ, F2, sbc, zpind, 5)                                                                     \
+    X(IMPLIED1, F3, nop, imp, 1)                                                                   \
+    X(READ, F4, nop_read, zpx, 4)                                                                  \
+    X(READ, F5, sbc, zpx, 4)                                                                       \
+    X(RMW, F6, inc, zpx, 6)                                                                        \
+    X(RMW, F7, smb7, zp, 5)                                                                        \
+    X(IMPLIED, F8, sed, imp, 2)                                                                    \
+    X(READ, F9, sbc, absy, 4)                                                                      \
+    X(IMPLIED, FA, plx, imp, 4)                                                                    \
+    X(IMPLIED1, FB, nop, imp, 1)                                                                   \
+    X(READ, FC, nop_read, abs, 4)                                                                  \
+    X(READ, FD, sbc, absx, 4)                                                                      \
+    X(RMW, FE, inc, absx, 7)                                                                       \
+    X(BIT_BRANCH, FF, bbs7, zprel, 5)
+
+#else
+
+/*
+ * Read-modify-writes on the NMOS 6502 always take the extra cycle with abs,X,
+ * and JMP (a) is a cycle shorter.
+ *
+ * Reference: http://www.6502.org/tutorials/6502opcodes.html and
+ * https://www.masswerk.at/6502/6502_instruction_set.html
+ */
+#define OPCODES(X)                                                                                 \
+    X(IMPLIED, 00, brk, imp, 7)                                                                    \
+    X(READ, 01, ora, zpxind, 6)                                                                    \
+    X(IMPLIED, 02, jam, imp, 2)                                                                    \
+    X(RMW, 03, slo, zpxind, 8)                                                                     \
+    X(READ, 04, nop_read, zp, 3)                                                                   \
+    X(READ, 05, ora, zp, 3)                                                                        \
+    X(RMW, 06, asl, zp, 5)                                                                         \
+    X(RMW, 07, slo, zp, 5)                                                                         \
+    X(IMPLIED, 08, php, imp, 3)                                                                    \
+    X(READ, 09, ora, imm, 2)                                                                       \
+    X(RMW_A, 0A, asl, acc, 2)                                                                      \
+    X(READ, 0B, anc, imm, 2)                                                                       \
+    X(READ, 0C, nop_read, abs, 4)                                                                  \
+    X(READ, 0D, ora, abs, 4)                                                                       \
+    X(RMW, 0E, asl, abs, 6)                                                                        \
+    X(RMW, 0F, slo, abs, 6)                                                                        \
+    X(BRANCH, 10, bpl, rel, 2)                                                                     \
+    X(READ, 11, ora, zpindy, 5)                                                                    \
+    X(IMPLIED, 12, jam, imp, 2)                                                                    \
+    X(RMW, 13, slo, zpindy, 8)                                                                     \
+    X(READ, 14, nop_read, zpx, 4)                                                                  \
+    X(READ, 15, ora, zpx, 4)                                                                       \
+    X(RMW, 16, asl, zpx, 6)                                                                        \
+    X(RMW, 17, slo, zpx, 6)                                                                        \
+    X(IMPLIED, 18, clc, imp, 2)                                                                    \
+    X(READ, 19, ora, absy, 4)                                                                      \
+    X(IMPLIED, 1A, nop, imp, 2)                                                                    \
+    X(RMW, 1B, slo, absy, 7)                                                                       \
+    X(READ, 1C, nop_read, absx, 4)                                                                 \
+    X(READ, 1D, ora, absx, 4)                                                                      \
+    X(RMW, 1E, asl, absx, 7)                                                                       \
+    X(RMW, 1F, slo, absx, 7)                                                                       \
+    X(JUMP, 20, jsr, abs, 6)                                                                       \
+    X(READ, 21, and, zpxind, 6)                                                                    \
+    X(IMPLIED, 22, jam, imp, 2)                                                                    \
+    X(RMW, 23, rla, zpxind, 8)                                                                     \
+    X(READ, 24, bit, zp, 3)                                                                        \
+    X(READ, 25, and, zp, 3)                                                                        \
+    X(RMW, 26, rol, zp, 5)                                                                         \
+    X(RMW, 27, rla, zp, 5)                                                                         \
+    X(IMPLIED, 28, plp, imp, 4)                                                                    \
+    X(READ, 29, and, imm, 2)                                                                       \
+    X(RMW_A, 2A, rol, acc, 2)                                                                      \
+    X(READ, 2B, anc, imm, 2)                                                                       \
+    X(READ, 2C, bit, abs, 4)                                                                       \
+    X(READ, 2D, and, abs, 4)                                                                       \
+    X(RMW, 2E, rol, abs, 6)                                                                        \
+    X(RMW, 2F, rla, abs, 6)                                                                        \
+    X(BRANCH, 30, bmi, rel, 2)                                                                     \
+    X(READ, 31, and, zpindy, 5)                                                                    \
+    X(IMPLIED, 32, jam, imp, 2)                                                                    \
+    X(RMW, 33, rla, zpindy, 8)                                                                     \
+    X(READ, 34, nop_read, zpx, 4)                                                                  \
+    X(READ, 35, and, zpx, 4)                                                                       \
+    X(RMW, 36, rol, zpx, 6)                                                                        \
+    X(RMW, 37, rla, zpx, 6)                                                                        \
+    X(IMPLIED, 38, sec, imp, 2)                                                                    \
+    X(READ, 39, and, absy, 4)                                                                      \
+    X(IMPLIED, 3A, nop, imp, 2)                                                                    \
+    X(RMW, 3B, rla, absy, 7)                                                                       \
+    X(READ, 3C, nop_read, absx, 4)                                                                 \
+    X(READ, 3D, and, absx, 4)                                                                      \
+    X(RMW, 3E, rol, absx, 7)                                                                       \
+    X(RMW, 3F, rla, absx, 7)                                                                       \
+    X(IMPLIED, 40, rti, imp, 6)                                                                    \
+    X(READ, 41, eor, zpxind, 6)                                                                    \
+    X(IMPLIED, 42, jam, imp, 2)                                                                    \
+    X(RMW, 43, sre, zpxind, 8)                                                                     \
+    X(READ, 44, nop_read, zp, 3)                                                                   \
+    X(READ, 45, eor, zp, 3)                                                                        \
+    X(RMW, 46, lsr, zp, 5)                                                                         \
+    X(RMW, 47, sre, zp, 5)                                                                         \
+    X(IMPLIED, 48, pha, imp, 3)                                                                    \
+    X(READ, 49, eor, imm, 2)                                                                       \
+    X(RMW_A, 4A, lsr, acc, 2)                                                                      \
+    X(READ, 4B, alr, imm, 2)                                                                       \
+    X(JUMP, 4C, jmp, abs, 3)                                                                       \
+    X(READ, 4D, eor, abs, 4)                                                                       \
+    X(RMW, 4E, lsr, abs, 6)                                                                        \
+    X(RMW, 4F, sre, abs, 6)                                                                        \
+    X(BRANCH, 50, bvc, rel, 2)                                                                     \
+    X(READ, 51, eor, zpindy, 5)                                                                    \
+    X(IMPLIED, 52, jam, imp, 2)                                                                    \
+    X(RMW, 53, sre, zpindy, 8)                                                                     \
+    X(READ, 54, nop_read, zpx, 4)                                                                  \
+    X(READ, 55, eor, zpx, 4)                                                                       \
+    X(RMW, 56, lsr, zpx, 6)                                                                        \
+    X(RMW, 57, sre, zpx, 6)                                                                        \
+    X(IMPLIED, 58, cli, imp, 2)                                                                    \
+    X(READ, 59, eor, absy, 4)                                                                      \
+    X(IMPLIED, 5A, nop, imp, 2)                                                                    \
+    X(RMW, 5B, sre, absy, 7)                                                                       \
+    X(READ, 5C, nop_read, absx, 4)                                                                 \
+    X(READ, 5D, eor, absx, 4)                                                                      \
+    X(RMW, 5E, lsr, absx, 7)                                                                       \
+    X(RMW, 5F, sre, absx, 7)                                                                       \
+    X(IMPLIED, 60, rts, imp, 6)                                                                    \
+    X(READ, 61, adc, zpxind, 6)                                                                    \
+    X(IMPLIED, 62, jam, imp, 2)                                                                    \
+    X(RMW, 63, rra, zpxind, 8)                                                                     \
+    X(READ, 64, nop_read, zp, 3)                                                                   \
+    X(READ, 65, adc, zp, 3)                                                                        \
+    X(RMW, 66, ror, zp, 5)                                                                         \
+    X(RMW, 67, rra, zp, 5)                                                                         \
+    X(IMPLIED, 68, pla, imp, 4)                                                                    \
+    X(READ, 69, adc, imm, 2)                                                                       \
+    X(RMW_A, 6A, ror, acc, 2)                                                                      \
+    X(READ, 6B, arr, imm, 2)                                                                       \
+    X(JUMP, 6C, jmp, ind, 5)                                                                       \
+    X(READ, 6D, adc, abs, 4)                                                                       \
+    X(RMW, 6E, ror, abs, 6)                                                                        \
+    X(RMW, 6F, rra, abs, 6)                                                                        \
+    X(BRANCH, 70, bvs, rel, 2)                                                                     \
+    X(READ, 71, adc, zpindy, 5)                                                                    \
+    X(IMPLIED, 72, jam, imp, 2)                                                                    \
+    X(RMW, 73, rra, zpindy, 8)                                                                     \
+    X(READ, 74, nop_read, zpx, 4)                                                                  \
+    X(READ, 75, adc, zpx, 4)                                                                       \
+    X(RMW, 76, ror, zpx, 6)                                                                        \
+    X(RMW, 77, rra, zpx, 6)                                                                        \
+    X(IMPLIED, 78, sei, imp, 2)                                                                    \
+    X(READ, 79, adc, absy, 4)                                                                      \
+    X(IMPLIED, 7A, nop, imp, 2)                                                                    \
+    X(RMW, 7B, rra, absy, 7)                                                                       \
+    X(READ, 7C, nop_read, absx, 4)                                                                 \
+    X(READ, 7D, adc, absx, 4)                                                                      \
+    X(RMW, 7E, ror, absx, 7)                                                                       \
+    X(RMW, 7F, rra, absx, 7)                                                                       \
+    X(READ, 80, nop_read, imm, 2)                                                                  \
+    X(WRITE, 81, sta, zpxind, 6)                                                                   \
+    X(READ, 82, nop_read, imm, 2)                                                                  \
+    X(WRITE, 83, sax, zpxind, 6)                                                                   \
+    X(WRITE, 84, sty, zp, 3)                                                                       \
+    X(WRITE, 85, sta, zp, 3)                                                                       \
+    X(WRITE, 86, stx, zp, 3)                                                                       \
+    X(WRITE, 87, sax, zp, 3)                                                                       \
+    X(IMPLIED, 88, dey, imp, 2)                                                                    \
+    X(READ, 89, nop_read, imm, 2)                                                                  \
+    X(IMPLIED, 8A, txa, imp, 2)                                                                    \
+    X(READ, 8B, ane, imm, 2)                                                                       \
+    X(WRITE, 8C, sty, abs, 4)                                                                      \
+    X(WRITE, 8D, sta, abs, 4)                                                                      \
+    X(WRITE, 8E, stx, abs, 4)                                                                      \
+    X(WRITE, 8F, sax, abs, 4)                                                                      \
+    X(BRANCH, 90, bcc, rel, 2)                                                                     \
+    X(WRITE, 91, sta, zpindy, 6)                                                                   \
+    X(IMPLIED, 92, jam, imp, 2)                                                                    \
+    X(WRITE_ADDR, 93, sha, zpindy, 6)                                                              \
+    X(WRITE, 94, sty, zpx, 4)                                                                      \
+    X(WRITE, 95, sta, zpx, 4)                                                                      \
+    X(WRITE, 96, stx, zpy, 4)                                                                      \
+    X(WRITE, 97, sax, zpy, 4)                                                                      \
+    X(IMPLIED, 98, tya, imp, 2)                                                                    \
+    X(WRITE, 99, sta, absy, 5)                                                                     \
+    X(IMPLIED, 9A, txs, imp, 2)                                                                    \
+    X(WRITE_ADDR, 9B, tas, absy, 5)                                                                \
+    X(WRITE_ADDR, 9C, shy, absx, 5)                                                                \
+    X(WRITE, 9D, sta, absx, 5)                                                                     \
+    X(WRITE_ADDR, 9E, shx, absy, 5)                                                                \
+    X(WRITE_ADDR, 9F, sha, absy, 5)                                                                \
+    X(READ, A0, ldy, imm, 2)                                                                       \
+    X(READ, A1, lda, zpxind, 6)                                                                    \
+    X(READ, A2, ldx, imm, 2)                                                                       \
+    X(READ, A3, lax, zpxind, 6)                                                                    \
+    X(READ, A4, ldy, zp, 3)                                                                        \
+    X(READ, A5, lda, zp, 3)                                                                        \
+    X(READ, A6, ldx, zp, 3)                                                                        \
+    X(READ, A7, lax, zp, 3)                                                                        \
+    X(IMPLIED, A8, tay, imp, 2)                                                                    \
+    X(READ, A9, lda, imm, 2)                                                                       \
+    X(IMPLIED, AA, tax, imp, 2)                                                                    \
+    X(READ, AB, lxa, imm, 2)                                                                       \
+    X(READ, AC, ldy, abs, 4)                                                                       \
+    X(READ, AD, lda, abs, 4)                                                                       \
+    X(READ, AE, ldx, abs, 4)                                                                       \
+    X(READ, AF, lax, abs, 4)                                                                       \
+    X(BRANCH, B0, bcs, rel, 2)                                                                     \
+    X(READ, B1, lda, zpindy, 5)                                                                    \
+    X(IMPLIED, B2, jam, imp, 2)                                                                    \
+    X(READ, B3, lax, zpindy, 5)                                                                    \
+    X(READ, B4, ldy, zpx, 4)                                                                       \
+    X(READ, B5, lda, zpx, 4)                                                                       \
+    X(READ, B6, ldx, zpy, 4)                                                                       \
+    X(READ, B7, lax, zpy, 4)                                                                       \
+    X(IMPLIED, B8, clv, imp, 2)                                                                    \
+    X(READ, B9, lda, absy, 4)                                                                      \
+    X(IMPLIED, BA, tsx, imp, 2)                                                                    \
+    X(READ, BB, las, absy, 4)                                                                      \
+    X(READ, BC, ldy, absx, 4)                                                                      \
+    X(READ, BD, lda, absx, 4)                                                                      \
+    X(READ, BE, ldx, absy, 4)                                                                      \
+    X(READ, BF, lax, absy, 4)                                                                      \
+    X(READ, C0, cpy, imm, 2)                                                                       \
+    X(READ, C1, cmp, zpxind, 6)                                                                    \
+    X(READ, C2, nop_read, imm, 2)                                                                  \
+    X(RMW, C3, dcp, zpxind, 8)                                                                     \
+    X(READ, C4, cpy, zp, 3)                                                                        \
+    X(READ, C5, cmp, zp, 3)                                                                        \
+    X(RMW, C6, dec, zp, 5)                                                                         \
+    X(RMW, C7, dcp, zp, 5)                                                                         \
+    X(IMPLIED, C8, iny, imp, 2)                                                                    \
+    X(READ, C9, cmp, imm, 2)                                                                       \
+    X(IMPLIED, CA, dex, imp, 2)                                                                    \
+    X(READ, CB, sbx, imm, 2)                                                                       \
+    X(READ, CC, cpy, abs, 4)                                                                       \
+    X(READ, CD, cmp, abs, 4)                                                                       \
+    X(RMW, CE, dec, abs, 6)                                                                        \
+    X(RMW, CF, dcp, abs, 6)                                                                        \
+    X(BRANCH, D0, bne, rel, 2)                                                                     \
+    X(READ, D1, cmp, zpindy, 5)                                                                    \
+    X(IMPLIED, D2, jam, imp, 2)                                                                    \
+    X(RMW, D3, dcp, zpindy, 8)                                                                     \
+    X(READ, D4, nop_read, zpx, 4)                                                                  \
+    X(READ, D5, cmp, zpx, 4)                                                                       \
+    X(RMW, D6, dec, zpx, 6)                                                                        \
+    X(RMW, D7, dcp, zpx, 6)                                                                        \
+    X(IMPLIED, D8, cld, imp, 2)                                                                    \
+    X(READ, D9, cmp, absy, 4)                                                                      \
+    X(IMPLIED, DA, nop, imp, 2)                                                                    \
+    X(RMW, DB, dcp, absy, 7)                                                                       \
+    X(READ, DC, nop_read, absx, 4)                                                                 \
+    X(READ, DD, cmp, absx, 4)                                                                      \
+    X(RMW, DE, dec, absx, 7)                                                                       \
+    X(RMW, DF, dcp, absx, 7)                                                                       \
+    X(READ, E0, cpx, imm, 2)                                                                       \
+    X(READ, E1, sbc, zpxind, 6)                                                                    \
+    X(READ, E2, nop_read, imm, 2)                                                                  \
+    X(RMW, E3, isc, zpxind, 8)                                                                     \
+    X(READ, E4, cpx, zp, 3)                                                                        \
+    X(READ, E5, sbc, zp, 3)                                                                        \
+    X(RMW, E6, inc, zp, 5)                                                                         \
+    X(RMW, E7, isc, zp, 5)                                                                         \
+    X(IMPLIED, E8, inx, imp, 2)                                                                    \
+    X(READ, E9, sbc, imm, 2)                                                                       \
+    X(IMPLIED, EA, nop, imp, 2)                                                                    \
+    X(READ, EB, sbc, imm, 2)                                                                       \
+    X(READ, EC, cpx, abs, 4)                                                                       \
+    X(READ, ED, sbc, abs, 4)                                                                       \
+    X(RMW, EE, inc, abs, 6)                                                                        \
+    X(RMW, EF, isc, abs, 6)                                                                        \
+    X(BRANCH, F0, beq, rel, 2)                                                                     \
+    X(READ, F1, sbc, zpindy, 5)                                                                    \
+    X(IMPLIED, F2, jam, imp, 2)                                                                    \
+    X(RMW, F3, isc, zpindy, 8)                                                                     \
+    X(READ, F4, nop_read, zpx, 4)                                                                  \
+    X(READ, F5, sbc, zpx, 4)                                                                       \
+    X(RMW, F6, inc, zpx, 6)                                                                        \
+    X(RMW, F7, isc, zpx, 6)                                                                        \
+    X(IMPLIED, F8, sed, imp, 2)                                                                    \
+    X(READ, F9, sbc, absy, 4)                                                                      \
+    X(IMPLIED, FA, nop, imp, 2)                                                                    \
+    X(RMW, FB, isc, absy, 7)                                                                       \
+    X(READ, FC, nop_read, absx, 4)                                                                 \
+    X(READ, FD, sbc, absx, 4)                                                                      \
+    X(RMW, FE, inc, absx, 7)                                                                       \
+    X(RMW, FF, isc, absx, 7)
+
+#endif
+
+/*
+ * Every opcode gets its own enumerator, so a duplicate opcode is a compile
+ * error, and the count must come out at exactly 256.
+ */
+#define X(kind, opcode, op, mode, cycles) OPCODE_DEFINED_##opcode,
+enum
+{
+    OPCODES(X) OPCODE_COUNT
+};
+#undef X
+
+_Static_assert(OPCODE_COUNT == 256, "the opcode table must define all 256 opcodes");
+
+/*
+ * Handler generators, one per kind of instruction. Single byte instructions
+ * read the following byte and discard it. Read-modify-write instructions read
+ * their operand twice on the 65C02, where the NMOS 6502 writes it back
+ * unmodified first. That only matters when accesses are bus cycles, or when
+ * they hit a device register.
+ */
+#define HANDLER_READ(opcode, op, mode)                                                             \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        op(load_##mode());                                                                         \
+    }
+
+#define HANDLER_WRITE(opcode, op, mode)                                                            \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        mem_write(ea_##mode(), op());                                                              \
+    }
+
+#define HANDLER_WRITE_ADDR(opcode, op, mode)                                                       \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        addr_t addr = ea_##mode();                                                                 \
+        mem_write(addr, op(addr));                                                                 \
+    }
+
+#if CPU_VARIANT == CPU_NMOS
+#define HANDLER_RMW(opcode, op, mode)                                                              \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        addr_t addr = ea_##mode();                                                                 \
+        word_t value = mem_read(addr);                                                             \
+        mem_write(addr, value);                                                                    \
+        mem_write(addr, op(value));                                                                \
+    }
+#else
+#define HANDLER_RMW(opcode, op, mode)                                                              \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        addr_t addr = ea_##mode();                                                                 \
+        word_t value = mem_read(addr);                                                             \
+        mem_dummy_read(addr);                                                                      \
+        mem_write(addr, op(value));                                                                \
+    }
+#endif
+
+#define HANDLER_RMW_A(opcode, op, mode)                                                            \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        mem_dummy_read(reg.pc);                                                                    \
+        reg.a = op(reg.a);                                                                         \
+    }
+
+#define HANDLER_IMPLIED(opcode, op, mode)                                                          \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        mem_dummy_read(reg.pc);                                                                    \
+        op();                                                                                      \
+    }
+
+/* Done in the cycle of the opcode fetch, no dummy read */
+#define HANDLER_IMPLIED1(opcode, op, mode)                                                         \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        op();                                                                                      \
+    }
+
+#define HANDLER_BRANCH(opcode, op, mode)                                                           \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        int8_t offset = shift();                                                                   \
+        addr_t from = reg.pc;                                                                      \
+        if (op())                                                                                  \
+            branch(offset);                                                                        \
+        edge(from, reg.pc);                                                                        \
+    }
+
+#define HANDLER_BIT_BRANCH(opcode, op, mode)                                                       \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        word_t value = mem_read(shift());                                                          \
+        int8_t offset = shift();                                                                   \
+        addr_t from = reg.pc;                                                                      \
+        if (op(value))                                                                             \
+            branch(offset);                                                                        \
+        edge(from, reg.pc);                                                                        \
+    }
+
+#define HANDLER_JUMP(opcode, op, mode)                                                             \
+    static void op_##opcode(void)                                                                  \
+    {                                                                                              \
+        addr_t from = reg.pc;                                                                      \
+        op(ea_##mode());                                                                           \
+        edge(from, reg.pc);                                                                        \
+    }
+
+#define X(kind, opcode, op, mode, cycles) HANDLER_##kind(opcode, op, mode)
+OPCODES(X)
+#undef X
+
+#define ADDR_MODE_imp ADDR_MODE_IMPLIED
+#define ADDR_MODE_acc ADDR_MODE_ACCUMULATOR
+#define ADDR_MODE_imm ADDR_MODE_IMMEDIATE
+#define ADDR_MODE_rel ADDR_MODE_RELATIVE
+#define ADDR_MODE_zp ADDR_MODE_ZEROPAGE
+#define ADDR_MODE_zpx ADDR_MODE_ZEROPAGE_X
+#define ADDR_MODE_zpy ADDR_MODE_ZEROPAGE_Y
+#define ADDR_MODE_zprel ADDR_MODE_ZEROPAGE_RELATIVE
+#define ADDR_MODE_zpxind ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT
+#define ADDR_MODE_zpind ADDR_MODE_ZEROPAGE_INDIRECT
+#define ADDR_MODE_zpindy ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED
+#define ADDR_MODE_abs ADDR_MODE_ABSOLUTE
+#define ADDR_MODE_absx ADDR_MODE_ABSOLUTE_X
+#define ADDR_MODE_absxp ADDR_MODE_ABSOLUTE_X
+#define ADDR_MODE_absy ADDR_MODE_ABSOLUTE_Y
+#define ADDR_MODE_ind ADDR_MODE_ABSOLUTE_INDIRECT
+#define ADDR_MODE_absxind ADDR_MODE_ABSOLUTE_INDEXED_INDIRECT
+
+#define X(kind, opcode, op, mode, cycles) [0x##opcode] = { op_##opcode, ADDR_MODE_##mode, cycles },
+const op_desc_t ops[256] = { OPCODES(X) };
+#undef X
+
+#define X(kind, opcode, op, mode, cycles) [0x##opcode] = #op,
+const char *const op_names[256] = { OPCODES(X) };
+#undef X
+
+const uint8_t addr_mode_length[] = {
+    [ADDR_MODE_ABSOLUTE] = 3,
+    [ADDR_MODE_ABSOLUTE_INDEXED_INDIRECT] = 3,
+    [ADDR_MODE_ABSOLUTE_X] = 3,
+    [ADDR_MODE_ABSOLUTE_Y] = 3,
+    [ADDR_MODE_ABSOLUTE_INDIRECT] = 3,
+    [ADDR_MODE_ACCUMULATOR] = 1,
+    [ADDR_MODE_IMMEDIATE] = 2,
+    [ADDR_MODE_IMPLIED] = 1,
+    [ADDR_MODE_RELATIVE] = 2,
+    [ADDR_MODE_ZEROPAGE] = 2,
+    [ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT] = 2,
+    [ADDR_MODE_ZEROPAGE_X] = 2,
+    [ADDR_MODE_ZEROPAGE_Y] = 2,
+    [ADDR_MODE_ZEROPAGE_INDIRECT] = 2,
+    [ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED] = 2,
+    [ADDR_MODE_ZEROPAGE_RELATIVE] = 3,
 };
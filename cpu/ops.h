@@ -3,15 +3,6 @@
 
 #include "cpu.h"
 
-typedef enum
-{
-    OPERAND_TYPE_NONE,
-    OPERAND_TYPE_WORD,
-    OPERAND_TYPE_ADDRESS,
-    OPERAND_TYPE_ACCUMULATOR,
-    OPERAND_TYPE_WORD_ADDRESS, /* In this case, word and address are unrelated */
-} operand_type_t;
-
 /*
  * Reference: http://www.obelisk.me.uk/65C02/addressing.html and WDC datasheet
  */
@@ -35,21 +26,25 @@ typedef enum
     ADDR_MODE_ZEROPAGE_RELATIVE, /* Zero Page followed by Relative: zp+r */
 } addr_mode_t;
 
-typedef struct operand
-{
-    word_t word;
-    addr_t addr;
-    operand_type_t type;
-} operand_t;
-
-typedef void (*op_handler_t)(operand_t operand);
+/*
+ * Instruction handlers are specialized per addressing mode, and decode their
+ * own operands.
+ */
+typedef void (*op_handler_t)(void);
 
 typedef struct op_desc
 {
     op_handler_t handler;
     addr_mode_t addr_mode;
+    uint8_t cycles; /* base cycle count, handlers add penalties themselves */
 } op_desc_t;
 
-extern op_desc_t ops[];
+extern const op_desc_t ops[256];
+
+/* Name of the handler, e.g. "adc" or "bbr6", for tools */
+extern const char *const op_names[256];
+
+/* Instruction length in bytes, including the opcode */
+extern const uint8_t addr_mode_length[];
 
 #endif /* CPU_OPS_H_ */
@@ -0,0 +1,156 @@
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../core/sched.h"
+#include "../cpu/mem.h"
+#include "debug.h"
+
+#define BITMAP_WORDS ((1 << 16) / 64)
+#define WORDS_PER_PAGE (256 / 64)
+
+static uint64_t bitmap[DEBUG_KIND_COUNT][BITMAP_WORDS];
+
+static const uint16_t page_flag[DEBUG_KIND_COUNT] = {
+    [DEBUG_EXEC] = MEM_PAGE_BREAK,
+    [DEBUG_WATCH_READ] = MEM_PAGE_WATCH_READ,
+    [DEBUG_WATCH_WRITE] = MEM_PAGE_WATCH_WRITE,
+};
+
+static debug_stop_handler_t stop_handler = NULL;
+static debug_stop_t pending = { .reason = DEBUG_STOP_NONE };
+volatile sig_atomic_t debug_stop_requested = 0;
+static bool stepping = false;
+
+static bool bitmap_test(debug_kind_t kind, addr_t addr)
+{
+    return bitmap[kind][addr / 64] & (UINT64_C(1) << (addr % 64));
+}
+
+static void update_page(debug_kind_t kind, unsigned int page)
+{
+    const uint64_t *w = &bitmap[kind][page * WORDS_PER_PAGE];
+
+    if (w[0] | w[1] | w[2] | w[3])
+        mem_page_flags[page] |= page_flag[kind];
+    else
+        mem_page_flags[page] &= ~page_flag[kind];
+}
+
+/*
+ * Route every instruction fetch through debug_exec() until the next stop. This
+ * is how stops that don't belong to an address (single steps, watchpoints,
+ * interrupt requests) get delivered at an instruction boundary without adding
+ * a check to the instruction loop.
+ */
+static void break_everywhere(void)
+{
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] |= MEM_PAGE_BREAK;
+}
+
+static void restore_break_flags(void)
+{
+    for (int i = 0; i < 256; i++)
+        update_page(DEBUG_EXEC, i);
+}
+
+void debug_set_stop_handler(debug_stop_handler_t handler)
+{
+    stop_handler = handler;
+}
+
+void debug_insert(debug_kind_t kind, addr_t addr, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i++)
+    {
+        addr_t a = addr + i;
+        bitmap[kind][a / 64] |= UINT64_C(1) << (a % 64);
+        update_page(kind, a >> 8);
+    }
+}
+
+void debug_remove(debug_kind_t kind, addr_t addr, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i++)
+    {
+        addr_t a = addr + i;
+        bitmap[kind][a / 64] &= ~(UINT64_C(1) << (a % 64));
+        update_page(kind, a >> 8);
+    }
+}
+
+void debug_clear(void)
+{
+    for (int kind = 0; kind < DEBUG_KIND_COUNT; kind++)
+    {
+        for (int i = 0; i < BITMAP_WORDS; i++)
+            bitmap[kind][i] = 0;
+
+        for (int i = 0; i < 256; i++)
+            update_page(kind, i);
+    }
+
+    pending.reason = DEBUG_STOP_NONE;
+    stepping = false;
+}
+
+void debug_request_stop(void)
+{
+    debug_stop_requested = 1;
+    sched_kick();
+}
+
+/* Only from the emulation thread, the page flags aren't safe to touch from a signal handler */
+void debug_take_stop_request(void)
+{
+    break_everywhere();
+}
+
+void debug_step(void)
+{
+    stepping = true;
+    break_everywhere();
+}
+
+void debug_exec(addr_t pc)
+{
+    debug_stop_t stop = { .reason = DEBUG_STOP_NONE, .addr = pc };
+
+    if (pending.reason != DEBUG_STOP_NONE)
+        stop = pending;
+    else if (bitmap_test(DEBUG_EXEC, pc))
+        stop.reason = DEBUG_STOP_BREAK;
+    else if (debug_stop_requested)
+        stop.reason = DEBUG_STOP_INTERRUPT;
+    else if (stepping)
+        stop.reason = DEBUG_STOP_STEP;
+    else
+        return; /* some other address on this page */
+
+    pending.reason = DEBUG_STOP_NONE;
+    debug_stop_requested = 0;
+    stepping = false;
+    restore_break_flags();
+
+    if (stop_handler)
+        stop_handler(&stop);
+}
+
+void debug_access(addr_t addr, bool write)
+{
+    debug_kind_t kind = write ? DEBUG_WATCH_WRITE : DEBUG_WATCH_READ;
+    debug_kind_t other = write ? DEBUG_WATCH_READ : DEBUG_WATCH_WRITE;
+
+    if (!bitmap_test(kind, addr) || pending.reason != DEBUG_STOP_NONE)
+        return;
+
+    /* Let the instruction finish, then stop at the next fetch */
+    pending = (debug_stop_t){
+        .reason = DEBUG_STOP_WATCH,
+        .addr = addr,
+        .write = write,
+        .access = bitmap_test(other, addr),
+    };
+    break_everywhere();
+}
@@ -0,0 +1,81 @@
+#ifndef DEBUG_DEBUG_H_
+#define DEBUG_DEBUG_H_
+
+#include <signal.h>
+#include <stdbool.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * Breakpoint and watchpoint engine
+ *
+ * Every address has one bit per kind in a bitmap, and every page has a flag in
+ * mem_page_flags telling whether any of its addresses has a bit set. The
+ * memory access functions only look at the page flag, so as long as no
+ * breakpoint or watchpoint is set, the only cost is the page flag test.
+ */
+typedef enum
+{
+    DEBUG_EXEC,
+    DEBUG_WATCH_READ,
+    DEBUG_WATCH_WRITE,
+    DEBUG_KIND_COUNT,
+} debug_kind_t;
+
+typedef enum
+{
+    DEBUG_STOP_NONE,
+    DEBUG_STOP_BREAK, /* execution breakpoint */
+    DEBUG_STOP_WATCH, /* watchpoint, see debug_stop_t.write */
+    DEBUG_STOP_STEP, /* single step finished */
+    DEBUG_STOP_INTERRUPT, /* debug_request_stop() */
+} debug_reason_t;
+
+typedef struct
+{
+    debug_reason_t reason;
+    addr_t addr; /* breakpoint or watchpoint address */
+    bool write; /* for watchpoints: triggered by a write */
+    bool access; /* for watchpoints: both read and write are watched */
+} debug_stop_t;
+
+/*
+ * Called with the machine stopped at an instruction boundary. When it returns,
+ * execution resumes at reg.pc.
+ */
+typedef void (*debug_stop_handler_t)(const debug_stop_t *stop);
+
+void debug_set_stop_handler(debug_stop_handler_t handler);
+
+void debug_insert(debug_kind_t kind, addr_t addr, unsigned int len);
+void debug_remove(debug_kind_t kind, addr_t addr, unsigned int len);
+void debug_clear(void);
+
+/*
+ * Stop before the next instruction. Async-signal-safe: it only raises a flag
+ * and kicks the scheduler, so a signal handler has to run on the thread of
+ * the CPU to stop. The CPU takes the request up with debug_poll() between
+ * batches of instructions.
+ */
+void debug_request_stop(void);
+
+extern volatile sig_atomic_t debug_stop_requested;
+void debug_take_stop_request(void);
+
+static inline void debug_poll(void)
+{
+    if (debug_stop_requested)
+        debug_take_stop_request();
+}
+
+/* Resume and stop again after one instruction */
+void debug_step(void);
+
+/*
+ * Hooks for the memory access functions. Only to be called when the page flag
+ * is set.
+ */
+void debug_exec(addr_t pc);
+void debug_access(addr_t addr, bool write);
+
+#endif /* DEBUG_DEBUG_H_ */
@@ -0,0 +1,385 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu/mem.h"
+#include "../utils/spsc.h"
+#include "diff.h"
+#include "refcpu.h"
+
+#define QUEUE_SIZE (1 << 16)
+
+/* Records between publishing the ring's indices, see utils/spsc.h */
+#define PUBLISH_BATCH 256
+
+#define HISTORY 16
+
+/* B and bit 5 only exist in pushed copies of P */
+#define P_MASK ((uint8_t)~(REF_B | REF_U))
+
+typedef enum
+{
+    REC_EXEC, /* about to execute an instruction */
+    REC_WRITE,
+    REC_READ, /* from a memory mapped device */
+    REC_INTERRUPT,
+    REC_SYNC_REGS,
+    REC_SYNC_MEM,
+} record_type_t;
+
+typedef struct
+{
+    uint64_t cycles;
+    uint16_t addr; /* pc for EXEC and SYNC_REGS, the vector for INTERRUPT */
+    uint8_t type;
+    uint8_t value;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t s;
+    uint8_t p;
+} record_t;
+
+static const char *const record_names[] = {
+    [REC_EXEC] = "instruction",
+    [REC_WRITE] = "write",
+    [REC_READ] = "device read",
+    [REC_INTERRUPT] = "interrupt",
+    [REC_SYNC_REGS] = "register sync",
+    [REC_SYNC_MEM] = "memory sync",
+};
+
+static record_t queue[QUEUE_SIZE];
+static spsc_t ring;
+static atomic_bool diverged;
+
+/* CPU thread side */
+static bool active = false;
+static pthread_t thread;
+
+/* Checker side */
+static ref_cpu_t ref;
+static uint8_t ref_mem[1 << 16];
+static bool io_page[256];
+static bool rom_page[256];
+static uint64_t expected_cycles;
+static bool cycles_known;
+static uint64_t instructions;
+static record_t history[HISTORY];
+
+/*
+ * CPU thread
+ */
+static void check_diverged(void)
+{
+    if (!atomic_load_explicit(&diverged, memory_order_acquire))
+        return;
+
+    fprintf(stderr, "diff: stopped at the first divergence\n");
+    exit(EXIT_FAILURE);
+}
+
+static void push_record(const record_t *rec)
+{
+    if (spsc_full(&ring))
+        spsc_wait_for_space(&ring, check_diverged);
+
+    queue[spsc_back(&ring)] = *rec;
+    spsc_push(&ring);
+}
+
+static void push_registers(record_type_t type)
+{
+    record_t rec = {
+        .type = type,
+        .cycles = cpu_cycles,
+        .addr = reg.pc,
+        .a = reg.a,
+        .x = reg.x,
+        .y = reg.y,
+        .s = reg.s,
+        .p = procstat_to_word(reg.p),
+    };
+
+    push_record(&rec);
+}
+
+static void push_access(record_type_t type, addr_t addr, word_t word)
+{
+    record_t rec = { .type = type, .addr = addr, .value = word };
+
+    push_record(&rec);
+}
+
+void diff_exec(addr_t pc)
+{
+    (void)pc;
+    push_registers(REC_EXEC);
+
+    if (spsc_publish_batch(&ring))
+        check_diverged();
+}
+
+void diff_write(addr_t addr, word_t word)
+{
+    push_access(REC_WRITE, addr, word);
+}
+
+void diff_io_read(addr_t addr, word_t word)
+{
+    push_access(REC_READ, addr, word);
+}
+
+void diff_interrupt(addr_t vector)
+{
+    if (active)
+        push_access(REC_INTERRUPT, vector, 0);
+}
+
+void diff_sync_registers(void)
+{
+    if (active)
+        push_registers(REC_SYNC_REGS);
+}
+
+void diff_sync_memory(addr_t addr, word_t word)
+{
+    if (active)
+        push_access(REC_SYNC_MEM, addr, word);
+}
+
+/*
+ * Checker thread
+ */
+static void print_registers(const char *label, uint16_t pc, uint8_t a, uint8_t x, uint8_t y,
+                            uint8_t s, uint8_t p)
+{
+    fprintf(stderr, "  %-10s pc=%04x a=%02x x=%02x y=%02x s=%02x p=%02x\n", label, pc, a, x, y, s,
+            p);
+}
+
+static void dump_memory(uint16_t first, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i += 16)
+    {
+        fprintf(stderr, "  %04x:", first + i);
+        for (unsigned int j = 0; j < 16; j++)
+            fprintf(stderr, " %02x", ref_mem[(uint16_t)(first + i + j)]);
+        fprintf(stderr, "\n");
+    }
+}
+
+static _Noreturn void diverge(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "diff: divergence after %llu instructions: ", (unsigned long long)instructions);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "last instructions, oldest first:\n");
+    for (uint64_t i = instructions > HISTORY ? instructions - HISTORY : 0; i < instructions; i++)
+    {
+        const record_t *h = &history[i % HISTORY];
+        char label[32];
+
+        snprintf(label, sizeof(label), "@%llu", (unsigned long long)h->cycles);
+        print_registers(label, h->addr, h->a, h->x, h->y, h->s, h->p);
+    }
+
+    fprintf(stderr, "reference core:\n");
+    print_registers("", ref.pc, ref.a, ref.x, ref.y, ref.s, ref.p);
+    fprintf(stderr, "  expected cycle %llu%s\n", (unsigned long long)expected_cycles,
+            cycles_known ? "" : " (unknown)");
+    fprintf(stderr, "reference memory, zero page and stack:\n");
+    dump_memory(0x0000, 0x200);
+    fprintf(stderr, "reference memory around pc:\n");
+    dump_memory((ref.pc & 0xFFF0) - 0x20, 0x50);
+
+    atomic_store_explicit(&diverged, true, memory_order_release);
+    pthread_exit(NULL);
+}
+
+/* Returns false once the CPU thread has stopped and everything is checked */
+static bool next_record(record_t *rec)
+{
+    if (!spsc_wait(&ring))
+        return false;
+
+    *rec = queue[spsc_front(&ring)];
+    spsc_pop(&ring);
+
+    return true;
+}
+
+/* Next record in the middle of an instruction, running out is a divergence */
+static record_t expect_record(record_type_t type, uint16_t addr)
+{
+    record_t rec;
+
+    if (!next_record(&rec))
+        diverge("main core did no %s at %04x", record_names[type], addr);
+
+    if (rec.type != type)
+        diverge("main core did %s at %04x, reference %s at %04x", record_names[rec.type],
+                rec.addr, record_names[type], addr);
+
+    if (rec.addr != addr)
+        diverge("%s at %04x, reference at %04x", record_names[type], rec.addr, addr);
+
+    return rec;
+}
+
+static uint8_t ref_read(ref_cpu_t *cpu, uint16_t addr)
+{
+    if (io_page[addr >> 8])
+        return expect_record(REC_READ, addr).value;
+
+    return ref_mem[addr];
+}
+
+static void ref_write(ref_cpu_t *cpu, uint16_t addr, uint8_t value)
+{
+    record_t rec = expect_record(REC_WRITE, addr);
+
+    if (rec.value != value)
+        diverge("write of %02x to %04x, reference wrote %02x", rec.value, addr, value);
+
+    if (!rom_page[addr >> 8])
+        ref_mem[addr] = value;
+}
+
+static void check_exec(const record_t *rec)
+{
+    if (rec->addr != ref.pc || rec->a != ref.a || rec->x != ref.x || rec->y != ref.y ||
+        rec->s != ref.s || (rec->p & P_MASK) != (ref.p & P_MASK))
+        diverge("main core at pc=%04x a=%02x x=%02x y=%02x s=%02x p=%02x on cycle %llu",
+                rec->addr, rec->a, rec->x, rec->y, rec->s, rec->p,
+                (unsigned long long)rec->cycles);
+
+    if (cycles_known && rec->cycles != expected_cycles)
+        diverge("main core at cycle %llu, reference at %llu", (unsigned long long)rec->cycles,
+                (unsigned long long)expected_cycles);
+
+    history[instructions % HISTORY] = *rec;
+    instructions++;
+    expected_cycles = rec->cycles;
+    cycles_known = true;
+}
+
+static void *checker(void *arg)
+{
+    record_t rec;
+
+    while (next_record(&rec))
+    {
+        switch (rec.type)
+        {
+        case REC_EXEC:
+            check_exec(&rec);
+            expected_cycles += ref_step(&ref);
+
+            /* How long WAI waits depends on the devices, which we don't have */
+            if (ref.waiting)
+            {
+                ref.waiting = false;
+                cycles_known = false;
+            }
+            break;
+        case REC_INTERRUPT:
+            expected_cycles += ref_interrupt(&ref, rec.addr);
+            break;
+        case REC_SYNC_REGS:
+            ref.pc = rec.addr;
+            ref.a = rec.a;
+            ref.x = rec.x;
+            ref.y = rec.y;
+            ref.s = rec.s;
+            ref.p = rec.p;
+            break;
+        case REC_SYNC_MEM:
+            ref_mem[rec.addr] = rec.value;
+            break;
+        default:
+            diverge("main core did %s at %04x between instructions", record_names[rec.type],
+                    rec.addr);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Control
+ */
+int diff_start(void)
+{
+    if (active)
+        return 0;
+
+    if (!CPU_CMOS)
+    {
+        fprintf(stderr, "diff: the reference core is a 65C02, not " CPU_VARIANT_NAME "\n");
+        return -1;
+    }
+
+    ref = (ref_cpu_t){
+        .a = reg.a,
+        .x = reg.x,
+        .y = reg.y,
+        .s = reg.s,
+        .p = procstat_to_word(reg.p),
+        .pc = reg.pc,
+        .read = ref_read,
+        .write = ref_write,
+    };
+    mem_read_block(0, ref_mem, sizeof(ref_mem));
+
+    for (int i = 0; i < 256; i++)
+    {
+        io_page[i] = mem_page_flags[i] & MEM_PAGE_IO;
+        rom_page[i] = mem_page_flags[i] & MEM_PAGE_ROM;
+    }
+
+    spsc_init(&ring, QUEUE_SIZE, PUBLISH_BATCH);
+    atomic_store(&diverged, false);
+    instructions = 0;
+    cycles_known = false;
+
+    if (pthread_create(&thread, NULL, checker, NULL) != 0)
+    {
+        fprintf(stderr, "diff: can't start checker thread\n");
+        return -1;
+    }
+
+    active = true;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] |= MEM_PAGE_DIFF;
+
+    return 0;
+}
+
+int diff_stop(void)
+{
+    if (!active)
+        return 0;
+
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] &= ~MEM_PAGE_DIFF;
+
+    spsc_stop(&ring);
+    pthread_join(thread, NULL);
+    active = false;
+
+    return atomic_load(&diverged) ? -1 : 0;
+}
+
+bool diff_active(void)
+{
+    return active;
+}
@@ -0,0 +1,46 @@
+#ifndef DEBUG_DIFF_H_
+#define DEBUG_DIFF_H_
+
+#include <stdbool.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * Lockstep differential checking
+ *
+ * The main core streams what it does into a lock-free queue: the registers at
+ * every instruction boundary, every memory write, every read from a memory
+ * mapped device and every interrupt it takes. A checker thread replays the
+ * stream on the reference core in debug/refcpu.c, which gets the device reads
+ * from the stream and has to come up with the same writes, registers and
+ * cycle counts on its own.
+ *
+ * The first divergence is dumped to stderr and the emulator exits. All pages
+ * are flagged MEM_PAGE_DIFF while checking, so none of this costs anything
+ * when it's off.
+ */
+
+/* Snapshot the machine and start checking from here on. Returns -1 on error. */
+int diff_start(void);
+
+/* Wait for the checker to catch up and stop it. Returns -1 if it diverged. */
+int diff_stop(void);
+
+bool diff_active(void);
+
+/*
+ * Hooks for the instruction loop and the memory access functions. Only to be
+ * called when the page flag is set.
+ */
+void diff_exec(addr_t pc);
+void diff_write(addr_t addr, word_t word);
+void diff_io_read(addr_t addr, word_t word);
+
+/* Interrupt entry, called whether checking or not */
+void diff_interrupt(addr_t vector);
+
+/* State changed from outside the program, e.g. by a debugger */
+void diff_sync_registers(void);
+void diff_sync_memory(addr_t addr, word_t word);
+
+#endif /* DEBUG_DIFF_H_ */
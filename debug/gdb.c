@@ -0,0 +1,692 @@
+/*
+ * Reference: https://sourceware.org/gdb/current/onlinedocs/gdb/Remote-Protocol.html
+ */
+#define _GNU_SOURCE /* F_SETOWN_EX */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "debug.h"
+#include "diff.h"
+#include "gdb.h"
+
+#define PACKET_SIZE 4096
+#define REG_COUNT 6
+
+static int conn = -1;
+static bool no_ack = false;
+static volatile sig_atomic_t running = 0;
+static debug_stop_t last_stop = { .reason = DEBUG_STOP_STEP };
+static void (*kill_handler)(void) = NULL;
+
+static char inbuf[256];
+static size_t inbuf_len = 0;
+static size_t inbuf_pos = 0;
+
+static const char hexdigits[] = "0123456789abcdef";
+
+/*
+ * Connection I/O
+ */
+static int conn_getc(void)
+{
+    while (inbuf_pos == inbuf_len)
+    {
+        ssize_t n = read(conn, inbuf, sizeof(inbuf));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        inbuf_len = n;
+        inbuf_pos = 0;
+    }
+
+    return (unsigned char)inbuf[inbuf_pos++];
+}
+
+static void conn_write(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(conn, data, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+
+        data += n;
+        len -= n;
+    }
+}
+
+static int hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static unsigned long parse_hex(const char **s)
+{
+    unsigned long value = 0;
+    int digit;
+
+    while ((digit = hex_value(**s)) >= 0)
+    {
+        value = (value << 4) | digit;
+        (*s)++;
+    }
+
+    return value;
+}
+
+static char *put_hex8(char *out, uint8_t value)
+{
+    *out++ = hexdigits[value >> 4];
+    *out++ = hexdigits[value & 0xF];
+    return out;
+}
+
+static void put_packet(const char *data)
+{
+    char buf[PACKET_SIZE + 4];
+    size_t len = strlen(data);
+    uint8_t sum = 0;
+
+    buf[0] = '$';
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i + 1] = data[i];
+        sum += (uint8_t)data[i];
+    }
+    buf[len + 1] = '#';
+    put_hex8(&buf[len + 2], sum);
+
+    /* We don't bother with retransmits, TCP and Unix sockets are reliable */
+    conn_write(buf, len + 4);
+}
+
+/*
+ * Read one packet into buf. Returns the payload length, or -1 if the debugger
+ * went away.
+ */
+static int get_packet(char *buf, size_t size)
+{
+    int c;
+
+    for (;;)
+    {
+        size_t len = 0;
+        uint8_t sum = 0;
+
+        /* Skip acks and stray interrupt requests while stopped */
+        do
+        {
+            if ((c = conn_getc()) < 0)
+                return -1;
+        } while (c != '$');
+
+        while ((c = conn_getc()) != '#')
+        {
+            if (c < 0)
+                return -1;
+            if (len + 1 < size)
+                buf[len++] = c;
+            sum += c;
+        }
+        buf[len] = '\0';
+
+        int hi = hex_value(conn_getc());
+        int lo = hex_value(conn_getc());
+
+        if (no_ack)
+            return len;
+
+        if (hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum)
+        {
+            conn_write("+", 1);
+            return len;
+        }
+
+        conn_write("-", 1);
+    }
+}
+
+/*
+ * Register access
+ */
+static unsigned int reg_get(int nr)
+{
+    switch (nr)
+    {
+    case 0:
+        return reg.a;
+    case 1:
+        return reg.x;
+    case 2:
+        return reg.y;
+    case 3:
+        return procstat_to_word(reg.p);
+    case 4:
+        return reg.s;
+    case 5:
+        return reg.pc;
+    default:
+        return 0;
+    }
+}
+
+static void reg_set(int nr, unsigned int value)
+{
+    switch (nr)
+    {
+    case 0:
+        reg.a = value;
+        break;
+    case 1:
+        reg.x = value;
+        break;
+    case 2:
+        reg.y = value;
+        break;
+    case 3:
+        reg.p = word_to_procstat(value);
+        break;
+    case 4:
+        reg.s = value;
+        break;
+    case 5:
+        reg.pc = value;
+        break;
+    default:
+        return;
+    }
+
+    /* The reference core has to follow what the debugger does */
+    diff_sync_registers();
+}
+
+static int reg_size(int nr)
+{
+    return nr == 5 ? 2 : 1;
+}
+
+static char *put_reg(char *out, int nr)
+{
+    unsigned int value = reg_get(nr);
+
+    for (int i = 0; i < reg_size(nr); i++)
+        out = put_hex8(out, value >> (8 * i));
+
+    return out;
+}
+
+/* Parse a little-endian register value and advance s */
+static unsigned int parse_reg(const char **s, int nr)
+{
+    unsigned int value = 0;
+
+    for (int i = 0; i < reg_size(nr); i++)
+    {
+        int hi = hex_value((*s)[0]);
+        int lo = hi >= 0 ? hex_value((*s)[1]) : -1;
+
+        if (lo < 0)
+            break;
+
+        value |= ((hi << 4) | lo) << (8 * i);
+        *s += 2;
+    }
+
+    return value;
+}
+
+/*
+ * Command handlers
+ */
+static void reply_stop(void)
+{
+    char buf[32];
+
+    switch (last_stop.reason)
+    {
+    case DEBUG_STOP_WATCH:
+        snprintf(buf, sizeof(buf), "T05%s:%04x;",
+                 last_stop.access ? "awatch" : last_stop.write ? "watch" : "rwatch",
+                 last_stop.addr);
+        break;
+    case DEBUG_STOP_INTERRUPT:
+        snprintf(buf, sizeof(buf), "S02"); /* SIGINT */
+        break;
+    default:
+        snprintf(buf, sizeof(buf), "S05"); /* SIGTRAP */
+        break;
+    }
+
+    put_packet(buf);
+}
+
+static void read_registers(void)
+{
+    char buf[2 * 7 + 1];
+    char *out = buf;
+
+    for (int i = 0; i < REG_COUNT; i++)
+        out = put_reg(out, i);
+    *out = '\0';
+
+    put_packet(buf);
+}
+
+static void write_registers(const char *args)
+{
+    for (int i = 0; i < REG_COUNT && *args; i++)
+        reg_set(i, parse_reg(&args, i));
+
+    put_packet("OK");
+}
+
+static void read_register(const char *args)
+{
+    char buf[8];
+    int nr = parse_hex(&args);
+
+    if (nr >= REG_COUNT)
+    {
+        put_packet("E01");
+        return;
+    }
+
+    *put_reg(buf, nr) = '\0';
+    put_packet(buf);
+}
+
+static void write_register(const char *args)
+{
+    int nr = parse_hex(&args);
+
+    if (nr >= REG_COUNT || *args++ != '=')
+    {
+        put_packet("E01");
+        return;
+    }
+
+    reg_set(nr, parse_reg(&args, nr));
+    put_packet("OK");
+}
+
+/*
+ * Memory is accessed directly rather than through mem_read()/mem_write(), so
+ * that the debugger doesn't trigger watchpoints or device side effects.
+ */
+static void read_memory(const char *args)
+{
+    char buf[PACKET_SIZE];
+    char *out = buf;
+    addr_t addr = parse_hex(&args);
+    unsigned long len = *args == ',' ? (args++, parse_hex(&args)) : 0;
+
+    if (len > (PACKET_SIZE - 1) / 2)
+        len = (PACKET_SIZE - 1) / 2;
+
+    for (unsigned long i = 0; i < len; i++)
+        out = put_hex8(out, mem_peek(addr + i));
+    *out = '\0';
+
+    put_packet(buf);
+}
+
+static void write_memory(const char *args)
+{
+    addr_t addr = parse_hex(&args);
+    unsigned long len = *args == ',' ? (args++, parse_hex(&args)) : 0;
+
+    if (*args++ != ':')
+    {
+        put_packet("E01");
+        return;
+    }
+
+    for (unsigned long i = 0; i < len; i++)
+    {
+        int hi = hex_value(args[0]);
+        int lo = hi >= 0 ? hex_value(args[1]) : -1;
+
+        if (lo < 0)
+        {
+            put_packet("E01");
+            return;
+        }
+
+        mem_poke(addr + i, (hi << 4) | lo);
+        diff_sync_memory(addr + i, mem_peek(addr + i));
+        args += 2;
+    }
+
+    put_packet("OK");
+}
+
+/* Z/z packets: "type,addr,kind" */
+static void breakpoint(const char *args, bool insert)
+{
+    int type = parse_hex(&args);
+    addr_t addr;
+    unsigned int len;
+
+    if (*args++ != ',')
+    {
+        put_packet("E01");
+        return;
+    }
+    addr = parse_hex(&args);
+    len = *args == ',' ? (args++, parse_hex(&args)) : 1;
+
+    if (len == 0 || type > 4)
+    {
+        put_packet(""); /* unsupported */
+        return;
+    }
+
+    void (*op)(debug_kind_t, addr_t, unsigned int) = insert ? debug_insert : debug_remove;
+
+    switch (type)
+    {
+    case 0: /* software breakpoint */
+    case 1: /* hardware breakpoint, same thing for us */
+        op(DEBUG_EXEC, addr, 1);
+        break;
+    case 2:
+        op(DEBUG_WATCH_WRITE, addr, len);
+        break;
+    case 3:
+        op(DEBUG_WATCH_READ, addr, len);
+        break;
+    case 4:
+        op(DEBUG_WATCH_READ, addr, len);
+        op(DEBUG_WATCH_WRITE, addr, len);
+        break;
+    }
+
+    put_packet("OK");
+}
+
+/*
+ * "monitor" commands:
+ *   accuracy instruction|cycle|pin: change the accuracy level
+ */
+static void monitor(const char *args)
+{
+    char cmd[128];
+    size_t len = 0;
+    accuracy_t accuracy;
+
+    while (len + 1 < sizeof(cmd) && hex_value(args[0]) >= 0 && hex_value(args[1]) >= 0)
+    {
+        cmd[len++] = (hex_value(args[0]) << 4) | hex_value(args[1]);
+        args += 2;
+    }
+    cmd[len] = '\0';
+
+    if (strncmp(cmd, "accuracy ", 9) == 0 && accuracy_from_name(cmd + 9, &accuracy) == 0)
+    {
+        mem_set_accuracy(accuracy);
+        put_packet("OK");
+    }
+    else
+    {
+        put_packet("E01");
+    }
+}
+
+static void query(const char *args)
+{
+    if (strncmp(args, "Rcmd,", 5) == 0)
+        monitor(args + 5);
+    else if (strncmp(args, "Supported", 9) == 0)
+        put_packet("PacketSize=1000;QStartNoAckMode+");
+    else if (strcmp(args, "Attached") == 0)
+        put_packet("1");
+    else if (strcmp(args, "C") == 0)
+        put_packet("QC1");
+    else if (strcmp(args, "fThreadInfo") == 0)
+        put_packet("m1");
+    else if (strcmp(args, "sThreadInfo") == 0)
+        put_packet("l");
+    else
+        put_packet("");
+}
+
+static void detach(void)
+{
+    debug_set_stop_handler(NULL);
+    debug_clear();
+    close(conn);
+    conn = -1;
+}
+
+/*
+ * Serve the debugger until it resumes the machine
+ */
+static void serve(void)
+{
+    char buf[PACKET_SIZE];
+
+    for (;;)
+    {
+        if (get_packet(buf, sizeof(buf)) < 0)
+        {
+            fprintf(stderr, "gdb: debugger disconnected\n");
+            detach();
+            return;
+        }
+
+        const char *args = &buf[1];
+
+        switch (buf[0])
+        {
+        case '?':
+            reply_stop();
+            break;
+        case 'g':
+            read_registers();
+            break;
+        case 'G':
+            write_registers(args);
+            break;
+        case 'p':
+            read_register(args);
+            break;
+        case 'P':
+            write_register(args);
+            break;
+        case 'm':
+            read_memory(args);
+            break;
+        case 'M':
+            write_memory(args);
+            break;
+        case 'Z':
+            breakpoint(args, true);
+            break;
+        case 'z':
+            breakpoint(args, false);
+            break;
+        case 'q':
+            query(args);
+            break;
+        case 'Q':
+            if (strcmp(args, "StartNoAckMode") == 0)
+            {
+                put_packet("OK");
+                no_ack = true;
+            }
+            else
+            {
+                put_packet("");
+            }
+            break;
+        case 'H':
+            put_packet("OK");
+            break;
+        case 'c':
+        case 's':
+            if (*args)
+                reg_set(5, parse_hex(&args));
+            if (buf[0] == 's')
+                debug_step();
+            running = 1;
+            return;
+        case 'D':
+            put_packet("OK");
+            detach();
+            return;
+        case 'k':
+            detach();
+            if (!kill_handler)
+                exit(0);
+            kill_handler();
+            return;
+        default:
+            put_packet("");
+            break;
+        }
+    }
+}
+
+static void stopped(const debug_stop_t *stop)
+{
+    last_stop = *stop;
+
+    /* Only report stops the debugger is waiting for */
+    if (running)
+    {
+        running = 0;
+        reply_stop();
+    }
+
+    serve();
+}
+
+/*
+ * The debugger sends a single 0x03 byte to interrupt a running target. Rather
+ * than polling the socket from the instruction loop, we get SIGIO when data
+ * arrives and turn that into a stop request. The signal goes to the emulation
+ * thread, whose scheduler the request kicks.
+ */
+static void sigio_handler(int sig)
+{
+    (void)sig;
+
+    if (running)
+        debug_request_stop();
+}
+
+static int listen_socket(const char *spec)
+{
+    int fd;
+
+    if (strncmp(spec, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sa = { .sun_family = AF_UNIX };
+
+        if (strlen(spec + 5) >= sizeof(sa.sun_path))
+        {
+            fprintf(stderr, "gdb: socket path too long: %s\n", spec + 5);
+            return -1;
+        }
+        strcpy(sa.sun_path, spec + 5);
+        unlink(sa.sun_path);
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+            goto err;
+    }
+    else
+    {
+        struct sockaddr_in sa = {
+            .sin_family = AF_INET,
+            .sin_port = htons(atoi(spec)),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        int one = 1;
+
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+            return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+            goto err;
+    }
+
+    if (listen(fd, 1) < 0)
+        goto err;
+
+    return fd;
+
+err:
+    close(fd);
+    return -1;
+}
+
+int gdb_stub_open(const char *spec)
+{
+    struct sigaction sa = { .sa_handler = sigio_handler };
+    struct f_owner_ex owner = { .type = F_OWNER_TID, .pid = syscall(SYS_gettid) };
+    int fd = listen_socket(spec);
+    int one = 1;
+
+    if (fd < 0)
+    {
+        perror("gdb: listen");
+        return -1;
+    }
+
+    fprintf(stderr, "gdb: waiting for connection on %s\n", spec);
+    conn = accept(fd, NULL, NULL);
+    close(fd);
+
+    if (conn < 0)
+    {
+        perror("gdb: accept");
+        return -1;
+    }
+
+    /* Fails harmlessly on Unix sockets */
+    setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGIO, &sa, NULL);
+    fcntl(conn, F_SETOWN_EX, &owner);
+    fcntl(conn, F_SETFL, fcntl(conn, F_GETFL) | O_ASYNC);
+
+    debug_set_stop_handler(stopped);
+    debug_step(); /* halt before the first instruction */
+
+    return 0;
+}
+
+void gdb_set_kill_handler(void (*handler)(void))
+{
+    kill_handler = handler;
+}
@@ -0,0 +1,25 @@
+#ifndef DEBUG_GDB_H_
+#define DEBUG_GDB_H_
+
+/*
+ * GDB Remote Serial Protocol stub
+ *
+ * spec is either a TCP port number on the loopback interface, or
+ * "unix:<path>" for a Unix domain socket. Blocks until a debugger connects,
+ * and stops the machine before the first instruction.
+ *
+ * Register layout for 'g'/'G'/'p'/'P', in this order:
+ *   0: a, 1: x, 2: y, 3: p, 4: s (one byte each), 5: pc (two bytes, little-endian)
+ *
+ * Returns 0 on success, -1 on error (reported on stderr).
+ */
+int gdb_stub_open(const char *spec);
+
+/*
+ * What a kill request from the debugger does, on the emulation thread at a
+ * stop. The debugger is detached first. Without a handler the process exits
+ * right away.
+ */
+void gdb_set_kill_handler(void (*handler)(void));
+
+#endif /* DEBUG_GDB_H_ */
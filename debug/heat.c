@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu/mem.h"
+#include "../cpu/ops.h"
+#include "heat.h"
+#include "symbols.h"
+
+uint8_t heat_map[1 << 16];
+uint8_t heat_next[256];
+
+static bool active = false;
+
+void heat_start(void)
+{
+    for (unsigned int h = 0; h < 256; h++)
+        heat_next[h] = h < HEAT_COUNT_MAX << HEAT_COUNT_SHIFT ? h + (1 << HEAT_COUNT_SHIFT) : h;
+
+    active = true;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] |= MEM_PAGE_HEAT;
+}
+
+void heat_stop(void)
+{
+    active = false;
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] &= ~MEM_PAGE_HEAT;
+}
+
+void heat_clear(void)
+{
+    memset(heat_map, 0, sizeof(heat_map));
+}
+
+bool heat_active(void)
+{
+    return active;
+}
+
+int heat_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (fwrite(heat_map, 1, sizeof(heat_map), f) != sizeof(heat_map) || fclose(f) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static unsigned int heat_count(addr_t addr)
+{
+    return heat_map[addr] >> HEAT_COUNT_SHIFT;
+}
+
+int heat_save_lcov(const char *path, const char *labels_path)
+{
+    symbol_table_t table;
+    const symbol_t *labels;
+    unsigned int lines_found = 0;
+    unsigned int lines_hit = 0;
+    int functions_hit = 0;
+    int count;
+    FILE *f;
+
+    if (symbols_load(labels_path, &table) < 0)
+        return -1;
+    labels = table.symbols;
+    count = table.count;
+
+    f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        symbols_free(&table);
+        return -1;
+    }
+
+    fprintf(f, "TN:fakeoid\nSF:%s\n", labels_path);
+
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(f, "FN:%u,%s\n", labels[i].addr, labels[i].name);
+        fprintf(f, "FNDA:%u,%s\n", heat_count(labels[i].addr), labels[i].name);
+        functions_hit += (heat_map[labels[i].addr] & HEAT_EXEC) != 0;
+    }
+    fprintf(f, "FNF:%d\nFNH:%d\n", count, functions_hit);
+
+    /*
+     * Executed opcodes are known to start instructions, so the decoding gets
+     * back in step with the code after running through data
+     */
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t end = i + 1 < count ? labels[i + 1].addr : 0x10000;
+        uint32_t addr = labels[i].addr;
+
+        while (addr < end)
+        {
+            bool hit = heat_map[addr] & HEAT_EXEC;
+            uint32_t next = addr + addr_mode_length[ops[mem_peek(addr)].addr_mode];
+
+            fprintf(f, "DA:%u,%u\n", addr, hit ? heat_count(addr) : 0);
+            lines_found++;
+            lines_hit += hit;
+
+            for (uint32_t b = addr + 1; !hit && b < next && b < end; b++)
+            {
+                if (heat_map[b] & HEAT_EXEC)
+                    next = b;
+            }
+            addr = next;
+        }
+    }
+    fprintf(f, "LF:%u\nLH:%u\nend_of_record\n", lines_found, lines_hit);
+    symbols_free(&table);
+
+    if (fclose(f) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
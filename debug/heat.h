@@ -0,0 +1,56 @@
+#ifndef DEBUG_HEAT_H_
+#define DEBUG_HEAT_H_
+
+#include <stdbool.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * Guest memory heatmap
+ *
+ * A shadow byte per guest address. The low bits tell whether the address was
+ * ever read, written or executed as the first byte of an instruction, the
+ * high bits count accesses and stick at HEAT_COUNT_MAX. Instruction fetches
+ * are reads, so operand bytes show up as read and opcode bytes as both.
+ *
+ * All pages are flagged MEM_PAGE_HEAT while recording, nothing is spent on it
+ * otherwise. The map is 64k, small enough to stay in cache next to memory.
+ */
+#define HEAT_READ BIT(0)
+#define HEAT_WRITE BIT(1)
+#define HEAT_EXEC BIT(2)
+#define HEAT_COUNT_SHIFT 3
+#define HEAT_COUNT_MAX 31
+
+extern uint8_t heat_map[1 << 16];
+/* Each shadow byte counted once more, unless saturated, set up by heat_start() */
+extern uint8_t heat_next[256];
+
+void heat_start(void);
+void heat_stop(void);
+void heat_clear(void);
+bool heat_active(void);
+
+/*
+ * Hook for the memory access functions, only to be called when the page flag
+ * is set. Opcode fetches pass HEAT_READ | HEAT_EXEC.
+ */
+static inline void heat_access(addr_t addr, uint8_t kind)
+{
+    heat_map[addr] = heat_next[heat_map[addr] | kind];
+}
+
+/* Write the raw map, one byte per address from $0000. Returns -1 on error. */
+int heat_save(const char *path);
+
+/*
+ * Write an lcov tracefile for the code described by a symbol file, see
+ * debug/symbols.h. Each label becomes a function and the code up to the next
+ * label is decoded into instructions, reported as lines numbered by address.
+ * Only code labels should be given, data would be decoded as instructions
+ * never executed.
+ * Returns -1 on error.
+ */
+int heat_save_lcov(const char *path, const char *labels);
+
+#endif /* DEBUG_HEAT_H_ */
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "irqlat.h"
+
+/* An assertion time that isn't there */
+#define NONE UINT64_MAX
+
+CPU_LOCAL bool irqlat_active = false;
+
+static char names[IRQLAT_SOURCES][IRQLAT_NAME_LEN];
+static irqlat_hist_t hists[IRQLAT_SOURCES][IRQLAT_KINDS];
+
+/* When each line went active, NONE once the CPU has taken it */
+static uint64_t asserted[IRQLAT_SOURCES];
+
+/* Handlers being run, with the sources they're for */
+static struct
+{
+    uint64_t start;
+    unsigned int sources;
+} handlers[IRQLAT_DEPTH];
+static unsigned int depth;
+
+static const char *const kind_names[IRQLAT_KINDS] = {
+    [IRQLAT_LATENCY] = "latency",
+    [IRQLAT_DURATION] = "duration",
+};
+
+static int bucket(uint64_t value)
+{
+    int shift;
+
+    if (value < 2 * IRQLAT_SUB_BUCKETS)
+        return value;
+
+    shift = 63 - __builtin_clzll(value) - IRQLAT_SUB_BITS;
+    return ((shift + 1) << IRQLAT_SUB_BITS) + (value >> shift) - IRQLAT_SUB_BUCKETS;
+}
+
+static uint64_t bucket_low(int i)
+{
+    int shift;
+
+    if (i < 2 * IRQLAT_SUB_BUCKETS)
+        return i;
+
+    shift = (i >> IRQLAT_SUB_BITS) - 1;
+    return (uint64_t)((i & (IRQLAT_SUB_BUCKETS - 1)) + IRQLAT_SUB_BUCKETS) << shift;
+}
+
+static uint64_t bucket_high(int i)
+{
+    if (i < 2 * IRQLAT_SUB_BUCKETS)
+        return i;
+
+    return bucket_low(i) + (UINT64_C(1) << ((i >> IRQLAT_SUB_BITS) - 1)) - 1;
+}
+
+static void add(irqlat_hist_t *hist, uint64_t value)
+{
+    hist->buckets[bucket(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+void irqlat_name(unsigned int source, const char *name)
+{
+    for (int i = 0; i < IRQLAT_IRQ_SOURCES; i++)
+        if (source & BIT(i))
+            snprintf(names[i], IRQLAT_NAME_LEN, "%s", name);
+}
+
+const char *irqlat_source_name(int index)
+{
+    if (!names[index][0])
+    {
+        if (index == IRQLAT_NMI)
+            snprintf(names[index], IRQLAT_NAME_LEN, "nmi");
+        else
+            snprintf(names[index], IRQLAT_NAME_LEN, "irq%d", index);
+    }
+
+    return names[index];
+}
+
+void irqlat_start(void)
+{
+    memset(hists, 0, sizeof(hists));
+    for (int i = 0; i < IRQLAT_SOURCES; i++)
+        asserted[i] = NONE;
+    depth = 0;
+    irqlat_active = true;
+}
+
+void irqlat_stop(void)
+{
+    irqlat_active = false;
+}
+
+const irqlat_hist_t *irqlat_hist(int index, irqlat_kind_t kind)
+{
+    return &hists[index][kind];
+}
+
+uint64_t irqlat_quantile(const irqlat_hist_t *hist, double q)
+{
+    uint64_t want = q * hist->count;
+    uint64_t seen = 0;
+
+    if (!hist->count)
+        return 0;
+
+    for (int i = 0; i < IRQLAT_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen > want || seen == hist->count)
+            return bucket_high(i) < hist->max ? bucket_high(i) : hist->max;
+    }
+
+    return hist->max;
+}
+
+/*
+ * Emulation thread
+ */
+void irqlat_record_lines(unsigned int sources, bool active)
+{
+    for (unsigned int s = sources & (BIT(IRQLAT_IRQ_SOURCES) - 1); s; s &= s - 1)
+        asserted[__builtin_ctz(s)] = active ? cpu_cycles : NONE;
+}
+
+void irqlat_record_nmi(void)
+{
+    /* Another edge before the CPU got to the first doesn't restart the clock */
+    if (asserted[IRQLAT_NMI] == NONE)
+        asserted[IRQLAT_NMI] = cpu_cycles;
+}
+
+void irqlat_record_enter(addr_t vector, unsigned int sources)
+{
+    unsigned int slot = depth++ % IRQLAT_DEPTH;
+
+    if (vector == VECTOR_NMIB)
+        sources = BIT(IRQLAT_NMI);
+    sources &= BIT(IRQLAT_SOURCES) - 1;
+
+    handlers[slot].start = cpu_cycles;
+    handlers[slot].sources = sources;
+
+    for (unsigned int s = sources; s; s &= s - 1)
+    {
+        int i = __builtin_ctz(s);
+
+        if (asserted[i] != NONE)
+        {
+            add(&hists[i][IRQLAT_LATENCY], cpu_cycles - asserted[i]);
+            asserted[i] = NONE;
+        }
+    }
+}
+
+void irqlat_record_return(void)
+{
+    unsigned int slot;
+
+    /* An RTI used as a jump, or returning from before recording started */
+    if (!depth)
+        return;
+
+    slot = --depth % IRQLAT_DEPTH;
+    for (unsigned int s = handlers[slot].sources; s; s &= s - 1)
+        add(&hists[__builtin_ctz(s)][IRQLAT_DURATION], cpu_cycles - handlers[slot].start);
+}
+
+/*
+ * Output
+ */
+int irqlat_save(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "# cycles from assertion to vector (latency) and from vector to RTI (duration)\n");
+    fprintf(f, "# source kind count mean p50 p90 p99 p999 max\n");
+    for (int i = 0; i < IRQLAT_SOURCES; i++)
+    {
+        for (int k = 0; k < IRQLAT_KINDS; k++)
+        {
+            const irqlat_hist_t *h = &hists[i][k];
+
+            if (!h->count)
+                continue;
+
+            fprintf(f, "%s %s %llu %.1f %llu %llu %llu %llu %llu\n", irqlat_source_name(i),
+                    kind_names[k], (unsigned long long)h->count, (double)h->sum / h->count,
+                    (unsigned long long)irqlat_quantile(h, 0.5),
+                    (unsigned long long)irqlat_quantile(h, 0.9),
+                    (unsigned long long)irqlat_quantile(h, 0.99),
+                    (unsigned long long)irqlat_quantile(h, 0.999), (unsigned long long)h->max);
+        }
+    }
+
+    fprintf(f, "# source kind low high count\n");
+    for (int i = 0; i < IRQLAT_SOURCES; i++)
+    {
+        for (int k = 0; k < IRQLAT_KINDS; k++)
+        {
+            for (int b = 0; b < IRQLAT_BUCKETS; b++)
+            {
+                if (!hists[i][k].buckets[b])
+                    continue;
+
+                fprintf(f, "%s %s %llu %llu %llu\n", irqlat_source_name(i), kind_names[k],
+                        (unsigned long long)bucket_low(b), (unsigned long long)bucket_high(b),
+                        (unsigned long long)hists[i][k].buckets[b]);
+            }
+        }
+    }
+
+    if (fclose(f) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
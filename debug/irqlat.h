@@ -0,0 +1,109 @@
+#ifndef DEBUG_IRQLAT_H_
+#define DEBUG_IRQLAT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * Interrupt latency histograms
+ *
+ * For every interrupt source (a bit of cpu_irq_lines, or NMIB) this records
+ * in emulated cycles how long it took from the device asserting the line to
+ * the CPU vectoring through VECTOR_IRQBRK or VECTOR_NMIB (entry latency), and
+ * from there to the RTI returning from the handler (handler duration).
+ *
+ * An IRQ entry is put down to every line asserted at the time, a handler
+ * that services several of them counts for each. Its latency is only known
+ * for lines that went active since the last entry, a line that stays asserted
+ * through the RTI takes the CPU straight back in without a new edge, and one
+ * that's released before the CPU takes it (polled, or masked all along)
+ * isn't counted at all. BRK is tracked like an interrupt so its RTI is
+ * matched, but isn't counted either.
+ *
+ * Histograms are log-linear: values below 2 * IRQLAT_SUB_BUCKETS are exact,
+ * above that every power of two is split into IRQLAT_SUB_BUCKETS buckets, so
+ * a value is off by at most 1/IRQLAT_SUB_BUCKETS. Recording is a handful of
+ * stores per interrupt, and only CPU 0 is followed, the one on the thread
+ * that called irqlat_start().
+ */
+#define IRQLAT_IRQ_SOURCES 8 /* bits of cpu_irq_lines */
+#define IRQLAT_NMI IRQLAT_IRQ_SOURCES
+#define IRQLAT_SOURCES (IRQLAT_IRQ_SOURCES + 1)
+#define IRQLAT_NAME_LEN 16
+
+/* Handlers interrupted by others, deeper ones overwrite the oldest */
+#define IRQLAT_DEPTH 8
+
+#define IRQLAT_SUB_BITS 3
+#define IRQLAT_SUB_BUCKETS (1 << IRQLAT_SUB_BITS)
+#define IRQLAT_BUCKETS ((64 - IRQLAT_SUB_BITS + 1) << IRQLAT_SUB_BITS)
+
+typedef enum
+{
+    IRQLAT_LATENCY,
+    IRQLAT_DURATION,
+    IRQLAT_KINDS,
+} irqlat_kind_t;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[IRQLAT_BUCKETS];
+} irqlat_hist_t;
+
+/* Set while recording, on the recording thread */
+extern CPU_LOCAL bool irqlat_active;
+
+/* Name an IRQ source for the output, e.g. IRQ_SOURCE_VIA as "via" */
+void irqlat_name(unsigned int source, const char *name);
+const char *irqlat_source_name(int index);
+
+void irqlat_start(void);
+void irqlat_stop(void);
+
+const irqlat_hist_t *irqlat_hist(int index, irqlat_kind_t kind);
+
+/* Smallest value with at least the fraction q of the values at or below it */
+uint64_t irqlat_quantile(const irqlat_hist_t *hist, double q);
+
+/* Write the histograms in text form. Returns -1 on error. */
+int irqlat_save(const char *path);
+
+/*
+ * Hooks for the CPU. sources is the IRQ lines that go active or inactive, or
+ * those asserted for an IRQ entry and 0 for BRK.
+ */
+void irqlat_record_lines(unsigned int sources, bool asserted);
+void irqlat_record_nmi(void);
+void irqlat_record_enter(addr_t vector, unsigned int sources);
+void irqlat_record_return(void);
+
+static inline void irqlat_lines(unsigned int sources, bool asserted)
+{
+    if (irqlat_active && sources)
+        irqlat_record_lines(sources, asserted);
+}
+
+static inline void irqlat_nmi(void)
+{
+    if (irqlat_active)
+        irqlat_record_nmi();
+}
+
+static inline void irqlat_enter(addr_t vector, unsigned int sources)
+{
+    if (irqlat_active)
+        irqlat_record_enter(vector, sources);
+}
+
+static inline void irqlat_return(void)
+{
+    if (irqlat_active)
+        irqlat_record_return();
+}
+
+#endif /* DEBUG_IRQLAT_H_ */
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/sched.h"
+#include "../cpu/cpu.h"
+#include "prof.h"
+#include "symbols.h"
+
+/* Longest folded line: every frame, the leaf and the truncation marker */
+#define LINE_MAX_LEN ((CPU_CALL_DEPTH + 2) * (SYMBOL_NAME_MAX + 1))
+
+/* A distinct stack, its addresses are in the frame pool from first on */
+typedef struct
+{
+    uint64_t hash;
+    uint64_t count;
+    uint32_t first;
+    uint16_t length;
+    bool truncated;
+} stack_entry_t;
+
+/* A stack as written out, stacks naming the same symbols are merged */
+typedef struct
+{
+    char *line;
+    uint64_t count;
+} folded_t;
+
+static sched_event_t event;
+static uint64_t period;
+static bool active = false;
+
+/* Open addressing, never more than half full */
+static stack_entry_t *stacks;
+static size_t stack_slots;
+static size_t stack_count;
+
+static addr_t *frames;
+static size_t frame_count;
+static size_t frame_size;
+
+static uint64_t lost;
+
+static uint64_t hash_stack(const addr_t *stack, unsigned int length, bool truncated)
+{
+    /* FNV-1a */
+    uint64_t hash = UINT64_C(0xcbf29ce484222325) ^ truncated;
+
+    for (unsigned int i = 0; i < length; i++)
+        hash = (hash ^ stack[i]) * UINT64_C(0x100000001b3);
+
+    return hash;
+}
+
+static bool same_stack(const stack_entry_t *entry, uint64_t hash, const addr_t *stack,
+                       unsigned int length, bool truncated)
+{
+    return entry->hash == hash && entry->length == length && entry->truncated == truncated &&
+           memcmp(&frames[entry->first], stack, length * sizeof(*stack)) == 0;
+}
+
+static int grow_stacks(void)
+{
+    size_t slots = stack_slots ? stack_slots * 2 : 1024;
+    stack_entry_t *grown = calloc(slots, sizeof(*grown));
+
+    if (!grown)
+        return -1;
+
+    for (size_t i = 0; i < stack_slots; i++)
+    {
+        size_t s;
+
+        if (!stacks[i].count)
+            continue;
+
+        for (s = stacks[i].hash & (slots - 1); grown[s].count; s = (s + 1) & (slots - 1))
+            ;
+        grown[s] = stacks[i];
+    }
+
+    free(stacks);
+    stacks = grown;
+    stack_slots = slots;
+
+    return 0;
+}
+
+static void count_stack(const addr_t *stack, unsigned int length, bool truncated)
+{
+    uint64_t hash = hash_stack(stack, length, truncated);
+    size_t s;
+
+    if (stack_count * 2 >= stack_slots && grow_stacks() < 0)
+    {
+        lost++;
+        return;
+    }
+
+    for (s = hash & (stack_slots - 1); stacks[s].count; s = (s + 1) & (stack_slots - 1))
+    {
+        if (same_stack(&stacks[s], hash, stack, length, truncated))
+        {
+            stacks[s].count++;
+            return;
+        }
+    }
+
+    if (frame_count + length > frame_size)
+    {
+        size_t size = frame_size ? frame_size * 2 : 4096;
+        addr_t *grown = realloc(frames, size * sizeof(*frames));
+
+        if (!grown)
+        {
+            lost++;
+            return;
+        }
+        frames = grown;
+        frame_size = size;
+    }
+
+    memcpy(&frames[frame_count], stack, length * sizeof(*stack));
+    stacks[s] = (stack_entry_t){
+        .hash = hash,
+        .count = 1,
+        .first = frame_count,
+        .length = length,
+        .truncated = truncated,
+    };
+    frame_count += length;
+    stack_count++;
+}
+
+/* Outermost call site first, the PC last */
+static void take_sample(void *ctx, uint64_t when)
+{
+    addr_t stack[CPU_CALL_DEPTH + 1];
+    unsigned int depth = cpu_call_depth < CPU_CALL_DEPTH ? cpu_call_depth : CPU_CALL_DEPTH;
+
+    for (unsigned int i = 0; i < depth; i++)
+        stack[i] = cpu_calls[(cpu_call_depth - depth + i) % CPU_CALL_DEPTH];
+    stack[depth] = reg.pc;
+
+    count_stack(stack, depth + 1, cpu_call_depth > CPU_CALL_DEPTH);
+
+    /* From when it was due, so the period doesn't drift with batch ends */
+    sched_add(&event, when + period);
+}
+
+void prof_start(uint64_t new_period)
+{
+    if (active)
+        return;
+
+    period = new_period;
+    sched_event_init(&event, take_sample, NULL);
+    sched_add(&event, cpu_cycles + period);
+    active = true;
+}
+
+void prof_stop(void)
+{
+    if (!active)
+        return;
+
+    sched_cancel(&event);
+    active = false;
+}
+
+bool prof_active(void)
+{
+    return active;
+}
+
+/*
+ * Saving
+ */
+static char *append_name(char *p, const symbol_table_t *table, addr_t addr)
+{
+    const symbol_t *symbol = symbols_find(table, addr);
+
+    if (symbol)
+        return p + sprintf(p, "%s", symbol->name);
+
+    return p + sprintf(p, "$%04X", addr);
+}
+
+static int compare_folded(const void *a, const void *b)
+{
+    return strcmp(((const folded_t *)a)->line, ((const folded_t *)b)->line);
+}
+
+static int write_folded(FILE *f, const symbol_table_t *table)
+{
+    folded_t *folded = calloc(stack_count ? stack_count : 1, sizeof(*folded));
+    size_t count = 0;
+    int ret = 0;
+
+    if (!folded)
+        return -1;
+
+    for (size_t i = 0; i < stack_slots; i++)
+    {
+        const stack_entry_t *entry = &stacks[i];
+        char line[LINE_MAX_LEN];
+        char *p = line;
+
+        if (!entry->count)
+            continue;
+
+        if (entry->truncated)
+            p += sprintf(p, "[truncated];");
+
+        for (unsigned int j = 0; j < entry->length; j++)
+        {
+            if (j)
+                *p++ = ';';
+            p = append_name(p, table, frames[entry->first + j]);
+        }
+
+        folded[count].line = strdup(line);
+        folded[count].count = entry->count;
+        if (!folded[count++].line)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0)
+        qsort(folded, count, sizeof(*folded), compare_folded);
+
+    for (size_t i = 0; ret == 0 && i < count; i++)
+    {
+        uint64_t total = folded[i].count;
+
+        while (i + 1 < count && strcmp(folded[i].line, folded[i + 1].line) == 0)
+            total += folded[++i].count;
+
+        fprintf(f, "%s %llu\n", folded[i].line, (unsigned long long)total);
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(folded[i].line);
+    free(folded);
+
+    return ret;
+}
+
+int prof_save(const char *path, const char *symbols)
+{
+    symbol_table_t table = { NULL, 0 };
+    FILE *f;
+    int ret;
+
+    if (symbols && symbols_load(symbols, &table) < 0)
+        return -1;
+
+    f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        symbols_free(&table);
+        return -1;
+    }
+
+    ret = write_folded(f, &table);
+    symbols_free(&table);
+
+    if (ret < 0)
+        fprintf(stderr, "prof: out of memory\n");
+
+    if (fclose(f) != 0)
+    {
+        perror(path);
+        ret = -1;
+    }
+
+    if (lost)
+        fprintf(stderr, "prof: %llu samples lost, out of memory\n", (unsigned long long)lost);
+
+    return ret;
+}
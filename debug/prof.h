@@ -0,0 +1,33 @@
+#ifndef DEBUG_PROF_H_
+#define DEBUG_PROF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Sampling guest profiler
+ *
+ * A scheduler event every so many cycles records the guest PC and the shadow
+ * call stack kept by the CPU (see cpu_call()), the addresses every pending
+ * call was made from. Each address is named after the routine it is in.
+ * Samples are taken at emulated cycles, not host time, so the same run gives
+ * the same profile. Identical stacks are counted together as they come in.
+ *
+ * The output is folded stacks, one "outer;inner;leaf count" line per stack,
+ * as read by flamegraph.pl and most other flame graph tools.
+ */
+
+/* Prime, so it doesn't keep hitting the same spot of a periodic loop */
+#define PROF_DEFAULT_PERIOD 997
+
+void prof_start(uint64_t period);
+void prof_stop(void);
+bool prof_active(void);
+
+/*
+ * Write the folded stacks, with addresses named by a symbol file (see
+ * debug/symbols.h) if one is given. Returns -1 on error.
+ */
+int prof_save(const char *path, const char *symbols);
+
+#endif /* DEBUG_PROF_H_ */
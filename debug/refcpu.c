@@ -0,0 +1,872 @@
+/*
+ * Reference: WDC W65C02S datasheet and http://6502.org/tutorials/65c02opcodes.html
+ */
+#include <stddef.h>
+
+#include "../cpu/cpu.h" /* only for CPU_VARIANT */
+#include "refcpu.h"
+
+static uint8_t rd(ref_cpu_t *c, uint16_t addr)
+{
+    return c->read(c, addr);
+}
+
+static void wr(ref_cpu_t *c, uint16_t addr, uint8_t value)
+{
+    c->write(c, addr, value);
+}
+
+static uint8_t fetch(ref_cpu_t *c)
+{
+    return rd(c, c->pc++);
+}
+
+static uint16_t fetch16(ref_cpu_t *c)
+{
+    uint16_t lo = fetch(c);
+
+    return lo | fetch(c) << 8;
+}
+
+static uint16_t rd16(ref_cpu_t *c, uint16_t addr)
+{
+    uint16_t lo = rd(c, addr);
+
+    return lo | rd(c, (uint16_t)(addr + 1)) << 8;
+}
+
+static void set(ref_cpu_t *c, uint8_t flag, bool on)
+{
+    if (on)
+        c->p |= flag;
+    else
+        c->p &= ~flag;
+}
+
+static uint8_t nz(ref_cpu_t *c, uint8_t value)
+{
+    set(c, REF_Z, value == 0);
+    set(c, REF_N, value & 0x80);
+    return value;
+}
+
+static void push(ref_cpu_t *c, uint8_t value)
+{
+    wr(c, 0x100 + c->s, value);
+    c->s--;
+}
+
+static uint8_t pull(ref_cpu_t *c)
+{
+    c->s++;
+    return rd(c, 0x100 + c->s);
+}
+
+/*
+ * Addressing modes. Those that can cross a page while indexing add the
+ * penalty cycle to *n, when given.
+ */
+static uint16_t am_zp(ref_cpu_t *c)
+{
+    return fetch(c);
+}
+
+static uint16_t am_zpx(ref_cpu_t *c)
+{
+    return (fetch(c) + c->x) & 0xFF;
+}
+
+static uint16_t am_zpy(ref_cpu_t *c)
+{
+    return (fetch(c) + c->y) & 0xFF;
+}
+
+static uint16_t am_abs(ref_cpu_t *c)
+{
+    return fetch16(c);
+}
+
+static uint16_t indexed(uint16_t base, uint8_t index, unsigned int *n)
+{
+    uint16_t addr = base + index;
+
+    if (n && (addr & 0xFF00) != (base & 0xFF00))
+        (*n)++;
+    return addr;
+}
+
+static uint16_t am_absx(ref_cpu_t *c, unsigned int *n)
+{
+    return indexed(fetch16(c), c->x, n);
+}
+
+static uint16_t am_absy(ref_cpu_t *c, unsigned int *n)
+{
+    return indexed(fetch16(c), c->y, n);
+}
+
+static uint16_t zp_ptr(ref_cpu_t *c, uint8_t zp)
+{
+    uint16_t lo = rd(c, zp);
+
+    return lo | rd(c, (uint8_t)(zp + 1)) << 8;
+}
+
+static uint16_t am_izx(ref_cpu_t *c)
+{
+    return zp_ptr(c, fetch(c) + c->x);
+}
+
+static uint16_t am_izy(ref_cpu_t *c, unsigned int *n)
+{
+    return indexed(zp_ptr(c, fetch(c)), c->y, n);
+}
+
+static uint16_t am_izp(ref_cpu_t *c)
+{
+    return zp_ptr(c, fetch(c));
+}
+
+/*
+ * Operations
+ */
+static void adc(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    unsigned int carry = c->p & REF_C;
+    unsigned int sum;
+
+    if (c->p & REF_D)
+    {
+        int lo = (c->a & 0x0F) + (v & 0x0F) + carry;
+        int hi, sv;
+
+        if (lo > 9)
+            lo = ((lo + 6) & 0x0F) + 0x10;
+
+        /* V comes from the signed sum before the high digit is adjusted */
+        sv = (int8_t)(c->a & 0xF0) + (int8_t)(v & 0xF0) + lo;
+        set(c, REF_V, sv < -128 || sv > 127);
+
+        hi = (c->a & 0xF0) + (v & 0xF0) + lo;
+        if (hi > 0x9F)
+            hi += 0x60;
+        set(c, REF_C, hi > 0xFF);
+        c->a = nz(c, hi & 0xFF);
+        (*n)++;
+        return;
+    }
+
+    sum = c->a + v + carry;
+
+    set(c, REF_V, (c->a & 0x80) == (v & 0x80) && (c->a & 0x80) != (sum & 0x80));
+    set(c, REF_C, sum > 0xFF);
+    c->a = nz(c, sum & 0xFF);
+}
+
+static void sbc(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    int borrow = !(c->p & REF_C);
+    int diff = c->a - v - borrow;
+
+    set(c, REF_V, (c->a & 0x80) != (v & 0x80) && (c->a & 0x80) != (diff & 0x80));
+    set(c, REF_C, diff >= 0);
+
+    if (c->p & REF_D)
+    {
+        int lo = (c->a & 0x0F) - (v & 0x0F) - borrow;
+
+        if (diff < 0)
+            diff -= 0x60;
+        if (lo < 0)
+            diff -= 0x06;
+        (*n)++;
+    }
+
+    c->a = nz(c, diff & 0xFF);
+}
+
+static void ora(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    c->a = nz(c, c->a | v);
+}
+
+static void and(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    c->a = nz(c, c->a & v);
+}
+
+static void eor(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    c->a = nz(c, c->a ^ v);
+}
+
+static void lda(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    c->a = nz(c, v);
+}
+
+static void compare(ref_cpu_t *c, uint8_t r, uint8_t v)
+{
+    set(c, REF_C, r >= v);
+    nz(c, r - v);
+}
+
+static void cmp(ref_cpu_t *c, uint8_t v, unsigned int *n)
+{
+    compare(c, c->a, v);
+}
+
+static void bit(ref_cpu_t *c, uint8_t v)
+{
+    set(c, REF_Z, !(c->a & v));
+    set(c, REF_N, v & 0x80);
+    set(c, REF_V, v & 0x40);
+}
+
+static uint8_t asl(ref_cpu_t *c, uint8_t v)
+{
+    set(c, REF_C, v & 0x80);
+    return nz(c, v << 1);
+}
+
+static uint8_t lsr(ref_cpu_t *c, uint8_t v)
+{
+    set(c, REF_C, v & 0x01);
+    return nz(c, v >> 1);
+}
+
+static uint8_t rol(ref_cpu_t *c, uint8_t v)
+{
+    uint8_t r = v << 1 | (c->p & REF_C);
+
+    set(c, REF_C, v & 0x80);
+    return nz(c, r);
+}
+
+static uint8_t ror(ref_cpu_t *c, uint8_t v)
+{
+    uint8_t r = v >> 1 | (c->p & REF_C) << 7;
+
+    set(c, REF_C, v & 0x01);
+    return nz(c, r);
+}
+
+static uint8_t inc(ref_cpu_t *c, uint8_t v)
+{
+    return nz(c, v + 1);
+}
+
+static uint8_t dec(ref_cpu_t *c, uint8_t v)
+{
+    return nz(c, v - 1);
+}
+
+static uint8_t tsb(ref_cpu_t *c, uint8_t v)
+{
+    set(c, REF_Z, !(c->a & v));
+    return v | c->a;
+}
+
+static uint8_t trb(ref_cpu_t *c, uint8_t v)
+{
+    set(c, REF_Z, !(c->a & v));
+    return v & ~c->a;
+}
+
+static void rmw(ref_cpu_t *c, uint16_t addr, uint8_t (*op)(ref_cpu_t *, uint8_t))
+{
+    wr(c, addr, op(c, rd(c, addr)));
+}
+
+/* Relative branch, returns the cycles on top of the base count */
+static unsigned int branch(ref_cpu_t *c, int8_t offset, bool taken)
+{
+    uint16_t target = c->pc + offset;
+    unsigned int n;
+
+    if (!taken)
+        return 0;
+
+    n = (target & 0xFF00) != (c->pc & 0xFF00) ? 2 : 1;
+    c->pc = target;
+    return n;
+}
+
+static unsigned int bit_branch(ref_cpu_t *c, uint8_t mask, bool if_set)
+{
+    uint8_t v = rd(c, fetch(c));
+    int8_t offset = fetch(c);
+
+    return 5 + branch(c, offset, ((v & mask) != 0) == if_set);
+}
+
+/* Groups of read instructions with the same addressing modes */
+#define READ_GROUP(base, op)                                                                       \
+    case base + 0x01:                                                                              \
+        n = 6;                                                                                     \
+        op(c, rd(c, am_izx(c)), &n);                                                               \
+        break;                                                                                     \
+    case base + 0x05:                                                                              \
+        n = 3;                                                                                     \
+        op(c, rd(c, am_zp(c)), &n);                                                                \
+        break;                                                                                     \
+    case base + 0x09:                                                                              \
+        n = 2;                                                                                     \
+        op(c, fetch(c), &n);                                                                       \
+        break;                                                                                     \
+    case base + 0x0D:                                                                              \
+        n = 4;                                                                                     \
+        op(c, rd(c, am_abs(c)), &n);                                                               \
+        break;                                                                                     \
+    case base + 0x11:                                                                              \
+        n = 5;                                                                                     \
+        op(c, rd(c, am_izy(c, &n)), &n);                                                           \
+        break;                                                                                     \
+    case base + 0x12:                                                                              \
+        n = 5;                                                                                     \
+        op(c, rd(c, am_izp(c)), &n);                                                               \
+        break;                                                                                     \
+    case base + 0x15:                                                                              \
+        n = 4;                                                                                     \
+        op(c, rd(c, am_zpx(c)), &n);                                                               \
+        break;                                                                                     \
+    case base + 0x19:                                                                              \
+        n = 4;                                                                                     \
+        op(c, rd(c, am_absy(c, &n)), &n);                                                          \
+        break;                                                                                     \
+    case base + 0x1D:                                                                              \
+        n = 4;                                                                                     \
+        op(c, rd(c, am_absx(c, &n)), &n);                                                          \
+        break;
+
+/* Shifts and rotates */
+#define SHIFT_GROUP(base, op)                                                                      \
+    case base + 0x06:                                                                              \
+        n = 5;                                                                                     \
+        rmw(c, am_zp(c), op);                                                                      \
+        break;                                                                                     \
+    case base + 0x0A:                                                                              \
+        n = 2;                                                                                     \
+        c->a = op(c, c->a);                                                                        \
+        break;                                                                                     \
+    case base + 0x0E:                                                                              \
+        n = 6;                                                                                     \
+        rmw(c, am_abs(c), op);                                                                     \
+        break;                                                                                     \
+    case base + 0x16:                                                                              \
+        n = 6;                                                                                     \
+        rmw(c, am_zpx(c), op);                                                                     \
+        break;                                                                                     \
+    case base + 0x1E:                                                                              \
+        n = 6;                                                                                     \
+        rmw(c, am_absx(c, &n), op);                                                                \
+        break;
+
+unsigned int ref_step(ref_cpu_t *c)
+{
+    uint8_t opcode = fetch(c);
+    unsigned int n = 0;
+    uint16_t addr;
+
+    switch (opcode)
+    {
+        READ_GROUP(0x00, ora)
+        READ_GROUP(0x20, and)
+        READ_GROUP(0x40, eor)
+        READ_GROUP(0x60, adc)
+        READ_GROUP(0xA0, lda)
+        READ_GROUP(0xC0, cmp)
+        READ_GROUP(0xE0, sbc)
+
+        SHIFT_GROUP(0x00, asl)
+        SHIFT_GROUP(0x20, rol)
+        SHIFT_GROUP(0x40, lsr)
+        SHIFT_GROUP(0x60, ror)
+
+    /* Stores */
+    case 0x81:
+        n = 6;
+        wr(c, am_izx(c), c->a);
+        break;
+    case 0x85:
+        n = 3;
+        wr(c, am_zp(c), c->a);
+        break;
+    case 0x8D:
+        n = 4;
+        wr(c, am_abs(c), c->a);
+        break;
+    case 0x91:
+        n = 6;
+        wr(c, am_izy(c, NULL), c->a);
+        break;
+    case 0x92:
+        n = 5;
+        wr(c, am_izp(c), c->a);
+        break;
+    case 0x95:
+        n = 4;
+        wr(c, am_zpx(c), c->a);
+        break;
+    case 0x99:
+        n = 5;
+        wr(c, am_absy(c, NULL), c->a);
+        break;
+    case 0x9D:
+        n = 5;
+        wr(c, am_absx(c, NULL), c->a);
+        break;
+    case 0x86:
+        n = 3;
+        wr(c, am_zp(c), c->x);
+        break;
+    case 0x8E:
+        n = 4;
+        wr(c, am_abs(c), c->x);
+        break;
+    case 0x96:
+        n = 4;
+        wr(c, am_zpy(c), c->x);
+        break;
+    case 0x84:
+        n = 3;
+        wr(c, am_zp(c), c->y);
+        break;
+    case 0x8C:
+        n = 4;
+        wr(c, am_abs(c), c->y);
+        break;
+    case 0x94:
+        n = 4;
+        wr(c, am_zpx(c), c->y);
+        break;
+    case 0x64:
+        n = 3;
+        wr(c, am_zp(c), 0);
+        break;
+    case 0x74:
+        n = 4;
+        wr(c, am_zpx(c), 0);
+        break;
+    case 0x9C:
+        n = 4;
+        wr(c, am_abs(c), 0);
+        break;
+    case 0x9E:
+        n = 5;
+        wr(c, am_absx(c, NULL), 0);
+        break;
+
+    /* X and Y loads and compares */
+    case 0xA2:
+        n = 2;
+        c->x = nz(c, fetch(c));
+        break;
+    case 0xA6:
+        n = 3;
+        c->x = nz(c, rd(c, am_zp(c)));
+        break;
+    case 0xAE:
+        n = 4;
+        c->x = nz(c, rd(c, am_abs(c)));
+        break;
+    case 0xB6:
+        n = 4;
+        c->x = nz(c, rd(c, am_zpy(c)));
+        break;
+    case 0xBE:
+        n = 4;
+        c->x = nz(c, rd(c, am_absy(c, &n)));
+        break;
+    case 0xA0:
+        n = 2;
+        c->y = nz(c, fetch(c));
+        break;
+    case 0xA4:
+        n = 3;
+        c->y = nz(c, rd(c, am_zp(c)));
+        break;
+    case 0xAC:
+        n = 4;
+        c->y = nz(c, rd(c, am_abs(c)));
+        break;
+    case 0xB4:
+        n = 4;
+        c->y = nz(c, rd(c, am_zpx(c)));
+        break;
+    case 0xBC:
+        n = 4;
+        c->y = nz(c, rd(c, am_absx(c, &n)));
+        break;
+    case 0xE0:
+        n = 2;
+        compare(c, c->x, fetch(c));
+        break;
+    case 0xE4:
+        n = 3;
+        compare(c, c->x, rd(c, am_zp(c)));
+        break;
+    case 0xEC:
+        n = 4;
+        compare(c, c->x, rd(c, am_abs(c)));
+        break;
+    case 0xC0:
+        n = 2;
+        compare(c, c->y, fetch(c));
+        break;
+    case 0xC4:
+        n = 3;
+        compare(c, c->y, rd(c, am_zp(c)));
+        break;
+    case 0xCC:
+        n = 4;
+        compare(c, c->y, rd(c, am_abs(c)));
+        break;
+
+    /* BIT */
+    case 0x24:
+        n = 3;
+        bit(c, rd(c, am_zp(c)));
+        break;
+    case 0x2C:
+        n = 4;
+        bit(c, rd(c, am_abs(c)));
+        break;
+    case 0x34:
+        n = 4;
+        bit(c, rd(c, am_zpx(c)));
+        break;
+    case 0x3C:
+        n = 4;
+        bit(c, rd(c, am_absx(c, &n)));
+        break;
+    case 0x89:
+        n = 2;
+        set(c, REF_Z, !(c->a & fetch(c)));
+        break;
+
+    /* Increments and decrements */
+    case 0xE6:
+        n = 5;
+        rmw(c, am_zp(c), inc);
+        break;
+    case 0xEE:
+        n = 6;
+        rmw(c, am_abs(c), inc);
+        break;
+    case 0xF6:
+        n = 6;
+        rmw(c, am_zpx(c), inc);
+        break;
+    case 0xFE:
+        n = 7;
+        rmw(c, am_absx(c, NULL), inc);
+        break;
+    case 0x1A:
+        n = 2;
+        c->a = inc(c, c->a);
+        break;
+    case 0xC6:
+        n = 5;
+        rmw(c, am_zp(c), dec);
+        break;
+    case 0xCE:
+        n = 6;
+        rmw(c, am_abs(c), dec);
+        break;
+    case 0xD6:
+        n = 6;
+        rmw(c, am_zpx(c), dec);
+        break;
+    case 0xDE:
+        n = 7;
+        rmw(c, am_absx(c, NULL), dec);
+        break;
+    case 0x3A:
+        n = 2;
+        c->a = dec(c, c->a);
+        break;
+    case 0xE8:
+        n = 2;
+        c->x = nz(c, c->x + 1);
+        break;
+    case 0xCA:
+        n = 2;
+        c->x = nz(c, c->x - 1);
+        break;
+    case 0xC8:
+        n = 2;
+        c->y = nz(c, c->y + 1);
+        break;
+    case 0x88:
+        n = 2;
+        c->y = nz(c, c->y - 1);
+        break;
+
+    /* TSB, TRB */
+    case 0x04:
+        n = 5;
+        rmw(c, am_zp(c), tsb);
+        break;
+    case 0x0C:
+        n = 6;
+        rmw(c, am_abs(c), tsb);
+        break;
+    case 0x14:
+        n = 5;
+        rmw(c, am_zp(c), trb);
+        break;
+    case 0x1C:
+        n = 6;
+        rmw(c, am_abs(c), trb);
+        break;
+
+    /* Branches */
+    case 0x10:
+        n = 2 + branch(c, fetch(c), !(c->p & REF_N));
+        break;
+    case 0x30:
+        n = 2 + branch(c, fetch(c), c->p & REF_N);
+        break;
+    case 0x50:
+        n = 2 + branch(c, fetch(c), !(c->p & REF_V));
+        break;
+    case 0x70:
+        n = 2 + branch(c, fetch(c), c->p & REF_V);
+        break;
+    case 0x90:
+        n = 2 + branch(c, fetch(c), !(c->p & REF_C));
+        break;
+    case 0xB0:
+        n = 2 + branch(c, fetch(c), c->p & REF_C);
+        break;
+    case 0xD0:
+        n = 2 + branch(c, fetch(c), !(c->p & REF_Z));
+        break;
+    case 0xF0:
+        n = 2 + branch(c, fetch(c), c->p & REF_Z);
+        break;
+    case 0x80:
+        n = 2 + branch(c, fetch(c), true);
+        break;
+
+    /* Jumps and returns */
+    case 0x4C:
+        n = 3;
+        c->pc = fetch16(c);
+        break;
+    case 0x6C:
+        n = 6;
+        c->pc = rd16(c, fetch16(c));
+        break;
+    case 0x7C:
+        n = 6;
+        c->pc = rd16(c, fetch16(c) + c->x);
+        break;
+    case 0x20:
+        n = 6;
+        addr = fetch16(c);
+        c->pc--;
+        push(c, c->pc >> 8);
+        push(c, c->pc & 0xFF);
+        c->pc = addr;
+        break;
+    case 0x60:
+        n = 6;
+        addr = pull(c);
+        addr |= pull(c) << 8;
+        c->pc = addr + 1;
+        break;
+    case 0x40:
+        n = 6;
+        c->p = pull(c) | REF_B | REF_U;
+        addr = pull(c);
+        addr |= pull(c) << 8;
+        c->pc = addr;
+        break;
+    case 0x00:
+        n = 7;
+        c->pc++;
+        push(c, c->pc >> 8);
+        push(c, c->pc & 0xFF);
+        push(c, c->p | REF_B | REF_U);
+        c->p = (c->p | REF_I) & ~REF_D;
+        c->pc = rd16(c, 0xFFFE);
+        break;
+
+    /* Stack */
+    case 0x48:
+        n = 3;
+        push(c, c->a);
+        break;
+    case 0xDA:
+        n = 3;
+        push(c, c->x);
+        break;
+    case 0x5A:
+        n = 3;
+        push(c, c->y);
+        break;
+    case 0x08:
+        n = 3;
+        push(c, c->p | REF_B | REF_U);
+        break;
+    case 0x68:
+        n = 4;
+        c->a = nz(c, pull(c));
+        break;
+    case 0xFA:
+        n = 4;
+        c->x = nz(c, pull(c));
+        break;
+    case 0x7A:
+        n = 4;
+        c->y = nz(c, pull(c));
+        break;
+    case 0x28:
+        n = 4;
+        c->p = pull(c) | REF_B | REF_U;
+        break;
+
+    /* Transfers */
+    case 0xAA:
+        n = 2;
+        c->x = nz(c, c->a);
+        break;
+    case 0xA8:
+        n = 2;
+        c->y = nz(c, c->a);
+        break;
+    case 0x8A:
+        n = 2;
+        c->a = nz(c, c->x);
+        break;
+    case 0x98:
+        n = 2;
+        c->a = nz(c, c->y);
+        break;
+    case 0xBA:
+        n = 2;
+        c->x = nz(c, c->s);
+        break;
+    case 0x9A:
+        n = 2;
+        c->s = c->x;
+        break;
+
+    /* Flags */
+    case 0x18:
+        n = 2;
+        c->p &= ~REF_C;
+        break;
+    case 0x38:
+        n = 2;
+        c->p |= REF_C;
+        break;
+    case 0x58:
+        n = 2;
+        c->p &= ~REF_I;
+        break;
+    case 0x78:
+        n = 2;
+        c->p |= REF_I;
+        break;
+    case 0xB8:
+        n = 2;
+        c->p &= ~REF_V;
+        break;
+    case 0xD8:
+        n = 2;
+        c->p &= ~REF_D;
+        break;
+    case 0xF8:
+        n = 2;
+        c->p |= REF_D;
+        break;
+
+    /* Processor control */
+    case 0xEA:
+        n = 2;
+        break;
+#if CPU_VARIANT != CPU_ROCKWELL
+    case 0xCB:
+        n = 3;
+        c->waiting = true;
+        break;
+    case 0xDB:
+        n = 3;
+        c->stopped = true;
+        break;
+#endif
+
+    /* Unused opcodes, which are NOPs of various lengths on the 65C02 */
+    case 0x02:
+    case 0x22:
+    case 0x42:
+    case 0x62:
+    case 0x82:
+    case 0xC2:
+    case 0xE2:
+        n = 2;
+        fetch(c);
+        break;
+    case 0x44:
+        n = 3;
+        rd(c, am_zp(c));
+        break;
+    case 0x54:
+    case 0xD4:
+    case 0xF4:
+        n = 4;
+        rd(c, am_zpx(c));
+        break;
+    case 0x5C:
+        n = 8;
+        rd(c, am_abs(c));
+        break;
+    case 0xDC:
+    case 0xFC:
+        n = 4;
+        rd(c, am_abs(c));
+        break;
+
+    default:
+        if ((opcode & 0x0F) == 0x07)
+        {
+            /* RMB0-7, SMB0-7 */
+            uint8_t mask = 1 << ((opcode >> 4) & 7);
+
+            n = 5;
+            addr = am_zp(c);
+            if (opcode & 0x80)
+                wr(c, addr, rd(c, addr) | mask);
+            else
+                wr(c, addr, rd(c, addr) & ~mask);
+        }
+        else if ((opcode & 0x0F) == 0x0F)
+        {
+            /* BBR0-7, BBS0-7 */
+            n = bit_branch(c, 1 << ((opcode >> 4) & 7), opcode & 0x80);
+        }
+        else
+        {
+            /* The rest of columns 3 and B */
+            n = 1;
+        }
+        break;
+    }
+
+    return n;
+}
+
+unsigned int ref_interrupt(ref_cpu_t *c, uint16_t vector)
+{
+    push(c, c->pc >> 8);
+    push(c, c->pc & 0xFF);
+    push(c, (c->p & ~REF_B) | REF_U);
+    c->p = (c->p | REF_I) & ~REF_D;
+    c->pc = rd16(c, vector);
+    c->waiting = false;
+
+    return 7;
+}
@@ -0,0 +1,46 @@
+#ifndef DEBUG_REFCPU_H_
+#define DEBUG_REFCPU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Reference 65C02 core for differential checking, WDC or Rockwell as the
+ * CPU_VARIANT built
+ *
+ * Deliberately written differently from cpu/: a plain switch over opcodes,
+ * P kept as a byte, and no state shared with the main core. It isn't fast and
+ * doesn't try to be, and it knows nothing about bus cycles or dummy reads.
+ */
+#define REF_C 0x01
+#define REF_Z 0x02
+#define REF_I 0x04
+#define REF_D 0x08
+#define REF_B 0x10
+#define REF_U 0x20 /* unused, always 1 */
+#define REF_V 0x40
+#define REF_N 0x80
+
+typedef struct ref_cpu
+{
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t s;
+    uint8_t p;
+    uint16_t pc;
+    bool waiting; /* after WAI */
+    bool stopped; /* after STP */
+
+    uint8_t (*read)(struct ref_cpu *cpu, uint16_t addr);
+    void (*write)(struct ref_cpu *cpu, uint16_t addr, uint8_t value);
+    void *ctx;
+} ref_cpu_t;
+
+/* Execute one instruction, returns the number of cycles it took */
+unsigned int ref_step(ref_cpu_t *cpu);
+
+/* Enter an interrupt handler through the given vector */
+unsigned int ref_interrupt(ref_cpu_t *cpu, uint16_t vector);
+
+#endif /* DEBUG_REFCPU_H_ */
@@ -0,0 +1,231 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+
+typedef enum
+{
+    FORMAT_LABELS,
+    FORMAT_DBG,
+    FORMAT_MAP,
+} format_t;
+
+/* While loading, the file order keeps the sort stable */
+typedef struct
+{
+    symbol_t symbol;
+    int order;
+} entry_t;
+
+typedef struct
+{
+    entry_t *entries;
+    int count;
+    int size;
+} loader_t;
+
+static int add(loader_t *l, unsigned long addr, const char *name, size_t len)
+{
+    if (addr > 0xFFFF || len == 0)
+        return 0;
+
+    if (l->count == l->size)
+    {
+        int size = l->size ? l->size * 2 : 256;
+        entry_t *entries = realloc(l->entries, size * sizeof(*entries));
+
+        if (!entries)
+            return -1;
+        l->entries = entries;
+        l->size = size;
+    }
+
+    l->entries[l->count].symbol.addr = addr;
+    snprintf(l->entries[l->count].symbol.name, SYMBOL_NAME_MAX, "%.*s", (int)len, name);
+    l->entries[l->count].order = l->count;
+    l->count++;
+
+    return 0;
+}
+
+/* "al 00C000 .name" or "C000 name" */
+static int parse_label(loader_t *l, char *p)
+{
+    char *end;
+    unsigned long addr;
+
+    while (isspace((unsigned char)*p))
+        p++;
+    if (strncmp(p, "al ", 3) == 0)
+        p += 3;
+    if (*p == '$')
+        p++;
+
+    addr = strtoul(p, &end, 16);
+    if (end == p)
+        return 0;
+
+    for (p = end; isspace((unsigned char)*p) || *p == '.'; p++)
+        ;
+
+    return add(l, addr, p, strcspn(p, " \t\r\n"));
+}
+
+/* Value of a key=value field of a debug file line, NULL if it isn't there */
+static const char *field(const char *line, const char *key)
+{
+    size_t len = strlen(key);
+
+    for (const char *p = strchr(line, '\t'); p; p = strchr(p, ','))
+    {
+        p++;
+        if (strncmp(p, key, len) == 0 && p[len] == '=')
+            return p + len + 1;
+    }
+
+    return NULL;
+}
+
+/* sym id=1,name="main",addrsize=absolute,...,val=0xC000,seg=0,type=lab */
+static int parse_dbg(loader_t *l, const char *line)
+{
+    const char *name = field(line, "name");
+    const char *val = field(line, "val");
+    const char *type = field(line, "type");
+
+    if (strncmp(line, "sym\t", 4) != 0 || !name || !val || !type || strncmp(type, "lab", 3) != 0 ||
+        *name != '"')
+        return 0;
+
+    name++;
+    return add(l, strtoul(val, NULL, 0), name, strcspn(name, "\""));
+}
+
+/* Two exports per line, "name value flags", the label flag is L */
+static int parse_map_exports(loader_t *l, const char *line)
+{
+    char name[SYMBOL_NAME_MAX];
+    char flags[8];
+    unsigned long addr;
+    int n;
+
+    while (sscanf(line, "%63s %lx %7s%n", name, &addr, flags, &n) == 3)
+    {
+        if (strchr(flags, 'L') && add(l, addr, name, strlen(name)) < 0)
+            return -1;
+        line += n;
+    }
+
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const entry_t *ea = a;
+    const entry_t *eb = b;
+
+    if (ea->symbol.addr != eb->symbol.addr)
+        return (ea->symbol.addr > eb->symbol.addr) - (ea->symbol.addr < eb->symbol.addr);
+
+    return (ea->order > eb->order) - (ea->order < eb->order);
+}
+
+int symbols_load(const char *path, symbol_table_t *table)
+{
+    FILE *f = fopen(path, "r");
+    loader_t l = { NULL, 0, 0 };
+    format_t format = FORMAT_LABELS;
+    bool exports = false;
+    char line[1024];
+    int ret = 0;
+
+    table->symbols = NULL;
+    table->count = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    for (int n = 1; ret == 0 && fgets(line, sizeof(line), f); n++)
+    {
+        if (n == 1 && strncmp(line, "version\t", 8) == 0)
+            format = FORMAT_DBG;
+        else if (n == 1 && strncmp(line, "Modules list:", 13) == 0)
+            format = FORMAT_MAP;
+
+        switch (format)
+        {
+        case FORMAT_LABELS:
+            ret = parse_label(&l, line);
+            break;
+        case FORMAT_DBG:
+            ret = parse_dbg(&l, line);
+            break;
+        case FORMAT_MAP:
+            /* The section is underlined, and ends at an empty line */
+            if (strncmp(line, "Exports list by name:", 21) == 0)
+                exports = true;
+            else if (line[strspn(line, " \t\r\n")] == '\0')
+                exports = false;
+            else if (exports && line[0] != '-')
+                ret = parse_map_exports(&l, line);
+            break;
+        }
+    }
+
+    fclose(f);
+
+    if (ret < 0)
+    {
+        fprintf(stderr, "symbols: %s: out of memory\n", path);
+        free(l.entries);
+        return -1;
+    }
+
+    qsort(l.entries, l.count, sizeof(*l.entries), compare_entries);
+
+    /* Entries shrink in place to the symbols they hold */
+    table->symbols = (symbol_t *)l.entries;
+    table->count = l.count;
+    for (int i = 0; i < l.count; i++)
+        memmove(&table->symbols[i], &l.entries[i].symbol, sizeof(symbol_t));
+
+    return 0;
+}
+
+void symbols_free(symbol_table_t *table)
+{
+    free(table->symbols);
+    table->symbols = NULL;
+    table->count = 0;
+}
+
+const symbol_t *symbols_find(const symbol_table_t *table, addr_t addr)
+{
+    int lo = 0;
+    int hi = table->count;
+
+    /* First symbol above addr */
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (table->symbols[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return NULL;
+
+    /* The first of several at the same address */
+    while (lo > 1 && table->symbols[lo - 2].addr == table->symbols[lo - 1].addr)
+        lo--;
+
+    return &table->symbols[lo - 1];
+}
@@ -0,0 +1,35 @@
+#ifndef DEBUG_SYMBOLS_H_
+#define DEBUG_SYMBOLS_H_
+
+#include "../cpu/cpu.h"
+
+/*
+ * Guest symbols, from any of
+ * - an ld65 debug file (--dbgfile), its code labels
+ * - an ld65 map file (-m), its exported labels
+ * - a label file, ld65/VICE style ("al 00C000 .name") or plain "C000 name"
+ * The format is told from the first line.
+ */
+#define SYMBOL_NAME_MAX 64
+
+typedef struct
+{
+    addr_t addr;
+    char name[SYMBOL_NAME_MAX];
+} symbol_t;
+
+/* Sorted by address, symbols at the same address in file order */
+typedef struct
+{
+    symbol_t *symbols;
+    int count;
+} symbol_table_t;
+
+/* Returns -1 on error, with the table empty */
+int symbols_load(const char *path, symbol_table_t *table);
+void symbols_free(symbol_table_t *table);
+
+/* The symbol at or closest below an address, NULL if there's none */
+const symbol_t *symbols_find(const symbol_table_t *table, addr_t addr);
+
+#endif /* DEBUG_SYMBOLS_H_ */
@@ -0,0 +1,360 @@
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu/cpu.h"
+#include "../utils/spsc.h"
+#include "vcd.h"
+
+#define MAX_SIGNALS 32
+#define MAX_NAME 32
+
+/* 16 MiB of records, a few seconds of pin accuracy */
+#define RING_SIZE (1 << 20)
+
+#define FS_PER_S 1000000000000000ull
+
+/* Records between publishing the ring's indices, see utils/spsc.h */
+#define PUBLISH_BATCH 256
+
+/* Identifiers are made of the printable characters */
+#define ID_FIRST '!'
+#define ID_CHARS ('~' - '!' + 1)
+
+typedef struct
+{
+    uint64_t cycle;
+    uint32_t value; /* two bits per pin, a pin_state_t each */
+    uint16_t signal; /* index into selected */
+} record_t;
+
+static const char levels[] = {
+    [PIN_STATE_NONE] = 'z',
+    [PIN_STATE_HI] = '1',
+    [PIN_STATE_LO] = '0',
+    [PIN_STATE_INVALID] = 'x',
+};
+
+static struct
+{
+    char name[MAX_NAME];
+    pin_t *pins;
+    int count;
+} signals[MAX_SIGNALS];
+static int signal_count = 0;
+
+/* Indices into signals, and their last values */
+static int selected[MAX_SIGNALS];
+static uint32_t last[MAX_SIGNALS];
+static int selected_count;
+
+static record_t *records;
+static spsc_t ring;
+
+/* Emulation thread side */
+static bool active = false;
+static bool observing = false;
+static pthread_t thread;
+
+/* Writer side */
+static FILE *file;
+static uint64_t now;
+static const char *unit_name;
+static uint64_t cycle_units;
+
+static void add_builtin_signals(void)
+{
+    static bool added = false;
+
+    if (added)
+        return;
+    added = true;
+
+    vcd_add_signal("cpu_addr_bus", cpu_addr_bus, 16);
+    vcd_add_signal("cpu_data_bus", cpu_data_bus, 8);
+    vcd_add_signal("cpu_rwb", &cpu_rwb, 1);
+    vcd_add_signal("ram_cs", &ram_cs, 1);
+    vcd_add_signal("ram_oe", &ram_oe, 1);
+    vcd_add_signal("ram_we", &ram_we, 1);
+}
+
+int vcd_add_signal(const char *name, pin_t *pins, int count)
+{
+    if (active || signal_count == MAX_SIGNALS || count < 1 || count > VCD_MAX_WIDTH ||
+        strlen(name) >= MAX_NAME)
+        return -1;
+
+    for (int i = 0; i < signal_count; i++)
+        if (strcmp(signals[i].name, name) == 0)
+            return -1;
+
+    strcpy(signals[signal_count].name, name);
+    signals[signal_count].pins = pins;
+    signals[signal_count].count = count;
+    signal_count++;
+
+    return 0;
+}
+
+static uint32_t sample(int signal)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < signals[signal].count; i++)
+        value |= (uint32_t)pin_net_state(&signals[signal].pins[i]) << (2 * i);
+
+    return value;
+}
+
+/*
+ * Emulation thread
+ */
+static void observe(const bus_cycle_t *cycle, void *ctx)
+{
+    if (!active)
+        return;
+
+    for (int i = 0; i < selected_count; i++)
+    {
+        uint32_t value = sample(selected[i]);
+
+        if (value == last[i])
+            continue;
+        last[i] = value;
+
+        if (spsc_full(&ring))
+            spsc_wait_for_space(&ring, NULL);
+
+        records[spsc_back(&ring)] = (record_t){
+            .cycle = cycle->cycle,
+            .value = value,
+            .signal = i,
+        };
+        spsc_push(&ring);
+    }
+
+    spsc_publish_batch(&ring);
+}
+
+/*
+ * Writer thread
+ */
+/* Returns false once the emulation thread has stopped and everything is written */
+static bool next_record(record_t *rec)
+{
+    if (!spsc_wait(&ring))
+        return false;
+
+    *rec = records[spsc_front(&ring)];
+    spsc_pop(&ring);
+
+    return true;
+}
+
+static void write_time(uint64_t cycle)
+{
+    fprintf(file, "#%llu\n", (unsigned long long)(cycle * cycle_units));
+}
+
+static void write_id(int index)
+{
+    do
+    {
+        putc_unlocked(ID_FIRST + index % ID_CHARS, file);
+        index /= ID_CHARS;
+    } while (index);
+}
+
+static void write_value(int index, uint32_t value)
+{
+    int count = signals[selected[index]].count;
+
+    if (count == 1)
+    {
+        putc_unlocked(levels[value & 3], file);
+    }
+    else
+    {
+        putc_unlocked('b', file);
+        for (int i = count - 1; i >= 0; i--)
+            putc_unlocked(levels[(value >> (2 * i)) & 3], file);
+        putc_unlocked(' ', file);
+    }
+
+    write_id(index);
+    putc_unlocked('\n', file);
+}
+
+static void *writer(void *arg)
+{
+    record_t rec;
+
+    while (next_record(&rec))
+    {
+        if (rec.cycle != now)
+        {
+            now = rec.cycle;
+            write_time(now);
+        }
+
+        write_value(rec.signal, rec.value);
+    }
+
+    return NULL;
+}
+
+/*
+ * Control
+ */
+static bool matches(const char *name, const char *filter)
+{
+    char *patterns = strdup(filter);
+    char *save;
+    bool match = false;
+
+    for (char *p = strtok_r(patterns, ",", &save); p && !match; p = strtok_r(NULL, ",", &save))
+        match = fnmatch(p, name, 0) == 0;
+
+    free(patterns);
+    return match;
+}
+
+/*
+ * Pick the largest unit that a cycle at the clock rate is a whole number of,
+ * to the femtosecond. At the 1 MHz the board runs at that's 1 us per cycle.
+ */
+static void set_timescale(uint64_t hz)
+{
+    static const char *const names[] = { "s", "ms", "us", "ns", "ps", "fs" };
+    uint64_t period = (FS_PER_S + hz / 2) / hz;
+    uint64_t unit = FS_PER_S;
+    int i;
+
+    if (!period)
+        period = 1;
+
+    for (i = 0; period % unit; i++)
+        unit /= 1000;
+    unit_name = names[i];
+    cycle_units = period / unit;
+}
+
+static void write_header(void)
+{
+    fprintf(file, "$comment fakeoid bus pins, one CPU cycle is %llu %s $end\n",
+            (unsigned long long)cycle_units, unit_name);
+    fprintf(file, "$timescale 1 %s $end\n", unit_name);
+    fprintf(file, "$scope module bus $end\n");
+
+    for (int i = 0; i < selected_count; i++)
+    {
+        int count = signals[selected[i]].count;
+
+        fprintf(file, "$var wire %d ", count);
+        write_id(i);
+        fprintf(file, " %s", signals[selected[i]].name);
+        if (count > 1)
+            fprintf(file, " [%d:0]", count - 1);
+        fprintf(file, " $end\n");
+    }
+
+    fprintf(file, "$upscope $end\n");
+    fprintf(file, "$enddefinitions $end\n");
+
+    now = cpu_cycles;
+    write_time(now);
+    fprintf(file, "$dumpvars\n");
+    for (int i = 0; i < selected_count; i++)
+    {
+        last[i] = sample(selected[i]);
+        write_value(i, last[i]);
+    }
+    fprintf(file, "$end\n");
+}
+
+int vcd_start(const char *path, const char *filter, uint64_t hz)
+{
+    if (active)
+        return 0;
+
+    set_timescale(hz ? hz : VCD_DEFAULT_HZ);
+
+    add_builtin_signals();
+
+    selected_count = 0;
+    for (int i = 0; i < signal_count; i++)
+        if (!filter || matches(signals[i].name, filter))
+            selected[selected_count++] = i;
+
+    if (!selected_count)
+    {
+        fprintf(stderr, "vcd: no signal matches %s\n", filter);
+        return -1;
+    }
+
+    records = malloc(RING_SIZE * sizeof(*records));
+    if (!records)
+    {
+        fprintf(stderr, "vcd: out of memory\n");
+        return -1;
+    }
+
+    file = fopen(path, "w");
+    if (!file)
+    {
+        perror(path);
+        free(records);
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 16);
+    write_header();
+
+    spsc_init(&ring, RING_SIZE, PUBLISH_BATCH);
+
+    if (pthread_create(&thread, NULL, writer, NULL) != 0)
+    {
+        fprintf(stderr, "vcd: can't start writer thread\n");
+        fclose(file);
+        free(records);
+        return -1;
+    }
+
+    if (!observing)
+    {
+        bus_observe(observe, NULL);
+        observing = true;
+    }
+    active = true;
+
+    return 0;
+}
+
+int vcd_stop(void)
+{
+    int ret = 0;
+
+    if (!active)
+        return 0;
+
+    active = false;
+    spsc_stop(&ring);
+    pthread_join(thread, NULL);
+
+    write_time(cpu_cycles > now ? cpu_cycles : now);
+    if (ferror(file))
+        ret = -1;
+    if (fclose(file) != 0)
+        ret = -1;
+    if (ret < 0)
+        fprintf(stderr, "vcd: write error\n");
+
+    free(records);
+    return ret;
+}
+
+bool vcd_active(void)
+{
+    return active;
+}
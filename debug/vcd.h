@@ -0,0 +1,48 @@
+#ifndef DEBUG_VCD_H_
+#define DEBUG_VCD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../core/bus.h"
+
+/*
+ * Value change dump of the bus pins, for GTKWave and friends
+ *
+ * After every bus cycle the level of each captured net is compared against
+ * the last one seen, and changes go into a preallocated ring as binary
+ * records stamped with the bus cycle. A writer thread turns them into text,
+ * so the emulation thread never formats anything. If the writer falls behind
+ * the emulation thread waits for it, nothing is dropped.
+ *
+ * Pins only carry levels at pin accuracy. At the other accuracy levels the
+ * nets float and there is nothing to record. Times in the dump are CPU cycles
+ * scaled to the clock rate, so a viewer shows them in real time.
+ */
+
+/* Clock rate assumed when none is given, the board's own */
+#define VCD_DEFAULT_HZ 1000000
+
+/* Most pins a signal can have */
+#define VCD_MAX_WIDTH 16
+
+/*
+ * Make a group of pins known as a signal, least significant pin first. The
+ * CPU, decoder and RAM pins are built in, pin level devices add their own.
+ * Returns -1 if there's no room or the name is taken.
+ */
+int vcd_add_signal(const char *name, pin_t *pins, int count);
+
+/*
+ * Start dumping to a file. filter is a comma separated list of fnmatch(3)
+ * patterns selecting signals by name, NULL captures all of them. hz is the
+ * CPU clock rate, 0 for VCD_DEFAULT_HZ. Returns -1 on error.
+ */
+int vcd_start(const char *path, const char *filter, uint64_t hz);
+
+/* Wait for the writer to catch up and close the file. Returns -1 on error. */
+int vcd_stop(void);
+
+bool vcd_active(void);
+
+#endif /* DEBUG_VCD_H_ */
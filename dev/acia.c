@@ -0,0 +1,139 @@
+#include "acia.h"
+
+static void update_irq(acia_t *acia)
+{
+    if (acia->callbacks->irq)
+        acia->callbacks->irq(acia->ctx, acia->status & ACIA_STATUS_IRQ);
+}
+
+/* With DTR off, the receiver interrupt is off too */
+static bool irq_enabled(acia_t *acia)
+{
+    return (acia->command & (ACIA_COMMAND_DTR | ACIA_COMMAND_IRD)) == ACIA_COMMAND_DTR;
+}
+
+static void clear_irq(acia_t *acia)
+{
+    if (acia->status & ACIA_STATUS_IRQ)
+    {
+        acia->status &= ~ACIA_STATUS_IRQ;
+        update_irq(acia);
+    }
+}
+
+static void received(acia_t *acia, uint8_t byte)
+{
+    acia->rx_data = byte;
+    acia->status |= ACIA_STATUS_RDRF;
+
+    if (irq_enabled(acia))
+    {
+        acia->status |= ACIA_STATUS_IRQ;
+        update_irq(acia);
+    }
+}
+
+/* Move the next byte into the receiver data register, if there is one */
+static void next_byte(acia_t *acia)
+{
+    if (!acia->rx_len || acia->status & ACIA_STATUS_RDRF)
+        return;
+
+    acia->rx_len--;
+    received(acia, *acia->rx++);
+}
+
+void acia_init(acia_t *acia, const acia_callbacks_t *callbacks, void *ctx)
+{
+    static const acia_callbacks_t none = { 0 };
+
+    *acia = (acia_t){
+        .status = ACIA_STATUS_TDRE,
+        .callbacks = callbacks ? callbacks : &none,
+        .ctx = ctx,
+    };
+}
+
+void acia_fixup(void *data, const void *live, size_t size)
+{
+    acia_t *acia = data;
+    const acia_t *prev = live;
+
+    acia->rx = prev->rx;
+    acia->rx_len = prev->rx_len;
+    acia->callbacks = prev->callbacks;
+    acia->ctx = prev->ctx;
+}
+
+void acia_receive(acia_t *acia, const uint8_t *data, size_t len)
+{
+    acia->rx = data;
+    acia->rx_len = len;
+    next_byte(acia);
+}
+
+void acia_receive_byte(acia_t *acia, uint8_t byte)
+{
+    if (acia->status & ACIA_STATUS_RDRF)
+        acia->status |= ACIA_STATUS_OVERRUN;
+    else
+        received(acia, byte);
+}
+
+uint8_t acia_read(acia_t *acia, acia_reg_t reg)
+{
+    uint8_t value;
+
+    switch (reg)
+    {
+    case ACIA_DATA:
+        value = acia->rx_data;
+        acia->status &= ~(ACIA_STATUS_RDRF | ACIA_STATUS_OVERRUN);
+        next_byte(acia);
+        return value;
+    case ACIA_STATUS:
+        value = acia->status;
+        clear_irq(acia);
+        return value;
+    case ACIA_COMMAND:
+        return acia->command;
+    case ACIA_CONTROL:
+        return acia->control;
+    }
+
+    return 0xFF;
+}
+
+void acia_write(acia_t *acia, acia_reg_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case ACIA_DATA:
+        if (acia->callbacks->tx)
+            acia->callbacks->tx(acia->ctx, value);
+        break;
+    case ACIA_STATUS:
+        acia->command &= 0xE0;
+        acia->status &= ~ACIA_STATUS_OVERRUN;
+        clear_irq(acia);
+        break;
+    case ACIA_COMMAND:
+        acia->command = value;
+        if (!irq_enabled(acia))
+            clear_irq(acia);
+        break;
+    case ACIA_CONTROL:
+        acia->control = value;
+        break;
+    }
+}
+
+word_t acia_mmio_read(void *ctx, addr_t addr)
+{
+    return acia_read(ctx, addr & 0x3);
+}
+
+void acia_mmio_write(void *ctx, addr_t addr, word_t word)
+{
+    acia_write(ctx, addr & 0x3, word);
+}
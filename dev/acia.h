@@ -0,0 +1,81 @@
+#ifndef DEV_ACIA_H_
+#define DEV_ACIA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * 6551 Asynchronous Communications Interface Adapter
+ *
+ * Serial timing isn't modelled. Received bytes come from a buffer and the
+ * next one is ready as soon as the previous one is read, transmitted bytes
+ * go straight to a callback.
+ *
+ * Reference: WDC W65C51N datasheet
+ */
+typedef enum
+{
+    ACIA_DATA,
+    ACIA_STATUS, /* writing it is a programmed reset */
+    ACIA_COMMAND,
+    ACIA_CONTROL,
+} acia_reg_t;
+
+#define ACIA_STATUS_OVERRUN BIT(2)
+#define ACIA_STATUS_RDRF BIT(3) /* receiver data register full */
+#define ACIA_STATUS_TDRE BIT(4) /* transmitter data register empty */
+#define ACIA_STATUS_IRQ BIT(7)
+
+#define ACIA_COMMAND_DTR BIT(0)
+#define ACIA_COMMAND_IRD BIT(1) /* receiver interrupt disabled */
+
+/* Everything is optional */
+typedef struct
+{
+    void (*tx)(void *ctx, uint8_t byte);
+    void (*irq)(void *ctx, bool asserted);
+} acia_callbacks_t;
+
+typedef struct
+{
+    uint8_t rx_data;
+    uint8_t status;
+    uint8_t command;
+    uint8_t control;
+
+    /* Bytes still to be received. Not copied, the buffer has to stay around. */
+    const uint8_t *rx;
+    size_t rx_len;
+
+    const acia_callbacks_t *callbacks;
+    void *ctx;
+} acia_t;
+
+void acia_init(acia_t *acia, const acia_callbacks_t *callbacks, void *ctx);
+
+/*
+ * For state_register(), keeps the callbacks of the live device. Bytes still
+ * to be received belong to the host side and stay as they are.
+ */
+void acia_fixup(void *data, const void *live, size_t size);
+
+/* Replace whatever is still to be received with the given bytes */
+void acia_receive(acia_t *acia, const uint8_t *data, size_t len);
+
+/*
+ * A byte arriving on the serial line now. If the last one wasn't read yet,
+ * this one is lost and the overrun flag set.
+ */
+void acia_receive_byte(acia_t *acia, uint8_t byte);
+
+uint8_t acia_read(acia_t *acia, acia_reg_t reg);
+void acia_write(acia_t *acia, acia_reg_t reg, uint8_t value);
+
+/* For mem_map_io(), the register is selected by the low address bits */
+word_t acia_mmio_read(void *ctx, addr_t addr);
+void acia_mmio_write(void *ctx, addr_t addr, word_t word);
+
+#endif /* DEV_ACIA_H_ */
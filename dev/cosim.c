@@ -0,0 +1,390 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../core/decode.h"
+#include "cosim.h"
+
+#define MAX_NETS 32
+
+/* How long to wait for the model before checking it's still there */
+#define MODEL_TIMEOUT_S 1
+
+typedef struct
+{
+    char name[COSIM_NAME_LEN];
+    pin_t *net;
+    int count;
+} net_t;
+
+/* Nets that can be connected */
+static net_t nets[MAX_NETS];
+static int net_count = 0;
+
+/* Connected ones, our pins on them are numbered like the bits */
+static struct
+{
+    pin_t *net;
+    int first;
+    int count;
+    bool driven;
+} connected[COSIM_MAX_NETS];
+static int connected_count;
+static pin_t *pins;
+static int bit_count;
+static int words;
+
+static cosim_shm_t *shm;
+static char shm_name[64];
+static uint32_t seq;
+static unsigned int spins;
+static bool announced;
+static bool phi2_low;
+static bool active = false;
+static bool attached = false;
+
+static void add_builtin_nets(void)
+{
+    static bool added = false;
+
+    if (added)
+        return;
+    added = true;
+
+    cosim_add_net("cpu_addr_bus", cpu_addr_bus, 16);
+    cosim_add_net("cpu_data_bus", cpu_data_bus, 8);
+    cosim_add_net("cpu_rwb", &cpu_rwb, 1);
+    cosim_add_net("ram_cs", &ram_cs, 1);
+    cosim_add_net("ram_oe", &ram_oe, 1);
+    cosim_add_net("ram_we", &ram_we, 1);
+}
+
+int cosim_add_net(const char *name, pin_t *net, int count)
+{
+    if (active || net_count == MAX_NETS || count < 1 || count > COSIM_MAX_BITS ||
+        strlen(name) >= COSIM_NAME_LEN)
+        return -1;
+
+    for (int i = 0; i < net_count; i++)
+        if (strcmp(nets[i].name, name) == 0)
+            return -1;
+
+    strcpy(nets[net_count].name, name);
+    nets[net_count].net = net;
+    nets[net_count].count = count;
+    net_count++;
+
+    return 0;
+}
+
+/*
+ * Emulation thread
+ */
+static void sample(void)
+{
+    memset(shm->level, 0, words * sizeof(uint64_t));
+    memset(shm->floating, 0, words * sizeof(uint64_t));
+
+    for (int i = 0; i < bit_count; i++)
+    {
+        uint64_t bit = UINT64_C(1) << (i & 63);
+
+        switch (pin_evaluate(&pins[i]))
+        {
+        case PIN_STATE_HI:
+            shm->level[i >> 6] |= bit;
+            break;
+        case PIN_STATE_LO:
+            break;
+        case PIN_STATE_NONE:
+        case PIN_STATE_INVALID:
+            shm->floating[i >> 6] |= bit;
+            break;
+        }
+    }
+}
+
+static void drive(void)
+{
+    for (int n = 0; n < connected_count; n++)
+    {
+        if (!connected[n].driven)
+            continue;
+
+        for (int i = connected[n].first; i < connected[n].first + connected[n].count; i++)
+        {
+            uint64_t bit = UINT64_C(1) << (i & 63);
+
+            if (!(shm->enable[i >> 6] & bit))
+                pin_set(&pins[i], PIN_STATE_NONE);
+            else
+                pin_set(&pins[i], shm->drive[i >> 6] & bit ? PIN_STATE_HI : PIN_STATE_LO);
+        }
+    }
+}
+
+static void wait_for_model(void)
+{
+    struct timespec timeout = { MODEL_TIMEOUT_S, 0 };
+
+    while (cosim_wait(&shm->response, seq, spins, &timeout) < 0)
+    {
+        pid_t model = __atomic_load_n(&shm->model_pid, __ATOMIC_ACQUIRE);
+
+        if (!model && !announced)
+        {
+            fprintf(stderr, "cosim: waiting for the model on %s\n", shm_name);
+            announced = true;
+        }
+        else if (model && kill(model, 0) < 0 && errno == ESRCH)
+        {
+            fprintf(stderr, "cosim: the model has gone away\n");
+            shm_unlink(shm_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void exchange(cosim_phase_t phase)
+{
+    sample();
+    shm->phase = phase;
+    cosim_post(&shm->request, ++seq);
+
+    wait_for_model();
+    drive();
+}
+
+/*
+ * Devices only let go of the bus when they're evaluated, so while PHI2 is
+ * low a net can still be driven from the last bus cycle. It's only settled
+ * once the bus cycle is over, where the observers are called.
+ */
+static void evaluate(void *ctx)
+{
+    if (!active)
+        return;
+
+    exchange(COSIM_PHASE_PHI2_LOW);
+    phi2_low = true;
+}
+
+static void observe(const bus_cycle_t *cycle, void *ctx)
+{
+    /* Memory mapped devices are observed too, but don't go through the pins */
+    if (!phi2_low)
+        return;
+
+    exchange(COSIM_PHASE_PHI2_HIGH);
+    phi2_low = false;
+}
+
+/*
+ * Control
+ */
+static int connect_net(const char *spec)
+{
+    char name[COSIM_NAME_LEN + 4];
+    char *out;
+    net_t *net = NULL;
+    cosim_net_t *shared;
+
+    snprintf(name, sizeof(name), "%s", spec);
+    out = strchr(name, ':');
+    if (out)
+    {
+        if (strcmp(out, ":out") != 0)
+        {
+            fprintf(stderr, "cosim: %s: expected :out\n", spec);
+            return -1;
+        }
+        *out = '\0';
+    }
+
+    for (int i = 0; i < net_count; i++)
+        if (strcmp(nets[i].name, name) == 0)
+            net = &nets[i];
+
+    if (!net)
+    {
+        fprintf(stderr, "cosim: no net %s\n", name);
+        return -1;
+    }
+
+    for (int i = 0; i < connected_count; i++)
+    {
+        if (strcmp(shm->nets[i].name, name) == 0)
+        {
+            fprintf(stderr, "cosim: %s given twice\n", name);
+            return -1;
+        }
+    }
+
+    if (connected_count == COSIM_MAX_NETS || bit_count + net->count > COSIM_MAX_BITS)
+    {
+        fprintf(stderr, "cosim: too many nets\n");
+        return -1;
+    }
+
+    connected[connected_count].net = net->net;
+    connected[connected_count].first = bit_count;
+    connected[connected_count].count = net->count;
+    connected[connected_count].driven = out != NULL;
+
+    shared = &shm->nets[connected_count];
+    strcpy(shared->name, name);
+    shared->first = bit_count;
+    shared->width = net->count;
+    shared->driven = out != NULL;
+
+    /* Our own pins join the net, that's all it takes to connect them */
+    for (int i = 0; i < net->count; i++)
+    {
+        static const pin_t pin = { PIN_TYPE_BIDIRECTIONAL, PIN_STATE_NONE, { NULL, NULL } };
+        pin_t *p = &pins[bit_count + i];
+
+        memcpy(p, &pin, sizeof(pin));
+        dl_list_init(&p->list);
+        dl_list_add(&net->net[i].list, &p->list);
+    }
+
+    /* The model takes over from the glue logic it replaces */
+    if (out)
+        decode_yield(net->net, true);
+
+    connected_count++;
+    bit_count += net->count;
+
+    return 0;
+}
+
+static void disconnect(void)
+{
+    for (int i = 0; i < connected_count; i++)
+        if (connected[i].driven)
+            decode_yield(connected[i].net, false);
+
+    for (int i = 0; i < bit_count; i++)
+        dl_list_del(&pins[i].list);
+
+    free(pins);
+    pins = NULL;
+}
+
+int cosim_start(const char *name, const char *list)
+{
+    char *specs;
+    char *save;
+    int fd;
+
+    if (active)
+        return 0;
+
+    add_builtin_nets();
+
+    pins = calloc(COSIM_MAX_BITS, sizeof(*pins));
+    specs = strdup(list);
+    if (!pins || !specs)
+    {
+        fprintf(stderr, "cosim: out of memory\n");
+        free(pins);
+        free(specs);
+        return -1;
+    }
+
+    snprintf(shm_name, sizeof(shm_name), "%s", name);
+    fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(*shm)) < 0)
+    {
+        perror(shm_name);
+        if (fd >= 0)
+            close(fd);
+        free(pins);
+        free(specs);
+        return -1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        perror(shm_name);
+        shm_unlink(shm_name);
+        free(pins);
+        free(specs);
+        return -1;
+    }
+
+    connected_count = 0;
+    bit_count = 0;
+    for (char *s = strtok_r(specs, ",", &save); s; s = strtok_r(NULL, ",", &save))
+    {
+        if (connect_net(s) < 0)
+        {
+            free(specs);
+            disconnect();
+            munmap(shm, sizeof(*shm));
+            shm_unlink(shm_name);
+            return -1;
+        }
+    }
+    free(specs);
+
+    if (!connected_count)
+    {
+        fprintf(stderr, "cosim: no nets\n");
+        disconnect();
+        munmap(shm, sizeof(*shm));
+        shm_unlink(shm_name);
+        return -1;
+    }
+
+    shm->version = COSIM_VERSION;
+    shm->pid = getpid();
+    shm->net_count = connected_count;
+    shm->bit_count = bit_count;
+
+    /* The model checks the magic last */
+    __atomic_store_n(&shm->magic, COSIM_MAGIC, __ATOMIC_RELEASE);
+
+    words = (bit_count + 63) / 64;
+    seq = 0;
+    spins = cosim_spins();
+    announced = false;
+    phi2_low = false;
+
+    if (!attached)
+    {
+        bus_attach(evaluate, NULL);
+        bus_observe(observe, NULL);
+        attached = true;
+    }
+    active = true;
+
+    return 0;
+}
+
+void cosim_stop(void)
+{
+    if (!active)
+        return;
+
+    active = false;
+    shm->phase = COSIM_PHASE_DONE;
+    cosim_post(&shm->request, ++seq);
+
+    for (int i = 0; i < bit_count; i++)
+        pin_set(&pins[i], PIN_STATE_NONE);
+    disconnect();
+
+    munmap(shm, sizeof(*shm));
+    shm_unlink(shm_name);
+}
+
+bool cosim_active(void)
+{
+    return active;
+}
@@ -0,0 +1,49 @@
+#ifndef DEV_COSIM_H_
+#define DEV_COSIM_H_
+
+#include <stdbool.h>
+
+#include "../core/bus.h"
+#include "cosim_shm.h"
+
+/*
+ * Lockstep co-simulation with a model running in another process, e.g. glue
+ * logic verilated from the HDL going into an FPGA
+ *
+ * The bridge is a pin level device with pins of its own on the nets crossing
+ * the boundary. Every bus cycle it hands the model the levels on those nets
+ * twice: as PHI2 goes low, when its turn as a device comes, and as PHI2 goes
+ * high, once every device has responded and the CPU has sampled the data
+ * bus. What the model drives in reply to the first is seen by the devices
+ * attached after the bridge and by the CPU in the same bus cycle, what it
+ * drives in reply to the second from the next bus cycle on.
+ *
+ * The exchange goes through a shared memory segment laid out as in
+ * dev/cosim_shm.h, each side polling for a while and then sleeping on a
+ * futex, so a handoff costs no system call while both sides keep up. Only
+ * the nets given to cosim_start() are exchanged.
+ *
+ * The model is only called at pin accuracy, it's not part of savestates.
+ */
+
+/*
+ * Make a group of pins known as a net that can cross the boundary, least
+ * significant pin first. The CPU, decoder and RAM pins are built in.
+ * Returns -1 if there's no room or the name is taken.
+ */
+int cosim_add_net(const char *name, pin_t *pins, int count);
+
+/*
+ * Create the segment, named like "/fakeoid-cosim", and connect the nets in
+ * the comma separated list. Nets the model drives are named with ":out"
+ * appended, the others it only sees. Call it before attaching the devices
+ * that should see what the model drives. Returns -1 on error.
+ */
+int cosim_start(const char *name, const char *nets);
+
+/* Tell the model the run is over and remove the segment */
+void cosim_stop(void);
+
+bool cosim_active(void);
+
+#endif /* DEV_COSIM_H_ */
@@ -0,0 +1,155 @@
+#ifndef DEV_COSIM_SHM_H_
+#define DEV_COSIM_SHM_H_
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ * Shared memory layout of the co-simulation bridge, see dev/cosim.h
+ *
+ * This header is all the model side needs, it doesn't include anything else
+ * from the emulator. The words used for the handoff are plain integers
+ * accessed with the GCC atomic builtins rather than _Atomic, as the model
+ * side is usually a C++ Verilator testbench.
+ *
+ * The model side:
+ *
+ *   1. shm_open() and mmap() the segment, check magic and version
+ *   2. store its pid in model_pid, so a model that dies is noticed
+ *   3. for seq = 1, 2, ...: cosim_wait(&shm->request, seq), stop if phase is
+ *      COSIM_PHASE_DONE, otherwise set the clock input to the phase, copy the
+ *      levels in, eval(), copy drive and enable out and
+ *      cosim_post(&shm->response, seq)
+ *
+ * Bits are numbered across the nets in the order of the net table, the first
+ * pin of a net being its least significant bit.
+ */
+#define COSIM_MAGIC 0x53434B46 /* "FKCS" */
+#define COSIM_VERSION 1
+#define COSIM_MAX_NETS 32
+#define COSIM_MAX_BITS 256
+#define COSIM_WORDS (COSIM_MAX_BITS / 64)
+#define COSIM_NAME_LEN 16
+
+/*
+ * Times to poll the other side before sleeping. With a CPU to spare, it's
+ * polled while it runs, otherwise handed the CPU in between.
+ */
+#define COSIM_SPINS 4000
+#define COSIM_YIELDS 100
+
+#ifdef __cplusplus
+#define COSIM_CACHE_LINE alignas(64)
+#else
+#define COSIM_CACHE_LINE _Alignas(64)
+#endif
+
+typedef enum
+{
+    COSIM_PHASE_PHI2_LOW,
+    COSIM_PHASE_PHI2_HIGH,
+    COSIM_PHASE_DONE, /* the emulator is going away */
+} cosim_phase_t;
+
+typedef struct
+{
+    char name[COSIM_NAME_LEN];
+    uint16_t first; /* bit */
+    uint16_t width;
+    uint8_t driven; /* by the model, otherwise it only sees the levels */
+} cosim_net_t;
+
+/* One side posts a sequence number, the other waits for it */
+typedef struct
+{
+    uint32_t seq;
+    uint32_t waiting; /* set while the other side is asleep on seq */
+} cosim_flag_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid; /* of the emulator */
+    int32_t model_pid; /* 0 until the model is there */
+    uint32_t net_count;
+    uint32_t bit_count;
+    cosim_net_t nets[COSIM_MAX_NETS];
+
+    /* Emulator to model, once per clock phase */
+    COSIM_CACHE_LINE cosim_flag_t request;
+    uint32_t phase; /* a cosim_phase_t */
+    uint64_t level[COSIM_WORDS];
+    uint64_t floating[COSIM_WORDS]; /* nobody on the emulator side drives it */
+
+    /* Model to emulator, in reply */
+    COSIM_CACHE_LINE cosim_flag_t response;
+    uint64_t drive[COSIM_WORDS];
+    uint64_t enable[COSIM_WORDS]; /* only bits of driven nets count */
+} cosim_shm_t;
+
+static inline void cosim_pause(bool yield)
+{
+    if (yield)
+        sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+    else
+        __builtin_ia32_pause();
+#endif
+}
+
+/* Publish seq, after everything it covers has been written */
+static inline void cosim_post(cosim_flag_t *flag, uint32_t seq)
+{
+    __atomic_store_n(&flag->seq, seq, __ATOMIC_SEQ_CST);
+
+    /* Only pay for the system call if the other side went to sleep */
+    if (__atomic_exchange_n(&flag->waiting, 0, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &flag->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* How to poll before sleeping, see COSIM_SPINS */
+static inline unsigned int cosim_spins(void)
+{
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? COSIM_SPINS : COSIM_YIELDS;
+}
+
+/*
+ * Wait for seq to be posted, polling spins times first (cosim_spins()) and
+ * then sleeping. Returns -1 if nothing came within timeout, NULL for no
+ * timeout.
+ */
+static inline int cosim_wait(cosim_flag_t *flag, uint32_t seq, unsigned int spins,
+                             const struct timespec *timeout)
+{
+    for (unsigned int i = 0; i < spins; i++)
+    {
+        if (__atomic_load_n(&flag->seq, __ATOMIC_ACQUIRE) == seq)
+            return 0;
+        cosim_pause(spins == COSIM_YIELDS);
+    }
+
+    for (;;)
+    {
+        uint32_t now;
+
+        /* Against cosim_post(): either it sees waiting, or we see seq */
+        __atomic_store_n(&flag->waiting, 1, __ATOMIC_SEQ_CST);
+        now = __atomic_load_n(&flag->seq, __ATOMIC_SEQ_CST);
+        if (now == seq)
+            return 0;
+
+        if (syscall(SYS_futex, &flag->seq, FUTEX_WAIT, now, timeout, NULL, 0) < 0 &&
+            errno == ETIMEDOUT)
+            return -1;
+    }
+}
+
+#endif /* DEV_COSIM_SHM_H_ */
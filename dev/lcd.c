@@ -0,0 +1,488 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cpu/cpu.h"
+#include "lcd.h"
+
+/* Execution times, the clear and home instructions take longer */
+#define LCD_US 37
+#define LCD_LONG_US 1520
+
+#define LINE_LEN 40
+#define ONE_LINE_LEN 80
+
+/* Instructions, by their highest set bit */
+#define LCD_CLEAR BIT(0)
+#define LCD_HOME BIT(1)
+#define LCD_ENTRY_MODE BIT(2)
+#define LCD_DISPLAY BIT(3)
+#define LCD_SHIFT BIT(4)
+#define LCD_FUNCTION BIT(5)
+#define LCD_SET_CGRAM BIT(6)
+#define LCD_SET_DDRAM BIT(7)
+
+#define LCD_BUSY BIT(7)
+
+/* A row as drawn: a UTF-8 glyph and maybe reverse video per column */
+#define ROW_BUF (LCD_MAX_COLUMNS * 16)
+
+static struct
+{
+    lcd_t *lcd;
+    int fd;
+    unsigned int fps;
+    pthread_t thread;
+    atomic_bool stopping;
+    bool running;
+    char rows[LCD_MAX_ROWS][ROW_BUF];
+} renderer;
+
+/*
+ * Changes are bracketed by an odd sequence number, the renderer retries a
+ * copy taken while it was odd or that saw it move
+ */
+static void change_begin(lcd_t *lcd)
+{
+    unsigned int seq = atomic_load_explicit(&lcd->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&lcd->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void change_end(lcd_t *lcd)
+{
+    unsigned int seq = atomic_load_explicit(&lcd->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&lcd->seq, seq + 1, memory_order_release);
+}
+
+void lcd_init(lcd_t *lcd, int columns, int rows, unsigned int cycles_per_us)
+{
+    /* Power on: 8-bit, one line, display off, incrementing */
+    *lcd = (lcd_t){
+        .increment = true,
+        .eight_bit = true,
+        .cycles_per_us = cycles_per_us,
+        .columns = columns,
+        .rows = rows,
+    };
+    memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+    atomic_init(&lcd->seq, 0);
+}
+
+void lcd_fixup(void *data, const void *live, size_t size)
+{
+    lcd_t *lcd = data;
+    const lcd_t *prev = live;
+
+    atomic_store(&lcd->seq, atomic_load(&prev->seq) + 2);
+}
+
+static bool busy(const lcd_t *lcd)
+{
+    return cpu_cycles < lcd->busy_until;
+}
+
+/* The address counter wraps around the part of DDRAM that exists */
+static void move_ac(lcd_t *lcd, int dir)
+{
+    if (lcd->cgram_selected)
+        lcd->ac = (lcd->ac + dir) & (LCD_CGRAM_SIZE - 1);
+    else if (!lcd->two_lines)
+        lcd->ac = (lcd->ac + dir + ONE_LINE_LEN) % ONE_LINE_LEN;
+    else if (dir > 0)
+        lcd->ac = lcd->ac == LINE_LEN - 1 ? 0x40 : lcd->ac == 0x40 + LINE_LEN - 1 ? 0 : lcd->ac + 1;
+    else
+        lcd->ac = lcd->ac == 0 ? 0x40 + LINE_LEN - 1 : lcd->ac == 0x40 ? LINE_LEN - 1 : lcd->ac - 1;
+}
+
+static void shift_display(lcd_t *lcd, int dir)
+{
+    int len = lcd->two_lines ? LINE_LEN : ONE_LINE_LEN;
+
+    lcd->shift = (lcd->shift + dir + len) % len;
+}
+
+static void instruction(lcd_t *lcd, uint8_t op)
+{
+    unsigned int us = LCD_US;
+
+    if (op & LCD_SET_DDRAM)
+    {
+        lcd->ac = op & 0x7F;
+        lcd->cgram_selected = false;
+    }
+    else if (op & LCD_SET_CGRAM)
+    {
+        lcd->ac = op & 0x3F;
+        lcd->cgram_selected = true;
+    }
+    else if (op & LCD_FUNCTION)
+    {
+        lcd->eight_bit = op & BIT(4);
+        lcd->two_lines = op & BIT(3);
+    }
+    else if (op & LCD_SHIFT)
+    {
+        /* Right is towards higher addresses for the cursor */
+        int dir = op & BIT(2) ? 1 : -1;
+
+        if (op & BIT(3))
+            shift_display(lcd, -dir);
+        else
+            move_ac(lcd, dir);
+    }
+    else if (op & LCD_DISPLAY)
+    {
+        lcd->display_on = op & BIT(2);
+        lcd->cursor_on = op & BIT(1);
+        lcd->blink_on = op & BIT(0);
+    }
+    else if (op & LCD_ENTRY_MODE)
+    {
+        lcd->increment = op & BIT(1);
+        lcd->shift_on_write = op & BIT(0);
+    }
+    else if (op & LCD_HOME)
+    {
+        lcd->ac = 0;
+        lcd->cgram_selected = false;
+        lcd->shift = 0;
+        us = LCD_LONG_US;
+    }
+    else if (op & LCD_CLEAR)
+    {
+        memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+        lcd->ac = 0;
+        lcd->cgram_selected = false;
+        lcd->shift = 0;
+        lcd->increment = true;
+        us = LCD_LONG_US;
+    }
+
+    lcd->busy_until = cpu_cycles + us * lcd->cycles_per_us;
+}
+
+static void write_data(lcd_t *lcd, uint8_t byte)
+{
+    int dir = lcd->increment ? 1 : -1;
+
+    if (lcd->cgram_selected)
+    {
+        lcd->cgram[lcd->ac] = byte;
+    }
+    else
+    {
+        lcd->ddram[lcd->ac] = byte;
+        if (lcd->shift_on_write)
+            shift_display(lcd, dir);
+    }
+
+    move_ac(lcd, dir);
+    lcd->busy_until = cpu_cycles + LCD_US * lcd->cycles_per_us;
+}
+
+/* The controller ignores everything but status reads while busy */
+static void execute(lcd_t *lcd, bool rs, uint8_t byte)
+{
+    if (busy(lcd))
+        return;
+
+    change_begin(lcd);
+    if (rs)
+        write_data(lcd, byte);
+    else
+        instruction(lcd, byte);
+    change_end(lcd);
+}
+
+static uint8_t read_byte(lcd_t *lcd, bool rs)
+{
+    if (!rs)
+        return (busy(lcd) ? LCD_BUSY : 0) | (lcd->ac & 0x7F);
+
+    return lcd->cgram_selected ? lcd->cgram[lcd->ac] : lcd->ddram[lcd->ac];
+}
+
+/* Reading data moves the address counter, like writing it */
+static void read_done(lcd_t *lcd, bool rs)
+{
+    if (!rs || busy(lcd))
+        return;
+
+    change_begin(lcd);
+    move_ac(lcd, lcd->increment ? 1 : -1);
+    lcd->busy_until = cpu_cycles + LCD_US * lcd->cycles_per_us;
+    change_end(lcd);
+}
+
+void lcd_pins(lcd_t *lcd, bool rs, bool rw, bool e, uint8_t data)
+{
+    bool rising = e && !lcd->e;
+    bool falling = !e && lcd->e;
+
+    lcd->e = e;
+
+    /* RS and R/W are set up before E rises and held until after it falls */
+    if (rising)
+    {
+        lcd->rs = rs;
+        lcd->rw = rw;
+
+        if (rw && (lcd->eight_bit || !lcd->low_nibble))
+            lcd->read_latch = read_byte(lcd, rs);
+    }
+
+    if (!falling)
+        return;
+
+    if (lcd->eight_bit)
+    {
+        if (lcd->rw)
+            read_done(lcd, lcd->rs);
+        else
+            execute(lcd, lcd->rs, data);
+        return;
+    }
+
+    if (lcd->low_nibble)
+    {
+        if (lcd->rw)
+            read_done(lcd, lcd->rs);
+        else
+            execute(lcd, lcd->rs, lcd->high_nibble | data >> 4);
+    }
+    else
+    {
+        lcd->high_nibble = data & 0xF0;
+    }
+    lcd->low_nibble = !lcd->low_nibble;
+}
+
+uint8_t lcd_data(const lcd_t *lcd)
+{
+    if (!lcd->e || !lcd->rw)
+        return 0xFF;
+
+    if (lcd->eight_bit)
+        return lcd->read_latch;
+
+    return (lcd->low_nibble ? lcd->read_latch << 4 : lcd->read_latch & 0xF0) | 0x0F;
+}
+
+/*
+ * Rendering
+ */
+static const char *const extended[] = {
+    "α", "ä", "β", "ε", "μ", "σ", "ρ", "g", "√", "¹", "j", "ˣ", "¢", "£", "ñ", "ö",
+    "p", "q", "θ", "∞", "Ω", "ü", "Σ", "π", "x̄", "y", "千", "万", "円", "÷", " ", "█",
+};
+
+/* Character generator ROM A00 as UTF-8, custom characters as a shaded block */
+static char *glyph(char *p, uint8_t c)
+{
+    if (c < 0x10)
+        return p + sprintf(p, "▒");
+    if (c == 0x5C)
+        return p + sprintf(p, "¥");
+    if (c == 0x7E)
+        return p + sprintf(p, "→");
+    if (c == 0x7F)
+        return p + sprintf(p, "←");
+    if (c >= 0x20 && c < 0x7E)
+        return p + sprintf(p, "%c", c);
+
+    /* Half width katakana are in the same order as in Unicode */
+    if (c >= 0xA1 && c < 0xE0)
+    {
+        unsigned int u = 0xFF61 + c - 0xA1;
+
+        return p + sprintf(p, "%c%c%c", 0xE0 | u >> 12, 0x80 | (u >> 6 & 0x3F), 0x80 | (u & 0x3F));
+    }
+    if (c >= 0xE0)
+        return p + sprintf(p, "%s", extended[c - 0xE0]);
+
+    return p + sprintf(p, " ");
+}
+
+/* DDRAM address shown at a position, rows 2 and 3 continue rows 0 and 1 */
+static uint8_t position(const lcd_t *lcd, int row, int column)
+{
+    if (!lcd->two_lines)
+        return (column + lcd->shift) % ONE_LINE_LEN;
+
+    return (row & 1 ? 0x40 : 0) + (row / 2 * lcd->columns + column + lcd->shift) % LINE_LEN;
+}
+
+static void draw_row(const lcd_t *lcd, int row, char *p)
+{
+    for (int column = 0; column < lcd->columns; column++)
+    {
+        uint8_t addr = position(lcd, row, column);
+        bool cursor = (lcd->cursor_on || lcd->blink_on) && !lcd->cgram_selected && addr == lcd->ac;
+
+        if (!lcd->display_on || (!lcd->two_lines && row > 0))
+        {
+            *p++ = ' ';
+            continue;
+        }
+
+        if (cursor)
+            p += sprintf(p, "\033[7m");
+        p = glyph(p, lcd->ddram[addr]);
+        if (cursor)
+            p += sprintf(p, "\033[0m");
+    }
+    *p = '\0';
+}
+
+static void snapshot(lcd_t *copy)
+{
+    for (;;)
+    {
+        unsigned int seq = atomic_load_explicit(&renderer.lcd->seq, memory_order_acquire);
+
+        if (seq & 1)
+        {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(copy, renderer.lcd, sizeof(*copy));
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&renderer.lcd->seq, memory_order_relaxed) == seq)
+            return;
+    }
+}
+
+static void put(const char *s, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(renderer.fd, s, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        s += n;
+        len -= n;
+    }
+}
+
+static void draw_frame(const lcd_t *lcd)
+{
+    char line[LCD_MAX_COLUMNS + 4];
+
+    memset(line, '-', sizeof(line));
+    line[0] = line[lcd->columns + 1] = '+';
+    line[lcd->columns + 2] = '\n';
+
+    put("\033[2J\033[H", 7);
+    put(line, lcd->columns + 3);
+    for (int row = 0; row < lcd->rows; row++)
+    {
+        char blank[LCD_MAX_COLUMNS + 4];
+
+        memset(blank, ' ', sizeof(blank));
+        blank[0] = blank[lcd->columns + 1] = '|';
+        blank[lcd->columns + 2] = '\n';
+        put(blank, lcd->columns + 3);
+    }
+    put(line, lcd->columns + 3);
+}
+
+/* Only rows that look different are written */
+static void render(const lcd_t *lcd)
+{
+    char out[LCD_MAX_ROWS * (ROW_BUF + 16)];
+    char *p = out;
+
+    for (int row = 0; row < lcd->rows; row++)
+    {
+        char drawn[ROW_BUF];
+
+        draw_row(lcd, row, drawn);
+        if (strcmp(drawn, renderer.rows[row]) == 0)
+            continue;
+
+        strcpy(renderer.rows[row], drawn);
+        p += sprintf(p, "\033[%d;2H%s", row + 2, drawn);
+    }
+
+    if (p != out)
+    {
+        p += sprintf(p, "\033[%d;1H", lcd->rows + 3);
+        put(out, p - out);
+    }
+}
+
+static void *render_thread(void *arg)
+{
+    struct timespec period = { 0, 1000000000L / renderer.fps };
+    unsigned int drawn = 1; /* odd, never seen */
+    lcd_t copy;
+
+    draw_frame(renderer.lcd);
+
+    /* One more look once stopping, so the last frame is on screen */
+    for (bool last = false; !last; nanosleep(&period, NULL))
+    {
+        last = atomic_load_explicit(&renderer.stopping, memory_order_acquire);
+
+        if (atomic_load_explicit(&renderer.lcd->seq, memory_order_acquire) != drawn)
+        {
+            snapshot(&copy);
+            drawn = atomic_load_explicit(&copy.seq, memory_order_relaxed);
+            render(&copy);
+        }
+    }
+
+    return NULL;
+}
+
+int lcd_show(lcd_t *lcd, const char *tty, unsigned int fps)
+{
+    if (renderer.running || lcd->columns > LCD_MAX_COLUMNS || lcd->rows > LCD_MAX_ROWS || !fps)
+        return -1;
+
+    renderer.fd = open(tty, O_WRONLY | O_NOCTTY);
+    if (renderer.fd < 0)
+    {
+        perror(tty);
+        return -1;
+    }
+
+    renderer.lcd = lcd;
+    renderer.fps = fps;
+    memset(renderer.rows, 0, sizeof(renderer.rows));
+    atomic_store(&renderer.stopping, false);
+
+    if (pthread_create(&renderer.thread, NULL, render_thread, NULL) != 0)
+    {
+        fprintf(stderr, "lcd: can't start render thread\n");
+        close(renderer.fd);
+        return -1;
+    }
+
+    renderer.running = true;
+    return 0;
+}
+
+void lcd_hide(void)
+{
+    if (!renderer.running)
+        return;
+
+    atomic_store_explicit(&renderer.stopping, true, memory_order_release);
+    pthread_join(renderer.thread, NULL);
+    close(renderer.fd);
+    renderer.running = false;
+}
@@ -0,0 +1,85 @@
+#ifndef DEV_LCD_H_
+#define DEV_LCD_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HD44780 character LCD controller
+ *
+ * Driven pin by pin, usually through a VIA port: commands and data are taken
+ * on the falling edge of E, reads are driven on D0-D7 while E is high. Both
+ * the 8-bit and the 4-bit interface work, in 4-bit mode on D4-D7, high nibble
+ * first. The busy flag stays set for as long as the real controller takes.
+ *
+ * Rendering runs on a thread of its own, at a fixed rate. The emulation side
+ * only bumps a sequence number around changes, and a frame is only drawn if
+ * the number moved. Then only lines that look different are written, so
+ * firmware redrawing the same text costs no terminal output at all.
+ *
+ * Reference: Hitachi HD44780U datasheet, character generator ROM A00
+ */
+#define LCD_DDRAM_SIZE 0x80
+#define LCD_CGRAM_SIZE 0x40
+#define LCD_MAX_COLUMNS 40
+#define LCD_MAX_ROWS 4
+
+typedef struct
+{
+    uint8_t ddram[LCD_DDRAM_SIZE];
+    uint8_t cgram[LCD_CGRAM_SIZE];
+    uint8_t ac; /* address counter */
+    bool cgram_selected; /* the address counter points into CGRAM */
+    uint8_t shift; /* display shift, 0-39 */
+
+    /* Entry mode */
+    bool increment;
+    bool shift_on_write;
+
+    /* Display control */
+    bool display_on;
+    bool cursor_on;
+    bool blink_on;
+
+    /* Function set */
+    bool eight_bit;
+    bool two_lines;
+
+    /* Pins and the 4-bit interface */
+    bool e;
+    bool rw;
+    bool rs;
+    bool low_nibble; /* the next transfer is the low nibble */
+    uint8_t high_nibble; /* written so far */
+    uint8_t read_latch; /* byte being read */
+
+    uint64_t busy_until;
+    unsigned int cycles_per_us;
+    int columns;
+    int rows;
+
+    /* Odd while the emulation thread is changing things */
+    atomic_uint seq;
+} lcd_t;
+
+void lcd_init(lcd_t *lcd, int columns, int rows, unsigned int cycles_per_us);
+
+/* For state_register(), makes the display redraw */
+void lcd_fixup(void *data, const void *live, size_t size);
+
+/* Levels on the inputs, whenever one of them changes */
+void lcd_pins(lcd_t *lcd, bool rs, bool rw, bool e, uint8_t data);
+
+/* Levels driven on D0-D7, all high while the LCD isn't driving them */
+uint8_t lcd_data(const lcd_t *lcd);
+
+/*
+ * Draw the display on a terminal of its own, e.g. /dev/pts/3, at most fps
+ * times a second. Returns -1 on error.
+ */
+int lcd_show(lcd_t *lcd, const char *tty, unsigned int fps);
+void lcd_hide(void);
+
+#endif /* DEV_LCD_H_ */
@@ -0,0 +1,520 @@
+#include "via.h"
+
+/* ACR bits */
+#define ACR_PA_LATCH BIT(0)
+#define ACR_PB_LATCH BIT(1)
+#define ACR_SR_SHIFT 2
+#define ACR_SR_MASK (7u << ACR_SR_SHIFT)
+#define ACR_T2_PULSES BIT(5)
+#define ACR_T1_FREE_RUN BIT(6)
+#define ACR_T1_PB7 BIT(7)
+
+/* Shift register modes, ACR bits 4-2 */
+enum
+{
+    SR_DISABLED,
+    SR_IN_T2,
+    SR_IN_PHI2,
+    SR_IN_CB1,
+    SR_OUT_FREE_T2,
+    SR_OUT_T2,
+    SR_OUT_PHI2,
+    SR_OUT_CB1,
+};
+
+#define SR_MODE(via) (((via)->acr & ACR_SR_MASK) >> ACR_SR_SHIFT)
+#define SR_OUTPUT(mode) ((mode) & 4)
+
+static void update_irq(via_t *via)
+{
+    bool irq = (via->ifr & via->ier & 0x7F) != 0;
+
+    if (irq == via->irq)
+        return;
+
+    via->irq = irq;
+    if (via->callbacks->irq)
+        via->callbacks->irq(via->ctx, irq);
+}
+
+static void set_flag(via_t *via, uint8_t flag)
+{
+    via->ifr |= flag;
+    update_irq(via);
+}
+
+static void clear_flag(via_t *via, uint8_t flag)
+{
+    via->ifr &= ~flag;
+    update_irq(via);
+}
+
+static void port_out(via_t *via, via_port_t port)
+{
+    uint8_t value = port == VIA_PORT_A ? via->ora : via->orb;
+    uint8_t ddr = port == VIA_PORT_A ? via->ddra : via->ddrb;
+
+    if (port == VIA_PORT_B && via->acr & ACR_T1_PB7)
+    {
+        value = (value & 0x7F) | (via->pb7 ? 0x80 : 0);
+        ddr |= 0x80;
+    }
+
+    if (via->callbacks->port_out)
+        via->callbacks->port_out(via->ctx, port, value, ddr);
+}
+
+static uint8_t port_in(via_t *via, via_port_t port)
+{
+    return via->callbacks->port_in ? via->callbacks->port_in(via->ctx, port) : 0xFF;
+}
+
+/*
+ * Timer 1
+ *
+ * The counter is loaded with t1_count at t1_start, counts down to zero, shows
+ * 0xFFFF for one cycle and is reloaded from the latch, in both modes. That is
+ * a period of N + 2 cycles, and the interrupt flag is set on the cycle the
+ * counter wraps, N + 1 cycles after the load.
+ */
+
+/* Move t1_start up to the most recent reload, so the latch can change */
+static void t1_normalize(via_t *via, uint64_t now)
+{
+    uint64_t first = (uint64_t)via->t1_count + 2;
+    uint64_t period = (uint64_t)via->t1_latch + 2;
+
+    if (now - via->t1_start < first)
+        return;
+
+    via->t1_start += first;
+    via->t1_start += (now - via->t1_start) / period * period;
+    via->t1_count = via->t1_latch;
+}
+
+static uint16_t t1_counter(via_t *via, uint64_t now)
+{
+    uint64_t elapsed;
+
+    t1_normalize(via, now);
+    elapsed = now - via->t1_start;
+
+    return elapsed <= via->t1_count ? via->t1_count - elapsed : 0xFFFF;
+}
+
+static void t1_schedule(via_t *via)
+{
+    t1_normalize(via, cpu_cycles);
+
+    if (via->t1_armed || via->acr & ACR_T1_FREE_RUN)
+        sched_add(&via->t1_event, via->t1_start + via->t1_count + 1);
+    else
+        sched_cancel(&via->t1_event);
+}
+
+static void t1_expired(void *ctx, uint64_t when)
+{
+    via_t *via = ctx;
+
+    if (via->acr & ACR_T1_FREE_RUN)
+    {
+        via->pb7 = !via->pb7;
+    }
+    else
+    {
+        via->pb7 = true;
+        via->t1_armed = false;
+    }
+
+    if (via->acr & ACR_T1_PB7)
+        port_out(via, VIA_PORT_B);
+
+    set_flag(via, VIA_INT_T1);
+
+    /* Reload happens on the next cycle */
+    t1_normalize(via, when + 1);
+    if (via->acr & ACR_T1_FREE_RUN)
+        sched_add(&via->t1_event, via->t1_start + via->t1_count + 1);
+}
+
+static void t1_load(via_t *via)
+{
+    via->t1_count = via->t1_latch;
+    via->t1_start = cpu_cycles;
+    via->t1_armed = true;
+    via->pb7 = false;
+
+    clear_flag(via, VIA_INT_T1);
+    if (via->acr & ACR_T1_PB7)
+        port_out(via, VIA_PORT_B);
+
+    t1_schedule(via);
+}
+
+/*
+ * Timer 2
+ *
+ * In timed mode the counter keeps decrementing past zero without a reload. In
+ * pulse counting mode t2_count is the counter itself.
+ */
+static uint16_t t2_counter(via_t *via, uint64_t now)
+{
+    if (via->acr & ACR_T2_PULSES)
+        return via->t2_count;
+
+    return (uint16_t)(via->t2_count - (now - via->t2_start));
+}
+
+static void t2_expired(void *ctx, uint64_t when)
+{
+    via_t *via = ctx;
+
+    via->t2_armed = false;
+    set_flag(via, VIA_INT_T2);
+}
+
+static void t2_schedule(via_t *via)
+{
+    if (via->t2_armed && !(via->acr & ACR_T2_PULSES))
+        sched_add(&via->t2_event, via->t2_start + via->t2_count + 1);
+    else
+        sched_cancel(&via->t2_event);
+}
+
+/*
+ * Shift register
+ *
+ * A whole byte is shifted with a single event at the end, the register isn't
+ * updated bit by bit while it runs. CB2 input is sampled at the end as well.
+ */
+static uint64_t sr_bit_cycles(via_t *via)
+{
+    switch (SR_MODE(via))
+    {
+    case SR_IN_PHI2:
+    case SR_OUT_PHI2:
+        return 2;
+    default:
+        /* CB1 toggles every time the low byte of T2 times out */
+        return 2 * ((uint64_t)via->t2_latch + 2);
+    }
+}
+
+static void sr_shift_bit(via_t *via)
+{
+    if (SR_OUTPUT(SR_MODE(via)))
+        via->sr = (uint8_t)(via->sr << 1 | via->sr >> 7);
+    else
+        via->sr = (uint8_t)(via->sr << 1 | via->cb2_in);
+}
+
+static void sr_done(via_t *via)
+{
+    int mode = SR_MODE(via);
+
+    if (SR_OUTPUT(mode) && via->callbacks->shift_out)
+        via->callbacks->shift_out(via->ctx, via->sr);
+
+    if (mode == SR_OUT_FREE_T2)
+        sched_add(&via->sr_event, cpu_cycles + 8 * sr_bit_cycles(via));
+    else
+        set_flag(via, VIA_INT_SR);
+}
+
+static void sr_expired(void *ctx, uint64_t when)
+{
+    via_t *via = ctx;
+
+    for (int i = 0; i < 8; i++)
+        sr_shift_bit(via);
+
+    sr_done(via);
+}
+
+/* Reading or writing the shift register starts a byte */
+static void sr_start(via_t *via)
+{
+    int mode = SR_MODE(via);
+
+    clear_flag(via, VIA_INT_SR);
+    via->sr_bits = 0;
+    sched_cancel(&via->sr_event);
+
+    if (mode == SR_DISABLED)
+        return;
+
+    if (mode == SR_IN_CB1 || mode == SR_OUT_CB1)
+        via->sr_bits = 8;
+    else
+        sched_add(&via->sr_event, cpu_cycles + 8 * sr_bit_cycles(via));
+}
+
+/*
+ * Control lines. PCR bit 0/4 selects the active edge of CA1/CB1. For CA2/CB2,
+ * PCR bits 3-1/7-5 of 0x0 to 0x3 are input modes with bit 2/6 selecting the
+ * edge and bit 1/5 the "independent" mode, where port accesses leave the flag
+ * alone.
+ */
+static bool ca2_independent(via_t *via)
+{
+    return (via->pcr & 0x0A) == 0x02;
+}
+
+static bool cb2_independent(via_t *via)
+{
+    return (via->pcr & 0xA0) == 0x20;
+}
+
+static bool edge(bool old, bool level, bool positive)
+{
+    return old != level && level == positive;
+}
+
+void via_set_ca1(via_t *via, bool level)
+{
+    if (edge(via->ca1, level, via->pcr & BIT(0)))
+        set_flag(via, VIA_INT_CA1);
+
+    via->ca1 = level;
+}
+
+void via_set_ca2(via_t *via, bool level)
+{
+    if (!(via->pcr & BIT(3)) && edge(via->ca2, level, via->pcr & BIT(2)))
+        set_flag(via, VIA_INT_CA2);
+
+    via->ca2 = level;
+}
+
+void via_set_cb1(via_t *via, bool level)
+{
+    if (edge(via->cb1, level, via->pcr & BIT(4)))
+        set_flag(via, VIA_INT_CB1);
+
+    /* External shift clock, data moves on the rising edge */
+    if (via->sr_bits && !via->cb1 && level)
+    {
+        sr_shift_bit(via);
+        if (--via->sr_bits == 0)
+            sr_done(via);
+    }
+
+    via->cb1 = level;
+}
+
+void via_set_cb2(via_t *via, bool level)
+{
+    if (!(via->pcr & BIT(7)) && edge(via->cb2, level, via->pcr & BIT(6)))
+        set_flag(via, VIA_INT_CB2);
+
+    via->cb2 = level;
+    via->cb2_in = level;
+}
+
+void via_pb6_pulse(via_t *via)
+{
+    if (!(via->acr & ACR_T2_PULSES))
+        return;
+
+    if (--via->t2_count == 0 && via->t2_armed)
+    {
+        via->t2_armed = false;
+        set_flag(via, VIA_INT_T2);
+    }
+}
+
+static void write_acr(via_t *via, uint8_t value)
+{
+    uint64_t now = cpu_cycles;
+    uint8_t changed = via->acr ^ value;
+
+    /* Carry the timer state over into the new mode */
+    if (changed & ACR_T2_PULSES)
+    {
+        via->t2_count = t2_counter(via, now);
+        via->t2_start = now;
+    }
+
+    t1_normalize(via, now);
+    via->acr = value;
+
+    if (changed & (ACR_T1_FREE_RUN | ACR_T1_PB7))
+    {
+        t1_schedule(via);
+        port_out(via, VIA_PORT_B);
+    }
+
+    if (changed & ACR_T2_PULSES)
+        t2_schedule(via);
+
+    if (changed & ACR_SR_MASK)
+    {
+        sched_cancel(&via->sr_event);
+        via->sr_bits = 0;
+    }
+}
+
+void via_init(via_t *via, const via_callbacks_t *callbacks, void *ctx)
+{
+    static const via_callbacks_t none = { 0 };
+
+    *via = (via_t){
+        .callbacks = callbacks ? callbacks : &none,
+        .ctx = ctx,
+        .ca1 = true,
+        .ca2 = true,
+        .cb1 = true,
+        .cb2 = true,
+        .cb2_in = true,
+    };
+
+    sched_event_init(&via->t1_event, t1_expired, via);
+    sched_event_init(&via->t2_event, t2_expired, via);
+    sched_event_init(&via->sr_event, sr_expired, via);
+}
+
+void via_fixup(void *data, const void *live, size_t size)
+{
+    via_t *via = data;
+    const via_t *prev = live;
+
+    via->callbacks = prev->callbacks;
+    via->ctx = prev->ctx;
+    sched_event_fixup(&via->t1_event, &prev->t1_event);
+    sched_event_fixup(&via->t2_event, &prev->t2_event);
+    sched_event_fixup(&via->sr_event, &prev->sr_event);
+}
+
+uint8_t via_read(via_t *via, via_reg_t reg)
+{
+    uint64_t now = cpu_cycles;
+    uint8_t value;
+
+    switch (reg)
+    {
+    case VIA_ORB:
+        value = (via->orb & via->ddrb) | (port_in(via, VIA_PORT_B) & ~via->ddrb);
+        if (via->acr & ACR_T1_PB7)
+            value = (value & 0x7F) | (via->pb7 ? 0x80 : 0);
+        clear_flag(via, VIA_INT_CB1 | (cb2_independent(via) ? 0 : VIA_INT_CB2));
+        return value;
+    case VIA_ORA:
+        clear_flag(via, VIA_INT_CA1 | (ca2_independent(via) ? 0 : VIA_INT_CA2));
+        return port_in(via, VIA_PORT_A);
+    case VIA_ORA_NH:
+        return port_in(via, VIA_PORT_A);
+    case VIA_DDRB:
+        return via->ddrb;
+    case VIA_DDRA:
+        return via->ddra;
+    case VIA_T1CL:
+        clear_flag(via, VIA_INT_T1);
+        return t1_counter(via, now) & 0xFF;
+    case VIA_T1CH:
+        return t1_counter(via, now) >> 8;
+    case VIA_T1LL:
+        return via->t1_latch & 0xFF;
+    case VIA_T1LH:
+        return via->t1_latch >> 8;
+    case VIA_T2CL:
+        clear_flag(via, VIA_INT_T2);
+        return t2_counter(via, now) & 0xFF;
+    case VIA_T2CH:
+        return t2_counter(via, now) >> 8;
+    case VIA_SR:
+        value = via->sr;
+        sr_start(via);
+        return value;
+    case VIA_ACR:
+        return via->acr;
+    case VIA_PCR:
+        return via->pcr;
+    case VIA_IFR:
+        return via->ifr | (via->irq ? VIA_INT_IRQ : 0);
+    case VIA_IER:
+        return via->ier | VIA_INT_IRQ;
+    }
+
+    return 0xFF;
+}
+
+void via_write(via_t *via, via_reg_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case VIA_ORB:
+        via->orb = value;
+        clear_flag(via, VIA_INT_CB1 | (cb2_independent(via) ? 0 : VIA_INT_CB2));
+        port_out(via, VIA_PORT_B);
+        break;
+    case VIA_ORA:
+        clear_flag(via, VIA_INT_CA1 | (ca2_independent(via) ? 0 : VIA_INT_CA2));
+        /* fall through */
+    case VIA_ORA_NH:
+        via->ora = value;
+        port_out(via, VIA_PORT_A);
+        break;
+    case VIA_DDRB:
+        via->ddrb = value;
+        port_out(via, VIA_PORT_B);
+        break;
+    case VIA_DDRA:
+        via->ddra = value;
+        port_out(via, VIA_PORT_A);
+        break;
+    case VIA_T1CL:
+    case VIA_T1LL:
+        t1_normalize(via, cpu_cycles);
+        via->t1_latch = (via->t1_latch & 0xFF00) | value;
+        break;
+    case VIA_T1CH:
+        via->t1_latch = (via->t1_latch & 0x00FF) | value << 8;
+        t1_load(via);
+        break;
+    case VIA_T1LH:
+        t1_normalize(via, cpu_cycles);
+        via->t1_latch = (via->t1_latch & 0x00FF) | value << 8;
+        clear_flag(via, VIA_INT_T1);
+        break;
+    case VIA_T2CL:
+        via->t2_latch = value;
+        break;
+    case VIA_T2CH:
+        via->t2_count = via->t2_latch | value << 8;
+        via->t2_start = cpu_cycles;
+        via->t2_armed = true;
+        clear_flag(via, VIA_INT_T2);
+        t2_schedule(via);
+        break;
+    case VIA_SR:
+        via->sr = value;
+        sr_start(via);
+        break;
+    case VIA_ACR:
+        write_acr(via, value);
+        break;
+    case VIA_PCR:
+        via->pcr = value;
+        break;
+    case VIA_IFR:
+        clear_flag(via, value & 0x7F);
+        break;
+    case VIA_IER:
+        if (value & VIA_INT_IRQ)
+            via->ier |= value & 0x7F;
+        else
+            via->ier &= ~value;
+        update_irq(via);
+        break;
+    }
+}
+
+word_t via_mmio_read(void *ctx, addr_t addr)
+{
+    return via_read(ctx, addr & 0xF);
+}
+
+void via_mmio_write(void *ctx, addr_t addr, word_t word)
+{
+    via_write(ctx, addr & 0xF, word);
+}
@@ -0,0 +1,131 @@
+#ifndef DEV_VIA_H_
+#define DEV_VIA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../core/sched.h"
+#include "../cpu/cpu.h"
+
+/*
+ * 6522 Versatile Interface Adapter
+ *
+ * The timers and the shift register don't tick every cycle. Counter values
+ * are computed from the cycle they were loaded at when they're read, and
+ * interrupts come from scheduler events at the cycle they expire.
+ *
+ * Reference: WDC W65C22 datasheet
+ */
+typedef enum
+{
+    VIA_ORB, /* Output/Input Register B */
+    VIA_ORA, /* Output/Input Register A */
+    VIA_DDRB, /* Data Direction Register B */
+    VIA_DDRA, /* Data Direction Register A */
+    VIA_T1CL, /* T1 Low-Order Counter */
+    VIA_T1CH, /* T1 High-Order Counter */
+    VIA_T1LL, /* T1 Low-Order Latches */
+    VIA_T1LH, /* T1 High-Order Latches */
+    VIA_T2CL, /* T2 Low-Order Counter */
+    VIA_T2CH, /* T2 High-Order Counter */
+    VIA_SR, /* Shift Register */
+    VIA_ACR, /* Auxiliary Control Register */
+    VIA_PCR, /* Peripheral Control Register */
+    VIA_IFR, /* Interrupt Flag Register */
+    VIA_IER, /* Interrupt Enable Register */
+    VIA_ORA_NH, /* Output/Input Register A, no handshake */
+} via_reg_t;
+
+/* Interrupt flag/enable register bits */
+#define VIA_INT_CA2 BIT(0)
+#define VIA_INT_CA1 BIT(1)
+#define VIA_INT_SR BIT(2)
+#define VIA_INT_CB2 BIT(3)
+#define VIA_INT_CB1 BIT(4)
+#define VIA_INT_T2 BIT(5)
+#define VIA_INT_T1 BIT(6)
+#define VIA_INT_IRQ BIT(7)
+
+typedef enum
+{
+    VIA_PORT_A,
+    VIA_PORT_B,
+} via_port_t;
+
+/* Everything is optional */
+typedef struct
+{
+    /* Output register or data direction of a port changed */
+    void (*port_out)(void *ctx, via_port_t port, uint8_t value, uint8_t ddr);
+    /* Levels on the input pins of a port */
+    uint8_t (*port_in)(void *ctx, via_port_t port);
+    /* The shift register shifted out a byte on CB2 */
+    void (*shift_out)(void *ctx, uint8_t byte);
+    /* IRQB output changed */
+    void (*irq)(void *ctx, bool asserted);
+} via_callbacks_t;
+
+typedef struct
+{
+    uint8_t orb;
+    uint8_t ora;
+    uint8_t ddrb;
+    uint8_t ddra;
+    uint8_t acr;
+    uint8_t pcr;
+    uint8_t ifr;
+    uint8_t ier;
+
+    /* Timer 1: loaded with t1_count at cycle t1_start, then reloads from the latch */
+    uint16_t t1_latch;
+    uint16_t t1_count;
+    uint64_t t1_start;
+    bool t1_armed; /* one-shot mode: interrupt on the next time-out */
+    bool pb7;
+    sched_event_t t1_event;
+
+    /* Timer 2: loaded with t2_count at cycle t2_start, or counting PB6 pulses */
+    uint8_t t2_latch;
+    uint16_t t2_count;
+    uint64_t t2_start;
+    bool t2_armed;
+    sched_event_t t2_event;
+
+    /* Shift register */
+    uint8_t sr;
+    bool cb2_in;
+    int sr_bits; /* bits left to shift under an external clock */
+    sched_event_t sr_event;
+
+    /* Control line inputs */
+    bool ca1;
+    bool ca2;
+    bool cb1;
+    bool cb2;
+
+    bool irq;
+    const via_callbacks_t *callbacks;
+    void *ctx;
+} via_t;
+
+void via_init(via_t *via, const via_callbacks_t *callbacks, void *ctx);
+
+/* For state_register(), keeps the callbacks of the live device */
+void via_fixup(void *data, const void *live, size_t size);
+
+uint8_t via_read(via_t *via, via_reg_t reg);
+void via_write(via_t *via, via_reg_t reg, uint8_t value);
+
+/* For mem_map_io(), the register is selected by the low address bits */
+word_t via_mmio_read(void *ctx, addr_t addr);
+void via_mmio_write(void *ctx, addr_t addr, word_t word);
+
+/* Control line and serial inputs */
+void via_set_ca1(via_t *via, bool level);
+void via_set_ca2(via_t *via, bool level);
+void via_set_cb1(via_t *via, bool level);
+void via_set_cb2(via_t *via, bool level);
+void via_pb6_pulse(via_t *via);
+
+#endif /* DEV_VIA_H_ */
@@ -0,0 +1,191 @@
+/*
+ * libFuzzer entry points for fuzzing guest firmware
+ *
+ * Build every source file except main.c together with this one, with
+ * -fsanitize=fuzzer, and run the result like any libFuzzer target.
+ *
+ * Environment:
+ *   FAKEOID_ROM          ROM image of up to 32K, loaded at the top of the
+ *                        address space
+ *   FAKEOID_BOOT_CYCLES  cycles to run after reset before taking the snapshot
+ *   FAKEOID_CYCLES       cycle budget per input
+ *   FAKEOID_TAIL_CYCLES  cycles to keep running once the input is consumed
+ *   FAKEOID_CRASH        comma separated addresses that count as a crash when
+ *                        executed, e.g. the firmware's panic handler
+ *
+ * The machine boots once and is snapshotted. Every input starts from the
+ * snapshot and is fed to the firmware through the ACIA receiver. Only the
+ * pages written by the previous input are copied back, and coverage goes
+ * straight into libFuzzer's extra counters, so an input costs little more
+ * than the guest code it runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/board.h"
+#include "../core/bus.h"
+#include "../core/rom.h"
+#include "../core/sched.h"
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "../debug/debug.h"
+#include "../dev/acia.h"
+#include "../dev/via.h"
+
+#define DEFAULT_BOOT_CYCLES 1000000
+#define DEFAULT_CYCLES 200000
+#define DEFAULT_TAIL_CYCLES 20000
+
+/* How often to check whether the input is consumed */
+#define SLICE_CYCLES 1024
+
+static uint8_t coverage[CPU_COVERAGE_SIZE] __attribute__((section("__libfuzzer_extra_counters")));
+
+static board_t board;
+
+static uint64_t budget;
+static uint64_t tail;
+
+/* Everything an input can change */
+static struct
+{
+    registers_t reg;
+    uint64_t cycles;
+    cpu_state_t state;
+    unsigned int irq_lines;
+    bool nmi_pending;
+    addr_t calls[CPU_CALL_DEPTH];
+    unsigned int call_depth;
+    via_t via;
+    acia_t acia;
+    sched_snapshot_t sched;
+    word_t mem[1 << 16];
+} snapshot;
+
+static uint64_t env_number(const char *name, uint64_t fallback)
+{
+    const char *value = getenv(name);
+
+    return value ? strtoull(value, NULL, 0) : fallback;
+}
+
+static void crashed(const debug_stop_t *stop)
+{
+    fprintf(stderr, "fuzz: guest reached crash address %04x\n", stop->addr);
+    abort();
+}
+
+static void set_crash_addresses(const char *list)
+{
+    char *copy = strdup(list);
+
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ","))
+        debug_insert(DEBUG_EXEC, strtoul(tok[0] == '$' ? tok + 1 : tok, NULL, 16), 1);
+
+    free(copy);
+    debug_set_stop_handler(crashed);
+}
+
+static void take_snapshot(void)
+{
+    snapshot.reg = reg;
+    snapshot.cycles = cpu_cycles;
+    snapshot.state = cpu_state;
+    snapshot.irq_lines = cpu_irq_lines;
+    snapshot.nmi_pending = cpu_nmi_pending;
+    memcpy(snapshot.calls, cpu_calls, sizeof(snapshot.calls));
+    snapshot.call_depth = cpu_call_depth;
+    snapshot.via = board.via;
+    snapshot.acia = board.acia;
+    mem_read_block(0, snapshot.mem, sizeof(snapshot.mem));
+
+    if (sched_save(&snapshot.sched) < 0)
+    {
+        fprintf(stderr, "fuzz: too many pending events to snapshot\n");
+        exit(1);
+    }
+
+    mem_track_start();
+}
+
+static void restore_snapshot(void)
+{
+    const uint8_t *pages;
+    unsigned int count = mem_dirty_pages(&pages);
+
+    for (unsigned int i = 0; i < count; i++)
+        mem_write_block(pages[i] << 8, &snapshot.mem[pages[i] << 8], 256);
+    mem_track_reset();
+
+    reg = snapshot.reg;
+    cpu_cycles = snapshot.cycles;
+    cpu_state = snapshot.state;
+    cpu_irq_lines = snapshot.irq_lines;
+    cpu_nmi_pending = snapshot.nmi_pending;
+    memcpy(cpu_calls, snapshot.calls, sizeof(cpu_calls));
+    cpu_call_depth = snapshot.call_depth;
+
+    /* Device state first, it holds the events the scheduler puts back */
+    sched_clear();
+    board.via = snapshot.via;
+    board.acia = snapshot.acia;
+    sched_restore(&snapshot.sched);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    const char *rom = getenv("FAKEOID_ROM");
+    const char *crash = getenv("FAKEOID_CRASH");
+
+    if (!rom)
+    {
+        fprintf(stderr, "fuzz: set FAKEOID_ROM to the firmware image\n");
+        exit(1);
+    }
+
+    budget = env_number("FAKEOID_CYCLES", DEFAULT_CYCLES);
+    tail = env_number("FAKEOID_TAIL_CYCLES", DEFAULT_TAIL_CYCLES);
+
+    bus_init();
+    if (board_init(&board, NULL, NULL, NULL) < 0)
+        exit(1);
+
+    if (rom_load(rom) < 0)
+        exit(1);
+    cpu_reset();
+
+    cpu_run(env_number("FAKEOID_BOOT_CYCLES", DEFAULT_BOOT_CYCLES));
+
+    if (crash)
+        set_crash_addresses(crash);
+
+    take_snapshot();
+    cpu_coverage = coverage;
+
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    uint64_t end;
+    uint64_t consumed = 0;
+
+    restore_snapshot();
+    acia_receive(&board.acia, data, size);
+
+    end = cpu_cycles + budget;
+    while (cpu_cycles < end)
+    {
+        cpu_run(cpu_cycles + SLICE_CYCLES < end ? cpu_cycles + SLICE_CYCLES : end);
+
+        if (!consumed && !board.acia.rx_len && !(board.acia.status & ACIA_STATUS_RDRF))
+        {
+            consumed = cpu_cycles;
+            if (consumed + tail < end)
+                end = consumed + tail;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,518 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu/mem.h"
+#include "../debug/diff.h"
+#include "hle.h"
+
+#define FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+/* Mismatching bytes reported per verification */
+#define MAX_REPORTED 8
+
+static hle_hook_t hooks[MAX_HLE_HOOKS];
+static int hook_count = 0;
+
+static bool verify = false;
+
+/* Verification in progress: the native result, waiting for the guest's */
+static struct
+{
+    bool pending;
+    hle_hook_t *hook;
+    addr_t ret; /* where the guest routine returns to */
+    word_t s; /* with the stack pointer back at */
+    uint64_t start;
+    registers_t reg;
+    word_t mem[1 << 16];
+} check;
+
+/*
+ * Memory as the guest routine would access it, so watchpoints, the heatmap,
+ * write tracking and devices see it. While verifying, the native result is
+ * undone afterwards, and accesses go straight to memory.
+ */
+static word_t load(addr_t addr, bool verifying)
+{
+    return verifying ? mem_peek(addr) : mem_read(addr);
+}
+
+static void store(addr_t addr, word_t word, bool verifying)
+{
+    if (!verifying)
+        mem_write(addr, word);
+    else if (!(mem_page_flags[addr >> 8] & MEM_PAGE_ROM))
+        mem_poke(addr, word);
+}
+
+static addr_t read16(addr_t addr, bool verifying)
+{
+    return load(addr, verifying) | load(addr + 1, verifying) << 8;
+}
+
+static void write16(addr_t addr, addr_t value, bool verifying)
+{
+    store(addr, value & 0xFF, verifying);
+    store(addr + 1, value >> 8, verifying);
+}
+
+/*
+ * Built-in routines
+ */
+static void mul16(const hle_hook_t *hook, bool verifying)
+{
+    uint32_t product =
+        (uint32_t)read16(hook->args, verifying) * read16(hook->args + 2, verifying);
+
+    write16(hook->args + 4, product & 0xFFFF, verifying);
+    write16(hook->args + 6, product >> 16, verifying);
+}
+
+static void div16(const hle_hook_t *hook, bool verifying)
+{
+    addr_t dividend = read16(hook->args, verifying);
+    addr_t divisor = read16(hook->args + 2, verifying);
+
+    /* What a shift-and-subtract loop ends up with */
+    if (divisor == 0)
+    {
+        write16(hook->args + 4, 0xFFFF, verifying);
+        write16(hook->args + 6, dividend, verifying);
+        return;
+    }
+
+    write16(hook->args + 4, dividend / divisor, verifying);
+    write16(hook->args + 6, dividend % divisor, verifying);
+}
+
+static void hle_memcpy(const hle_hook_t *hook, bool verifying)
+{
+    addr_t src = read16(hook->args, verifying);
+    addr_t dst = read16(hook->args + 2, verifying);
+    addr_t len = read16(hook->args + 4, verifying);
+
+    /* Byte by byte, so overlapping copies behave like the guest loop */
+    for (unsigned int i = 0; i < len; i++)
+        store(dst + i, load(src + i, verifying), verifying);
+}
+
+static void hle_memset(const hle_hook_t *hook, bool verifying)
+{
+    addr_t dst = read16(hook->args, verifying);
+    addr_t len = read16(hook->args + 2, verifying);
+
+    for (unsigned int i = 0; i < len; i++)
+        store(dst + i, reg.a, verifying);
+}
+
+static void hle_putchar(const hle_hook_t *hook, bool verifying)
+{
+    if (verifying)
+        return;
+
+    putchar(reg.a);
+    fflush(stdout);
+}
+
+static const hle_routine_desc_t routines[] = {
+    { "mul16", mul16, 0 },
+    { "div16", div16, 0 },
+    { "memcpy", hle_memcpy, 0 },
+    { "memset", hle_memset, HLE_OUT_A },
+    { "putchar", hle_putchar, HLE_OUT_A },
+};
+
+static const hle_routine_desc_t *find_routine(const char *name)
+{
+    for (size_t i = 0; i < sizeof(routines) / sizeof(routines[0]); i++)
+        if (strcmp(routines[i].name, name) == 0)
+            return &routines[i];
+
+    return NULL;
+}
+
+static hle_hook_t *find_hook(addr_t addr)
+{
+    for (int i = 0; i < hook_count; i++)
+        if (hooks[i].addr == addr)
+            return &hooks[i];
+
+    return NULL;
+}
+
+static void update_page(unsigned int page)
+{
+    bool flag = check.pending && check.ret >> 8 == page;
+
+    for (int i = 0; i < hook_count && !flag; i++)
+        flag = hooks[i].addr >> 8 == page;
+
+    if (flag)
+        mem_page_flags[page] |= MEM_PAGE_HOOK;
+    else
+        mem_page_flags[page] &= ~MEM_PAGE_HOOK;
+}
+
+hle_hook_t *hle_add(addr_t addr, const char *routine, addr_t args, unsigned int cycles)
+{
+    const hle_routine_desc_t *desc = find_routine(routine);
+    hle_hook_t *hook = find_hook(addr);
+
+    if (!desc)
+        return NULL;
+
+    if (!hook)
+    {
+        if (hook_count == MAX_HLE_HOOKS)
+            return NULL;
+        hook = &hooks[hook_count++];
+    }
+
+    *hook = (hle_hook_t){
+        .addr = addr,
+        .desc = desc,
+        .args = args,
+        .cycles = cycles,
+    };
+    update_page(addr >> 8);
+
+    return hook;
+}
+
+void hle_clear(void)
+{
+    hook_count = 0;
+    check.pending = false;
+
+    for (int i = 0; i < 256; i++)
+        mem_page_flags[i] &= ~MEM_PAGE_HOOK;
+}
+
+uint64_t hle_rom_hash(const word_t *rom, size_t size)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= rom[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Config file
+ */
+static int parse_number(const char *s, unsigned long long *value)
+{
+    char *end;
+    int base = 0;
+
+    if (*s == '$')
+    {
+        s++;
+        base = 16;
+    }
+
+    if (!isxdigit((unsigned char)*s))
+        return -1;
+
+    *value = strtoull(s, &end, base);
+    return *end ? -1 : 0;
+}
+
+static int parse_addr(const char *s, addr_t *addr)
+{
+    unsigned long long value;
+
+    if (parse_number(s, &value) < 0 || value > 0xFFFF)
+        return -1;
+
+    *addr = value;
+    return 0;
+}
+
+/* hook <addr> <routine> [args=<addr>] [cycles=<n>] [clobber=<first>-<last>] */
+static int parse_hook(char *line, hle_hook_t *hook)
+{
+    char *addr = strtok(line, " \t");
+    char *routine = strtok(NULL, " \t");
+    char *opt;
+
+    *hook = (hle_hook_t){ 0 };
+
+    if (!addr || !routine || parse_addr(addr, &hook->addr) < 0)
+        return -1;
+
+    hook->desc = find_routine(routine);
+    if (!hook->desc)
+        return -1;
+
+    while ((opt = strtok(NULL, " \t")))
+    {
+        char *value = strchr(opt, '=');
+        unsigned long long n;
+
+        if (!value)
+            return -1;
+        *value++ = '\0';
+
+        if (strcmp(opt, "args") == 0)
+        {
+            if (parse_addr(value, &hook->args) < 0)
+                return -1;
+        }
+        else if (strcmp(opt, "cycles") == 0)
+        {
+            if (parse_number(value, &n) < 0 || n > UINT32_MAX)
+                return -1;
+            hook->cycles = n;
+        }
+        else if (strcmp(opt, "clobber") == 0)
+        {
+            char *last = strchr(value, '-');
+
+            if (last)
+                *last++ = '\0';
+            if (parse_addr(value, &hook->clobber_first) < 0 ||
+                parse_addr(last ? last : value, &hook->clobber_last) < 0)
+                return -1;
+            hook->clobber = true;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int hle_load(const char *path, uint64_t rom_hash)
+{
+    hle_hook_t loaded[MAX_HLE_HOOKS];
+    int count = 0;
+    bool rom_seen = false;
+    char line[256];
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char *p = line;
+        unsigned long long hash;
+
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        while (isspace((unsigned char)*p))
+            p++;
+
+        if (!*p)
+            continue;
+
+        if (strncmp(p, "rom", 3) == 0 && isspace((unsigned char)p[3]))
+        {
+            char *value = strtok(p + 3, " \t");
+
+            if (!value || parse_number(value, &hash) < 0)
+                goto syntax;
+
+            if (hash != rom_hash)
+            {
+                fprintf(stderr, "hle: %s is for ROM %016llx, this is %016llx\n", path, hash,
+                        (unsigned long long)rom_hash);
+                fclose(f);
+                return -1;
+            }
+            rom_seen = true;
+        }
+        else if (strncmp(p, "hook", 4) == 0 && isspace((unsigned char)p[4]))
+        {
+            if (count == MAX_HLE_HOOKS)
+            {
+                fprintf(stderr, "hle: %s:%d: too many hooks\n", path, lineno);
+                fclose(f);
+                return -1;
+            }
+            if (parse_hook(p + 4, &loaded[count++]) < 0)
+                goto syntax;
+        }
+        else
+        {
+            goto syntax;
+        }
+    }
+
+    fclose(f);
+
+    if (!rom_seen)
+    {
+        fprintf(stderr, "hle: %s doesn't name a ROM hash\n", path);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        hle_hook_t *hook = hle_add(loaded[i].addr, loaded[i].desc->name, loaded[i].args,
+                                   loaded[i].cycles);
+
+        if (!hook)
+        {
+            fprintf(stderr, "hle: %s: too many hooks\n", path);
+            return -1;
+        }
+
+        hook->clobber = loaded[i].clobber;
+        hook->clobber_first = loaded[i].clobber_first;
+        hook->clobber_last = loaded[i].clobber_last;
+    }
+
+    return count;
+
+syntax:
+    fprintf(stderr, "hle: %s:%d: syntax error\n", path, lineno);
+    fclose(f);
+    return -1;
+}
+
+/*
+ * Running hooks
+ */
+void hle_set_verify(bool enable)
+{
+    verify = enable;
+}
+
+/* Memory the comparison doesn't care about */
+static bool ignored(const hle_hook_t *hook, addr_t addr)
+{
+    /* Stack below the caller's stack pointer, the guest routine uses it */
+    if (addr >> 8 == 0x01 && (addr & 0xFF) <= check.s)
+        return true;
+
+    if (mem_page_flags[addr >> 8] & MEM_PAGE_IO)
+        return true;
+
+    return hook->clobber && addr >= hook->clobber_first && addr <= hook->clobber_last;
+}
+
+static void compare(void)
+{
+    hle_hook_t *hook = check.hook;
+    unsigned int outputs = hook->desc->outputs;
+    int bad = 0;
+
+    hook->verified++;
+    hook->guest_cycles = cpu_cycles - check.start;
+
+    if ((outputs & HLE_OUT_A && reg.a != check.reg.a) ||
+        (outputs & HLE_OUT_X && reg.x != check.reg.x) ||
+        (outputs & HLE_OUT_Y && reg.y != check.reg.y) ||
+        (outputs & HLE_OUT_C && reg.p.c != check.reg.p.c))
+    {
+        fprintf(stderr,
+                "hle: %s at $%04X: registers differ, native a=%02x x=%02x y=%02x c=%d, "
+                "guest a=%02x x=%02x y=%02x c=%d\n",
+                hook->desc->name, hook->addr, check.reg.a, check.reg.x, check.reg.y,
+                check.reg.p.c, reg.a, reg.x, reg.y, reg.p.c);
+        bad++;
+    }
+
+    for (unsigned int addr = 0; addr < sizeof(check.mem); addr++)
+    {
+        if (mem_peek(addr) == check.mem[addr] || ignored(hook, addr))
+            continue;
+
+        if (bad++ < MAX_REPORTED)
+            fprintf(stderr, "hle: %s at $%04X: $%04X native %02x, guest %02x\n",
+                    hook->desc->name, hook->addr, addr, check.mem[addr], mem_peek(addr));
+    }
+
+    if (bad)
+        hook->mismatches++;
+
+    /* Worth knowing once, to tune the cycle cost */
+    if (hook->verified == 1)
+        fprintf(stderr, "hle: %s at $%04X took %llu cycles as guest code, hook charges %u\n",
+                hook->desc->name, hook->addr, (unsigned long long)hook->guest_cycles,
+                hook->cycles);
+}
+
+/*
+ * Run the native routine and keep its result, then put everything back and let
+ * the guest routine run. Its return address gets flagged so that hle_exec()
+ * sees it come back.
+ */
+static void start_check(hle_hook_t *hook)
+{
+    registers_t saved = reg;
+
+    mem_read_block(0, check.mem, sizeof(check.mem));
+
+    hook->desc->routine(hook, true);
+    reg.pc = pop16() + 1;
+
+    /* Swap, so check holds the native result and memory the state before */
+    for (unsigned int addr = 0; addr < sizeof(check.mem); addr++)
+    {
+        word_t w = mem_peek(addr);
+
+        if (w == check.mem[addr])
+            continue;
+
+        mem_poke(addr, check.mem[addr]);
+        check.mem[addr] = w;
+    }
+
+    check.reg = reg;
+    check.ret = reg.pc;
+    check.s = reg.s;
+    check.hook = hook;
+    check.start = cpu_cycles;
+    check.pending = true;
+    reg = saved;
+
+    update_page(check.ret >> 8);
+}
+
+bool hle_exec(addr_t pc)
+{
+    hle_hook_t *hook;
+
+    if (check.pending && pc == check.ret && reg.s == check.s)
+    {
+        check.pending = false;
+        update_page(pc >> 8);
+        compare();
+    }
+
+    /* Hooks change state behind the reference core's back */
+    hook = find_hook(pc);
+    if (!hook || mem_get_accuracy() != ACCURACY_INSTRUCTION || diff_active())
+        return false;
+
+    hook->calls++;
+
+    if (verify && !check.pending)
+    {
+        start_check(hook);
+        return false;
+    }
+
+    hook->desc->routine(hook, false);
+    reg.pc = pop16() + 1;
+    cpu_return();
+    cpu_cycles += hook->cycles;
+
+    return true;
+}
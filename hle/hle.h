@@ -0,0 +1,104 @@
+#ifndef HLE_HLE_H_
+#define HLE_HLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../cpu/cpu.h"
+
+/*
+ * High-level emulation of known ROM routines
+ *
+ * A hook replaces a subroutine at a guest address with a native routine. When
+ * the CPU is about to execute the entry point, the native routine performs the
+ * effect of the subroutine on reg and memory, the hook's cycle cost is charged,
+ * and an RTS is done. Pages with a hook are flagged MEM_PAGE_HOOK, so the
+ * instruction loop pays nothing for hooks elsewhere. The native routine
+ * accesses memory through mem_read() and mem_write() like the guest code, so
+ * watchpoints, the heatmap, write tracking and devices see it do so.
+ *
+ * Hooks only run at instruction accuracy. At the other levels the guest code
+ * runs, since skipping its bus cycles would defeat the point.
+ *
+ * Built-in routines and their parameter blocks (16 bit values little endian,
+ * at the hook's args address):
+ *
+ * mul16:   [args] * [args+2] -> 32 bit product at [args+4]
+ * div16:   [args] / [args+2] -> quotient at [args+4], remainder at [args+6]
+ * memcpy:  copy [args+4] bytes from [args] to [args+2], lowest address first
+ * memset:  fill [args+2] bytes at [args] with A
+ * putchar: write A to stdout
+ */
+#define MAX_HLE_HOOKS 64
+
+/* Registers a routine returns values in, for verification */
+#define HLE_OUT_A BIT(0)
+#define HLE_OUT_X BIT(1)
+#define HLE_OUT_Y BIT(2)
+#define HLE_OUT_C BIT(3)
+
+typedef struct hle_hook hle_hook_t;
+
+/* When verifying, output to the outside world has to be left to the guest code */
+typedef void (*hle_routine_t)(const hle_hook_t *hook, bool verifying);
+
+typedef struct
+{
+    const char *name;
+    hle_routine_t routine;
+    unsigned int outputs; /* HLE_OUT_* */
+} hle_routine_desc_t;
+
+struct hle_hook
+{
+    addr_t addr;
+    const hle_routine_desc_t *desc;
+    addr_t args; /* parameter block */
+    unsigned int cycles; /* charged per call, RTS included */
+
+    /* Scratch memory the guest routine may leave in any state */
+    addr_t clobber_first;
+    addr_t clobber_last;
+    bool clobber;
+
+    uint64_t calls;
+    uint64_t verified;
+    uint64_t mismatches;
+    uint64_t guest_cycles; /* of the last verified call, for tuning 'cycles' */
+};
+
+/* Returns the new hook, or NULL for an unknown routine or a full table */
+hle_hook_t *hle_add(addr_t addr, const char *routine, addr_t args, unsigned int cycles);
+void hle_clear(void);
+
+/* FNV-1a hash identifying a ROM image */
+uint64_t hle_rom_hash(const word_t *rom, size_t size);
+
+/*
+ * Load hooks from a config file. The file has to name the hash of the ROM it
+ * was written for, and nothing is loaded for a different ROM:
+ *
+ *   # comment
+ *   rom 0x0123456789abcdef
+ *   hook $E000 mul16 args=$10 cycles=150
+ *   hook $E040 memcpy args=$20 cycles=40 clobber=$30-$33
+ *
+ * Returns the number of hooks loaded, or -1.
+ */
+int hle_load(const char *path, uint64_t rom_hash);
+
+/*
+ * Verification mode: a hooked call runs the native routine, then the guest
+ * routine from the same state, and the two results are compared when it
+ * returns. Mismatches are reported on stderr. The guest result is kept.
+ */
+void hle_set_verify(bool verify);
+
+/*
+ * Hook for the instruction loop. Only to be called when the page flag is set.
+ * Returns true if a hook ran, in which case reg.pc has changed.
+ */
+bool hle_exec(addr_t pc);
+
+#endif /* HLE_HLE_H_ */
@@ -0,0 +1,315 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/board.h"
+#include "../core/bus.h"
+#include "../core/rom.h"
+#include "../core/sched.h"
+#include "../cpu/cpu.h"
+#include "../cpu/mem.h"
+#include "../cpu/ops.h"
+#include "../debug/debug.h"
+#include "../dev/acia.h"
+#include "../dev/via.h"
+#include "fakeoid.h"
+
+struct fakeoid
+{
+    board_t board;
+
+    void (*tx)(void *ctx, uint8_t byte);
+    void *tx_ctx;
+    uint8_t *rx;
+
+    /* Set by the host, taken by the poll event */
+    atomic_bool stop_requested;
+    sched_event_t poll;
+
+    /* Why the current run ends, once it does */
+    fakeoid_stop_t stop;
+    unsigned int stop_mask;
+
+    /* A run starting at a breakpoint doesn't stop there again */
+    uint16_t resume_pc;
+    uint64_t resume_cycle;
+};
+
+static fakeoid_t machine;
+static bool built = false;
+static bool created = false;
+
+static void acia_tx(void *ctx, uint8_t byte)
+{
+    fakeoid_t *m = ctx;
+
+    if (m->tx)
+        m->tx(m->tx_ctx, byte);
+}
+
+static const acia_callbacks_t acia_callbacks = { .tx = acia_tx };
+
+/*
+ * Emulation thread
+ */
+static void end_run(fakeoid_t *m, fakeoid_stop_t stop)
+{
+    m->stop = stop;
+    cpu_exit();
+}
+
+static void poll(void *ctx, uint64_t when)
+{
+    fakeoid_t *m = ctx;
+
+    if (atomic_exchange_explicit(&m->stop_requested, false, memory_order_acquire))
+        end_run(m, FAKEOID_STOP_HOST);
+    else
+        sched_add(&m->poll, when + FAKEOID_POLL_PERIOD);
+}
+
+static void stopped(const debug_stop_t *stop)
+{
+    fakeoid_t *m = &machine;
+
+    if (stop->reason != DEBUG_STOP_BREAK ||
+        !(m->stop_mask & FAKEOID_STOP_MASK(FAKEOID_STOP_BREAK)))
+        return;
+
+    if (stop->addr == m->resume_pc && cpu_cycles == m->resume_cycle)
+        return;
+
+    end_run(m, FAKEOID_STOP_BREAK);
+}
+
+/* What the CPU is halted for, it executed the opcode before reg.pc */
+static fakeoid_stop_t halt_reason(void)
+{
+    if (cpu_state == CPU_WAITING)
+        return FAKEOID_STOP_WAI;
+
+    return strcmp(op_names[mem_peek(reg.pc - 1)], "jam") == 0 ? FAKEOID_STOP_INVALID
+                                                              : FAKEOID_STOP_STP;
+}
+
+static unsigned int exit_states(unsigned int stop_mask)
+{
+    unsigned int states = 0;
+
+    if (stop_mask & FAKEOID_STOP_MASK(FAKEOID_STOP_WAI))
+        states |= BIT(CPU_WAITING);
+    if (stop_mask & (FAKEOID_STOP_MASK(FAKEOID_STOP_STP) | FAKEOID_STOP_MASK(FAKEOID_STOP_INVALID)))
+        states |= BIT(CPU_STOPPED);
+
+    return states;
+}
+
+fakeoid_stop_t fakeoid_run(fakeoid_t *m, uint64_t max_cycles, unsigned int stop_mask)
+{
+    uint64_t until = max_cycles > UINT64_MAX - cpu_cycles ? UINT64_MAX : cpu_cycles + max_cycles;
+
+    m->stop_mask = stop_mask;
+    m->resume_pc = reg.pc;
+    m->resume_cycle = cpu_cycles;
+    cpu_exit_states = exit_states(stop_mask);
+
+    if (stop_mask & FAKEOID_STOP_MASK(FAKEOID_STOP_HOST))
+        sched_add(&m->poll, cpu_cycles);
+
+    while (cpu_cycles < until)
+    {
+        uint64_t instructions = cpu_instructions;
+        fakeoid_stop_t halt;
+
+        m->stop = FAKEOID_STOP_BUDGET;
+        cpu_run(until);
+
+        if (m->stop != FAKEOID_STOP_BUDGET)
+            break;
+
+        /*
+         * A CPU that was already halted returns at every event while it stays
+         * that way, it only counts once it has executed something
+         */
+        if (!(cpu_exit_states & BIT(cpu_state)) || cpu_instructions == instructions)
+            continue;
+
+        halt = halt_reason();
+        if (stop_mask & FAKEOID_STOP_MASK(halt))
+        {
+            m->stop = halt;
+            break;
+        }
+
+        /* Stopped, but by the one of STP and JAM that isn't in the mask */
+        cpu_exit_states &= ~BIT(cpu_state);
+    }
+
+    sched_cancel(&m->poll);
+    cpu_exit_states = 0;
+
+    return m->stop;
+}
+
+void fakeoid_request_stop(fakeoid_t *m)
+{
+    atomic_store_explicit(&m->stop_requested, true, memory_order_release);
+}
+
+/*
+ * Control
+ */
+static int build_board(fakeoid_t *m)
+{
+    bus_init();
+    if (board_init(&m->board, NULL, &acia_callbacks, m) < 0)
+        return -1;
+
+    sched_event_init(&m->poll, poll, m);
+    debug_set_stop_handler(stopped);
+
+    return 0;
+}
+
+fakeoid_t *fakeoid_create(void)
+{
+    if (created)
+    {
+        fprintf(stderr, "fakeoid: there's already a machine\n");
+        return NULL;
+    }
+
+    /* The bus can't be taken apart again, a new machine keeps the board */
+    if (!built)
+    {
+        if (build_board(&machine) < 0)
+            return NULL;
+        built = true;
+    }
+
+    atomic_init(&machine.stop_requested, false);
+    machine.tx = NULL;
+    created = true;
+
+    return &machine;
+}
+
+void fakeoid_destroy(fakeoid_t *m)
+{
+    if (!m)
+        return;
+
+    static const sched_snapshot_t nothing_pending;
+
+    acia_receive(&m->board.acia, NULL, 0);
+    free(m->rx);
+    m->rx = NULL;
+    debug_clear();
+    mem_release();
+    mem_export_close();
+
+    /* The next machine starts from power on, on the same board */
+    sched_restore(&nothing_pending);
+    sched_set_quantum(1);
+    board_reset(&m->board);
+    cpu_clear();
+    created = false;
+}
+
+int fakeoid_load(fakeoid_t *m, const char *path)
+{
+    return rom_load(path);
+}
+
+void fakeoid_reset(fakeoid_t *m)
+{
+    cpu_reset();
+}
+
+void fakeoid_set_break(fakeoid_t *m, uint16_t addr, bool set)
+{
+    if (set)
+        debug_insert(DEBUG_EXEC, addr, 1);
+    else
+        debug_remove(DEBUG_EXEC, addr, 1);
+}
+
+void fakeoid_set_quantum(fakeoid_t *m, uint64_t cycles)
+{
+    sched_set_quantum(cycles);
+}
+
+int fakeoid_export_memory(fakeoid_t *m, const char *name)
+{
+    return mem_export(name);
+}
+
+int fakeoid_read(fakeoid_t *m, uint16_t addr, void *data, size_t len)
+{
+    if (len > MEM_SIZE - addr)
+        return -1;
+
+    mem_read_block(addr, data, len);
+    return 0;
+}
+
+int fakeoid_write(fakeoid_t *m, uint16_t addr, const void *data, size_t len)
+{
+    if (len > MEM_SIZE - addr)
+        return -1;
+
+    mem_write_block(addr, data, len);
+    return 0;
+}
+
+void fakeoid_get_regs(fakeoid_t *m, fakeoid_regs_t *regs)
+{
+    *regs = (fakeoid_regs_t){
+        .a = reg.a,
+        .x = reg.x,
+        .y = reg.y,
+        .s = reg.s,
+        .p = procstat_to_word(reg.p),
+        .pc = reg.pc,
+    };
+}
+
+void fakeoid_set_regs(fakeoid_t *m, const fakeoid_regs_t *regs)
+{
+    reg.a = regs->a;
+    reg.x = regs->x;
+    reg.y = regs->y;
+    reg.s = regs->s;
+    reg.p = word_to_procstat(regs->p | BIT(4));
+    reg.pc = regs->pc;
+}
+
+uint64_t fakeoid_cycles(fakeoid_t *m)
+{
+    return cpu_cycles;
+}
+
+void fakeoid_serial_tx(fakeoid_t *m, void (*tx)(void *ctx, uint8_t byte), void *ctx)
+{
+    m->tx = tx;
+    m->tx_ctx = ctx;
+}
+
+int fakeoid_serial_receive(fakeoid_t *m, const void *data, size_t len)
+{
+    uint8_t *copy = malloc(len ? len : 1);
+
+    if (!copy)
+    {
+        fprintf(stderr, "fakeoid: out of memory\n");
+        return -1;
+    }
+
+    memcpy(copy, data, len);
+    acia_receive(&m->board.acia, copy, len);
+    free(m->rx);
+    m->rx = copy;
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef LIB_FAKEOID_H_
+#define LIB_FAKEOID_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Embedding the emulator in another program, e.g. a test bench
+ *
+ * This header is all the host needs, it doesn't include anything else from
+ * the emulator. Build every source file except main.c, fuzz/ and bench/
+ * together with lib/fakeoid.c, with -fPIC, and archive the objects into
+ * libfakeoid.a or link them with -shared into libfakeoid.so.
+ *
+ * The machine is the board main.c runs: RAM, the VIA and the ACIA behind the
+ * board's address decoder, and the ROM at $8000-$FFFF. Its state lives in the
+ * thread that created it, so every call but fakeoid_request_stop() has to be
+ * made from that thread, and there's one machine per process.
+ *
+ * fakeoid_run() executes a whole slice of instructions per call, returning
+ * when the cycle budget runs out or when something in the stop mask happens,
+ * always at an instruction boundary.
+ */
+typedef struct fakeoid fakeoid_t;
+
+typedef enum
+{
+    FAKEOID_STOP_BUDGET, /* the cycles are used up, can't be masked */
+    FAKEOID_STOP_BREAK, /* before the instruction at a breakpoint */
+    FAKEOID_STOP_STP, /* the CPU stopped until reset */
+    FAKEOID_STOP_WAI, /* the CPU waits for an interrupt */
+    FAKEOID_STOP_INVALID, /* a JAM locked up the NMOS 6502, the 65C02 has none */
+    FAKEOID_STOP_HOST, /* fakeoid_request_stop() */
+} fakeoid_stop_t;
+
+#define FAKEOID_STOP_MASK(stop) (1u << (stop))
+#define FAKEOID_STOP_ALL 0x3Fu
+
+typedef struct
+{
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t s;
+    uint8_t p;
+    uint16_t pc;
+} fakeoid_regs_t;
+
+/* Build the board, powered on with memory all zeroes. Returns NULL on error. */
+fakeoid_t *fakeoid_create(void);
+void fakeoid_destroy(fakeoid_t *m);
+
+/* Load a ROM image at the top of the address space. Returns -1 on error. */
+int fakeoid_load(fakeoid_t *m, const char *path);
+
+/* Reset the CPU, which starts at the reset vector */
+void fakeoid_reset(fakeoid_t *m);
+
+/*
+ * Run for at least max_cycles cycles, or until something in stop_mask
+ * happens (a mask of FAKEOID_STOP_MASK()). Stops that aren't in the mask are
+ * run through: a CPU that waits or stops lets the clock run on.
+ */
+fakeoid_stop_t fakeoid_run(fakeoid_t *m, uint64_t max_cycles, unsigned int stop_mask);
+
+/*
+ * Make the current or next fakeoid_run() return FAKEOID_STOP_HOST, within
+ * FAKEOID_POLL_PERIOD cycles. From any thread, or a signal handler.
+ */
+#define FAKEOID_POLL_PERIOD 1000
+
+void fakeoid_request_stop(fakeoid_t *m);
+
+void fakeoid_set_break(fakeoid_t *m, uint16_t addr, bool set);
+
+/*
+ * Let the CPU run up to cycles past device events before catching them up,
+ * which they also do whenever the CPU accesses a device. 1, the default, is
+ * exact; larger quanta run faster, and delay timers and interrupts by less
+ * than a quantum.
+ */
+void fakeoid_set_quantum(fakeoid_t *m, uint64_t cycles);
+
+/*
+ * Keep guest memory in a shared memory segment, named like "/fakeoid-mem", for
+ * other processes to map read-only while it runs, see cpu/mem_shm.h. Once per
+ * process, the name goes away with the machine. Needs a build with
+ * MEM_SPARSE=1, see cpu/mem.h. Returns -1 on error.
+ */
+int fakeoid_export_memory(fakeoid_t *m, const char *name);
+
+/*
+ * Bulk memory access, straight to the memory behind the address space:
+ * devices don't see it, and pages mapped to them read what was last written
+ * there. Returns -1 if the range doesn't fit in 64K.
+ */
+int fakeoid_read(fakeoid_t *m, uint16_t addr, void *data, size_t len);
+int fakeoid_write(fakeoid_t *m, uint16_t addr, const void *data, size_t len);
+
+void fakeoid_get_regs(fakeoid_t *m, fakeoid_regs_t *regs);
+void fakeoid_set_regs(fakeoid_t *m, const fakeoid_regs_t *regs);
+
+/* Elapsed cycles since power on */
+uint64_t fakeoid_cycles(fakeoid_t *m);
+
+/*
+ * The serial port. Bytes the guest sends go to tx as they're sent. Bytes
+ * given to fakeoid_serial_receive() replace what's still to be received, each
+ * arriving once the guest has read the last. Returns -1 if out of memory.
+ */
+void fakeoid_serial_tx(fakeoid_t *m, void (*tx)(void *ctx, uint8_t byte), void *ctx);
+int fakeoid_serial_receive(fakeoid_t *m, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_FAKEOID_H_ */
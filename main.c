@@ -1,114 +1,630 @@
 /*
  * Read this for info on cycles and timing: http://nparker.llx.com/a2/opcodes.html
  */
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "core/board.h"
+#include "core/bus.h"
+#include "core/decode.h"
+#include "core/input.h"
+#include "core/mp.h"
+#include "core/pace.h"
+#include "core/rom.h"
+#include "core/sched.h"
+#include "core/state.h"
+#include "core/stats.h"
 #include "cpu/cpu.h"
 #include "cpu/mem.h"
-#include "cpu/ops.h"
+#include "debug/diff.h"
+#include "debug/gdb.h"
+#include "debug/heat.h"
+#include "debug/irqlat.h"
+#include "debug/prof.h"
+#include "debug/vcd.h"
+#include "dev/acia.h"
+#include "dev/cosim.h"
+#include "dev/lcd.h"
+#include "dev/via.h"
+#include "hle/hle.h"
 
-void load_eeprom(void)
+#define MAX_ACCURACY_SWITCHES 8
+
+/* How often the statistics are published */
+#define STATS_PERIOD 100000
+
+/* On multiprocessor boards, $4000-$4FFF is dual ported RAM shared by all CPUs */
+#define SHARED_FIRST_PAGE 0x40
+#define SHARED_PAGES 0x10
+
+/* A byte on a 9600 baud serial line, at 1 MHz */
+#define SERIAL_BYTE_CYCLES 1042
+
+/* How long the stdin thread waits for room in a full queue */
+#define INPUT_RETRY_NS 1000000
+
+/* How often the machine looks for a shutdown request */
+#define SHUTDOWN_POLL_PERIOD 10000
+
+/* The LCD's data bus is port B of the VIA, its control lines are on port A */
+#define LCD_E BIT(7)
+#define LCD_RW BIT(6)
+#define LCD_RS BIT(5)
+#define LCD_COLUMNS 16
+#define LCD_ROWS 2
+#define LCD_FPS 30
+
+/* Accuracy level to switch to once a cycle is reached */
+typedef struct
 {
-    /* TODO */
+    uint64_t cycle;
+    accuracy_t accuracy;
+} accuracy_switch_t;
+
+static board_t board;
+static uint8_t shared_ram[SHARED_PAGES * 256];
+static input_queue_t serial_input;
+static volatile sig_atomic_t shutdown_requested = 0;
+static sched_event_t shutdown_poll;
+static lcd_t lcd;
+
+/* Every CPU runs with the same quantum, see sched_set_quantum() */
+static uint64_t quantum = 1;
+
+/* Levels on the VIA ports, pins that aren't outputs are pulled up */
+static uint8_t via_port_levels[2] = { 0xFF, 0xFF };
+
+static void via_port_out(void *ctx, via_port_t port, uint8_t value, uint8_t ddr)
+{
+    uint8_t a;
+
+    via_port_levels[port] = (value & ddr) | ~ddr;
+    a = via_port_levels[VIA_PORT_A];
+    lcd_pins(&lcd, a & LCD_RS, a & LCD_RW, a & LCD_E, via_port_levels[VIA_PORT_B]);
 }
 
-void reset(void)
+static uint8_t via_port_in(void *ctx, via_port_t port)
 {
-    reg.pc = VECTOR_RESET;
+    if (port == VIA_PORT_B)
+        return lcd_data(&lcd);
+
+    return via_port_levels[port];
 }
 
-int main(int argc, char *argv[])
+static const via_callbacks_t via_callbacks = {
+    .port_out = via_port_out,
+    .port_in = via_port_in,
+};
+
+static void acia_tx(void *ctx, uint8_t byte)
+{
+    putchar(byte);
+    fflush(stdout);
+}
+
+static const acia_callbacks_t acia_callbacks = { .tx = acia_tx };
+
+static void serial_deliver(void *ctx, const input_event_t *event)
+{
+    acia_receive_byte(ctx, event->value);
+}
+
+/* Feeds stdin to the ACIA receiver until end of file */
+static void *stdin_thread(void *arg)
+{
+    int c;
+
+    while ((c = getchar()) != EOF)
+    {
+        while (!input_push(&serial_input, 0, c))
+        {
+            struct timespec ts = { 0, INPUT_RETRY_NS };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Shutdown
+ *
+ * SIGINT and SIGTERM only set a flag, which a scheduler event picks up on the
+ * emulation thread and ends the run with. The emulator then saves and closes
+ * everything it was asked to, as it does when the CPU executes STP.
+ */
+static void request_shutdown(int sig)
+{
+    shutdown_requested = 1;
+}
+
+static void poll_shutdown(void *ctx, uint64_t when)
 {
-    (void)argc;
-    (void)argv;
+    if (shutdown_requested)
+        cpu_exit();
+    else
+        sched_add(&shutdown_poll, when + SHUTDOWN_POLL_PERIOD);
+}
+
+/* A debugger killing the machine, already on the emulation thread */
+static void kill_machine(void)
+{
+    shutdown_requested = 1;
+    cpu_exit();
+}
+
+static void catch_shutdown(void)
+{
+    struct sigaction sa = { .sa_handler = request_shutdown };
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
-    load_eeprom();
-    reset();
+    sched_event_init(&shutdown_poll, poll_shutdown, NULL);
+    sched_add(&shutdown_poll, cpu_cycles + SHUTDOWN_POLL_PERIOD);
+    gdb_set_kill_handler(kill_machine);
+    cpu_exit_states = BIT(CPU_STOPPED);
+}
 
-    while (1)
+/*
+ * The other CPUs of a multiprocessor board boot from the same ROM, and have
+ * no devices of their own. ctx is the memory of CPU 0, from mem_share().
+ */
+static void setup_cpu(int cpu, void *ctx)
+{
+    if (cpu == 0)
+        return;
+
+    mem_map_shared(ROM_BASE >> 8, ROM_SIZE >> 8, ctx);
+    decode_map_rom();
+    sched_set_quantum(quantum);
+    cpu_reset();
+}
+
+/* Of the image loaded, which is what hook files are for */
+static uint64_t rom_hash(void)
+{
+    size_t len;
+    const uint8_t *image = rom_image(&len);
+
+    return hle_rom_hash(image, len);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-R rom] [-g port|unix:path] [-a instruction|cycle|pin[@cycle]]...\n"
+            "          [-H hooks [-V]] [-D] [-M heatmap] [-C lcov -L labels]\n"
+            "          [-l state] [-s state [-k cycles]] [-P name] [-r hz[,jitter_us]]\n"
+            "          [-N cpus] [-d equations] [-w vcd [-f signals]]\n"
+            "          [-p folded[,cycles] [-L symbols]] [-i] [-e events | -E events]\n"
+            "          [-c tty[,columns,rows]] [-x shm,net[:out]...] [-I histograms]\n"
+            "          [-q cycles] [-m name]\n"
+            "\n"
+            "  -R  load a ROM image, at the top of memory if it's under 32K\n"
+            "  -g  wait for a GDB connection on a TCP port or Unix socket\n"
+            "  -a  accuracy level, from the given cycle on (default: from the start)\n"
+            "  -H  load high-level emulation hooks for the ROM from a file\n"
+            "  -V  verify hooks against the guest routines they replace\n"
+            "  -D  check every instruction against the reference core\n"
+            "  -M  record memory accesses and write the heatmap to a file on exit\n"
+            "  -C  record memory accesses and write lcov code coverage to a file on exit\n"
+            "  -L  label, ld65 map or ld65 debug file naming the code for -C and -p\n"
+            "  -l  load a savestate instead of resetting\n"
+            "  -s  save the machine to a file on exit\n"
+            "  -k  also checkpoint it to that file every so many cycles\n"
+            "  -P  publish statistics in a shared memory segment, e.g. /fakeoid\n"
+            "  -r  run in real time at the given clock rate, within the given jitter\n"
+            "      (default: 1000us)\n"
+            "  -N  number of CPUs sharing RAM at $4000-$4FFF (default: 1)\n"
+            "  -d  address decoder equations (default: the board's)\n"
+            "  -w  dump the bus pins to a VCD file, needs pin accuracy\n"
+            "  -f  comma separated patterns of the signals to dump (default: all)\n"
+            "  -p  sample the guest call stack every so many cycles and write folded\n"
+            "      stacks for flame graphs to a file on exit (default: 997)\n"
+            "  -i  feed stdin to the ACIA receiver\n"
+            "  -e  record the cycle every input is delivered at to a file\n"
+            "  -E  replay recorded input instead\n"
+            "  -c  show the LCD on a terminal of its own, e.g. /dev/pts/3 (default: 16x2)\n"
+            "  -x  co-simulate with a model through a shared memory segment, e.g.\n"
+            "      /fakeoid-cosim, exchanging the given nets, the ones it drives marked\n"
+            "      :out, needs pin accuracy\n"
+            "  -I  record interrupt latencies and handler durations and write the\n"
+            "      histograms to a file on exit\n"
+            "  -q  let the CPU run up to this many cycles past device events, which\n"
+            "      are synchronized when a device is accessed (default: 1, exact)\n"
+            "  -m  keep guest memory in a shared memory segment other processes can\n"
+            "      map, e.g. /fakeoid-mem, needs a build with MEM_SPARSE=1\n",
+            prog);
+    exit(1);
+}
+
+static int parse_accuracy_switch(char *arg, accuracy_switch_t *sw)
+{
+    char *at = strchr(arg, '@');
+
+    sw->cycle = 0;
+    if (at)
     {
-        uint8_t opcode = mem_read(reg.pc++);
-        op_desc_t op = ops[opcode];
-        operand_t operand = { .type = OPERAND_TYPE_ADDRESS };
+        *at = '\0';
+        sw->cycle = strtoull(at + 1, NULL, 0);
+    }
+
+    return accuracy_from_name(arg, &sw->accuracy);
+}
+
+static int compare_accuracy_switch(const void *a, const void *b)
+{
+    const accuracy_switch_t *sa = a;
+    const accuracy_switch_t *sb = b;
 
-        switch (op.addr_mode)
+    return (sa->cycle > sb->cycle) - (sa->cycle < sb->cycle);
+}
+
+int main(int argc, char *argv[])
+{
+    accuracy_switch_t switches[MAX_ACCURACY_SWITCHES];
+    int switch_count = 0;
+    const char *gdb = NULL;
+    const char *rom = NULL;
+    const char *hooks = NULL;
+    bool diff = false;
+    const char *heatmap = NULL;
+    const char *lcov = NULL;
+    const char *labels = NULL;
+    const char *load = NULL;
+    const char *save = NULL;
+    uint64_t checkpoint = 0;
+    uint64_t next_checkpoint = UINT64_MAX;
+    const char *stats = NULL;
+    const char *export = NULL;
+    uint64_t next_stats = UINT64_MAX;
+    uint64_t pace_hz = 0;
+    uint64_t pace_jitter = PACE_DEFAULT_JITTER_NS;
+    uint64_t pace_batch = 0;
+    uint64_t next_pace = UINT64_MAX;
+    int cpus = 1;
+    const char *equations = NULL;
+    const char *vcd = NULL;
+    const char *signals = NULL;
+    const char *profile = NULL;
+    uint64_t profile_period = PROF_DEFAULT_PERIOD;
+    bool serial_stdin = false;
+    const char *record = NULL;
+    const char *replay = NULL;
+    pthread_t serial_thread;
+    const char *lcd_tty = NULL;
+    int lcd_columns = LCD_COLUMNS;
+    int lcd_rows = LCD_ROWS;
+    const char *cosim = NULL;
+    const char *cosim_nets = NULL;
+    const char *irq_histograms = NULL;
+    char *end;
+    int next_switch = 0;
+    int status = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "R:g:a:H:VDM:C:L:l:s:k:P:r:N:d:w:f:p:ie:E:c:x:I:q:m:")) != -1)
+    {
+        switch (opt)
         {
-        case ADDR_MODE_ABSOLUTE:
-            operand.addr = shift() + (shift() << 8);
+        case 'g':
+            gdb = optarg;
             break;
-        case ADDR_MODE_ABSOLUTE_INDEXED_INDIRECT:
-            operand.addr = mem_read(shift() + (shift() << 8) + reg.x);
+        case 'a':
+            if (switch_count == MAX_ACCURACY_SWITCHES ||
+                parse_accuracy_switch(optarg, &switches[switch_count++]) < 0)
+                usage(argv[0]);
             break;
-        case ADDR_MODE_ABSOLUTE_X:
-            operand.addr = shift() + (shift() << 8) + reg.x;
+        case 'R':
+            rom = optarg;
             break;
-        case ADDR_MODE_ABSOLUTE_Y:
-            operand.addr = shift() + (shift() << 8) + reg.y;
+        case 'H':
+            hooks = optarg;
             break;
-        case ADDR_MODE_ABSOLUTE_INDIRECT:
-            operand.addr = mem_read(shift() + (shift() << 8));
+        case 'V':
+            hle_set_verify(true);
             break;
-        case ADDR_MODE_ACCUMULATOR:
-            operand.type = OPERAND_TYPE_ACCUMULATOR;
+        case 'D':
+            diff = true;
             break;
-        case ADDR_MODE_IMMEDIATE:
-            operand.type = OPERAND_TYPE_WORD;
-            operand.word = shift();
+        case 'M':
+            heatmap = optarg;
             break;
-        case ADDR_MODE_IMPLIED:
-            operand.type = OPERAND_TYPE_NONE;
+        case 'C':
+            lcov = optarg;
             break;
-        case ADDR_MODE_RELATIVE:
-        {
-            /* TODO: figure this out, signedness etc.*/
-            int8_t offset = shift();
-            operand.addr = reg.pc + offset;
+        case 'L':
+            labels = optarg;
             break;
-        }
-        case ADDR_MODE_ZEROPAGE:
-            operand.addr = shift();
+        case 'l':
+            load = optarg;
             break;
-        case ADDR_MODE_ZEROPAGE_INDEXED_INDIRECT:
-            operand.addr = mem_read((uint8_t)(shift() + reg.x));
+        case 's':
+            save = optarg;
             break;
-        case ADDR_MODE_ZEROPAGE_X:
-            operand.addr = (uint8_t)(shift() + reg.x);
+        case 'k':
+            checkpoint = strtoull(optarg, NULL, 0);
             break;
-        case ADDR_MODE_ZEROPAGE_Y:
-            operand.addr = (uint8_t)(shift() + reg.y);
+        case 'P':
+            stats = optarg;
             break;
-        case ADDR_MODE_ZEROPAGE_INDIRECT:
-        {
-            /* TODO: zp_offset+1 should wrap around? */
-            uint8_t zp_offset = shift();
-            operand.addr = mem_read(zp_offset) + (mem_read(zp_offset + 1) << 8);
+        case 'm':
+            export = optarg;
             break;
+        case 'd':
+            equations = optarg;
+            break;
+        case 'w':
+            vcd = optarg;
+            break;
+        case 'f':
+            signals = optarg;
+            break;
+        case 'p':
+            profile = optarg;
+            end = strchr(optarg, ',');
+            if (end)
+            {
+                *end = '\0';
+                profile_period = strtoull(end + 1, NULL, 0);
+            }
+            if (!profile_period)
+                usage(argv[0]);
+            break;
+        case 'i':
+            serial_stdin = true;
+            break;
+        case 'e':
+            record = optarg;
+            break;
+        case 'E':
+            replay = optarg;
+            break;
+        case 'c':
+            lcd_tty = optarg;
+            end = strchr(optarg, ',');
+            if (end)
+            {
+                *end = '\0';
+                if (sscanf(end + 1, "%d,%d", &lcd_columns, &lcd_rows) != 2 ||
+                    lcd_columns < 1 || lcd_columns > LCD_MAX_COLUMNS || lcd_rows < 1 ||
+                    lcd_rows > LCD_MAX_ROWS)
+                    usage(argv[0]);
+            }
+            break;
+        case 'x':
+            cosim = optarg;
+            end = strchr(optarg, ',');
+            if (!end)
+                usage(argv[0]);
+            *end = '\0';
+            cosim_nets = end + 1;
+            break;
+        case 'I':
+            irq_histograms = optarg;
+            break;
+        case 'N':
+            cpus = atoi(optarg);
+            break;
+        case 'q':
+            quantum = strtoull(optarg, NULL, 0);
+            if (!quantum)
+                usage(argv[0]);
+            break;
+        case 'r':
+            pace_hz = strtoull(optarg, &end, 0);
+            if (*end == ',')
+                pace_jitter = strtoull(end + 1, NULL, 0) * 1000;
+            if (!pace_hz || !pace_jitter)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
         }
-        case ADDR_MODE_ZEROPAGE_INDIRECT_INDEXED:
+    }
+
+    if ((lcov && !labels) || (checkpoint && !save) || (signals && !vcd) ||
+        (replay && (record || serial_stdin)))
+        usage(argv[0]);
+
+    /* The other CPUs' state isn't saved */
+    if (cpus < 1 || cpus > MP_MAX_CPUS || (cpus > 1 && (load || save)))
+        usage(argv[0]);
+
+    /* Hooks are for a particular ROM */
+    if (hooks && !rom)
+        usage(argv[0]);
+
+    /* Neither is the profiler's pending sample, nor the model's state */
+    if ((profile || cosim) && (load || save))
+        usage(argv[0]);
+
+    qsort(switches, switch_count, sizeof(switches[0]), compare_accuracy_switch);
+
+    if (equations && decode_load(equations) < 0)
+        return 1;
+
+    bus_init();
+    sched_set_quantum(quantum);
+
+    if (export && mem_export(export) < 0)
+        return 1;
+
+    /* Before the RAM, which should see the chip selects a model drives */
+    if (cosim && cosim_start(cosim, cosim_nets) < 0)
+        return 1;
+
+    if (board_init(&board, &via_callbacks, &acia_callbacks, NULL) < 0)
+        return 1;
+
+    state_register_machine();
+    state_register("via", &board.via, sizeof(board.via), via_fixup);
+    state_register("acia", &board.acia, sizeof(board.acia), acia_fixup);
+
+    /* The LCD's busy times are in microseconds */
+    lcd_init(&lcd, lcd_columns, lcd_rows, pace_hz > 1000000 ? (pace_hz + 999999) / 1000000 : 1);
+    state_register("lcd", &lcd, sizeof(lcd), lcd_fixup);
+
+    if (input_queue_init(&serial_input, "serial", SERIAL_BYTE_CYCLES, serial_deliver, &board.acia) < 0 ||
+        input_start(record, replay) < 0)
+        return 1;
+
+    if (rom && rom_load(rom) < 0)
+        return 1;
+    cpu_reset();
+
+    if (load && state_load(load) < 0)
+        return 1;
+
+    if (hooks && hle_load(hooks, rom_hash()) < 0)
+        return 1;
+
+    if (cpus > 1 && mp_start(cpus, shared_ram, SHARED_FIRST_PAGE, SHARED_PAGES, setup_cpu,
+                             (void *)mem_share(ROM_BASE >> 8, ROM_SIZE >> 8)) < 0)
+        return 1;
+
+    if (heatmap || lcov)
+        heat_start();
+
+    if (diff && diff_start() < 0)
+        return 1;
+
+    if (profile)
+        prof_start(profile_period);
+
+    /* Before the statistics, which publish the histograms too */
+    if (irq_histograms)
+    {
+        irqlat_name(IRQ_SOURCE_VIA, "via");
+        irqlat_name(IRQ_SOURCE_ACIA, "acia");
+        irqlat_start();
+    }
+
+    if (lcd_tty && lcd_show(&lcd, lcd_tty, LCD_FPS) < 0)
+        return 1;
+
+    if (serial_stdin && pthread_create(&serial_thread, NULL, stdin_thread, NULL) != 0)
+    {
+        fprintf(stderr, "can't start the stdin thread\n");
+        return 1;
+    }
+
+    if (gdb && gdb_stub_open(gdb) < 0)
+        return 1;
+
+    if (stats)
+    {
+        stats_add_device("via", &board.via);
+        stats_add_device("acia", &board.acia);
+        if (stats_open(stats) < 0)
+            return 1;
+        next_stats = cpu_cycles + STATS_PERIOD;
+    }
+
+    if (checkpoint)
+        next_checkpoint = cpu_cycles + checkpoint;
+
+    /* Last of what can fail, so an early exit doesn't leave a truncated dump */
+    if (vcd && vcd_start(vcd, signals, pace_hz) < 0)
+        return 1;
+
+    if (pace_hz)
+    {
+        pace_batch = pace_start(pace_hz, pace_jitter);
+        next_pace = cpu_cycles + pace_batch;
+    }
+
+    catch_shutdown();
+
+    /*
+     * Checkpoints are taken, statistics published and the pace kept between
+     * runs, where the machine is consistent. The machine runs until it's shut
+     * down or the CPU executes STP.
+     */
+    while (!shutdown_requested && cpu_state != CPU_STOPPED)
+    {
+        uint64_t until = next_checkpoint < next_stats ? next_checkpoint : next_stats;
+
+        if (next_pace < until)
+            until = next_pace;
+        if (next_switch < switch_count && switches[next_switch].cycle < until)
+            until = switches[next_switch].cycle;
+
+        cpu_run(until);
+
+        while (next_switch < switch_count && switches[next_switch].cycle <= cpu_cycles)
+            mem_set_accuracy(switches[next_switch++].accuracy);
+
+        if (cpu_cycles >= next_checkpoint)
         {
-            /* TODO: zp_offset+1 should wrap around? */
-            uint8_t zp_offset = shift();
-            operand.addr = mem_read(zp_offset) + (mem_read(zp_offset + 1) << 8) + reg.y;
-            break;
+            /* The poll isn't part of the machine, it can't be pending in a savestate */
+            sched_cancel(&shutdown_poll);
+            state_checkpoint(save);
+            sched_add(&shutdown_poll, cpu_cycles + SHUTDOWN_POLL_PERIOD);
+            next_checkpoint = cpu_cycles + checkpoint;
         }
-        case ADDR_MODE_ZEROPAGE_RELATIVE:
+
+        if (cpu_cycles >= next_stats)
         {
-            operand.type = OPERAND_TYPE_WORD_ADDRESS;
-            operand.word = shift();
-            /* TODO: figure this out, signedness etc.*/
-            int8_t offset = shift();
-            operand.addr = reg.pc + offset;
+            stats_publish();
+            next_stats = cpu_cycles + STATS_PERIOD;
         }
-        default:
-            break;
+
+        if (cpu_cycles >= next_pace)
+        {
+            pace_wait();
+            next_pace = cpu_cycles + pace_batch;
         }
+    }
+
+    sched_cancel(&shutdown_poll);
 
-        op.handler(operand);
+    if (cpus > 1)
+    {
+        mp_stop();
+
+        for (int i = 0; i < cpus; i++)
+        {
+            mp_stats_t mp;
+
+            mp_get_stats(i, &mp);
+            fprintf(stderr, "cpu %d: %llu shared bus cycles, %llu wait states\n", i,
+                    (unsigned long long)mp.accesses, (unsigned long long)mp.wait_states);
+        }
     }
 
-    return 0;
+    if (save && (state_checkpoint_wait() < 0 || state_save(save) < 0))
+        status = 1;
+    if (heatmap && heat_save(heatmap) < 0)
+        status = 1;
+    if (lcov && heat_save_lcov(lcov, labels) < 0)
+        status = 1;
+    if (vcd_stop() < 0)
+        status = 1;
+    prof_stop();
+    if (profile && prof_save(profile, labels) < 0)
+        status = 1;
+    irqlat_stop();
+    if (irq_histograms && irqlat_save(irq_histograms) < 0)
+        status = 1;
+    if (input_stop() < 0)
+        status = 1;
+
+    cosim_stop();
+    lcd_hide();
+    stats_close();
+    mem_export_close();
+    pace_report(stderr);
+
+    return diff_stop() < 0 ? 1 : status;
 }
@@ -0,0 +1,154 @@
+/*
+ * Reader for the guest memory the emulator exports with -m
+ *
+ * Build on its own, e.g. cc -o fakeoid-mem tools/mem.c
+ *
+ * usage: fakeoid-mem [-i seconds] name [address [length]]
+ *
+ * Dumps a consistent copy of the range once, or again every interval. Pages a
+ * device is mapped at are marked, as the CPU doesn't read them from memory.
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../cpu/mem_shm.h"
+
+#define MEM_SIZE (MEM_SHM_PAGES * MEM_SHM_PAGE_SIZE)
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-i seconds] name [address [length]]\n", prog);
+    exit(1);
+}
+
+/* Copy the range between changes, so it's all from the same layout */
+static void take_copy(const mem_shm_t *shm, unsigned int addr, unsigned int len, uint8_t *out,
+                      uint8_t *pages)
+{
+    uint32_t generation;
+
+    for (;;)
+    {
+        generation = atomic_load_explicit(&shm->header.generation, memory_order_acquire);
+        if (generation & 1)
+        {
+            usleep(100);
+            continue;
+        }
+
+        memcpy(out, &shm->data[0][0] + addr, len);
+        for (int i = 0; i < MEM_SHM_PAGES; i++)
+            pages[i] = atomic_load_explicit(&shm->header.pages[i], memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->header.generation, memory_order_relaxed) == generation)
+            return;
+    }
+}
+
+static void dump(unsigned int addr, unsigned int len, const uint8_t *data, const uint8_t *pages)
+{
+    for (unsigned int line = addr & ~0xFu; line < addr + len; line += 16)
+    {
+        uint8_t flags = pages[line / MEM_SHM_PAGE_SIZE];
+
+        printf("%04X %c ", line,
+               flags & MEM_SHM_PAGE_IO ? 'i' : flags & MEM_SHM_PAGE_LIVE ? ' ' : '?');
+
+        for (unsigned int a = line; a < line + 16; a++)
+        {
+            if (a < addr || a >= addr + len)
+                printf("   ");
+            else
+                printf(" %02X", data[a - addr]);
+        }
+
+        printf("  ");
+        for (unsigned int a = line; a < line + 16 && a < addr + len; a++)
+        {
+            uint8_t c = a < addr ? ' ' : data[a - addr];
+
+            putchar(c >= 0x20 && c < 0x7F ? c : '.');
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t data[MEM_SIZE];
+    uint8_t pages[MEM_SHM_PAGES];
+    unsigned long addr = 0;
+    unsigned long len = MEM_SIZE;
+    double interval = 0;
+    const mem_shm_t *shm;
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            interval = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc || argc - optind > 3 || interval < 0)
+        usage(argv[0]);
+    if (argc - optind > 1)
+        addr = strtoul(argv[optind + 1], NULL, 16);
+    if (argc - optind > 2)
+        len = strtoul(argv[optind + 2], NULL, 0);
+    if (addr >= MEM_SIZE || !len || len > MEM_SIZE - addr)
+        usage(argv[0]);
+
+    fd = shm_open(argv[optind], O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if (shm->header.magic != MEM_SHM_MAGIC || shm->header.version != MEM_SHM_VERSION ||
+        shm->header.page_size != MEM_SHM_PAGE_SIZE || shm->header.page_count != MEM_SHM_PAGES)
+    {
+        fprintf(stderr, "%s: not exported memory of this version\n", argv[optind]);
+        return 1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    if (kill(shm->header.pid, 0) < 0)
+        fprintf(stderr, "%s: emulator %d is gone, the memory is stale\n", argv[optind],
+                shm->header.pid);
+
+    for (;;)
+    {
+        take_copy(shm, addr, len, data, pages);
+        dump(addr, len, data, pages);
+        fflush(stdout);
+
+        if (!interval)
+            return 0;
+
+        usleep(interval * 1e6);
+        printf("\n");
+    }
+}
@@ -0,0 +1,235 @@
+/*
+ * Reader for the statistics the emulator publishes with -P
+ *
+ * Build on its own, e.g. cc -o fakeoid-stats tools/stats.c
+ *
+ * usage: fakeoid-stats [-i seconds] [-m] name
+ *
+ * Prints rates once per interval, or with -m the current totals once, in the
+ * Prometheus text format for scraping.
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../core/stats.h"
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+} irq_sample_t;
+
+typedef struct
+{
+    uint64_t host_ns;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t interrupts;
+    uint64_t bus_contentions;
+    uint64_t khz;
+    uint64_t pace_late;
+    uint64_t pace_lag_ns;
+    uint64_t pace_max_lag_ns;
+    uint64_t device_ns[STATS_MAX_DEVICES];
+    uint64_t device_calls[STATS_MAX_DEVICES];
+    irq_sample_t irq_latency[STATS_MAX_IRQ_SOURCES];
+    irq_sample_t irq_duration[STATS_MAX_IRQ_SOURCES];
+} sample_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-i seconds] [-m] name\n", prog);
+    exit(1);
+}
+
+static uint64_t get(_Atomic uint64_t *counter)
+{
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void take_irq_sample(stats_irq_hist_t *hist, irq_sample_t *s)
+{
+    s->count = get(&hist->count);
+    s->sum = get(&hist->sum);
+    s->p50 = get(&hist->p50);
+    s->p99 = get(&hist->p99);
+    s->max = get(&hist->max);
+}
+
+static void take_sample(stats_block_t *block, sample_t *s)
+{
+    s->host_ns = get(&block->host_ns);
+    s->cycles = get(&block->cycles);
+    s->instructions = get(&block->instructions);
+    s->interrupts = get(&block->interrupts);
+    s->bus_contentions = get(&block->bus_contentions);
+    s->khz = get(&block->khz);
+    s->pace_late = get(&block->pace_late);
+    s->pace_lag_ns = get(&block->pace_lag_ns);
+    s->pace_max_lag_ns = get(&block->pace_max_lag_ns);
+
+    for (uint32_t i = 0; i < block->device_count; i++)
+    {
+        s->device_ns[i] = get(&block->devices[i].host_ns);
+        s->device_calls[i] = get(&block->devices[i].calls);
+    }
+
+    for (uint32_t i = 0; i < block->irq_source_count; i++)
+    {
+        take_irq_sample(&block->irqs[i].latency, &s->irq_latency[i]);
+        take_irq_sample(&block->irqs[i].duration, &s->irq_duration[i]);
+    }
+}
+
+/* As a Prometheus summary, with the maximum as a gauge of its own */
+static void print_irq_metric(const char *metric, const char *source, const irq_sample_t *s)
+{
+    printf("fakeoid_irq_%s_cycles{source=\"%.*s\",quantile=\"0.5\"} %" PRIu64 "\n", metric,
+           STATS_NAME_LEN, source, s->p50);
+    printf("fakeoid_irq_%s_cycles{source=\"%.*s\",quantile=\"0.99\"} %" PRIu64 "\n", metric,
+           STATS_NAME_LEN, source, s->p99);
+    printf("fakeoid_irq_%s_cycles_sum{source=\"%.*s\"} %" PRIu64 "\n", metric, STATS_NAME_LEN,
+           source, s->sum);
+    printf("fakeoid_irq_%s_cycles_count{source=\"%.*s\"} %" PRIu64 "\n", metric,
+           STATS_NAME_LEN, source, s->count);
+    printf("fakeoid_irq_%s_max_cycles{source=\"%.*s\"} %" PRIu64 "\n", metric, STATS_NAME_LEN,
+           source, s->max);
+}
+
+static void print_metrics(const stats_block_t *block, const sample_t *s)
+{
+    printf("fakeoid_host_seconds %.3f\n", s->host_ns / 1e9);
+    printf("fakeoid_cycles_total %" PRIu64 "\n", s->cycles);
+    printf("fakeoid_instructions_total %" PRIu64 "\n", s->instructions);
+    printf("fakeoid_interrupts_total %" PRIu64 "\n", s->interrupts);
+    printf("fakeoid_bus_contentions_total %" PRIu64 "\n", s->bus_contentions);
+    printf("fakeoid_clock_hz %" PRIu64 "\n", s->khz * 1000);
+    printf("fakeoid_pace_late_batches_total %" PRIu64 "\n", s->pace_late);
+    printf("fakeoid_pace_lag_seconds %.6f\n", s->pace_lag_ns / 1e9);
+    printf("fakeoid_pace_max_lag_seconds %.6f\n", s->pace_max_lag_ns / 1e9);
+
+    for (uint32_t i = 0; i < block->device_count; i++)
+    {
+        printf("fakeoid_device_host_seconds{device=\"%.*s\"} %.6f\n", STATS_NAME_LEN,
+               block->devices[i].name, s->device_ns[i] / 1e9);
+        printf("fakeoid_device_calls_total{device=\"%.*s\"} %" PRIu64 "\n", STATS_NAME_LEN,
+               block->devices[i].name, s->device_calls[i]);
+    }
+
+    for (uint32_t i = 0; i < block->irq_source_count; i++)
+    {
+        if (!s->irq_latency[i].count && !s->irq_duration[i].count)
+            continue;
+
+        print_irq_metric("latency", block->irqs[i].name, &s->irq_latency[i]);
+        print_irq_metric("duration", block->irqs[i].name, &s->irq_duration[i]);
+    }
+}
+
+static void print_rates(const stats_block_t *block, const sample_t *prev, const sample_t *s)
+{
+    double seconds = (s->host_ns - prev->host_ns) / 1e9;
+
+    if (seconds <= 0)
+    {
+        printf("no update\n");
+        return;
+    }
+
+    printf("%8.3f MHz %10.0f instr/s %8.0f irq/s %6" PRIu64 " contentions", s->khz / 1e3,
+           (s->instructions - prev->instructions) / seconds,
+           (s->interrupts - prev->interrupts) / seconds, s->bus_contentions);
+
+    if (s->pace_late)
+        printf("  lag %.3f ms (max %.3f)", s->pace_lag_ns / 1e6, s->pace_max_lag_ns / 1e6);
+
+    for (uint32_t i = 0; i < block->device_count; i++)
+        printf("  %.*s %.1f%%", STATS_NAME_LEN, block->devices[i].name,
+               (s->device_ns[i] - prev->device_ns[i]) / 1e7 / seconds);
+
+    for (uint32_t i = 0; i < block->irq_source_count; i++)
+        if (s->irq_latency[i].count)
+            printf("  %.*s latency p99 %" PRIu64 " max %" PRIu64, STATS_NAME_LEN,
+                   block->irqs[i].name, s->irq_latency[i].p99, s->irq_latency[i].max);
+
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    double interval = 1;
+    bool metrics = false;
+    stats_block_t *block;
+    sample_t prev, cur;
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "i:m")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'm':
+            metrics = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1 || interval <= 0)
+        usage(argv[0]);
+
+    fd = shm_open(argv[optind], O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    block = mmap(NULL, sizeof(*block), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if (block->magic != STATS_MAGIC || block->version != STATS_VERSION ||
+        block->device_count > STATS_MAX_DEVICES || block->irq_source_count > STATS_MAX_IRQ_SOURCES)
+    {
+        fprintf(stderr, "%s: not a statistics block of this version\n", argv[optind]);
+        return 1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    if (kill(block->pid, 0) < 0)
+        fprintf(stderr, "%s: emulator %d is gone, the numbers are stale\n", argv[optind],
+                block->pid);
+
+    take_sample(block, &cur);
+    if (metrics)
+    {
+        print_metrics(block, &cur);
+        return 0;
+    }
+
+    for (;;)
+    {
+        prev = cur;
+        usleep(interval * 1e6);
+        take_sample(block, &cur);
+        print_rates(block, &prev, &cur);
+        fflush(stdout);
+    }
+}
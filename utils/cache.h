@@ -0,0 +1,10 @@
+#ifndef UTILS_CACHE_H_
+#define UTILS_CACHE_H_
+
+/*
+ * Size of a host cache line. Data written by different threads goes on lines
+ * of its own, so the threads don't fight over the line.
+ */
+#define CACHE_LINE 64
+
+#endif /* UTILS_CACHE_H_ */
@@ -0,0 +1,85 @@
+#include <sched.h>
+#include <time.h>
+
+#include "spsc.h"
+
+void spsc_init(spsc_t *ring, size_t size, size_t batch)
+{
+    ring->size = size;
+    ring->batch = batch;
+    ring->prod_head = ring->prod_published = ring->prod_tail = 0;
+    ring->cons_tail = ring->cons_head = 0;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->stopping, false);
+}
+
+/*
+ * Producer
+ */
+void spsc_publish(spsc_t *ring)
+{
+    atomic_store_explicit(&ring->head, ring->prod_head, memory_order_release);
+    ring->prod_published = ring->prod_head;
+}
+
+void spsc_wait_for_space(spsc_t *ring, void (*poll)(void))
+{
+    spsc_publish(ring);
+
+    while (!spsc_try_space(ring))
+    {
+        if (poll)
+            poll();
+        sched_yield();
+    }
+}
+
+bool spsc_try_space(spsc_t *ring)
+{
+    if (spsc_full(ring))
+        ring->prod_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return !spsc_full(ring);
+}
+
+void spsc_stop(spsc_t *ring)
+{
+    spsc_publish(ring);
+    atomic_store_explicit(&ring->stopping, true, memory_order_release);
+}
+
+/*
+ * Consumer
+ */
+static void idle(unsigned int *polls)
+{
+    if (++*polls < SPSC_SPIN_POLLS)
+    {
+        sched_yield();
+    }
+    else
+    {
+        struct timespec ts = { 0, SPSC_IDLE_NS };
+        nanosleep(&ts, NULL);
+    }
+}
+
+bool spsc_wait(spsc_t *ring)
+{
+    unsigned int polls = 0;
+
+    while (!spsc_ready(ring))
+    {
+        if (atomic_load_explicit(&ring->stopping, memory_order_acquire))
+        {
+            /* head was published before stopping was set */
+            ring->cons_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            return ring->cons_tail != ring->cons_head;
+        }
+
+        idle(&polls);
+    }
+
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef UTILS_SPSC_H_
+#define UTILS_SPSC_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cache.h"
+
+/*
+ * Single producer, single consumer ring
+ *
+ * Lock-free handoff of fixed size elements from one thread to another. The
+ * ring only keeps the indices: the elements are in an array of the user's
+ * own with a power of two size, indexed by the slots returned here, so
+ * copying one in or out is a plain assignment.
+ *
+ * Each side keeps a private copy of its own index and of what it last saw of
+ * the other's, and the shared indices are only stored every batch elements,
+ * so the two threads don't fight over the cache lines holding them on every
+ * element. The producer publishes its side explicitly, when it has pushed a
+ * batch (spsc_publish_batch()) or whenever it must (spsc_publish()).
+ *
+ * A consumer that has nothing to do spins for a while, yielding the host CPU,
+ * and then sleeps, see spsc_wait().
+ */
+#define SPSC_SPIN_POLLS 1000
+#define SPSC_IDLE_NS 50000
+
+typedef struct
+{
+    size_t size;
+    size_t batch;
+
+    /* Shared indices, each on its own cache line */
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    _Alignas(CACHE_LINE) atomic_bool stopping;
+
+    /* Producer side */
+    _Alignas(CACHE_LINE) size_t prod_head;
+    size_t prod_published;
+    size_t prod_tail;
+
+    /* Consumer side */
+    _Alignas(CACHE_LINE) size_t cons_tail;
+    size_t cons_head;
+} spsc_t;
+
+/* Empty, for size elements. Both sizes are powers of two. */
+void spsc_init(spsc_t *ring, size_t size, size_t batch);
+
+/*
+ * Producer
+ */
+void spsc_publish(spsc_t *ring);
+
+/* Publishes and waits for the consumer to make room, calling poll meanwhile */
+void spsc_wait_for_space(spsc_t *ring, void (*poll)(void));
+
+/* Returns false if the ring is full, without waiting */
+bool spsc_try_space(spsc_t *ring);
+
+/* Publish and tell the consumer there's nothing more coming */
+void spsc_stop(spsc_t *ring);
+
+static inline bool spsc_full(const spsc_t *ring)
+{
+    return ring->prod_head - ring->prod_tail == ring->size;
+}
+
+/* Slot for the next element, which spsc_push() then adds. Only when not full. */
+static inline size_t spsc_back(const spsc_t *ring)
+{
+    return ring->prod_head & (ring->size - 1);
+}
+
+static inline void spsc_push(spsc_t *ring)
+{
+    ring->prod_head++;
+}
+
+/* Returns true if it published */
+static inline bool spsc_publish_batch(spsc_t *ring)
+{
+    if (ring->prod_head - ring->prod_published < ring->batch)
+        return false;
+
+    spsc_publish(ring);
+    return true;
+}
+
+/*
+ * Consumer
+ */
+
+/* Elements there are to take, without waiting */
+static inline size_t spsc_ready(spsc_t *ring)
+{
+    if (ring->cons_tail == ring->cons_head)
+        ring->cons_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return ring->cons_head - ring->cons_tail;
+}
+
+/*
+ * Wait for an element. Returns false once the producer has stopped and
+ * everything it published is taken.
+ */
+bool spsc_wait(spsc_t *ring);
+
+/* Slot of the oldest element, which spsc_pop() then removes. Only when ready. */
+static inline size_t spsc_front(const spsc_t *ring)
+{
+    return ring->cons_tail & (ring->size - 1);
+}
+
+static inline void spsc_pop(spsc_t *ring)
+{
+    ring->cons_tail++;
+
+    if ((ring->cons_tail & (ring->batch - 1)) == 0)
+        atomic_store_explicit(&ring->tail, ring->cons_tail, memory_order_release);
+}
+
+#endif /* UTILS_SPSC_H_ */